@@ -0,0 +1,144 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*- */
+/*  GMime
+ *  Copyright (C) 2000-2022 Jeffrey Stedfast
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public License
+ *  as published by the Free Software Foundation; either version 2.1
+ *  of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free
+ *  Software Foundation, 51 Franklin Street, Fifth Floor, Boston, MA
+ *  02110-1301, USA.
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <iconv.h>
+#include <errno.h>
+
+
+static struct {
+	const char *name;   /* canonical charset name, see g_mime_charset_canon_name() */
+	const char *iconv;  /* charset name to pass to iconv_open() */
+} tables[] = {
+	/* These are the 8bit charsets whose lower half is US-ASCII
+	 * and which we convert to UTF-8 without the help of iconv.
+	 * iso-8859-12 was never published so there is no table for
+	 * it. */
+	{ "us-ascii",       "US-ASCII"     },
+	{ "iso-8859-1",     "ISO-8859-1"   },
+	{ "iso-8859-2",     "ISO-8859-2"   },
+	{ "iso-8859-3",     "ISO-8859-3"   },
+	{ "iso-8859-4",     "ISO-8859-4"   },
+	{ "iso-8859-5",     "ISO-8859-5"   },
+	{ "iso-8859-6",     "ISO-8859-6"   },
+	{ "iso-8859-7",     "ISO-8859-7"   },
+	{ "iso-8859-8",     "ISO-8859-8"   },
+	{ "iso-8859-9",     "ISO-8859-9"   },
+	{ "iso-8859-10",    "ISO-8859-10"  },
+	{ "iso-8859-11",    "ISO-8859-11"  },
+	{ "iso-8859-13",    "ISO-8859-13"  },
+	{ "iso-8859-14",    "ISO-8859-14"  },
+	{ "iso-8859-15",    "ISO-8859-15"  },
+	{ "iso-8859-16",    "ISO-8859-16"  },
+	{ "windows-cp1250", "CP1250"       },
+	{ "windows-cp1251", "CP1251"       },
+	{ "windows-cp1252", "CP1252"       },
+	{ "windows-cp1253", "CP1253"       },
+	{ "windows-cp1254", "CP1254"       },
+	{ "windows-cp1255", "CP1255"       },
+	{ "windows-cp1256", "CP1256"       },
+	{ "windows-cp1257", "CP1257"       },
+	{ "windows-cp1258", "CP1258"       },
+	{ "koi8-r",         "KOI8-R"       },
+	{ "koi8-u",         "KOI8-U"       },
+};
+
+#define G_N_ELEMENTS(arr) (sizeof (arr) / sizeof ((arr)[0]))
+
+static void
+table_name (char *name, const char *charset)
+{
+	for ( ; *charset; charset++, name++)
+		*name = *charset == '-' ? '_' : *charset;
+	
+	strcpy (name, "_table");
+}
+
+int main (int argc, char **argv)
+{
+	unsigned int out[128];
+	size_t inleft, outleft;
+	char *inbuf, *outbuf;
+	char name[64];
+	char in[128];
+	iconv_t cd;
+	size_t i, j;
+	
+	printf ("/* This file is automatically generated: DO NOT EDIT */\n\n");
+	printf ("/* Unicode code points for bytes 0x80-0xff; 0 means that the byte has no mapping */\n\n");
+	
+	for (j = 0; j < G_N_ELEMENTS (tables); j++) {
+		if ((cd = iconv_open ("UCS-4LE", tables[j].iconv)) == (iconv_t) -1) {
+			fprintf (stderr, "iconv_open (UCS-4LE, %s): %s\n", tables[j].iconv, strerror (errno));
+			return 1;
+		}
+		
+		/* convert each of the upper 128 characters on its own so
+		 * that we know which ones have no mapping */
+		for (i = 0; i < 128; i++) {
+			in[i] = (char) (i + 128);
+			inbuf = in + i;
+			inleft = 1;
+			outbuf = (char *) (out + i);
+			outleft = 4;
+			
+			/* Note: glibc's windows-cp1255 and windows-cp1258 converters hold back
+			 * base characters that might combine with a following diacritic, so
+			 * flush the descriptor to get at them. We never compose them. */
+			if (iconv (cd, &inbuf, &inleft, &outbuf, &outleft) == (size_t) -1 ||
+			    iconv (cd, NULL, NULL, &outbuf, &outleft) == (size_t) -1 || outleft != 0) {
+				iconv (cd, NULL, NULL, NULL, NULL);
+				out[i] = 0;
+			}
+		}
+		
+		iconv_close (cd);
+		
+		table_name (name, tables[j].name);
+		printf ("static const unsigned short %s[128] = {\n\t", name);
+		for (i = 0; i < 128; i++) {
+			unsigned char *c = (unsigned char *) (out + i);
+			unsigned int u = c[0] | (c[1] << 8) | (c[2] << 16) | ((unsigned int) c[3] << 24);
+			
+			if (u > 0xffff) {
+				fprintf (stderr, "%s: 0x%02x maps outside of the BMP\n", tables[j].name, (unsigned int) (i + 128));
+				return 1;
+			}
+			
+			if (i > 0)
+				printf ((i & 7) == 0 ? ",\n\t" : ", ");
+			
+			printf ("0x%04x", u);
+		}
+		printf ("\n};\n\n");
+	}
+	
+	printf ("static const GMimeIconvPath charset_tables[] = {\n");
+	for (j = 0; j < G_N_ELEMENTS (tables); j++) {
+		table_name (name, tables[j].name);
+		printf ("\t{ \"%s\", %s },\n", tables[j].name, name);
+	}
+	printf ("};\n");
+	
+	return 0;
+}
@@ -224,7 +224,7 @@ g_mime_application_pkcs7_mime_compress (GMimeObject *entity, GError **err)
 	g_mime_format_options_set_newline_format (options, GMIME_NEWLINE_FORMAT_DOS);
 	
 	/* get the cleartext */
-	stream = g_mime_stream_mem_new ();
+	stream = _g_mime_parser_options_create_stream (NULL);
 	g_mime_object_write_to_stream (entity, options, stream);
 	g_mime_format_options_free (options);
 	
@@ -232,7 +232,7 @@ g_mime_application_pkcs7_mime_compress (GMimeObject *entity, GError **err)
 	g_mime_stream_reset (stream);
 	
 	/* compress the content stream */
-	compressed = g_mime_stream_mem_new ();
+	compressed = _g_mime_parser_options_create_stream (NULL);
 	if (g_mime_crypto_context_compress (ctx, stream, compressed, err) == -1) {
 		g_object_unref (compressed);
 		g_object_unref (stream);
@@ -277,11 +277,11 @@ g_mime_application_pkcs7_mime_decompress (GMimeApplicationPkcs7Mime *pkcs7_mime)
 	
 	/* get the compressed stream */
 	content = g_mime_part_get_content ((GMimePart *) pkcs7_mime);
-	compressed = g_mime_stream_mem_new ();
+	compressed = _g_mime_parser_options_create_stream (NULL);
 	g_mime_data_wrapper_write_to_stream (content, compressed);
 	g_mime_stream_reset (compressed);
 	
-	stream = g_mime_stream_mem_new ();
+	stream = _g_mime_parser_options_create_stream (NULL);
 	filtered = g_mime_stream_filter_new (stream);
 	filter = g_mime_filter_dos2unix_new (FALSE);
 	g_mime_stream_filter_add ((GMimeStreamFilter *) filtered, filter);
@@ -359,7 +359,7 @@ g_mime_application_pkcs7_mime_encrypt (GMimeObject *entity, GMimeEncryptFlags fl
 	g_mime_format_options_set_newline_format (options, GMIME_NEWLINE_FORMAT_DOS);
 	
 	/* get the cleartext */
-	stream = g_mime_stream_mem_new ();
+	stream = _g_mime_parser_options_create_stream (NULL);
 	g_mime_object_write_to_stream (entity, options, stream);
 	g_mime_format_options_free (options);
 	
@@ -367,7 +367,7 @@ g_mime_application_pkcs7_mime_encrypt (GMimeObject *entity, GMimeEncryptFlags fl
 	g_mime_stream_reset (stream);
 	
 	/* encrypt the content stream */
-	ciphertext = g_mime_stream_mem_new ();
+	ciphertext = _g_mime_parser_options_create_stream (NULL);
 	if (g_mime_crypto_context_encrypt (ctx, FALSE, NULL, flags, recipients, stream, ciphertext, err) == -1) {
 		g_object_unref (ciphertext);
 		g_object_unref (stream);
@@ -441,11 +441,11 @@ g_mime_application_pkcs7_mime_decrypt (GMimeApplicationPkcs7Mime *pkcs7_mime,
 	
 	/* get the ciphertext stream */
 	content = g_mime_part_get_content ((GMimePart *) pkcs7_mime);
-	ciphertext = g_mime_stream_mem_new ();
+	ciphertext = _g_mime_parser_options_create_stream (NULL);
 	g_mime_data_wrapper_write_to_stream (content, ciphertext);
 	g_mime_stream_reset (ciphertext);
 	
-	stream = g_mime_stream_mem_new ();
+	stream = _g_mime_parser_options_create_stream (NULL);
 	filtered = g_mime_stream_filter_new (stream);
 	filter = g_mime_filter_dos2unix_new (FALSE);
 	g_mime_stream_filter_add ((GMimeStreamFilter *) filtered, filter);
@@ -528,7 +528,7 @@ g_mime_application_pkcs7_mime_sign (GMimeObject *entity, const char *userid, GEr
 	g_mime_format_options_set_newline_format (options, GMIME_NEWLINE_FORMAT_DOS);
 	
 	/* get the cleartext */
-	stream = g_mime_stream_mem_new ();
+	stream = _g_mime_parser_options_create_stream (NULL);
 	g_mime_object_write_to_stream (entity, options, stream);
 	g_mime_format_options_free (options);
 	
@@ -536,7 +536,7 @@ g_mime_application_pkcs7_mime_sign (GMimeObject *entity, const char *userid, GEr
 	g_mime_stream_reset (stream);
 	
 	/* sign the content stream */
-	ciphertext = g_mime_stream_mem_new ();
+	ciphertext = _g_mime_parser_options_create_stream (NULL);
 	if (g_mime_crypto_context_sign (ctx, FALSE, userid, stream, ciphertext, err) == -1) {
 		g_object_unref (ciphertext);
 		g_object_unref (stream);
@@ -598,11 +598,11 @@ g_mime_application_pkcs7_mime_verify (GMimeApplicationPkcs7Mime *pkcs7_mime, GMi
 	
 	/* get the ciphertext stream */
 	content = g_mime_part_get_content ((GMimePart *) pkcs7_mime);
-	ciphertext = g_mime_stream_mem_new ();
+	ciphertext = _g_mime_parser_options_create_stream (NULL);
 	g_mime_data_wrapper_write_to_stream (content, ciphertext);
 	g_mime_stream_reset (ciphertext);
 	
-	stream = g_mime_stream_mem_new ();
+	stream = _g_mime_parser_options_create_stream (NULL);
 	filtered = g_mime_stream_filter_new (stream);
 	filter = g_mime_filter_dos2unix_new (FALSE);
 	g_mime_stream_filter_add ((GMimeStreamFilter *) filtered, filter);
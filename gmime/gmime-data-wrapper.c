@@ -26,6 +26,7 @@
 #include "gmime-data-wrapper.h"
 #include "gmime-stream-filter.h"
 #include "gmime-filter-basic.h"
+#include "gmime-internal.h"
 
 
 /**
@@ -41,6 +42,22 @@
  **/
 
 
+/* content at least this large is decoded in parallel (if enabled) */
+#define PARALLEL_DECODE_THRESHOLD (4 * 1024 * 1024)
+
+/* minimum distance (in decoded bytes) between random-access checkpoints */
+#define CHECKPOINT_INTERVAL (64 * 1024)
+
+typedef struct {
+	gint64 raw;      /* offset into the encoded stream */
+	gint64 decoded;  /* corresponding offset into the decoded content */
+} DecodeCheckpoint;
+
+struct _GMimeDataWrapperPrivate {
+	GArray *checkpoints; /* index of decode checkpoints used for random access */
+	guint n_threads;     /* max number of threads used to decode the content */
+};
+
 static void g_mime_data_wrapper_class_init (GMimeDataWrapperClass *klass);
 static void g_mime_data_wrapper_init (GMimeDataWrapper *wrapper, GMimeDataWrapperClass *klass);
 static void g_mime_data_wrapper_finalize (GObject *object);
@@ -49,6 +66,9 @@ static ssize_t write_to_stream (GMimeDataWrapper *wrapper, GMimeStream *stream);
 
 
 static GObject *parent_class = NULL;
+static int private_offset = 0;
+
+#define GMIME_DATA_WRAPPER_GET_PRIVATE(wrapper) ((struct _GMimeDataWrapperPrivate *) G_STRUCT_MEMBER_P ((wrapper), private_offset))
 
 
 GType
@@ -70,6 +90,7 @@ g_mime_data_wrapper_get_type (void)
 		};
 		
 		type = g_type_register_static (G_TYPE_OBJECT, "GMimeDataWrapper", &info, 0);
+		private_offset = g_type_add_instance_private (type, sizeof (struct _GMimeDataWrapperPrivate));
 	}
 	
 	return type;
@@ -82,6 +103,7 @@ g_mime_data_wrapper_class_init (GMimeDataWrapperClass *klass)
 	GObjectClass *object_class = G_OBJECT_CLASS (klass);
 	
 	parent_class = g_type_class_ref (G_TYPE_OBJECT);
+	g_type_class_adjust_private_offset (klass, &private_offset);
 	
 	object_class->finalize = g_mime_data_wrapper_finalize;
 	
@@ -93,6 +115,21 @@ g_mime_data_wrapper_init (GMimeDataWrapper *wrapper, GMimeDataWrapperClass *klas
 {
 	wrapper->encoding = GMIME_CONTENT_ENCODING_DEFAULT;
 	wrapper->stream = NULL;
+	
+	GMIME_DATA_WRAPPER_GET_PRIVATE (wrapper)->checkpoints = NULL;
+	GMIME_DATA_WRAPPER_GET_PRIVATE (wrapper)->n_threads = 1;
+}
+
+static void
+data_wrapper_index_free (GMimeDataWrapper *wrapper)
+{
+	struct _GMimeDataWrapperPrivate *priv = GMIME_DATA_WRAPPER_GET_PRIVATE (wrapper);
+	
+	if (priv->checkpoints == NULL)
+		return;
+	
+	g_array_free (priv->checkpoints, TRUE);
+	priv->checkpoints = NULL;
 }
 
 static void
@@ -103,6 +140,8 @@ g_mime_data_wrapper_finalize (GObject *object)
 	if (wrapper->stream)
 		g_object_unref (wrapper->stream);
 	
+	data_wrapper_index_free (wrapper);
+	
 	G_OBJECT_CLASS (parent_class)->finalize (object);
 }
 
@@ -174,6 +213,7 @@ g_mime_data_wrapper_set_stream (GMimeDataWrapper *wrapper, GMimeStream *stream)
 	if (wrapper->stream)
 		g_object_unref (wrapper->stream);
 	
+	data_wrapper_index_free (wrapper);
 	wrapper->stream = stream;
 }
 
@@ -207,6 +247,9 @@ g_mime_data_wrapper_set_encoding (GMimeDataWrapper *wrapper, GMimeContentEncodin
 {
 	g_return_if_fail (GMIME_IS_DATA_WRAPPER (wrapper));
 	
+	if (wrapper->encoding != encoding)
+		data_wrapper_index_free (wrapper);
+	
 	wrapper->encoding = encoding;
 }
 
@@ -228,18 +271,68 @@ g_mime_data_wrapper_get_encoding (GMimeDataWrapper *wrapper)
 }
 
 
+/**
+ * g_mime_data_wrapper_set_decode_threads:
+ * @wrapper: a #GMimeDataWrapper
+ * @n_threads: the maximum number of threads to use or %0 to use one per processor
+ *
+ * Sets the maximum number of threads that g_mime_data_wrapper_write_to_stream()
+ * may use to decode large base64 or quoted-printable encoded content
+ * (see g_mime_encoding_write_to_stream()).
+ *
+ * The default is %1, which always decodes the content serially.
+ **/
+void
+g_mime_data_wrapper_set_decode_threads (GMimeDataWrapper *wrapper, guint n_threads)
+{
+	g_return_if_fail (GMIME_IS_DATA_WRAPPER (wrapper));
+	
+	GMIME_DATA_WRAPPER_GET_PRIVATE (wrapper)->n_threads = n_threads;
+}
+
+
+/**
+ * g_mime_data_wrapper_get_decode_threads:
+ * @wrapper: a #GMimeDataWrapper
+ *
+ * Gets the maximum number of threads that g_mime_data_wrapper_write_to_stream()
+ * may use to decode the content.
+ *
+ * Returns: the maximum number of threads or %0 if one per processor may be used.
+ **/
+guint
+g_mime_data_wrapper_get_decode_threads (GMimeDataWrapper *wrapper)
+{
+	g_return_val_if_fail (GMIME_IS_DATA_WRAPPER (wrapper), 1);
+	
+	return GMIME_DATA_WRAPPER_GET_PRIVATE (wrapper)->n_threads;
+}
+
+
 static ssize_t
 write_to_stream (GMimeDataWrapper *wrapper, GMimeStream *stream)
 {
+	guint n_threads = GMIME_DATA_WRAPPER_GET_PRIVATE (wrapper)->n_threads;
 	GMimeStream *filtered_stream;
 	GMimeFilter *filter;
 	ssize_t written;
 	
 	g_mime_stream_reset (wrapper->stream);
 	
+	if (n_threads == 0)
+		n_threads = g_get_num_processors ();
+	
 	switch (wrapper->encoding) {
 	case GMIME_CONTENT_ENCODING_BASE64:
 	case GMIME_CONTENT_ENCODING_QUOTEDPRINTABLE:
+		if (n_threads > 1 && g_mime_stream_length (wrapper->stream) >= PARALLEL_DECODE_THRESHOLD) {
+			/* large enough to be worth decoding on multiple threads */
+			written = g_mime_encoding_write_to_stream (wrapper->encoding, FALSE, wrapper->stream, stream, n_threads);
+			g_mime_stream_reset (wrapper->stream);
+			
+			return written;
+		}
+		/* fall through */
 	case GMIME_CONTENT_ENCODING_UUENCODE:
 		filter = g_mime_filter_basic_new (wrapper->encoding, FALSE);
 		filtered_stream = g_mime_stream_filter_new (wrapper->stream);
@@ -268,6 +361,9 @@ write_to_stream (GMimeDataWrapper *wrapper, GMimeStream *stream)
  *
  * Writes the raw (decoded) data to the output stream.
  *
+ * Large base64 and quoted-printable encoded content is decoded on
+ * multiple threads if enabled with g_mime_data_wrapper_set_decode_threads().
+ *
  * Returns: the number of bytes written or %-1 on failure.
  **/
 ssize_t
@@ -279,3 +375,239 @@ g_mime_data_wrapper_write_to_stream (GMimeDataWrapper *wrapper, GMimeStream *str
 	
 	return GMIME_DATA_WRAPPER_GET_CLASS (wrapper)->write_to_stream (wrapper, stream);
 }
+
+
+/**
+ * g_mime_data_wrapper_get_decoded_stream:
+ * @wrapper: a #GMimeDataWrapper
+ * @options: (nullable): a #GMimeParserOptions or %NULL
+ *
+ * Decodes the content of @wrapper into a new seekable stream.
+ *
+ * If the spill threshold of @options (see
+ * g_mime_parser_options_set_spill_threshold()) is non-zero, the
+ * decoded content is written to a #GMimeStreamSpill so that large
+ * content is moved to a temporary file instead of being held in
+ * memory. Otherwise, the content is decoded into a #GMimeStreamMem.
+ *
+ * Returns: (transfer full): a new stream positioned at the start of
+ * the decoded content or %NULL on failure.
+ **/
+GMimeStream *
+g_mime_data_wrapper_get_decoded_stream (GMimeDataWrapper *wrapper, GMimeParserOptions *options)
+{
+	GMimeStream *stream;
+	
+	g_return_val_if_fail (GMIME_IS_DATA_WRAPPER (wrapper), NULL);
+	g_return_val_if_fail (wrapper->stream != NULL, NULL);
+	
+	stream = _g_mime_parser_options_create_stream (options);
+	
+	if (g_mime_data_wrapper_write_to_stream (wrapper, stream) == -1) {
+		g_object_unref (stream);
+		return NULL;
+	}
+	
+	g_mime_stream_reset (stream);
+	
+	return stream;
+}
+
+
+static gboolean
+stream_write_all (GMimeStream *stream, const char *buf, size_t len)
+{
+	size_t nwritten = 0;
+	ssize_t n;
+	
+	while (nwritten < len) {
+		if ((n = g_mime_stream_write (stream, buf + nwritten, len - nwritten)) < 0)
+			return FALSE;
+		
+		nwritten += n;
+	}
+	
+	return TRUE;
+}
+
+/* copies the decoded bytes in [offset, end) from @src, which is positioned at decoded offset @pos */
+static ssize_t
+write_range (GMimeStream *src, gint64 pos, gint64 offset, gint64 end, GMimeStream *stream)
+{
+	ssize_t written = 0;
+	gint64 lo, hi;
+	ssize_t nread;
+	char buf[4096];
+	
+	while (pos < end) {
+		if ((nread = g_mime_stream_read (src, buf, sizeof (buf))) < 0)
+			return -1;
+		
+		if (nread == 0)
+			break;
+		
+		lo = MAX (pos, offset);
+		hi = MIN (pos + nread, end);
+		
+		if (hi > lo) {
+			if (!stream_write_all (stream, buf + (lo - pos), (size_t) (hi - lo)))
+				return -1;
+			
+			written += (ssize_t) (hi - lo);
+		}
+		
+		pos += nread;
+	}
+	
+	return written;
+}
+
+static ssize_t
+write_base64_range (GMimeDataWrapper *wrapper, gint64 offset, gint64 end, GMimeStream *stream)
+{
+	struct _GMimeDataWrapperPrivate *priv = GMIME_DATA_WRAPPER_GET_PRIVATE (wrapper);
+	GMimeStream *src = wrapper->stream;
+	DecodeCheckpoint *checkpoints, *last;
+	DecodeCheckpoint checkpoint;
+	char inbuf[4096], outbuf[4096];
+	GMimeEncoding decoder;
+	gint64 pos, raw, lo, hi;
+	ssize_t written = 0;
+	guint min, max, mid;
+	ssize_t nread;
+	size_t n;
+	
+	if (priv->checkpoints == NULL) {
+		priv->checkpoints = g_array_new (FALSE, FALSE, sizeof (DecodeCheckpoint));
+		checkpoint.raw = checkpoint.decoded = 0;
+		g_array_append_val (priv->checkpoints, checkpoint);
+	}
+	
+	/* find the last checkpoint at or before @offset */
+	checkpoints = (DecodeCheckpoint *) priv->checkpoints->data;
+	min = 0;
+	max = priv->checkpoints->len;
+	while (max - min > 1) {
+		mid = min + (max - min) / 2;
+		if (checkpoints[mid].decoded <= offset)
+			min = mid;
+		else
+			max = mid;
+	}
+	
+	checkpoint = checkpoints[min];
+	if (g_mime_stream_seek (src, src->bound_start + checkpoint.raw, GMIME_STREAM_SEEK_SET) == -1) {
+		/* not seekable past the start, so decode from the beginning */
+		if (g_mime_stream_reset (src) == -1)
+			return -1;
+		
+		checkpoint = checkpoints[0];
+	}
+	
+	g_mime_encoding_init_decode (&decoder, GMIME_CONTENT_ENCODING_BASE64);
+	raw = checkpoint.raw;
+	pos = checkpoint.decoded;
+	
+	while (pos < end) {
+		if ((nread = g_mime_stream_read (src, inbuf, sizeof (inbuf))) < 0)
+			return -1;
+		
+		if (nread == 0)
+			break;
+		
+		n = g_mime_encoding_step (&decoder, inbuf, (size_t) nread, outbuf);
+		raw += nread;
+		
+		lo = MAX (pos, offset);
+		hi = MIN (pos + (gint64) n, end);
+		
+		if (hi > lo) {
+			if (!stream_write_all (stream, outbuf + (lo - pos), (size_t) (hi - lo)))
+				return -1;
+			
+			written += (ssize_t) (hi - lo);
+		}
+		
+		pos += n;
+		
+		/* a decoder with no partial quartet can resume here, so remember where we are */
+		last = &g_array_index (priv->checkpoints, DecodeCheckpoint, priv->checkpoints->len - 1);
+		if (decoder.state == 0 && pos >= last->decoded + CHECKPOINT_INTERVAL) {
+			checkpoint.raw = raw;
+			checkpoint.decoded = pos;
+			g_array_append_val (priv->checkpoints, checkpoint);
+		}
+		
+		/* '=' padding marks the end of the content */
+		if (decoder.state == -1)
+			break;
+	}
+	
+	return written;
+}
+
+
+/**
+ * g_mime_data_wrapper_write_range_to_stream:
+ * @wrapper: a #GMimeDataWrapper
+ * @offset: offset into the decoded content
+ * @length: number of decoded bytes to write or %-1 for everything after @offset
+ * @stream: output stream
+ *
+ * Writes the given range of the raw (decoded) data to the output
+ * stream, e.g. to serve a partial fetch or range request for an
+ * attachment.
+ *
+ * For base64 encoded content, @wrapper lazily builds an index of
+ * points in the encoded stream at which decoding can resume, so once
+ * a region has been decoded, ranges within it only cost as much as
+ * their own length. Unencoded content is read directly from @offset
+ * and other encodings are decoded from the start.
+ *
+ * Returns: the number of bytes written or %-1 on failure.
+ **/
+ssize_t
+g_mime_data_wrapper_write_range_to_stream (GMimeDataWrapper *wrapper, gint64 offset, gint64 length, GMimeStream *stream)
+{
+	GMimeStream *filtered_stream;
+	GMimeFilter *filter;
+	ssize_t written;
+	gint64 end;
+	
+	g_return_val_if_fail (GMIME_IS_DATA_WRAPPER (wrapper), -1);
+	g_return_val_if_fail (GMIME_IS_STREAM (stream), -1);
+	g_return_val_if_fail (wrapper->stream != NULL, -1);
+	g_return_val_if_fail (offset >= 0, -1);
+	
+	end = length < 0 ? G_MAXINT64 : offset + length;
+	
+	switch (wrapper->encoding) {
+	case GMIME_CONTENT_ENCODING_BASE64:
+		written = write_base64_range (wrapper, offset, end, stream);
+		break;
+	case GMIME_CONTENT_ENCODING_QUOTEDPRINTABLE:
+	case GMIME_CONTENT_ENCODING_UUENCODE:
+		g_mime_stream_reset (wrapper->stream);
+		
+		filter = g_mime_filter_basic_new (wrapper->encoding, FALSE);
+		filtered_stream = g_mime_stream_filter_new (wrapper->stream);
+		g_mime_stream_filter_add (GMIME_STREAM_FILTER (filtered_stream), filter);
+		g_object_unref (filter);
+		
+		written = write_range (filtered_stream, 0, offset, end, stream);
+		g_object_unref (filtered_stream);
+		break;
+	default:
+		if (g_mime_stream_seek (wrapper->stream, wrapper->stream->bound_start + offset, GMIME_STREAM_SEEK_SET) != -1) {
+			written = write_range (wrapper->stream, offset, offset, end, stream);
+		} else {
+			g_mime_stream_reset (wrapper->stream);
+			written = write_range (wrapper->stream, 0, offset, end, stream);
+		}
+		break;
+	}
+	
+	g_mime_stream_reset (wrapper->stream);
+	
+	return written;
+}
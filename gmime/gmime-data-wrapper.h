@@ -27,6 +27,7 @@
 
 #include <gmime/gmime-content-type.h>
 #include <gmime/gmime-encodings.h>
+#include <gmime/gmime-parser-options.h>
 #include <gmime/gmime-stream.h>
 #include <gmime/gmime-utils.h>
 
@@ -76,8 +77,15 @@ GMimeStream *g_mime_data_wrapper_get_stream (GMimeDataWrapper *wrapper);
 void g_mime_data_wrapper_set_encoding (GMimeDataWrapper *wrapper, GMimeContentEncoding encoding);
 GMimeContentEncoding g_mime_data_wrapper_get_encoding (GMimeDataWrapper *wrapper);
 
+void g_mime_data_wrapper_set_decode_threads (GMimeDataWrapper *wrapper, guint n_threads);
+guint g_mime_data_wrapper_get_decode_threads (GMimeDataWrapper *wrapper);
+
 ssize_t g_mime_data_wrapper_write_to_stream (GMimeDataWrapper *wrapper, GMimeStream *stream);
 
+GMimeStream *g_mime_data_wrapper_get_decoded_stream (GMimeDataWrapper *wrapper, GMimeParserOptions *options);
+
+ssize_t g_mime_data_wrapper_write_range_to_stream (GMimeDataWrapper *wrapper, gint64 offset, gint64 length, GMimeStream *stream);
+
 G_END_DECLS
 
 #endif /* __GMIME_DATA_WRAPPER_H__ */
@@ -29,6 +29,7 @@
 
 #include "gmime-table-private.h"
 #include "gmime-encodings.h"
+#include "gmime-simd.h"
 
 
 #ifdef ENABLE_WARNINGS
@@ -365,6 +366,262 @@ g_mime_encoding_flush (GMimeEncoding *state, const char *inbuf, size_t inlen, ch
 }
 
 
+#define PARALLEL_CHUNK_SIZE (57 * 16 * 1024) /* ~912 KB of whole base64 lines */
+
+typedef struct {
+	GMimeEncoding encoder;
+	const char *inbuf;
+	size_t inlen;
+	gboolean flush;
+	char *outbuf;
+	size_t outlen;
+} EncodingChunk;
+
+static void
+encoding_chunk_process (EncodingChunk *chunk)
+{
+	chunk->outbuf = g_malloc (g_mime_encoding_outlen (&chunk->encoder, chunk->inlen));
+	
+	if (chunk->flush)
+		chunk->outlen = g_mime_encoding_flush (&chunk->encoder, chunk->inbuf, chunk->inlen, chunk->outbuf);
+	else
+		chunk->outlen = g_mime_encoding_step (&chunk->encoder, chunk->inbuf, chunk->inlen, chunk->outbuf);
+}
+
+static void
+encoding_chunk_run (gpointer data, gpointer user_data)
+{
+	encoding_chunk_process ((EncodingChunk *) data);
+}
+
+/* finds the last offset in (start, end] at which @encoder will be back in its initial state */
+static size_t
+encoding_chunk_split (GMimeEncoding *encoder, const char *inbuf, size_t start, size_t end)
+{
+	/* the base64 encoder resets after every 57 bytes of input */
+	if (encoder->encode && encoder->encoding == GMIME_CONTENT_ENCODING_BASE64)
+		return start + ((end - start) / 57) * 57;
+	
+	/* everything else resets at the end of a line */
+	while (end > start && inbuf[end - 1] != '\n')
+		end--;
+	
+	return end;
+}
+
+/* checks whether @encoder would produce the same output as a freshly initialized one */
+static gboolean
+encoding_is_initial (GMimeEncoding *encoder, GMimeEncoding *initial)
+{
+	if (encoder->state != initial->state)
+		return FALSE;
+	
+	/* the quoted-printable decoder only uses its saved byte mid-escape */
+	if (!encoder->encode && encoder->encoding == GMIME_CONTENT_ENCODING_QUOTEDPRINTABLE)
+		return TRUE;
+	
+	return encoder->save == initial->save;
+}
+
+static gboolean
+stream_write_all (GMimeStream *stream, const char *buf, size_t len)
+{
+	size_t nwritten = 0;
+	ssize_t n;
+	
+	while (nwritten < len) {
+		if ((n = g_mime_stream_write (stream, buf + nwritten, len - nwritten)) < 0)
+			return FALSE;
+		
+		nwritten += n;
+	}
+	
+	return TRUE;
+}
+
+
+/**
+ * g_mime_encoding_write_to_stream:
+ * @encoding: a #GMimeContentEncoding
+ * @encode: %TRUE to encode @src or %FALSE to decode it
+ * @src: source stream
+ * @dest: destination stream
+ * @n_threads: the maximum number of threads to use or %0 to use one per processor
+ *
+ * Encodes or decodes the content of @src and writes the result to
+ * @dest, splitting the content into large chunks that are processed
+ * on a thread pool and written in order.
+ *
+ * Chunks are split where the encoder or decoder returns to its
+ * initial state (on whole lines of input when base64 encoding and at
+ * line boundaries otherwise), so that each one can be processed
+ * independently. Any chunk that turns out not to begin in the
+ * initial state is redone serially, so the output is always
+ * identical to that of a #GMimeFilterBasic. When the length of @src
+ * is known, no more threads (or buffer space) are used than it has
+ * chunks.
+ *
+ * Note: uuencoded content needs the begin and end lines handled by
+ * #GMimeFilterBasic and is not supported.
+ *
+ * Returns: the number of bytes written to @dest or %-1 on error.
+ **/
+gint64
+g_mime_encoding_write_to_stream (GMimeContentEncoding encoding, gboolean encode, GMimeStream *src,
+				 GMimeStream *dest, guint n_threads)
+{
+	GMimeEncoding encoder, initial;
+	size_t bufsize, buflen, start, end;
+	gboolean flushed = FALSE;
+	gboolean eos = FALSE;
+	EncodingChunk *chunk;
+	GThreadPool *pool;
+	GArray *chunks;
+	gint64 total = 0;
+	gint64 length;
+	char *buffer;
+	ssize_t nread;
+	guint i;
+	
+	g_return_val_if_fail (encoding != GMIME_CONTENT_ENCODING_UUENCODE, -1);
+	g_return_val_if_fail (GMIME_IS_STREAM (src), -1);
+	g_return_val_if_fail (GMIME_IS_STREAM (dest), -1);
+	
+	if (n_threads == 0)
+		n_threads = g_get_num_processors ();
+	
+	/* there is no point in having more threads than there are chunks of content */
+	if ((length = g_mime_stream_length (src)) >= 0) {
+		gint64 n_chunks = (length + PARALLEL_CHUNK_SIZE - 1) / PARALLEL_CHUNK_SIZE;
+		
+		n_threads = (guint) CLAMP (n_chunks, 1, (gint64) n_threads);
+	}
+	
+	if (encode)
+		g_mime_encoding_init_encode (&encoder, encoding);
+	else
+		g_mime_encoding_init_decode (&encoder, encoding);
+	
+	initial = encoder;
+	
+	/* one extra chunk guarantees progress even if the content has no line breaks */
+	bufsize = (n_threads + 1) * PARALLEL_CHUNK_SIZE;
+	
+	/* ...but don't allocate more than the content needs (the extra byte lets the first read see the end) */
+	if (length >= 0 && (gint64) bufsize > length + 1)
+		bufsize = (size_t) length + 1;
+	
+	buffer = g_malloc (bufsize);
+	chunks = g_array_new (FALSE, FALSE, sizeof (EncodingChunk));
+	buflen = 0;
+	
+	do {
+		while (buflen < bufsize) {
+			if ((nread = g_mime_stream_read (src, buffer + buflen, bufsize - buflen)) < 0)
+				goto error;
+			
+			if (nread == 0) {
+				eos = TRUE;
+				break;
+			}
+			
+			buflen += nread;
+		}
+		
+		/* split the buffer into chunks, holding back whatever follows the last split point */
+		g_array_set_size (chunks, 0);
+		start = 0;
+		
+		while (start < buflen) {
+			end = MIN (start + PARALLEL_CHUNK_SIZE, buflen);
+			
+			if (!(eos && end == buflen)) {
+				size_t split = encoding_chunk_split (&initial, buffer, start, end);
+				
+				if (split > start)
+					end = split;
+				else if (end == buflen)
+					break;
+			}
+			
+			g_array_set_size (chunks, chunks->len + 1);
+			chunk = &g_array_index (chunks, EncodingChunk, chunks->len - 1);
+			chunk->encoder = initial;
+			chunk->inbuf = buffer + start;
+			chunk->inlen = end - start;
+			chunk->flush = eos && end == buflen;
+			chunk->outbuf = NULL;
+			chunk->outlen = 0;
+			start = end;
+		}
+		
+		if (chunks->len > 1) {
+			pool = g_thread_pool_new (encoding_chunk_run, NULL, (int) MIN (n_threads, chunks->len), FALSE, NULL);
+			for (i = 0; i < chunks->len; i++)
+				g_thread_pool_push (pool, &g_array_index (chunks, EncodingChunk, i), NULL);
+			g_thread_pool_free (pool, FALSE, TRUE);
+		} else if (chunks->len == 1) {
+			encoding_chunk_process (&g_array_index (chunks, EncodingChunk, 0));
+		}
+		
+		/* write out the results in order */
+		for (i = 0; i < chunks->len; i++) {
+			chunk = &g_array_index (chunks, EncodingChunk, i);
+			
+			if (encoding_is_initial (&encoder, &initial)) {
+				encoder.state = chunk->encoder.state;
+				encoder.save = chunk->encoder.save;
+			} else {
+				/* the chunk did not begin in the initial state, so redo it serially */
+				if (chunk->flush)
+					chunk->outlen = g_mime_encoding_flush (&encoder, chunk->inbuf, chunk->inlen, chunk->outbuf);
+				else
+					chunk->outlen = g_mime_encoding_step (&encoder, chunk->inbuf, chunk->inlen, chunk->outbuf);
+			}
+			
+			flushed = chunk->flush;
+			
+			if (!stream_write_all (dest, chunk->outbuf, chunk->outlen))
+				goto error;
+			
+			total += chunk->outlen;
+		}
+		
+		for (i = 0; i < chunks->len; i++)
+			g_free (g_array_index (chunks, EncodingChunk, i).outbuf);
+		g_array_set_size (chunks, 0);
+		
+		memmove (buffer, buffer + start, buflen - start);
+		buflen -= start;
+	} while (!eos);
+	
+	if (!flushed) {
+		char outbuf[128];
+		size_t n;
+		
+		n = g_mime_encoding_flush (&encoder, NULL, 0, outbuf);
+		
+		if (!stream_write_all (dest, outbuf, n))
+			goto error;
+		
+		total += n;
+	}
+	
+	g_array_free (chunks, TRUE);
+	g_free (buffer);
+	
+	return total;
+	
+ error:
+	for (i = 0; i < chunks->len; i++)
+		g_free (g_array_index (chunks, EncodingChunk, i).outbuf);
+	g_array_free (chunks, TRUE);
+	g_free (buffer);
+	
+	return -1;
+}
+
+
 /**
  * g_mime_encoding_base64_encode_close:
  * @inbuf: input buffer
@@ -467,6 +724,14 @@ g_mime_encoding_base64_encode_step (const unsigned char *inbuf, size_t inlen, un
 		if ((++quartets) >= 19) {
 			*outptr++ = '\n';
 			quartets = 0;
+
+			/* hand off as many whole lines as we can to the vectorized encoder */
+			if ((remaining = (size_t) (inend + 2 - inptr)) >= 57) {
+				size_t n = g_mime_simd_base64_encode_lines (inptr, remaining / 57, outptr);
+
+				inptr += (n / 77) * 57;
+				outptr += n;
+			}
 		}
 
 		if (inptr >= inend)
@@ -526,8 +791,10 @@ g_mime_encoding_base64_decode_step (const unsigned char *inbuf, size_t inlen, un
 	register const unsigned char *inptr = inbuf;
 	const unsigned char *inend = inptr + inlen;
 	unsigned char *outptr = outbuf;
+	const unsigned char *resume = inbuf;
 	unsigned int saved = *save;
 	unsigned char c, rank;
+	gboolean simd;
 	int n, eq, eof = 0;
 
 	n = *state;
@@ -536,8 +803,22 @@ g_mime_encoding_base64_decode_step (const unsigned char *inbuf, size_t inlen, un
 	if (n == -1)
 		return 0;
 
+	simd = g_mime_simd_get_level () != GMIME_SIMD_NONE;
+
 	/* decode every quartet into a triplet */
 	while (inptr < inend) {
+		if (simd && n == 0 && inptr >= resume && (inend - inptr) >= 16) {
+			size_t nread;
+
+			/* decode runs of clean base64 16 characters at a time */
+			outptr += g_mime_simd_base64_decode (inptr, (size_t) (inend - inptr), outptr, &nread);
+			inptr += nread;
+
+			/* let the scalar decoder get past whatever stopped the vectorized one */
+			resume = inptr + 16;
+			continue;
+		}
+
 		rank = gmime_base64_rank[(c = *inptr++)];
 
 		if (rank != 0xFF) {
@@ -839,6 +1120,26 @@ g_mime_encoding_uudecode_step (const unsigned char *inbuf, size_t inlen, unsigne
 			continue;
 		}
 		
+		/* decode whole quartets directly while they don't straddle a line break */
+		while (i == 0 && uulen >= 3 && (inend - inptr) >= 4 &&
+		       inptr[0] != '\n' && inptr[1] != '\n' && inptr[2] != '\n' && inptr[3] != '\n') {
+			unsigned char r0, r1, r2, r3;
+			
+			r0 = gmime_uu_rank[inptr[0]];
+			r1 = gmime_uu_rank[inptr[1]];
+			r2 = gmime_uu_rank[inptr[2]];
+			r3 = gmime_uu_rank[inptr[3]];
+			
+			*outptr++ = r0 << 2 | r1 >> 4;
+			*outptr++ = r1 << 4 | r2 >> 2;
+			*outptr++ = r2 << 6 | r3;
+			uulen -= 3;
+			inptr += 4;
+		}
+		
+		if (inptr == inend || *inptr == '\n' || uulen == 0)
+			continue;
+		
 		ch = *inptr++;
 		
 		if (uulen > 0) {
@@ -913,6 +1214,12 @@ g_mime_encoding_quoted_encode_close (const unsigned char *inbuf, size_t inlen, u
 		if (is_qpsafe (last) && !is_blank (last)) {
 			*outptr++ = last;
 		} else {
+			/* make sure that the encoded char and the trailing '=' fit on the line */
+			if (*save > 72) {
+				*outptr++ = '=';
+				*outptr++ = '\n';
+			}
+			
 			*outptr++ = '=';
 			*outptr++ = tohex[(last >> 4) & 0xf];
 			*outptr++ = tohex[last & 0xf];
@@ -953,12 +1260,33 @@ g_mime_encoding_quoted_encode_step (const unsigned char *inbuf, size_t inlen, un
 	register unsigned char *outptr = outbuf;
 	register guint32 sofar = *save;  /* keeps track of how many chars on a line */
 	register int last = *state;  /* keeps track if last char to end was a space cr etc */
+	gboolean simd = g_mime_simd_get_level () != GMIME_SIMD_NONE;
 	unsigned char c;
+	size_t n;
 	
 	while (inptr < inend) {
+		if (simd && last == -1 && sofar < 75 && (inend - inptr) >= 16) {
+			/* copy the run of printable characters that fits on this line in bulk */
+			n = MIN ((size_t) (inend - inptr), 75 - sofar);
+			n = g_mime_simd_qp_safe_span (inptr, n);
+			memcpy (outptr, inptr, n);
+			outptr += n;
+			inptr += n;
+			sofar += n;
+			
+			if (inptr == inend)
+				break;
+		}
+		
 		c = *inptr++;
 		if (c == '\r') {
 			if (last != -1) {
+				if (sofar > 72) {
+					*outptr++ = '=';
+					*outptr++ = '\n';
+					sofar = 0;
+				}
+				
 				*outptr++ = '=';
 				*outptr++ = tohex[(last >> 4) & 0xf];
 				*outptr++ = tohex[last & 0xf];
@@ -967,6 +1295,11 @@ g_mime_encoding_quoted_encode_step (const unsigned char *inbuf, size_t inlen, un
 			last = c;
 		} else if (c == '\n') {
 			if (last != -1 && last != '\r') {
+				if (sofar > 73) {
+					*outptr++ = '=';
+					*outptr++ = '\n';
+				}
+				
 				*outptr++ = '=';
 				*outptr++ = tohex[(last >> 4) & 0xf];
 				*outptr++ = tohex[last & 0xf];
@@ -980,6 +1313,12 @@ g_mime_encoding_quoted_encode_step (const unsigned char *inbuf, size_t inlen, un
 					*outptr++ = last;
 					sofar++;
 				} else {
+					if (sofar > 72) {
+						*outptr++ = '=';
+						*outptr++ = '\n';
+						sofar = 0;
+					}
+					
 					*outptr++ = '=';
 					*outptr++ = tohex[(last >> 4) & 0xf];
 					*outptr++ = tohex[last & 0xf];
@@ -1051,6 +1390,7 @@ g_mime_encoding_quoted_decode_step (const unsigned char *inbuf, size_t inlen, un
 	const register unsigned char *inptr = inbuf;
 	const unsigned char *inend = inbuf + inlen;
 	register unsigned char *outptr = outbuf;
+	const unsigned char *eq;
 	guint32 isave = *save;
 	int istate = *state;
 	unsigned char c;
@@ -1060,24 +1400,17 @@ g_mime_encoding_quoted_decode_step (const unsigned char *inbuf, size_t inlen, un
 	while (inptr < inend) {
 		switch (istate) {
 		case 0:
-			while (inptr < inend) {
-				c = *inptr++;
-				/* FIXME: use a specials table to avoid 3 comparisons for the common case */
-				if (c == '=') { 
-					istate = 1;
-					break;
-				}
-#ifdef CANONICALISE_EOL
-				/*else if (c=='\r') {
-					state = 3;
-				} else if (c=='\n') {
-					*outptr++ = '\r';
-					*outptr++ = c;
-					} */
-#endif
-				else {
-					*outptr++ = c;
-				}
+			/* copy the literal text up to the next '=' in bulk */
+			if (!(eq = memchr (inptr, '=', (size_t) (inend - inptr))))
+				eq = inend;
+			
+			memmove (outptr, inptr, (size_t) (eq - inptr));
+			outptr += eq - inptr;
+			inptr = eq;
+			
+			if (inptr < inend) {
+				istate = 1;
+				inptr++;
 			}
 			break;
 		case 1:
@@ -24,6 +24,7 @@
 
 #include <glib.h>
 #include <sys/types.h>
+#include <gmime/gmime-stream.h>
 
 G_BEGIN_DECLS
 
@@ -168,6 +169,9 @@ size_t g_mime_encoding_outlen (GMimeEncoding *state, size_t inlen);
 size_t g_mime_encoding_step (GMimeEncoding *state, const char *inbuf, size_t inlen, char *outbuf);
 size_t g_mime_encoding_flush (GMimeEncoding *state, const char *inbuf, size_t inlen, char *outbuf);
 
+gint64 g_mime_encoding_write_to_stream (GMimeContentEncoding encoding, gboolean encode, GMimeStream *src,
+					GMimeStream *dest, guint n_threads);
+
 
 /* do incremental base64 (de/en)coding */
 size_t g_mime_encoding_base64_decode_step (const unsigned char *inbuf, size_t inlen, unsigned char *outbuf, int *state, guint32 *save);
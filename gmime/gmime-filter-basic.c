@@ -27,6 +27,7 @@
 
 #include "gmime-filter-basic.h"
 #include "gmime-utils.h"
+#include "gmime-internal.h"
 
 
 /**
@@ -40,6 +41,12 @@
  **/
 
 
+/* base64 and quoted-printable decoders never get more than this many
+ * bytes ahead of their input (when completing a partial quartet saved
+ * from the previous call), so they can decode over their input */
+#define INPLACE_PRESPACE 3
+
+
 static void g_mime_filter_basic_class_init (GMimeFilterBasicClass *klass);
 static void g_mime_filter_basic_init (GMimeFilterBasic *filter, GMimeFilterBasicClass *klass);
 static void g_mime_filter_basic_finalize (GObject *object);
@@ -181,6 +188,14 @@ filter_filter (GMimeFilter *filter, char *inbuf, size_t inlen, size_t prespace,
 		}
 	}
 	
+	if (_g_mime_filter_can_filter_inplace (filter) && prespace >= INPLACE_PRESPACE) {
+		/* decode over the input */
+		*outbuf = inbuf - INPLACE_PRESPACE;
+		*outlen = g_mime_encoding_step (encoder, inbuf, inlen, *outbuf);
+		*outprespace = prespace - INPLACE_PRESPACE;
+		return;
+	}
+	
 	len = g_mime_encoding_outlen (encoder, inlen);
 	g_mime_filter_set_size (filter, len, FALSE);
 	nwritten = g_mime_encoding_step (encoder, inbuf, inlen, filter->outbuf);
@@ -211,6 +226,14 @@ filter_complete (GMimeFilter *filter, char *inbuf, size_t inlen, size_t prespace
 		}
 	}
 	
+	if (_g_mime_filter_can_filter_inplace (filter) && prespace >= INPLACE_PRESPACE) {
+		/* decode over the input */
+		*outbuf = inbuf - INPLACE_PRESPACE;
+		*outlen = g_mime_encoding_flush (encoder, inbuf, inlen, *outbuf);
+		*outprespace = prespace - INPLACE_PRESPACE;
+		return;
+	}
+	
 	len = g_mime_encoding_outlen (encoder, inlen);
 	g_mime_filter_set_size (filter, len, FALSE);
 	nwritten = g_mime_encoding_flush (encoder, inbuf, inlen, filter->outbuf);
@@ -254,5 +277,9 @@ g_mime_filter_basic_new (GMimeContentEncoding encoding, gboolean encode)
 	else
 		g_mime_encoding_init_decode (&basic->encoder, encoding);
 	
+	if (!encode && (encoding == GMIME_CONTENT_ENCODING_BASE64 ||
+			encoding == GMIME_CONTENT_ENCODING_QUOTEDPRINTABLE))
+		_g_mime_filter_set_inplace ((GMimeFilter *) basic, TRUE);
+	
 	return (GMimeFilter *) basic;
 }
@@ -26,6 +26,7 @@
 #include <string.h>
 
 #include "gmime-filter-best.h"
+#include "gmime-simd.h"
 
 
 /**
@@ -117,76 +118,81 @@ filter_copy (GMimeFilter *filter)
 	return g_mime_filter_best_new (best->flags);
 }
 
+/* checks whether the line starting at @lineptr is a From_ line */
+static void
+check_from (GMimeFilterBest *best, const unsigned char *lineptr, const unsigned char *inend)
+{
+	size_t left = inend - lineptr;
+	
+	if (left >= 5) {
+		if (!strncmp ((const char *) lineptr, "From ", 5))
+			best->hadfrom = TRUE;
+	} else if (left > 0 && !strncmp ((const char *) lineptr, "From ", left)) {
+		/* not enough data to tell, save what we have for the next pass */
+		memcpy (best->frombuf, lineptr, left);
+		best->frombuf[left] = '\0';
+		best->fromlen = left;
+	}
+}
+
 static void
 filter_filter (GMimeFilter *filter, char *inbuf, size_t inlen, size_t prespace,
 	       char **outbuf, size_t *outlen, size_t *outprespace)
 {
 	GMimeFilterBest *best = (GMimeFilterBest *) filter;
-	register unsigned char *inptr, *inend;
-	register unsigned char c;
-	size_t left;
+	const unsigned char *inptr, *inend;
+	GMimeSimdTextStats stats;
+	size_t n;
 	
 	if (best->flags & GMIME_FILTER_BEST_CHARSET)
 		g_mime_charset_step (&best->charset, inbuf, inlen);
 	
-	if (best->flags & GMIME_FILTER_BEST_ENCODING) {
+	if ((best->flags & GMIME_FILTER_BEST_ENCODING) && inlen > 0) {
 		best->total += inlen;
 		
-		inptr = (unsigned char *) inbuf;
+		inptr = (const unsigned char *) inbuf;
 		inend = inptr + inlen;
 		
-		while (inptr < inend) {
-			c = 0;
-			
-			if (best->midline) {
-				while (inptr < inend && (c = *inptr++) != '\n') {
-					if (c == 0)
-						best->count0++;
-					else if (c & 0x80)
-						best->count8++;
-					
-					if (best->fromlen > 0 && best->fromlen < 5)
-						best->frombuf[best->fromlen++] = c & 0xff;
-					
-					best->linelen++;
-				}
-				
-				if (c == '\n') {
-					best->maxline = MAX (best->maxline, best->linelen);
-					best->startline = TRUE;
-					best->midline = FALSE;
-					best->linelen = 0;
-				}
-			}
+		/* finish checking a From_ line that was split across passes */
+		if (best->fromlen > 0) {
+			n = MIN (5 - best->fromlen, inlen);
+			memcpy (best->frombuf + best->fromlen, inptr, n);
+			best->fromlen += n;
+			best->frombuf[best->fromlen] = '\0';
 			
-			/* check our from-save buffer for "From " */
-			if (best->fromlen == 5 && !strcmp ((char *) best->frombuf, "From "))
+			if (strncmp ((char *) best->frombuf, "From ", best->fromlen) != 0) {
+				best->fromlen = 0;
+			} else if (best->fromlen == 5) {
 				best->hadfrom = TRUE;
-			
-			best->fromlen = 0;
-			
-			left = inend - inptr;
-			
-			/* if we have not yet found a from-line, check for one */
-			if (best->startline && !best->hadfrom && left > 0) {
-				if (left < 5) {
-					if (!strncmp ((char *) inptr, "From ", left)) {
-						memcpy (best->frombuf, inptr, left);
-						best->frombuf[left] = '\0';
-						best->fromlen = left;
-						break;
-					}
-				} else {
-					if (!strncmp ((char *) inptr, "From ", 5)) {
-						best->hadfrom = TRUE;
-						inptr += 5;
-					}
-				}
+				best->fromlen = 0;
 			}
+		}
+		
+		/* if we have not yet found a from-line, check for one */
+		if (!best->hadfrom) {
+			if (best->startline)
+				check_from (best, inptr, inend);
 			
-			best->startline = FALSE;
-			best->midline = TRUE;
+			while (!best->hadfrom && (n = g_mime_simd_line_find (inptr, inend - inptr, 'F', 'F')) < (size_t) (inend - inptr)) {
+				inptr += n + 1;
+				check_from (best, inptr, inend);
+			}
 		}
+		
+		stats.count0 = best->count0;
+		stats.count8 = best->count8;
+		stats.linelen = best->linelen;
+		stats.maxline = best->maxline;
+		
+		g_mime_simd_text_stats ((const unsigned char *) inbuf, inlen, &stats);
+		
+		best->count0 = stats.count0;
+		best->count8 = stats.count8;
+		best->linelen = stats.linelen;
+		best->maxline = stats.maxline;
+		
+		best->startline = inbuf[inlen - 1] == '\n';
+		best->midline = !best->startline;
 	}
 	
 	*outprespace = prespace;
@@ -28,6 +28,7 @@
 #include "gmime-filter-charset.h"
 #include "gmime-charset.h"
 #include "gmime-iconv.h"
+#include "gmime-internal.h"
 
 
 /**
@@ -38,6 +39,11 @@
  *
  * A #GMimeFilter which is used for converting text from one charset
  * to another.
+ *
+ * Conversions to UTF-8 from UTF-8, UTF-16LE/BE, US-ASCII, the
+ * ISO-8859 and windows-125x families and KOI8-R/U are done natively
+ * (well-formed UTF-8 is copied straight through); everything else is
+ * converted using iconv.
  **/
 
 
@@ -133,10 +139,13 @@ filter_filter (GMimeFilter *filter, char *in, size_t len, size_t prespace,
 {
 	GMimeFilterCharset *charset = (GMimeFilterCharset *) filter;
 	size_t inleft, outleft, converted = 0;
+	const GMimeIconvPath *path;
 	char *inbuf;
 	char *outbuf;
 	
-	if (charset->cd == (iconv_t) -1)
+	path = _g_mime_iconv_get_path (charset->to_charset, charset->from_charset);
+	
+	if (path == NULL && charset->cd == (iconv_t) -1)
 		goto noop;
 	
 	g_mime_filter_set_size (filter, len * 5 + 16, FALSE);
@@ -147,7 +156,7 @@ filter_filter (GMimeFilter *filter, char *in, size_t len, size_t prespace,
 	inleft = len;
 	
 	do {
-		converted = iconv (charset->cd, &inbuf, &inleft, &outbuf, &outleft);
+		converted = _g_mime_iconv_convert (charset->cd, path, &inbuf, &inleft, &outbuf, &outleft);
 		if (converted == (size_t) -1) {
 			if (errno == E2BIG || errno == EINVAL)
 				break;
@@ -200,10 +209,13 @@ filter_complete (GMimeFilter *filter, char *in, size_t len, size_t prespace,
 {
 	GMimeFilterCharset *charset = (GMimeFilterCharset *) filter;
 	size_t inleft, outleft, converted = 0;
+	const GMimeIconvPath *path;
 	char *inbuf;
 	char *outbuf;
 	
-	if (charset->cd == (iconv_t) -1)
+	path = _g_mime_iconv_get_path (charset->to_charset, charset->from_charset);
+	
+	if (path == NULL && charset->cd == (iconv_t) -1)
 		goto noop;
 	
 	g_mime_filter_set_size (filter, len * 5 + 16, FALSE);
@@ -215,7 +227,7 @@ filter_complete (GMimeFilter *filter, char *in, size_t len, size_t prespace,
 	
 	if (inleft > 0) {
 		do {
-			converted = iconv (charset->cd, &inbuf, &inleft, &outbuf, &outleft);
+			converted = _g_mime_iconv_convert (charset->cd, path, &inbuf, &inleft, &outbuf, &outleft);
 			if (converted != (size_t) -1)
 				continue;
 			
@@ -258,7 +270,7 @@ filter_complete (GMimeFilter *filter, char *in, size_t len, size_t prespace,
 	}
 	
 	/* flush the iconv conversion */
-	while (iconv (charset->cd, NULL, NULL, &outbuf, &outleft) == (size_t) -1) {
+	while (_g_mime_iconv_convert (charset->cd, path, NULL, NULL, &outbuf, &outleft) == (size_t) -1) {
 		if (errno != E2BIG)
 			break;
 		
@@ -305,11 +317,13 @@ GMimeFilter *
 g_mime_filter_charset_new (const char *from_charset, const char *to_charset)
 {
 	GMimeFilterCharset *charset;
-	iconv_t cd;
+	iconv_t cd = (iconv_t) -1;
 	
-	cd = g_mime_iconv_open (to_charset, from_charset);
-	if (cd == (iconv_t) -1)
-		return NULL;
+	/* we don't need iconv for conversions that we can do natively */
+	if (!_g_mime_iconv_get_path (to_charset, from_charset)) {
+		if ((cd = g_mime_iconv_open (to_charset, from_charset)) == (iconv_t) -1)
+			return NULL;
+	}
 	
 	charset = g_object_new (GMIME_TYPE_FILTER_CHARSET, NULL);
 	charset->from_charset = g_strdup (from_charset);
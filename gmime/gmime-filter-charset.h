@@ -45,6 +45,10 @@ typedef struct _GMimeFilterCharsetClass GMimeFilterCharsetClass;
  * @cd: charset conversion state
  *
  * A filter to convert between charsets.
+ *
+ * Note: GMime converts between UTF-8, UTF-16 and the common 8bit
+ * charsets itself, without an iconv conversion descriptor. For those
+ * conversions @cd is (iconv_t) -1 even though the filter is valid.
  **/
 struct _GMimeFilterCharset {
 	GMimeFilter parent_object;
@@ -0,0 +1,665 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*- */
+/*  GMime
+ *  Copyright (C) 2000-2022 Jeffrey Stedfast
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public License
+ *  as published by the Free Software Foundation; either version 2.1
+ *  of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free
+ *  Software Foundation, 51 Franklin Street, Fifth Floor, Boston, MA
+ *  02110-1301, USA.
+ */
+
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <string.h>
+
+#include "gmime-filter-digest.h"
+#include "gmime-simd.h"
+
+
+/**
+ * SECTION: gmime-filter-digest
+ * @title: GMimeFilterDigest
+ * @short_description: Calculate several digests at once
+ * @see_also: #GMimeFilter, #GMimeFilterChecksum
+ *
+ * Calculates any combination of cryptographic digests (MD5, SHA-1,
+ * SHA-256 and SHA-512) and fast non-cryptographic checksums (CRC32C
+ * and 64-bit xxHash) of a stream in a single pass, which is a lot
+ * cheaper than stacking a #GMimeFilterChecksum for each of them.
+ *
+ * Where the CPU supports them, CRC32C is calculated with the SSE4.2
+ * crc32 instruction and SHA-256 with the SHA extensions.
+ **/
+
+
+/* each digest is fed this much of the input at a time so that the data
+ * only has to be read from memory once, staying in the L1 cache for the
+ * other digests */
+#define DIGEST_SLICE 8192
+
+#define XXH_PRIME64_1 G_GUINT64_CONSTANT (0x9e3779b185ebca87)
+#define XXH_PRIME64_2 G_GUINT64_CONSTANT (0xc2b2ae3d27d4eb4f)
+#define XXH_PRIME64_3 G_GUINT64_CONSTANT (0x165667b19e3779f9)
+#define XXH_PRIME64_4 G_GUINT64_CONSTANT (0x85ebca77c2b2ae63)
+#define XXH_PRIME64_5 G_GUINT64_CONSTANT (0x27d4eb2f165667c5)
+
+#define rotl64(x, n) (((x) << (n)) | ((x) >> (64 - (n))))
+
+typedef struct {
+	guint32 state[8];
+	unsigned char block[64];
+	size_t blocklen;
+	guint64 length;
+} Sha256;
+
+typedef struct {
+	guint64 v[4];
+	unsigned char stripe[32];
+	size_t stripelen;
+	guint64 length;
+} Xxh64;
+
+struct _GMimeFilterDigestPrivate {
+	/* MD5, SHA-1, SHA-256 (unless the CPU has the SHA extensions) and SHA-512 */
+	GChecksum *checksums[4];
+	Sha256 *sha256;
+	guint32 crc32c;
+	Xxh64 xxh64;
+};
+
+static const GChecksumType checksum_types[4] = {
+	G_CHECKSUM_MD5, G_CHECKSUM_SHA1, G_CHECKSUM_SHA256, G_CHECKSUM_SHA512
+};
+
+static const guint32 sha256_init[8] = {
+	0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+};
+
+/* CRC32C (Castagnoli) lookup table for the reflected polynomial 0x82f63b78 */
+static const guint32 crc32c_table[256] = {
+	0x00000000, 0xf26b8303, 0xe13b70f7, 0x1350f3f4, 0xc79a971f, 0x35f1141c,
+	0x26a1e7e8, 0xd4ca64eb, 0x8ad958cf, 0x78b2dbcc, 0x6be22838, 0x9989ab3b,
+	0x4d43cfd0, 0xbf284cd3, 0xac78bf27, 0x5e133c24, 0x105ec76f, 0xe235446c,
+	0xf165b798, 0x030e349b, 0xd7c45070, 0x25afd373, 0x36ff2087, 0xc494a384,
+	0x9a879fa0, 0x68ec1ca3, 0x7bbcef57, 0x89d76c54, 0x5d1d08bf, 0xaf768bbc,
+	0xbc267848, 0x4e4dfb4b, 0x20bd8ede, 0xd2d60ddd, 0xc186fe29, 0x33ed7d2a,
+	0xe72719c1, 0x154c9ac2, 0x061c6936, 0xf477ea35, 0xaa64d611, 0x580f5512,
+	0x4b5fa6e6, 0xb93425e5, 0x6dfe410e, 0x9f95c20d, 0x8cc531f9, 0x7eaeb2fa,
+	0x30e349b1, 0xc288cab2, 0xd1d83946, 0x23b3ba45, 0xf779deae, 0x05125dad,
+	0x1642ae59, 0xe4292d5a, 0xba3a117e, 0x4851927d, 0x5b016189, 0xa96ae28a,
+	0x7da08661, 0x8fcb0562, 0x9c9bf696, 0x6ef07595, 0x417b1dbc, 0xb3109ebf,
+	0xa0406d4b, 0x522bee48, 0x86e18aa3, 0x748a09a0, 0x67dafa54, 0x95b17957,
+	0xcba24573, 0x39c9c670, 0x2a993584, 0xd8f2b687, 0x0c38d26c, 0xfe53516f,
+	0xed03a29b, 0x1f682198, 0x5125dad3, 0xa34e59d0, 0xb01eaa24, 0x42752927,
+	0x96bf4dcc, 0x64d4cecf, 0x77843d3b, 0x85efbe38, 0xdbfc821c, 0x2997011f,
+	0x3ac7f2eb, 0xc8ac71e8, 0x1c661503, 0xee0d9600, 0xfd5d65f4, 0x0f36e6f7,
+	0x61c69362, 0x93ad1061, 0x80fde395, 0x72966096, 0xa65c047d, 0x5437877e,
+	0x4767748a, 0xb50cf789, 0xeb1fcbad, 0x197448ae, 0x0a24bb5a, 0xf84f3859,
+	0x2c855cb2, 0xdeeedfb1, 0xcdbe2c45, 0x3fd5af46, 0x7198540d, 0x83f3d70e,
+	0x90a324fa, 0x62c8a7f9, 0xb602c312, 0x44694011, 0x5739b3e5, 0xa55230e6,
+	0xfb410cc2, 0x092a8fc1, 0x1a7a7c35, 0xe811ff36, 0x3cdb9bdd, 0xceb018de,
+	0xdde0eb2a, 0x2f8b6829, 0x82f63b78, 0x709db87b, 0x63cd4b8f, 0x91a6c88c,
+	0x456cac67, 0xb7072f64, 0xa457dc90, 0x563c5f93, 0x082f63b7, 0xfa44e0b4,
+	0xe9141340, 0x1b7f9043, 0xcfb5f4a8, 0x3dde77ab, 0x2e8e845f, 0xdce5075c,
+	0x92a8fc17, 0x60c37f14, 0x73938ce0, 0x81f80fe3, 0x55326b08, 0xa759e80b,
+	0xb4091bff, 0x466298fc, 0x1871a4d8, 0xea1a27db, 0xf94ad42f, 0x0b21572c,
+	0xdfeb33c7, 0x2d80b0c4, 0x3ed04330, 0xccbbc033, 0xa24bb5a6, 0x502036a5,
+	0x4370c551, 0xb11b4652, 0x65d122b9, 0x97baa1ba, 0x84ea524e, 0x7681d14d,
+	0x2892ed69, 0xdaf96e6a, 0xc9a99d9e, 0x3bc21e9d, 0xef087a76, 0x1d63f975,
+	0x0e330a81, 0xfc588982, 0xb21572c9, 0x407ef1ca, 0x532e023e, 0xa145813d,
+	0x758fe5d6, 0x87e466d5, 0x94b49521, 0x66df1622, 0x38cc2a06, 0xcaa7a905,
+	0xd9f75af1, 0x2b9cd9f2, 0xff56bd19, 0x0d3d3e1a, 0x1e6dcdee, 0xec064eed,
+	0xc38d26c4, 0x31e6a5c7, 0x22b65633, 0xd0ddd530, 0x0417b1db, 0xf67c32d8,
+	0xe52cc12c, 0x1747422f, 0x49547e0b, 0xbb3ffd08, 0xa86f0efc, 0x5a048dff,
+	0x8ecee914, 0x7ca56a17, 0x6ff599e3, 0x9d9e1ae0, 0xd3d3e1ab, 0x21b862a8,
+	0x32e8915c, 0xc083125f, 0x144976b4, 0xe622f5b7, 0xf5720643, 0x07198540,
+	0x590ab964, 0xab613a67, 0xb831c993, 0x4a5a4a90, 0x9e902e7b, 0x6cfbad78,
+	0x7fab5e8c, 0x8dc0dd8f, 0xe330a81a, 0x115b2b19, 0x020bd8ed, 0xf0605bee,
+	0x24aa3f05, 0xd6c1bc06, 0xc5914ff2, 0x37faccf1, 0x69e9f0d5, 0x9b8273d6,
+	0x88d28022, 0x7ab90321, 0xae7367ca, 0x5c18e4c9, 0x4f48173d, 0xbd23943e,
+	0xf36e6f75, 0x0105ec76, 0x12551f82, 0xe03e9c81, 0x34f4f86a, 0xc69f7b69,
+	0xd5cf889d, 0x27a40b9e, 0x79b737ba, 0x8bdcb4b9, 0x988c474d, 0x6ae7c44e,
+	0xbe2da0a5, 0x4c4623a6, 0x5f16d052, 0xad7d5351
+};
+
+
+static void g_mime_filter_digest_class_init (GMimeFilterDigestClass *klass);
+static void g_mime_filter_digest_init (GMimeFilterDigest *filter, GMimeFilterDigestClass *klass);
+static void g_mime_filter_digest_finalize (GObject *object);
+
+static GMimeFilter *filter_copy (GMimeFilter *filter);
+static void filter_filter (GMimeFilter *filter, char *in, size_t len, size_t prespace,
+			   char **out, size_t *outlen, size_t *outprespace);
+static void filter_complete (GMimeFilter *filter, char *in, size_t len, size_t prespace,
+			     char **out, size_t *outlen, size_t *outprespace);
+static void filter_reset (GMimeFilter *filter);
+
+
+static GMimeFilterClass *parent_class = NULL;
+
+
+GType
+g_mime_filter_digest_get_type (void)
+{
+	static GType type = 0;
+	
+	if (!type) {
+		static const GTypeInfo info = {
+			sizeof (GMimeFilterDigestClass),
+			NULL, /* base_class_init */
+			NULL, /* base_class_finalize */
+			(GClassInitFunc) g_mime_filter_digest_class_init,
+			NULL, /* class_finalize */
+			NULL, /* class_data */
+			sizeof (GMimeFilterDigest),
+			0,    /* n_preallocs */
+			(GInstanceInitFunc) g_mime_filter_digest_init,
+		};
+		
+		type = g_type_register_static (GMIME_TYPE_FILTER, "GMimeFilterDigest", &info, 0);
+	}
+	
+	return type;
+}
+
+
+static void
+g_mime_filter_digest_class_init (GMimeFilterDigestClass *klass)
+{
+	GObjectClass *object_class = G_OBJECT_CLASS (klass);
+	GMimeFilterClass *filter_class = GMIME_FILTER_CLASS (klass);
+	
+	parent_class = g_type_class_ref (GMIME_TYPE_FILTER);
+	
+	object_class->finalize = g_mime_filter_digest_finalize;
+	
+	filter_class->copy = filter_copy;
+	filter_class->filter = filter_filter;
+	filter_class->complete = filter_complete;
+	filter_class->reset = filter_reset;
+}
+
+static void
+g_mime_filter_digest_init (GMimeFilterDigest *filter, GMimeFilterDigestClass *klass)
+{
+	filter->priv = g_new0 (struct _GMimeFilterDigestPrivate, 1);
+	filter->digests = 0;
+}
+
+static void
+g_mime_filter_digest_finalize (GObject *object)
+{
+	GMimeFilterDigest *filter = (GMimeFilterDigest *) object;
+	struct _GMimeFilterDigestPrivate *priv = filter->priv;
+	guint i;
+	
+	for (i = 0; i < G_N_ELEMENTS (priv->checksums); i++) {
+		if (priv->checksums[i])
+			g_checksum_free (priv->checksums[i]);
+	}
+	
+	g_free (priv->sha256);
+	g_free (priv);
+	
+	G_OBJECT_CLASS (parent_class)->finalize (object);
+}
+
+
+static void
+sha256_reset (Sha256 *sha)
+{
+	memcpy (sha->state, sha256_init, sizeof (sha->state));
+	sha->blocklen = 0;
+	sha->length = 0;
+}
+
+static void
+sha256_update (Sha256 *sha, const unsigned char *inbuf, size_t inlen)
+{
+	size_t n;
+	
+	sha->length += inlen;
+	
+	if (sha->blocklen > 0) {
+		n = MIN (sizeof (sha->block) - sha->blocklen, inlen);
+		memcpy (sha->block + sha->blocklen, inbuf, n);
+		sha->blocklen += n;
+		inbuf += n;
+		inlen -= n;
+		
+		if (sha->blocklen < sizeof (sha->block))
+			return;
+		
+		g_mime_simd_sha256_blocks (sha->state, sha->block, 1);
+		sha->blocklen = 0;
+	}
+	
+	if (inlen >= 64) {
+		g_mime_simd_sha256_blocks (sha->state, inbuf, inlen / 64);
+		inbuf += inlen & ~((size_t) 63);
+		inlen &= 63;
+	}
+	
+	memcpy (sha->block, inbuf, inlen);
+	sha->blocklen = inlen;
+}
+
+static void
+sha256_digest (const Sha256 *sha, unsigned char *digest)
+{
+	guint64 nbits = GUINT64_TO_BE (sha->length * 8);
+	unsigned char block[128];
+	size_t n = sha->blocklen;
+	guint32 state[8];
+	size_t padded;
+	guint i;
+	
+	memcpy (state, sha->state, sizeof (state));
+	memcpy (block, sha->block, n);
+	block[n++] = 0x80;
+	
+	padded = n <= 56 ? 64 : 128;
+	memset (block + n, 0, padded - 8 - n);
+	memcpy (block + padded - 8, &nbits, 8);
+	
+	g_mime_simd_sha256_blocks (state, block, padded / 64);
+	
+	for (i = 0; i < 8; i++)
+		state[i] = GUINT32_TO_BE (state[i]);
+	
+	memcpy (digest, state, 32);
+}
+
+static guint32
+crc32c_update (guint32 crc, const unsigned char *inbuf, size_t inlen)
+{
+	const unsigned char *inend = inbuf + inlen;
+	
+	if (g_mime_simd_has_crc32c ())
+		return g_mime_simd_crc32c (crc, inbuf, inlen);
+	
+	while (inbuf < inend)
+		crc = crc32c_table[(crc ^ *inbuf++) & 0xff] ^ (crc >> 8);
+	
+	return crc;
+}
+
+static inline guint64
+xxh64_read64 (const unsigned char *inptr)
+{
+	guint64 value;
+	
+	memcpy (&value, inptr, sizeof (value));
+	
+	return GUINT64_FROM_LE (value);
+}
+
+static inline guint64
+xxh64_round (guint64 acc, guint64 input)
+{
+	acc += input * XXH_PRIME64_2;
+	acc = rotl64 (acc, 31);
+	
+	return acc * XXH_PRIME64_1;
+}
+
+static void
+xxh64_reset (Xxh64 *xxh)
+{
+	xxh->v[0] = XXH_PRIME64_1 + XXH_PRIME64_2;
+	xxh->v[1] = XXH_PRIME64_2;
+	xxh->v[2] = 0;
+	xxh->v[3] = -XXH_PRIME64_1;
+	xxh->stripelen = 0;
+	xxh->length = 0;
+}
+
+static void
+xxh64_update (Xxh64 *xxh, const unsigned char *inbuf, size_t inlen)
+{
+	const unsigned char *inend = inbuf + inlen;
+	guint64 v0, v1, v2, v3;
+	size_t n;
+	
+	xxh->length += inlen;
+	
+	if (xxh->stripelen > 0) {
+		n = MIN (sizeof (xxh->stripe) - xxh->stripelen, inlen);
+		memcpy (xxh->stripe + xxh->stripelen, inbuf, n);
+		xxh->stripelen += n;
+		inbuf += n;
+		
+		if (xxh->stripelen < sizeof (xxh->stripe))
+			return;
+		
+		xxh->v[0] = xxh64_round (xxh->v[0], xxh64_read64 (xxh->stripe));
+		xxh->v[1] = xxh64_round (xxh->v[1], xxh64_read64 (xxh->stripe + 8));
+		xxh->v[2] = xxh64_round (xxh->v[2], xxh64_read64 (xxh->stripe + 16));
+		xxh->v[3] = xxh64_round (xxh->v[3], xxh64_read64 (xxh->stripe + 24));
+		xxh->stripelen = 0;
+	}
+	
+	v0 = xxh->v[0];
+	v1 = xxh->v[1];
+	v2 = xxh->v[2];
+	v3 = xxh->v[3];
+	
+	while (inend - inbuf >= 32) {
+		v0 = xxh64_round (v0, xxh64_read64 (inbuf));
+		v1 = xxh64_round (v1, xxh64_read64 (inbuf + 8));
+		v2 = xxh64_round (v2, xxh64_read64 (inbuf + 16));
+		v3 = xxh64_round (v3, xxh64_read64 (inbuf + 24));
+		inbuf += 32;
+	}
+	
+	xxh->v[0] = v0;
+	xxh->v[1] = v1;
+	xxh->v[2] = v2;
+	xxh->v[3] = v3;
+	
+	memcpy (xxh->stripe, inbuf, inend - inbuf);
+	xxh->stripelen = inend - inbuf;
+}
+
+static guint64
+xxh64_digest (const Xxh64 *xxh)
+{
+	const unsigned char *inptr = xxh->stripe;
+	const unsigned char *inend = inptr + xxh->stripelen;
+	guint64 hash;
+	guint32 word;
+	guint i;
+	
+	if (xxh->length >= 32) {
+		hash = rotl64 (xxh->v[0], 1) + rotl64 (xxh->v[1], 7) + rotl64 (xxh->v[2], 12) + rotl64 (xxh->v[3], 18);
+		
+		for (i = 0; i < 4; i++) {
+			hash ^= xxh64_round (0, xxh->v[i]);
+			hash = hash * XXH_PRIME64_1 + XXH_PRIME64_4;
+		}
+	} else {
+		hash = XXH_PRIME64_5;
+	}
+	
+	hash += xxh->length;
+	
+	while (inend - inptr >= 8) {
+		hash ^= xxh64_round (0, xxh64_read64 (inptr));
+		hash = rotl64 (hash, 27) * XXH_PRIME64_1 + XXH_PRIME64_4;
+		inptr += 8;
+	}
+	
+	if (inend - inptr >= 4) {
+		memcpy (&word, inptr, sizeof (word));
+		hash ^= (guint64) GUINT32_FROM_LE (word) * XXH_PRIME64_1;
+		hash = rotl64 (hash, 23) * XXH_PRIME64_2 + XXH_PRIME64_3;
+		inptr += 4;
+	}
+	
+	while (inptr < inend) {
+		hash ^= *inptr++ * XXH_PRIME64_5;
+		hash = rotl64 (hash, 11) * XXH_PRIME64_1;
+	}
+	
+	hash ^= hash >> 33;
+	hash *= XXH_PRIME64_2;
+	hash ^= hash >> 29;
+	hash *= XXH_PRIME64_3;
+	hash ^= hash >> 32;
+	
+	return hash;
+}
+
+
+static GMimeFilter *
+filter_copy (GMimeFilter *filter)
+{
+	struct _GMimeFilterDigestPrivate *priv = ((GMimeFilterDigest *) filter)->priv;
+	GMimeFilterDigest *digest = (GMimeFilterDigest *) filter;
+	struct _GMimeFilterDigestPrivate *copy_priv;
+	GMimeFilterDigest *copy;
+	guint i;
+	
+	copy = (GMimeFilterDigest *) g_mime_filter_digest_new (digest->digests);
+	copy_priv = copy->priv;
+	
+	for (i = 0; i < G_N_ELEMENTS (priv->checksums); i++) {
+		if (priv->checksums[i]) {
+			g_checksum_free (copy_priv->checksums[i]);
+			copy_priv->checksums[i] = g_checksum_copy (priv->checksums[i]);
+		}
+	}
+	
+	if (priv->sha256)
+		memcpy (copy_priv->sha256, priv->sha256, sizeof (Sha256));
+	
+	copy_priv->crc32c = priv->crc32c;
+	copy_priv->xxh64 = priv->xxh64;
+	
+	return (GMimeFilter *) copy;
+}
+
+static void
+filter_filter (GMimeFilter *filter, char *in, size_t len, size_t prespace,
+	       char **out, size_t *outlen, size_t *outprespace)
+{
+	GMimeFilterDigest *digest = (GMimeFilterDigest *) filter;
+	struct _GMimeFilterDigestPrivate *priv = digest->priv;
+	const unsigned char *inptr = (const unsigned char *) in;
+	size_t offset, n;
+	guint i;
+	
+	for (offset = 0; offset < len; offset += n) {
+		n = MIN (DIGEST_SLICE, len - offset);
+		
+		for (i = 0; i < G_N_ELEMENTS (priv->checksums); i++) {
+			if (priv->checksums[i])
+				g_checksum_update (priv->checksums[i], inptr + offset, n);
+		}
+		
+		if (priv->sha256)
+			sha256_update (priv->sha256, inptr + offset, n);
+		
+		if (digest->digests & GMIME_DIGEST_CRC32C)
+			priv->crc32c = crc32c_update (priv->crc32c, inptr + offset, n);
+		
+		if (digest->digests & GMIME_DIGEST_XXH64)
+			xxh64_update (&priv->xxh64, inptr + offset, n);
+	}
+	
+	*out = in;
+	*outlen = len;
+	*outprespace = prespace;
+}
+
+static void
+filter_complete (GMimeFilter *filter, char *in, size_t len, size_t prespace,
+		 char **out, size_t *outlen, size_t *outprespace)
+{
+	filter_filter (filter, in, len, prespace, out, outlen, outprespace);
+}
+
+static void
+filter_reset (GMimeFilter *filter)
+{
+	struct _GMimeFilterDigestPrivate *priv = ((GMimeFilterDigest *) filter)->priv;
+	guint i;
+	
+	for (i = 0; i < G_N_ELEMENTS (priv->checksums); i++) {
+		if (priv->checksums[i])
+			g_checksum_reset (priv->checksums[i]);
+	}
+	
+	if (priv->sha256)
+		sha256_reset (priv->sha256);
+	
+	priv->crc32c = 0xffffffff;
+	xxh64_reset (&priv->xxh64);
+}
+
+
+/**
+ * g_mime_filter_digest_new:
+ * @digests: the #GMimeDigestType flags of the digests to calculate
+ *
+ * Creates a new filter which calculates each of the requested digests
+ * of the data passing through it.
+ *
+ * Returns: a new #GMimeFilterDigest filter.
+ **/
+GMimeFilter *
+g_mime_filter_digest_new (GMimeDigestType digests)
+{
+	struct _GMimeFilterDigestPrivate *priv;
+	GMimeFilterDigest *digest;
+	guint i;
+	
+	digest = g_object_new (GMIME_TYPE_FILTER_DIGEST, NULL);
+	digest->digests = digests;
+	priv = digest->priv;
+	
+	if ((digests & GMIME_DIGEST_SHA256) && g_mime_simd_has_sha256 ()) {
+		priv->sha256 = g_new (Sha256, 1);
+		sha256_reset (priv->sha256);
+		digests &= ~GMIME_DIGEST_SHA256;
+	}
+	
+	for (i = 0; i < G_N_ELEMENTS (priv->checksums); i++) {
+		if (digests & (1 << i))
+			priv->checksums[i] = g_checksum_new (checksum_types[i]);
+	}
+	
+	priv->crc32c = 0xffffffff;
+	xxh64_reset (&priv->xxh64);
+	
+	return (GMimeFilter *) digest;
+}
+
+
+/**
+ * g_mime_filter_digest_get_digest:
+ * @filter: digest filter object
+ * @digest: the #GMimeDigestType of the digest to get
+ * @buf: the digest buffer
+ * @len: the length of the digest buffer
+ *
+ * Outputs the @digest of the data that has passed through the filter
+ * so far into @buf. The filter can continue to be used afterwards.
+ *
+ * Returns: the number of bytes used of @buf or %0 if @digest is not
+ * being calculated by @filter or @buf is too small to hold it.
+ **/
+size_t
+g_mime_filter_digest_get_digest (GMimeFilterDigest *filter, GMimeDigestType digest, unsigned char *buf, size_t len)
+{
+	struct _GMimeFilterDigestPrivate *priv;
+	GChecksum *checksum;
+	guint64 xxh64;
+	guint32 crc32c;
+	guint i;
+	
+	g_return_val_if_fail (GMIME_IS_FILTER_DIGEST (filter), 0);
+	g_return_val_if_fail (buf != NULL, 0);
+	
+	priv = filter->priv;
+	
+	if (!(filter->digests & digest))
+		return 0;
+	
+	switch (digest) {
+	case GMIME_DIGEST_SHA256:
+		if (priv->sha256) {
+			if (len < 32)
+				return 0;
+			
+			sha256_digest (priv->sha256, buf);
+			
+			return 32;
+		}
+		/* fall through */
+	case GMIME_DIGEST_MD5:
+	case GMIME_DIGEST_SHA1:
+	case GMIME_DIGEST_SHA512:
+		for (i = 0; (1 << i) != digest; i++)
+			;
+		
+		if (len < (size_t) g_checksum_type_get_length (checksum_types[i]))
+			return 0;
+		
+		/* getting the digest closes a GChecksum, so use a copy */
+		checksum = g_checksum_copy (priv->checksums[i]);
+		g_checksum_get_digest (checksum, buf, &len);
+		g_checksum_free (checksum);
+		
+		return len;
+	case GMIME_DIGEST_CRC32C:
+		if (len < 4)
+			return 0;
+		
+		crc32c = GUINT32_TO_BE (~priv->crc32c);
+		memcpy (buf, &crc32c, 4);
+		
+		return 4;
+	case GMIME_DIGEST_XXH64:
+		if (len < 8)
+			return 0;
+		
+		xxh64 = GUINT64_TO_BE (xxh64_digest (&priv->xxh64));
+		memcpy (buf, &xxh64, 8);
+		
+		return 8;
+	default:
+		g_return_val_if_reached (0);
+	}
+}
+
+
+/**
+ * g_mime_filter_digest_get_string:
+ * @filter: digest filter object
+ * @digest: the #GMimeDigestType of the digest to get
+ *
+ * Outputs the @digest of the data that has passed through the filter
+ * so far as a newly allocated hexadecimal string.
+ *
+ * Returns: the hexadecimal representation of the digest or %NULL if
+ * @digest is not being calculated by @filter. The returned string
+ * should be freed with g_free() when no longer needed.
+ **/
+char *
+g_mime_filter_digest_get_string (GMimeFilterDigest *filter, GMimeDigestType digest)
+{
+	static const char hex[] = "0123456789abcdef";
+	unsigned char buf[64];
+	size_t len, i;
+	char *str;
+	
+	g_return_val_if_fail (GMIME_IS_FILTER_DIGEST (filter), NULL);
+	
+	if ((len = g_mime_filter_digest_get_digest (filter, digest, buf, sizeof (buf))) == 0)
+		return NULL;
+	
+	str = g_malloc (len * 2 + 1);
+	
+	for (i = 0; i < len; i++) {
+		str[i * 2] = hex[buf[i] >> 4];
+		str[i * 2 + 1] = hex[buf[i] & 0x0f];
+	}
+	
+	str[len * 2] = '\0';
+	
+	return str;
+}
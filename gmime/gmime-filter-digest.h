@@ -0,0 +1,92 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*- */
+/*  GMime
+ *  Copyright (C) 2000-2022 Jeffrey Stedfast
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public License
+ *  as published by the Free Software Foundation; either version 2.1
+ *  of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free
+ *  Software Foundation, 51 Franklin Street, Fifth Floor, Boston, MA
+ *  02110-1301, USA.
+ */
+
+#ifndef __GMIME_FILTER_DIGEST_H__
+#define __GMIME_FILTER_DIGEST_H__
+
+#include <gmime/gmime-filter.h>
+
+G_BEGIN_DECLS
+
+#define GMIME_TYPE_FILTER_DIGEST            (g_mime_filter_digest_get_type ())
+#define GMIME_FILTER_DIGEST(obj)            (G_TYPE_CHECK_INSTANCE_CAST ((obj), GMIME_TYPE_FILTER_DIGEST, GMimeFilterDigest))
+#define GMIME_FILTER_DIGEST_CLASS(klass)    (G_TYPE_CHECK_CLASS_CAST ((klass), GMIME_TYPE_FILTER_DIGEST, GMimeFilterDigestClass))
+#define GMIME_IS_FILTER_DIGEST(obj)         (G_TYPE_CHECK_INSTANCE_TYPE ((obj), GMIME_TYPE_FILTER_DIGEST))
+#define GMIME_IS_FILTER_DIGEST_CLASS(klass) (G_TYPE_CHECK_CLASS_TYPE ((klass), GMIME_TYPE_FILTER_DIGEST))
+#define GMIME_FILTER_DIGEST_GET_CLASS(obj)  (G_TYPE_INSTANCE_GET_CLASS ((obj), GMIME_TYPE_FILTER_DIGEST, GMimeFilterDigestClass))
+
+typedef struct _GMimeFilterDigest GMimeFilterDigest;
+typedef struct _GMimeFilterDigestClass GMimeFilterDigestClass;
+
+
+/**
+ * GMimeDigestType:
+ * @GMIME_DIGEST_MD5: The MD5 digest (16 bytes).
+ * @GMIME_DIGEST_SHA1: The SHA-1 digest (20 bytes).
+ * @GMIME_DIGEST_SHA256: The SHA-256 digest (32 bytes).
+ * @GMIME_DIGEST_SHA512: The SHA-512 digest (64 bytes).
+ * @GMIME_DIGEST_CRC32C: The CRC32C (Castagnoli) checksum (4 bytes, big-endian).
+ * @GMIME_DIGEST_XXH64: The 64-bit xxHash fingerprint with a seed of 0 (8 bytes, big-endian).
+ *
+ * The digests that a #GMimeFilterDigest can calculate. These are bit
+ * flags so that several digests may be requested at once.
+ **/
+typedef enum {
+	GMIME_DIGEST_MD5    = 1 << 0,
+	GMIME_DIGEST_SHA1   = 1 << 1,
+	GMIME_DIGEST_SHA256 = 1 << 2,
+	GMIME_DIGEST_SHA512 = 1 << 3,
+	GMIME_DIGEST_CRC32C = 1 << 4,
+	GMIME_DIGEST_XXH64  = 1 << 5
+} GMimeDigestType;
+
+
+/**
+ * GMimeFilterDigest:
+ * @parent_object: parent #GMimeFilter
+ * @priv: private state data
+ * @digests: the #GMimeDigestType flags of the digests being calculated
+ *
+ * A filter for calculating several digests of a stream in a single pass.
+ **/
+struct _GMimeFilterDigest {
+	GMimeFilter parent_object;
+	
+	struct _GMimeFilterDigestPrivate *priv;
+	
+	GMimeDigestType digests;
+};
+
+struct _GMimeFilterDigestClass {
+	GMimeFilterClass parent_class;
+	
+};
+
+
+GType g_mime_filter_digest_get_type (void);
+
+GMimeFilter *g_mime_filter_digest_new (GMimeDigestType digests);
+
+size_t g_mime_filter_digest_get_digest (GMimeFilterDigest *filter, GMimeDigestType digest, unsigned char *buf, size_t len);
+char *g_mime_filter_digest_get_string (GMimeFilterDigest *filter, GMimeDigestType digest);
+
+G_END_DECLS
+
+#endif /* __GMIME_FILTER_DIGEST_H__ */
@@ -23,7 +23,10 @@
 #include <config.h>
 #endif
 
+#include <string.h>
+
 #include "gmime-filter-dos2unix.h"
+#include "gmime-internal.h"
 
 
 /**
@@ -92,6 +95,8 @@ g_mime_filter_dos2unix_init (GMimeFilterDos2Unix *filter, GMimeFilterDos2UnixCla
 {
 	filter->ensure_newline = FALSE;
 	filter->pc = '\0';
+	
+	_g_mime_filter_set_inplace ((GMimeFilter *) filter, TRUE);
 }
 
 
@@ -111,37 +116,60 @@ convert (GMimeFilter *filter, char *inbuf, size_t inlen, size_t prespace,
 	register const char *inptr = inbuf;
 	const char *inend = inbuf + inlen;
 	size_t expected = inlen;
-	char *outptr;
-	
-	if (flush && dos2unix->ensure_newline)
-		expected++;
+	char *outptr, *outstart;
+	const char *cr;
+	size_t n;
 	
-	if (dos2unix->pc == '\r')
-		expected++;
-	
-	g_mime_filter_set_size (filter, expected, FALSE);
+	if (_g_mime_filter_can_filter_inplace (filter) && prespace > 0 && !(flush && dos2unix->ensure_newline)) {
+		/* the output is never longer than the input plus a held-back '\r',
+		 * so we can write it over the input starting 1 byte earlier */
+		outstart = inbuf - 1;
+		prespace--;
+	} else {
+		if (flush && dos2unix->ensure_newline)
+			expected++;
+		
+		if (dos2unix->pc == '\r')
+			expected++;
+		
+		g_mime_filter_set_size (filter, expected, FALSE);
+		outstart = filter->outbuf;
+		prespace = filter->outpre;
+	}
 	
-	outptr = filter->outbuf;
+	outptr = outstart;
 	while (inptr < inend) {
-		if (*inptr == '\n') {
-			*outptr++ = *inptr;
-		} else {
-			if (dos2unix->pc == '\r')
-				*outptr++ = dos2unix->pc;
+		/* find the next '\r' and copy everything before it in one go */
+		if (!(cr = memchr (inptr, '\r', inend - inptr)))
+			cr = inend;
+		
+		if ((n = cr - inptr) > 0) {
+			/* a held back '\r' is only dropped if a '\n' follows it */
+			if (dos2unix->pc == '\r' && *inptr != '\n')
+				*outptr++ = '\r';
 			
-			if (*inptr != '\r')
-				*outptr++ = *inptr;
+			dos2unix->pc = cr[-1];
+			memmove (outptr, inptr, n);
+			outptr += n;
+			inptr = cr;
 		}
 		
+		if (inptr == inend)
+			break;
+		
+		/* hold back the '\r' until we know what follows it */
+		if (dos2unix->pc == '\r')
+			*outptr++ = '\r';
+		
 		dos2unix->pc = *inptr++;
 	}
 	
 	if (flush && dos2unix->ensure_newline && dos2unix->pc != '\n')
 		dos2unix->pc = *outptr++ = '\n';
 	
-	*outlen = outptr - filter->outbuf;
-	*outprespace = filter->outpre;
-	*outbuf = filter->outbuf;
+	*outlen = outptr - outstart;
+	*outprespace = prespace;
+	*outbuf = outstart;
 }
 
 static void
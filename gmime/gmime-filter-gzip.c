@@ -81,6 +81,15 @@ enum {
 
 #define GZIP_FLAG_RESERVED (GZIP_FLAG_RESERVED0 | GZIP_FLAG_RESERVED1 | GZIP_FLAG_RESERVED2)
 
+/* when using more than one thread, the input is compressed in
+ * independent blocks of this size (as pigz does), each primed with
+ * the preceding 32 KB of input as its dictionary */
+#define GZIP_BLOCK_SIZE (128 * 1024)
+#define GZIP_DICT_SIZE  (32 * 1024)
+
+/* ...and each thread gets this much compressed input to decompress */
+#define GUNZIP_CHUNK_SIZE (256 * 1024)
+
 /* http://www.gzip.org/zlib/rfc-gzip.html */
 typedef union {
 	unsigned char buf[10];
@@ -107,6 +116,9 @@ typedef union {
 		guint8 got_fname:1;
 		guint8 got_fcomment:1;
 		guint8 got_crc16:1;
+		guint8 streaming:1;
+		guint8 done:1;
+		guint8 trailer;
 	} unzip;
 	struct {
 		guint32 wrote_hdr:1;
@@ -114,6 +126,31 @@ typedef union {
 	} zip;
 } gzip_state_t;
 
+typedef struct {
+	z_stream *stream;
+	const unsigned char *inbuf;
+	size_t inlen;
+	size_t dictlen;
+	gboolean finish;
+	unsigned char *outbuf;
+	size_t outsize;
+	size_t outlen;
+	guint32 crc32;
+} GZipBlock;
+
+typedef struct {
+	z_stream *stream;
+	const unsigned char *inbuf;
+	size_t inlen;
+	size_t hdrlen;
+	size_t nread;
+	unsigned char *outbuf;
+	size_t outsize;
+	size_t outlen;
+	gboolean ended;
+	gboolean error;
+} GUnzipMember;
+
 struct _GMimeFilterGZipPrivate {
 	z_stream *stream;
 	
@@ -125,6 +162,15 @@ struct _GMimeFilterGZipPrivate {
 	
 	guint32 crc32;
 	guint32 isize;
+	
+	/* block mode state (only used with more than 1 thread) */
+	guint threads;
+	unsigned char *buffer;
+	size_t bufsize;
+	size_t buflen;
+	size_t dictlen;
+	GZipBlock *blocks;
+	GArray *members;
 };
 
 static void g_mime_filter_gzip_class_init (GMimeFilterGZipClass *klass);
@@ -189,6 +235,25 @@ g_mime_filter_gzip_init (GMimeFilterGZip *filter, GMimeFilterGZipClass *klass)
 	filter->priv = g_new0 (struct _GMimeFilterGZipPrivate, 1);
 	filter->priv->stream = g_new0 (z_stream, 1);
 	filter->priv->crc32 = crc32 (0, Z_NULL, 0);
+	filter->priv->threads = 1;
+}
+
+static void
+gzip_blocks_free (struct _GMimeFilterGZipPrivate *priv)
+{
+	guint i;
+	
+	if (priv->blocks == NULL)
+		return;
+	
+	for (i = 0; i < priv->threads; i++) {
+		deflateEnd (priv->blocks[i].stream);
+		g_free (priv->blocks[i].stream);
+		g_free (priv->blocks[i].outbuf);
+	}
+	
+	g_free (priv->blocks);
+	priv->blocks = NULL;
 }
 
 static void
@@ -202,8 +267,13 @@ g_mime_filter_gzip_finalize (GObject *object)
 	else
 		inflateEnd (priv->stream);
 	
+	gzip_blocks_free (priv);
+	if (priv->members)
+		g_array_free (priv->members, TRUE);
+	
 	g_free (priv->filename);
 	g_free (priv->comment);
+	g_free (priv->buffer);
 	g_free (priv->stream);
 	g_free (priv);
 	
@@ -215,8 +285,12 @@ static GMimeFilter *
 filter_copy (GMimeFilter *filter)
 {
 	GMimeFilterGZip *gzip = (GMimeFilterGZip *) filter;
+	GMimeFilter *copy;
 	
-	return g_mime_filter_gzip_new (gzip->mode, gzip->level);
+	copy = g_mime_filter_gzip_new (gzip->mode, gzip->level);
+	g_mime_filter_gzip_set_threads ((GMimeFilterGZip *) copy, gzip->priv->threads);
+	
+	return copy;
 }
 
 static inline size_t
@@ -225,6 +299,57 @@ next_alloc_size (size_t n)
 	return (n + 1023) & ~1023;
 }
 
+static size_t
+gzip_header_length (GMimeFilterGZip *gzip)
+{
+	size_t filenamelen = gzip->priv->filename ? strlen (gzip->priv->filename) + 1 : 0;
+	size_t commentlen = gzip->priv->comment ? strlen (gzip->priv->comment) + 1 : 0;
+	
+	return 10 + filenamelen + commentlen;
+}
+
+static size_t
+gzip_header_encode (GMimeFilterGZip *gzip, char *outbuf)
+{
+	struct _GMimeFilterGZipPrivate *priv = gzip->priv;
+	char *outptr;
+	size_t n;
+	
+	priv->hdr.v.id1 = 31;
+	priv->hdr.v.id2 = 139;
+	priv->hdr.v.cm = Z_DEFLATED;
+	priv->hdr.v.mtime = 0;
+	priv->hdr.v.flg = 0;
+	if (gzip->priv->filename)
+		priv->hdr.v.flg |= GZIP_FLAG_FNAME;
+	if (gzip->priv->comment)
+		priv->hdr.v.flg |= GZIP_FLAG_FCOMMENT;
+	if (gzip->level == Z_BEST_COMPRESSION)
+		priv->hdr.v.xfl = 2;
+	else if (gzip->level == Z_BEST_SPEED)
+		priv->hdr.v.xfl = 4;
+	else
+		priv->hdr.v.xfl = 0;
+	priv->hdr.v.os = GZIP_OS_UNKNOWN;
+	
+	memcpy (outbuf, priv->hdr.buf, 10);
+	outptr = outbuf + 10;
+	
+	if (gzip->priv->filename) {
+		n = strlen (gzip->priv->filename) + 1;
+		memcpy (outptr, gzip->priv->filename, n);
+		outptr += n;
+	}
+	
+	if (gzip->priv->comment) {
+		n = strlen (gzip->priv->comment) + 1;
+		memcpy (outptr, gzip->priv->comment, n);
+		outptr += n;
+	}
+	
+	return outptr - outbuf;
+}
+
 static void
 gzip_filter (GMimeFilter *filter, char *in, size_t len, size_t prespace,
 	     char **out, size_t *outlen, size_t *outprespace, gboolean flush)
@@ -242,45 +367,14 @@ gzip_filter (GMimeFilter *filter, char *in, size_t len, size_t prespace,
 	}
 	
 	if (!priv->state.zip.wrote_hdr) {
-		size_t filenamelen = gzip->priv->filename ? strlen (gzip->priv->filename) + 1 : 0;
-		size_t commentlen = gzip->priv->comment ? strlen (gzip->priv->comment) + 1 : 0;
-		size_t hdrlen = 10 + filenamelen + commentlen;
-		char *outptr;
-		
-		priv->hdr.v.id1 = 31;
-		priv->hdr.v.id2 = 139;
-		priv->hdr.v.cm = Z_DEFLATED;
-		priv->hdr.v.mtime = 0;
-		priv->hdr.v.flg = 0;
-		if (gzip->priv->filename)
-			priv->hdr.v.flg |= GZIP_FLAG_FNAME;
-		if (gzip->priv->comment)
-			priv->hdr.v.flg |= GZIP_FLAG_FCOMMENT;
-		if (gzip->level == Z_BEST_COMPRESSION)
-			priv->hdr.v.xfl = 2;
-		else if (gzip->level == Z_BEST_SPEED)
-			priv->hdr.v.xfl = 4;
-		else
-			priv->hdr.v.xfl = 0;
-		priv->hdr.v.os = GZIP_OS_UNKNOWN;
+		size_t hdrlen = gzip_header_length (gzip);
 		
 		atleast = next_alloc_size ((len * 2) + hdrlen + 12);
 		g_mime_filter_set_size (filter, atleast, FALSE);
 		
-		memcpy (filter->outbuf, priv->hdr.buf, 10);
-		outptr = filter->outbuf + 10;
+		gzip_header_encode (gzip, filter->outbuf);
 		
-		if (gzip->priv->filename) {
-			memcpy (outptr, gzip->priv->filename, filenamelen);
-			outptr += filenamelen;
-		}
-		
-		if (gzip->priv->comment) {
-			memcpy (outptr, gzip->priv->comment, commentlen);
-			outptr += commentlen;
-		}
-		
-		priv->stream->next_out = (unsigned char *) outptr;
+		priv->stream->next_out = (unsigned char *) filter->outbuf + hdrlen;
 		priv->stream->avail_out = filter->outsize - hdrlen;
 		
 		priv->state.zip.wrote_hdr = TRUE;
@@ -533,16 +627,511 @@ gunzip_filter (GMimeFilter *filter, char *in, size_t len, size_t prespace,
 	*outprespace = filter->outpre;
 }
 
+static void
+gzip_block_run (gpointer data, gpointer user_data)
+{
+	GZipBlock *block = data;
+	z_stream *stream = block->stream;
+	size_t bound, olen;
+	int retval;
+	
+	block->crc32 = crc32 (crc32 (0, Z_NULL, 0), block->inbuf, block->inlen);
+	
+	/* leave room for the empty stored block emitted by Z_SYNC_FLUSH */
+	bound = deflateBound (stream, block->inlen) + 16;
+	if (block->outsize < bound) {
+		g_free (block->outbuf);
+		block->outbuf = g_malloc (bound);
+		block->outsize = bound;
+	}
+	
+	deflateReset (stream);
+	
+	if (block->dictlen > 0)
+		deflateSetDictionary (stream, block->inbuf - block->dictlen, block->dictlen);
+	
+	stream->next_in = (unsigned char *) block->inbuf;
+	stream->avail_in = block->inlen;
+	stream->next_out = block->outbuf;
+	stream->avail_out = block->outsize;
+	
+	/* all but the last block end with a sync flush so that the
+	 * blocks can simply be concatenated into a single stream */
+	do {
+		retval = deflate (stream, block->finish ? Z_FINISH : Z_SYNC_FLUSH);
+		
+		if (retval == Z_STREAM_END || retval == Z_STREAM_ERROR || stream->avail_out > 0)
+			break;
+		
+		olen = block->outsize;
+		block->outsize *= 2;
+		block->outbuf = g_realloc (block->outbuf, block->outsize);
+		stream->next_out = block->outbuf + olen;
+		stream->avail_out = block->outsize - olen;
+	} while (1);
+	
+	block->outlen = stream->next_out - block->outbuf;
+}
+
+static void
+gzip_blocks_compress (GMimeFilter *filter, size_t *outlen, gboolean flush)
+{
+	GMimeFilterGZip *gzip = (GMimeFilterGZip *) filter;
+	struct _GMimeFilterGZipPrivate *priv = gzip->priv;
+	const unsigned char *inbuf = priv->buffer + priv->dictlen;
+	size_t inlen = priv->buflen - priv->dictlen;
+	size_t offset, total = 0;
+	guint nblocks, i;
+	GThreadPool *pool;
+	GZipBlock *block;
+	size_t keep;
+	
+	nblocks = (guint) ((inlen + GZIP_BLOCK_SIZE - 1) / GZIP_BLOCK_SIZE);
+	
+	if (nblocks == 0) {
+		if (!flush)
+			return;
+		
+		/* we still need to terminate the deflate stream */
+		nblocks = 1;
+	}
+	
+	for (i = 0, offset = 0; i < nblocks; i++, offset += GZIP_BLOCK_SIZE) {
+		block = &priv->blocks[i];
+		block->inbuf = inbuf + offset;
+		block->inlen = MIN (GZIP_BLOCK_SIZE, inlen - offset);
+		block->dictlen = i > 0 ? GZIP_DICT_SIZE : priv->dictlen;
+		block->finish = flush && i + 1 == nblocks;
+	}
+	
+	if (nblocks > 1) {
+		pool = g_thread_pool_new (gzip_block_run, NULL, (int) nblocks, FALSE, NULL);
+		for (i = 0; i < nblocks; i++)
+			g_thread_pool_push (pool, &priv->blocks[i], NULL);
+		g_thread_pool_free (pool, FALSE, TRUE);
+	} else {
+		gzip_block_run (&priv->blocks[0], NULL);
+	}
+	
+	for (i = 0; i < nblocks; i++)
+		total += priv->blocks[i].outlen;
+	
+	/* reserve room for the trailer as well */
+	g_mime_filter_set_size (filter, *outlen + total + 8, TRUE);
+	
+	for (i = 0; i < nblocks; i++) {
+		block = &priv->blocks[i];
+		
+		memcpy (filter->outbuf + *outlen, block->outbuf, block->outlen);
+		*outlen += block->outlen;
+		
+		priv->crc32 = crc32_combine (priv->crc32, block->crc32, block->inlen);
+		priv->isize += block->inlen;
+	}
+	
+	/* keep the last 32 KB of input as the dictionary for the next batch */
+	keep = MIN (GZIP_DICT_SIZE, priv->buflen);
+	memmove (priv->buffer, priv->buffer + priv->buflen - keep, keep);
+	priv->buflen = priv->dictlen = keep;
+}
+
+static void
+gzip_filter_blocks (GMimeFilter *filter, char *in, size_t len, size_t prespace,
+		    char **out, size_t *outlen, size_t *outprespace, gboolean flush)
+{
+	GMimeFilterGZip *gzip = (GMimeFilterGZip *) filter;
+	struct _GMimeFilterGZipPrivate *priv = gzip->priv;
+	size_t olen = 0, n;
+	guint32 val;
+	guint i;
+	
+	if (priv->state.zip.flushed) {
+		*outprespace = prespace;
+		*outlen = 0;
+		*out = in;
+		return;
+	}
+	
+	if (priv->blocks == NULL) {
+		priv->blocks = g_new0 (GZipBlock, priv->threads);
+		
+		for (i = 0; i < priv->threads; i++) {
+			priv->blocks[i].stream = g_new0 (z_stream, 1);
+			deflateInit2 (priv->blocks[i].stream, gzip->level, Z_DEFLATED, -MAX_WBITS, MAX_MEM_LEVEL, Z_DEFAULT_STRATEGY);
+		}
+		
+		priv->bufsize = GZIP_DICT_SIZE + priv->threads * GZIP_BLOCK_SIZE;
+		priv->buffer = g_realloc (priv->buffer, priv->bufsize);
+	}
+	
+	if (!priv->state.zip.wrote_hdr) {
+		g_mime_filter_set_size (filter, gzip_header_length (gzip), FALSE);
+		olen = gzip_header_encode (gzip, filter->outbuf);
+		priv->state.zip.wrote_hdr = TRUE;
+	}
+	
+	while (len > 0) {
+		n = MIN (len, priv->dictlen + priv->threads * GZIP_BLOCK_SIZE - priv->buflen);
+		memcpy (priv->buffer + priv->buflen, in, n);
+		priv->buflen += n;
+		len -= n;
+		in += n;
+		
+		if (priv->buflen == priv->dictlen + priv->threads * GZIP_BLOCK_SIZE)
+			gzip_blocks_compress (filter, &olen, FALSE);
+	}
+	
+	if (flush) {
+		gzip_blocks_compress (filter, &olen, TRUE);
+		
+		val = GUINT32_TO_LE (priv->crc32);
+		memcpy (filter->outbuf + olen, &val, 4);
+		olen += 4;
+		
+		val = GUINT32_TO_LE (priv->isize);
+		memcpy (filter->outbuf + olen, &val, 4);
+		olen += 4;
+		
+		priv->state.zip.flushed = TRUE;
+	}
+	
+	*out = filter->outbuf;
+	*outlen = olen;
+	*outprespace = filter->outpre;
+}
+
+/* returns 1 if @inbuf begins with a complete gzip member header, 0 if
+ * more data is needed to tell or -1 if it is not a gzip header */
+static int
+gunzip_header_parse (const unsigned char *inbuf, size_t inlen, size_t *hdrlen, char **filename, char **comment)
+{
+	const unsigned char *fname = NULL, *fcomment = NULL;
+	const unsigned char *nul;
+	size_t n = 10;
+	guint8 flg;
+	
+	if ((inlen >= 1 && inbuf[0] != 31) || (inlen >= 2 && inbuf[1] != 139) ||
+	    (inlen >= 3 && inbuf[2] != Z_DEFLATED) || (inlen >= 4 && (inbuf[3] & GZIP_FLAG_RESERVED)))
+		return -1;
+	
+	if (inlen < 10)
+		return 0;
+	
+	flg = inbuf[3];
+	
+	if (flg & GZIP_FLAG_FEXTRA) {
+		if (inlen - n < 2)
+			return 0;
+		
+		n += 2 + (inbuf[n] | (inbuf[n + 1] << 8));
+		
+		if (n > inlen)
+			return 0;
+	}
+	
+	if (flg & GZIP_FLAG_FNAME) {
+		if (!(nul = memchr (inbuf + n, 0, inlen - n)))
+			return 0;
+		
+		fname = inbuf + n;
+		n = (nul - inbuf) + 1;
+	}
+	
+	if (flg & GZIP_FLAG_FCOMMENT) {
+		if (!(nul = memchr (inbuf + n, 0, inlen - n)))
+			return 0;
+		
+		fcomment = inbuf + n;
+		n = (nul - inbuf) + 1;
+	}
+	
+	if (flg & GZIP_FLAG_FHCRC)
+		n += 2;
+	
+	if (n > inlen)
+		return 0;
+	
+	if (filename)
+		*filename = fname ? g_strdup ((const char *) fname) : NULL;
+	
+	if (comment)
+		*comment = fcomment ? g_strdup ((const char *) fcomment) : NULL;
+	
+	*hdrlen = n;
+	
+	return 1;
+}
+
+static void
+gunzip_member_run (gpointer data, gpointer user_data)
+{
+	GUnzipMember *member = data;
+	z_stream *stream;
+	size_t olen;
+	int retval;
+	
+	member->stream = stream = g_new0 (z_stream, 1);
+	inflateInit2 (stream, -MAX_WBITS);
+	
+	member->outsize = next_alloc_size (MIN (member->inlen * 2, GUNZIP_CHUNK_SIZE));
+	member->outbuf = g_malloc (member->outsize);
+	
+	stream->next_in = (unsigned char *) member->inbuf + member->hdrlen;
+	stream->avail_in = member->inlen - member->hdrlen;
+	stream->next_out = member->outbuf;
+	stream->avail_out = member->outsize;
+	
+	do {
+		retval = inflate (stream, Z_NO_FLUSH);
+		
+		if (retval == Z_STREAM_END) {
+			member->ended = TRUE;
+			break;
+		}
+		
+		if (retval != Z_OK && retval != Z_BUF_ERROR) {
+			/* most likely a false match for a member header */
+			member->error = TRUE;
+			break;
+		}
+		
+		if (stream->avail_in == 0)
+			break;
+		
+		olen = member->outsize;
+		member->outsize *= 2;
+		member->outbuf = g_realloc (member->outbuf, member->outsize);
+		stream->next_out = member->outbuf + olen;
+		stream->avail_out = member->outsize - olen;
+	} while (1);
+	
+	member->nread = stream->next_in - member->inbuf;
+	member->outlen = stream->next_out - member->outbuf;
+}
+
+static void
+gunzip_output_append (GMimeFilter *filter, size_t *outlen, const unsigned char *data, size_t len)
+{
+	if (*outlen + len > filter->outsize)
+		g_mime_filter_set_size (filter, MAX (next_alloc_size (*outlen + len), filter->outsize * 2), TRUE);
+	
+	memcpy (filter->outbuf + *outlen, data, len);
+	*outlen += len;
+}
+
+/* decodes the complete members at the start of the buffer in parallel,
+ * returning the number of bytes consumed */
+static size_t
+gunzip_members_decode (GMimeFilter *filter, size_t *outlen, gboolean flush)
+{
+	GMimeFilterGZip *gzip = (GMimeFilterGZip *) filter;
+	struct _GMimeFilterGZipPrivate *priv = gzip->priv;
+	const unsigned char *inend = priv->buffer + priv->buflen;
+	const unsigned char *inptr = priv->buffer;
+	GUnzipMember *member, candidate;
+	size_t offset = 0, hdrlen, n;
+	char *filename, *comment;
+	GThreadPool *pool;
+	z_stream *stream;
+	guint i;
+	
+	/* a member can begin wherever there is something that looks like a
+	 * gzip header; false matches fail to inflate and are skipped since
+	 * only the members that follow on from the previous one are used */
+	memset (&candidate, 0, sizeof (candidate));
+	g_array_set_size (priv->members, 0);
+	
+	while (inptr < inend && (inptr = memchr (inptr, 31, inend - inptr))) {
+		if (gunzip_header_parse (inptr, inend - inptr, &hdrlen, NULL, NULL) == 1) {
+			candidate.inbuf = inptr;
+			candidate.inlen = inend - inptr;
+			candidate.hdrlen = hdrlen;
+			g_array_append_val (priv->members, candidate);
+		}
+		
+		inptr++;
+	}
+	
+	if (priv->members->len > 1) {
+		pool = g_thread_pool_new (gunzip_member_run, NULL, (int) MIN (priv->threads, priv->members->len), FALSE, NULL);
+		for (i = 0; i < priv->members->len; i++)
+			g_thread_pool_push (pool, &g_array_index (priv->members, GUnzipMember, i), NULL);
+		g_thread_pool_free (pool, FALSE, TRUE);
+	} else if (priv->members->len == 1) {
+		gunzip_member_run (&g_array_index (priv->members, GUnzipMember, 0), NULL);
+	}
+	
+	/* stitch the members together in order */
+	for (i = 0; offset < priv->buflen; i++) {
+		while (i < priv->members->len && g_array_index (priv->members, GUnzipMember, i).inbuf < priv->buffer + offset)
+			i++;
+		
+		if (i == priv->members->len || g_array_index (priv->members, GUnzipMember, i).inbuf != priv->buffer + offset) {
+			if (gunzip_header_parse (priv->buffer + offset, priv->buflen - offset, &hdrlen, NULL, NULL) == 0 && !flush)
+				break;
+			
+			/* trailing garbage */
+			priv->state.unzip.done = TRUE;
+			offset = priv->buflen;
+			break;
+		}
+		
+		member = &g_array_index (priv->members, GUnzipMember, i);
+		
+		if (!priv->state.unzip.got_hdr) {
+			gunzip_header_parse (member->inbuf, member->inlen, &hdrlen, &filename, &comment);
+			g_free (priv->filename);
+			g_free (priv->comment);
+			priv->filename = filename;
+			priv->comment = comment;
+			priv->state.unzip.got_hdr = TRUE;
+		}
+		
+		if (!member->ended && !member->error && offset > 0 && !flush) {
+			/* decode this member again once we have more of it */
+			break;
+		}
+		
+		gunzip_output_append (filter, outlen, member->outbuf, member->outlen);
+		
+		if (member->error) {
+			w(fprintf (stderr, "gunzip: %s\n", member->stream->msg));
+			priv->state.unzip.done = TRUE;
+			offset = priv->buflen;
+			break;
+		}
+		
+		if (!member->ended) {
+			/* the member is larger than what we can decode in
+			 * parallel; continue inflating it as it streams in */
+			stream = priv->stream;
+			priv->stream = member->stream;
+			member->stream = stream;
+			
+			priv->state.unzip.streaming = TRUE;
+			offset = priv->buflen;
+			break;
+		}
+		
+		/* skip over the crc32 and isize trailer */
+		offset += member->nread;
+		n = MIN (8, priv->buflen - offset);
+		priv->state.unzip.trailer = 8 - n;
+		offset += n;
+	}
+	
+	for (i = 0; i < priv->members->len; i++) {
+		member = &g_array_index (priv->members, GUnzipMember, i);
+		
+		if (member->stream) {
+			inflateEnd (member->stream);
+			g_free (member->stream);
+		}
+		
+		g_free (member->outbuf);
+	}
+	
+	g_array_set_size (priv->members, 0);
+	
+	return offset;
+}
+
+static size_t
+gunzip_member_stream (GMimeFilter *filter, size_t *outlen)
+{
+	GMimeFilterGZip *gzip = (GMimeFilterGZip *) filter;
+	struct _GMimeFilterGZipPrivate *priv = gzip->priv;
+	int retval;
+	
+	priv->stream->next_in = priv->buffer;
+	priv->stream->avail_in = priv->buflen;
+	
+	do {
+		g_mime_filter_set_size (filter, next_alloc_size (*outlen + (priv->stream->avail_in * 2) + 12), TRUE);
+		priv->stream->next_out = (unsigned char *) filter->outbuf + *outlen;
+		priv->stream->avail_out = filter->outsize - *outlen;
+		
+		retval = inflate (priv->stream, Z_NO_FLUSH);
+		*outlen = (char *) priv->stream->next_out - filter->outbuf;
+		
+		if (retval == Z_STREAM_END) {
+			priv->state.unzip.streaming = FALSE;
+			priv->state.unzip.trailer = 8;
+			inflateReset (priv->stream);
+			break;
+		}
+		
+		if (retval != Z_OK && retval != Z_BUF_ERROR) {
+			w(fprintf (stderr, "gunzip: %d: %s\n", retval, priv->stream->msg));
+			priv->state.unzip.done = TRUE;
+			break;
+		}
+	} while (priv->stream->avail_in > 0);
+	
+	return priv->buflen - priv->stream->avail_in;
+}
+
+static void
+gunzip_filter_blocks (GMimeFilter *filter, char *in, size_t len, size_t prespace,
+		      char **out, size_t *outlen, size_t *outprespace, gboolean flush)
+{
+	GMimeFilterGZip *gzip = (GMimeFilterGZip *) filter;
+	struct _GMimeFilterGZipPrivate *priv = gzip->priv;
+	size_t olen = 0, n;
+	
+	if (priv->members == NULL)
+		priv->members = g_array_new (FALSE, FALSE, sizeof (GUnzipMember));
+	
+	if (priv->buflen + len > priv->bufsize) {
+		priv->bufsize = next_alloc_size (MAX (priv->buflen + len, priv->threads * GUNZIP_CHUNK_SIZE));
+		priv->buffer = g_realloc (priv->buffer, priv->bufsize);
+	}
+	
+	memcpy (priv->buffer + priv->buflen, in, len);
+	priv->buflen += len;
+	
+	while (priv->buflen > 0 && !priv->state.unzip.done) {
+		if (priv->state.unzip.trailer > 0) {
+			n = MIN (priv->state.unzip.trailer, priv->buflen);
+			priv->state.unzip.trailer -= n;
+		} else if (priv->state.unzip.streaming) {
+			n = gunzip_member_stream (filter, &olen);
+		} else if (priv->buflen >= priv->threads * GUNZIP_CHUNK_SIZE || flush) {
+			if ((n = gunzip_members_decode (filter, &olen, flush)) == 0)
+				break;
+		} else {
+			/* wait until there is enough input to go around */
+			break;
+		}
+		
+		memmove (priv->buffer, priv->buffer + n, priv->buflen - n);
+		priv->buflen -= n;
+	}
+	
+	if (priv->state.unzip.done)
+		priv->buflen = 0;
+	
+	*out = filter->outbuf;
+	*outlen = olen;
+	*outprespace = filter->outpre;
+}
+
 static void
 filter_filter (GMimeFilter *filter, char *in, size_t len, size_t prespace,
 	       char **out, size_t *outlen, size_t *outprespace)
 {
 	GMimeFilterGZip *gzip = (GMimeFilterGZip *) filter;
 	
-	if (gzip->mode == GMIME_FILTER_GZIP_MODE_ZIP)
+	if (gzip->priv->threads > 1) {
+		if (gzip->mode == GMIME_FILTER_GZIP_MODE_ZIP)
+			gzip_filter_blocks (filter, in, len, prespace, out, outlen, outprespace, FALSE);
+		else
+			gunzip_filter_blocks (filter, in, len, prespace, out, outlen, outprespace, FALSE);
+	} else if (gzip->mode == GMIME_FILTER_GZIP_MODE_ZIP) {
 		gzip_filter (filter, in, len, prespace, out, outlen, outprespace, FALSE);
-	else
+	} else {
 		gunzip_filter (filter, in, len, prespace, out, outlen, outprespace, FALSE);
+	}
 }
 
 static void
@@ -551,10 +1140,16 @@ filter_complete (GMimeFilter *filter, char *in, size_t len, size_t prespace,
 {
 	GMimeFilterGZip *gzip = (GMimeFilterGZip *) filter;
 	
-	if (gzip->mode == GMIME_FILTER_GZIP_MODE_ZIP)
+	if (gzip->priv->threads > 1) {
+		if (gzip->mode == GMIME_FILTER_GZIP_MODE_ZIP)
+			gzip_filter_blocks (filter, in, len, prespace, out, outlen, outprespace, TRUE);
+		else
+			gunzip_filter_blocks (filter, in, len, prespace, out, outlen, outprespace, TRUE);
+	} else if (gzip->mode == GMIME_FILTER_GZIP_MODE_ZIP) {
 		gzip_filter (filter, in, len, prespace, out, outlen, outprespace, TRUE);
-	else
+	} else {
 		gunzip_filter (filter, in, len, prespace, out, outlen, outprespace, TRUE);
+	}
 }
 
 static void
@@ -564,6 +1159,8 @@ filter_reset (GMimeFilter *filter)
 	struct _GMimeFilterGZipPrivate *priv = gzip->priv;
 	
 	memset (&priv->state, 0, sizeof (priv->state));
+	priv->buflen = 0;
+	priv->dictlen = 0;
 	
 	if (gzip->mode == GMIME_FILTER_GZIP_MODE_ZIP) {
 		deflateReset (priv->stream);
@@ -693,3 +1290,53 @@ g_mime_filter_gzip_set_comment (GMimeFilterGZip *gzip, const char *comment)
 	g_free (gzip->priv->comment);
 	gzip->priv->comment = buf;
 }
+
+
+/**
+ * g_mime_filter_gzip_get_threads:
+ * @gzip: A #GMimeFilterGZip filter
+ *
+ * Gets the number of threads that the filter uses to compress or
+ * decompress.
+ *
+ * Returns: the number of threads.
+ **/
+guint
+g_mime_filter_gzip_get_threads (GMimeFilterGZip *gzip)
+{
+	g_return_val_if_fail (GMIME_IS_FILTER_GZIP (gzip), 1);
+	
+	return gzip->priv->threads;
+}
+
+
+/**
+ * g_mime_filter_gzip_set_threads:
+ * @gzip: A #GMimeFilterGZip filter
+ * @n_threads: the number of threads to use or %0 to use one per processor
+ *
+ * Sets the number of threads that the filter should use. This must be
+ * called before any data is passed through the filter.
+ *
+ * With more than 1 thread, the compressor splits its input into 128 KB
+ * blocks which are compressed in parallel, each primed with the 32 KB
+ * of input that precede it, and concatenated into a single gzip
+ * member, much like pigz does. The output is slightly larger than
+ * that of a single-threaded compressor.
+ *
+ * The decompressor, on the other hand, can only decode separate gzip
+ * members in parallel (a single member is decoded on the calling
+ * thread as usual). Unlike the single-threaded decompressor, it also
+ * decodes any members that follow the first one.
+ **/
+void
+g_mime_filter_gzip_set_threads (GMimeFilterGZip *gzip, guint n_threads)
+{
+	g_return_if_fail (GMIME_IS_FILTER_GZIP (gzip));
+	
+	if (n_threads == 0)
+		n_threads = g_get_num_processors ();
+	
+	gzip_blocks_free (gzip->priv);
+	gzip->priv->threads = n_threads;
+}
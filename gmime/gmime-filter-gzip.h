@@ -84,6 +84,9 @@ void g_mime_filter_gzip_set_filename (GMimeFilterGZip *gzip, const char *filenam
 const char *g_mime_filter_gzip_get_comment (GMimeFilterGZip *gzip);
 void g_mime_filter_gzip_set_comment (GMimeFilterGZip *gzip, const char *comment);
 
+guint g_mime_filter_gzip_get_threads (GMimeFilterGZip *gzip);
+void g_mime_filter_gzip_set_threads (GMimeFilterGZip *gzip, guint n_threads);
+
 G_END_DECLS
 
 #endif /* __GMIME_FILTER_GZIP_H__ */
@@ -579,5 +579,7 @@ g_mime_filter_html_new (guint32 flags, guint32 colour)
 			url_scanner_add (filter->scanner, &patterns[i].pattern);
 	}
 	
+	url_scanner_compile (filter->scanner);
+	
 	return (GMimeFilter *) filter;
 }
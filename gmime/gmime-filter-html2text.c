@@ -0,0 +1,695 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*- */
+/*  GMime
+ *  Copyright (C) 2000-2022 Jeffrey Stedfast
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public License
+ *  as published by the Free Software Foundation; either version 2.1
+ *  of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free
+ *  Software Foundation, 51 Franklin Street, Fifth Floor, Boston, MA
+ *  02110-1301, USA.
+ */
+
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "gmime-filter-html2text.h"
+#include "gmime-simd.h"
+
+
+/**
+ * SECTION: gmime-filter-html2text
+ * @title: GMimeFilterHTML2Text
+ * @short_description: Convert HTML into plain text
+ *
+ * A #GMimeFilter for converting HTML into plain text. Tags, comments
+ * and the content of &lt;script&gt; and &lt;style&gt; elements are
+ * removed, character references are decoded and runs of whitespace
+ * are collapsed into a single space. Block-level elements such as
+ * paragraphs, list items and table rows are separated by line breaks.
+ *
+ * Character references are decoded into UTF-8, so the filter is meant
+ * to be added after a #GMimeFilterCharset that converts to UTF-8. No
+ * more than a tag name or a character reference is buffered between
+ * calls, no matter how large or malformed the HTML.
+ **/
+
+
+enum {
+	HTML2TEXT_TEXT,
+	HTML2TEXT_TAG_OPEN,
+	HTML2TEXT_TAG_NAME,
+	HTML2TEXT_TAG,
+	HTML2TEXT_TAG_DQUOTE,
+	HTML2TEXT_TAG_SQUOTE,
+	HTML2TEXT_DECL,
+	HTML2TEXT_DECL_DASH,
+	HTML2TEXT_COMMENT,
+	HTML2TEXT_COMMENT_DASH,
+	HTML2TEXT_COMMENT_DASH_DASH,
+	HTML2TEXT_BOGUS,
+	HTML2TEXT_RAWTEXT,
+	HTML2TEXT_RAWTEXT_LT,
+	HTML2TEXT_RAWTEXT_END,
+	HTML2TEXT_ENTITY
+};
+
+enum {
+	IS_HTML_SPACE   = (1 << 0),  /* whitespace and control characters */
+	IS_HTML_ALPHA   = (1 << 1),
+	IS_HTML_ENTITY  = (1 << 2),  /* alphanumerics and '#' */
+	IS_HTML_SPECIAL = (1 << 3),  /* '<' and '&' */
+};
+
+static unsigned char html_table[256] = {
+	1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,
+	1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,
+	1,0,0,4,0,0,8,0,0,0,0,0,0,0,0,0,
+	4,4,4,4,4,4,4,4,4,4,0,0,8,0,0,0,
+	0,6,6,6,6,6,6,6,6,6,6,6,6,6,6,6,
+	6,6,6,6,6,6,6,6,6,6,6,0,0,0,0,0,
+	0,6,6,6,6,6,6,6,6,6,6,6,6,6,6,6,
+	6,6,6,6,6,6,6,6,6,6,6,0,0,0,0,0,
+	0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,
+	0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,
+	0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,
+	0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,
+	0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,
+	0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,
+	0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,
+	0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0
+};
+
+#define is_html_space(x) ((html_table[(unsigned char)(x)] & IS_HTML_SPACE) != 0)
+#define is_html_alpha(x) ((html_table[(unsigned char)(x)] & IS_HTML_ALPHA) != 0)
+#define is_html_entity(x) ((html_table[(unsigned char)(x)] & IS_HTML_ENTITY) != 0)
+#define is_html_text(x) ((html_table[(unsigned char)(x)] & (IS_HTML_SPACE | IS_HTML_SPECIAL)) == 0)
+
+typedef struct {
+	const char *name;
+	gunichar codepoint;
+} HtmlEntity;
+
+/* the HTML 4 Latin-1 and special character entities, sorted for bsearch() */
+static const HtmlEntity html_entities[] = {
+	{ "AElig", 0x00c6 },
+	{ "Aacute", 0x00c1 },
+	{ "Acirc", 0x00c2 },
+	{ "Agrave", 0x00c0 },
+	{ "Aring", 0x00c5 },
+	{ "Atilde", 0x00c3 },
+	{ "Auml", 0x00c4 },
+	{ "Ccedil", 0x00c7 },
+	{ "Dagger", 0x2021 },
+	{ "ETH", 0x00d0 },
+	{ "Eacute", 0x00c9 },
+	{ "Ecirc", 0x00ca },
+	{ "Egrave", 0x00c8 },
+	{ "Euml", 0x00cb },
+	{ "Iacute", 0x00cd },
+	{ "Icirc", 0x00ce },
+	{ "Igrave", 0x00cc },
+	{ "Iuml", 0x00cf },
+	{ "Ntilde", 0x00d1 },
+	{ "OElig", 0x0152 },
+	{ "Oacute", 0x00d3 },
+	{ "Ocirc", 0x00d4 },
+	{ "Ograve", 0x00d2 },
+	{ "Oslash", 0x00d8 },
+	{ "Otilde", 0x00d5 },
+	{ "Ouml", 0x00d6 },
+	{ "Prime", 0x2033 },
+	{ "Scaron", 0x0160 },
+	{ "THORN", 0x00de },
+	{ "Uacute", 0x00da },
+	{ "Ucirc", 0x00db },
+	{ "Ugrave", 0x00d9 },
+	{ "Uuml", 0x00dc },
+	{ "Yacute", 0x00dd },
+	{ "Yuml", 0x0178 },
+	{ "aacute", 0x00e1 },
+	{ "acirc", 0x00e2 },
+	{ "acute", 0x00b4 },
+	{ "aelig", 0x00e6 },
+	{ "agrave", 0x00e0 },
+	{ "amp", 0x0026 },
+	{ "apos", 0x0027 },
+	{ "aring", 0x00e5 },
+	{ "atilde", 0x00e3 },
+	{ "auml", 0x00e4 },
+	{ "bdquo", 0x201e },
+	{ "brvbar", 0x00a6 },
+	{ "bull", 0x2022 },
+	{ "ccedil", 0x00e7 },
+	{ "cedil", 0x00b8 },
+	{ "cent", 0x00a2 },
+	{ "circ", 0x02c6 },
+	{ "copy", 0x00a9 },
+	{ "curren", 0x00a4 },
+	{ "dagger", 0x2020 },
+	{ "darr", 0x2193 },
+	{ "deg", 0x00b0 },
+	{ "divide", 0x00f7 },
+	{ "eacute", 0x00e9 },
+	{ "ecirc", 0x00ea },
+	{ "egrave", 0x00e8 },
+	{ "emsp", 0x2003 },
+	{ "ensp", 0x2002 },
+	{ "eth", 0x00f0 },
+	{ "euml", 0x00eb },
+	{ "euro", 0x20ac },
+	{ "fnof", 0x0192 },
+	{ "frac12", 0x00bd },
+	{ "frac14", 0x00bc },
+	{ "frac34", 0x00be },
+	{ "frasl", 0x2044 },
+	{ "gt", 0x003e },
+	{ "harr", 0x2194 },
+	{ "hellip", 0x2026 },
+	{ "iacute", 0x00ed },
+	{ "icirc", 0x00ee },
+	{ "iexcl", 0x00a1 },
+	{ "igrave", 0x00ec },
+	{ "iquest", 0x00bf },
+	{ "iuml", 0x00ef },
+	{ "laquo", 0x00ab },
+	{ "larr", 0x2190 },
+	{ "ldquo", 0x201c },
+	{ "lrm", 0x200e },
+	{ "lsaquo", 0x2039 },
+	{ "lsquo", 0x2018 },
+	{ "lt", 0x003c },
+	{ "macr", 0x00af },
+	{ "mdash", 0x2014 },
+	{ "micro", 0x00b5 },
+	{ "middot", 0x00b7 },
+	{ "minus", 0x2212 },
+	{ "nbsp", 0x00a0 },
+	{ "ndash", 0x2013 },
+	{ "not", 0x00ac },
+	{ "ntilde", 0x00f1 },
+	{ "oacute", 0x00f3 },
+	{ "ocirc", 0x00f4 },
+	{ "oelig", 0x0153 },
+	{ "ograve", 0x00f2 },
+	{ "oline", 0x203e },
+	{ "ordf", 0x00aa },
+	{ "ordm", 0x00ba },
+	{ "oslash", 0x00f8 },
+	{ "otilde", 0x00f5 },
+	{ "ouml", 0x00f6 },
+	{ "para", 0x00b6 },
+	{ "permil", 0x2030 },
+	{ "plusmn", 0x00b1 },
+	{ "pound", 0x00a3 },
+	{ "prime", 0x2032 },
+	{ "quot", 0x0022 },
+	{ "raquo", 0x00bb },
+	{ "rarr", 0x2192 },
+	{ "rdquo", 0x201d },
+	{ "reg", 0x00ae },
+	{ "rlm", 0x200f },
+	{ "rsaquo", 0x203a },
+	{ "rsquo", 0x2019 },
+	{ "sbquo", 0x201a },
+	{ "scaron", 0x0161 },
+	{ "sect", 0x00a7 },
+	{ "shy", 0x00ad },
+	{ "sup1", 0x00b9 },
+	{ "sup2", 0x00b2 },
+	{ "sup3", 0x00b3 },
+	{ "szlig", 0x00df },
+	{ "thinsp", 0x2009 },
+	{ "thorn", 0x00fe },
+	{ "tilde", 0x02dc },
+	{ "times", 0x00d7 },
+	{ "trade", 0x2122 },
+	{ "uacute", 0x00fa },
+	{ "uarr", 0x2191 },
+	{ "ucirc", 0x00fb },
+	{ "ugrave", 0x00f9 },
+	{ "uml", 0x00a8 },
+	{ "uuml", 0x00fc },
+	{ "yacute", 0x00fd },
+	{ "yen", 0x00a5 },
+	{ "yuml", 0x00ff },
+	{ "zwj", 0x200d },
+	{ "zwnj", 0x200c },
+};
+
+/* elements that start a new line, sorted for bsearch() */
+static const char *html_block_elements[] = {
+	"address", "article", "aside", "blockquote", "br", "caption", "dd", "div",
+	"dl", "dt", "fieldset", "figcaption", "figure", "footer", "form", "h1",
+	"h2", "h3", "h4", "h5", "h6", "header", "hr", "li", "main", "nav", "ol",
+	"p", "pre", "section", "table", "title", "tr", "ul"
+};
+
+
+static void g_mime_filter_html2text_class_init (GMimeFilterHTML2TextClass *klass);
+static void g_mime_filter_html2text_init (GMimeFilterHTML2Text *filter, GMimeFilterHTML2TextClass *klass);
+
+static GMimeFilter *filter_copy (GMimeFilter *filter);
+static void filter_filter (GMimeFilter *filter, char *in, size_t len, size_t prespace,
+			   char **out, size_t *outlen, size_t *outprespace);
+static void filter_complete (GMimeFilter *filter, char *in, size_t len, size_t prespace,
+			     char **out, size_t *outlen, size_t *outprespace);
+static void filter_reset (GMimeFilter *filter);
+
+
+static GMimeFilterClass *parent_class = NULL;
+
+
+GType
+g_mime_filter_html2text_get_type (void)
+{
+	static GType type = 0;
+	
+	if (!type) {
+		static const GTypeInfo info = {
+			sizeof (GMimeFilterHTML2TextClass),
+			NULL, /* base_class_init */
+			NULL, /* base_class_finalize */
+			(GClassInitFunc) g_mime_filter_html2text_class_init,
+			NULL, /* class_finalize */
+			NULL, /* class_data */
+			sizeof (GMimeFilterHTML2Text),
+			0,    /* n_preallocs */
+			(GInstanceInitFunc) g_mime_filter_html2text_init,
+		};
+		
+		type = g_type_register_static (GMIME_TYPE_FILTER, "GMimeFilterHTML2Text", &info, 0);
+	}
+	
+	return type;
+}
+
+
+static void
+g_mime_filter_html2text_class_init (GMimeFilterHTML2TextClass *klass)
+{
+	GMimeFilterClass *filter_class = GMIME_FILTER_CLASS (klass);
+	
+	parent_class = g_type_class_ref (GMIME_TYPE_FILTER);
+	
+	filter_class->copy = filter_copy;
+	filter_class->filter = filter_filter;
+	filter_class->complete = filter_complete;
+	filter_class->reset = filter_reset;
+}
+
+static void
+g_mime_filter_html2text_init (GMimeFilterHTML2Text *filter, GMimeFilterHTML2TextClass *klass)
+{
+	filter_reset ((GMimeFilter *) filter);
+}
+
+
+static GMimeFilter *
+filter_copy (GMimeFilter *filter)
+{
+	return g_mime_filter_html2text_new ();
+}
+
+static int
+entity_cmp (const void *key, const void *entity)
+{
+	return strcmp ((const char *) key, ((const HtmlEntity *) entity)->name);
+}
+
+static int
+element_cmp (const void *key, const void *element)
+{
+	return strcmp ((const char *) key, *((const char **) element));
+}
+
+/* decodes a nul-terminated character reference (without the '&' and ';'), returning 0 if it isn't one */
+static gunichar
+entity_decode (const char *entity)
+{
+	const HtmlEntity *named;
+	unsigned long value;
+	const char *start;
+	char *end;
+	
+	if (entity[0] != '#') {
+		named = bsearch (entity, html_entities, G_N_ELEMENTS (html_entities), sizeof (HtmlEntity), entity_cmp);
+		
+		return named ? named->codepoint : 0;
+	}
+	
+	if (entity[1] == 'x' || entity[1] == 'X') {
+		start = entity + 2;
+		value = strtoul (start, &end, 16);
+	} else {
+		start = entity + 1;
+		value = strtoul (start, &end, 10);
+	}
+	
+	if (end == start || *end != '\0')
+		return 0;
+	
+	if (value == 0 || value > 0x10ffff || (value >= 0xd800 && value < 0xe000))
+		return 0xfffd;
+	
+	return (gunichar) value;
+}
+
+/* whitespace is held back until we know that more text follows it on the same line */
+static inline void
+write_space (GMimeFilterHTML2Text *html2text)
+{
+	if (html2text->last != '\n')
+		html2text->last = ' ';
+}
+
+static inline char *
+write_pending_space (GMimeFilterHTML2Text *html2text, char *outptr)
+{
+	if (html2text->last == ' ')
+		*outptr++ = ' ';
+	
+	return outptr;
+}
+
+static inline char *
+write_newline (GMimeFilterHTML2Text *html2text, char *outptr)
+{
+	if (html2text->last != '\n')
+		html2text->last = *outptr++ = '\n';
+	
+	return outptr;
+}
+
+/* writes an unterminated or unknown character reference as text */
+static char *
+write_entity (GMimeFilterHTML2Text *html2text, char *outptr)
+{
+	outptr = write_pending_space (html2text, outptr);
+	*outptr++ = '&';
+	memcpy (outptr, html2text->entity, html2text->entlen);
+	outptr += html2text->entlen;
+	html2text->last = outptr[-1];
+	
+	return outptr;
+}
+
+static char *
+tag_end (GMimeFilterHTML2Text *html2text, char *outptr)
+{
+	const char *name = html2text->name;
+	
+	html2text->name[html2text->namelen] = '\0';
+	html2text->state = HTML2TEXT_TEXT;
+	
+	if (bsearch (name, html_block_elements, G_N_ELEMENTS (html_block_elements), sizeof (char *), element_cmp))
+		return write_newline (html2text, outptr);
+	
+	if (!strcmp (name, "td") || !strcmp (name, "th"))
+		write_space (html2text);
+	
+	if (!html2text->endtag) {
+		if (!strcmp (name, "script"))
+			html2text->rawtext = "script";
+		else if (!strcmp (name, "style"))
+			html2text->rawtext = "style";
+		
+		if (html2text->rawtext != NULL)
+			html2text->state = HTML2TEXT_RAWTEXT;
+	}
+	
+	return outptr;
+}
+
+static void
+convert (GMimeFilter *filter, char *inbuf, size_t inlen, size_t prespace,
+	 char **outbuf, size_t *outlen, size_t *outprespace, gboolean flush)
+{
+	GMimeFilterHTML2Text *html2text = (GMimeFilterHTML2Text *) filter;
+	register const char *inptr = inbuf;
+	const char *inend = inbuf + inlen;
+	char *outptr, *outstart;
+	const char *p;
+	gunichar c;
+	size_t n;
+	
+	/* the output can only outgrow the input by the space, '<' or
+	 * character reference that was held back by the previous call */
+	g_mime_filter_set_size (filter, inlen + sizeof (html2text->entity) + 1, FALSE);
+	outptr = outstart = filter->outbuf;
+	
+	while (inptr < inend) {
+		switch (html2text->state) {
+		case HTML2TEXT_TEXT:
+			if (is_html_text (*inptr)) {
+				outptr = write_pending_space (html2text, outptr);
+				
+				/* copy everything up to the next tag, reference or run of whitespace */
+				n = g_mime_simd_html_text_span ((const unsigned char *) inptr, inend - inptr, (unsigned char *) outptr);
+				outptr += n;
+				inptr += n;
+				
+				while (inptr < inend && is_html_text (*inptr))
+					*outptr++ = *inptr++;
+				
+				if ((html2text->last = outptr[-1]) == ' ')
+					outptr--;
+			} else if (*inptr == '<') {
+				html2text->state = HTML2TEXT_TAG_OPEN;
+				inptr++;
+			} else if (*inptr == '&') {
+				html2text->state = HTML2TEXT_ENTITY;
+				html2text->entlen = 0;
+				inptr++;
+			} else {
+				write_space (html2text);
+				inptr++;
+			}
+			break;
+		case HTML2TEXT_TAG_OPEN:
+			html2text->endtag = FALSE;
+			html2text->namelen = 0;
+			
+			if (*inptr == '/') {
+				html2text->state = HTML2TEXT_TAG_NAME;
+				html2text->endtag = TRUE;
+				inptr++;
+			} else if (is_html_alpha (*inptr)) {
+				html2text->state = HTML2TEXT_TAG_NAME;
+			} else if (*inptr == '!') {
+				html2text->state = HTML2TEXT_DECL;
+				inptr++;
+			} else if (*inptr == '?') {
+				html2text->state = HTML2TEXT_BOGUS;
+				inptr++;
+			} else {
+				/* not a tag after all */
+				html2text->state = HTML2TEXT_TEXT;
+				outptr = write_pending_space (html2text, outptr);
+				html2text->last = *outptr++ = '<';
+			}
+			break;
+		case HTML2TEXT_TAG_NAME:
+			if (is_html_space (*inptr) || *inptr == '/' || *inptr == '>') {
+				html2text->state = html2text->namelen > 0 ? HTML2TEXT_TAG : HTML2TEXT_BOGUS;
+				html2text->equals = FALSE;
+			} else if (html2text->namelen == 0 && !is_html_alpha (*inptr)) {
+				html2text->state = HTML2TEXT_BOGUS;
+			} else {
+				/* names that are too long are truncated, they can't match anything we know anyway */
+				if (html2text->namelen < sizeof (html2text->name) - 1)
+					html2text->name[html2text->namelen++] = g_ascii_tolower (*inptr);
+				inptr++;
+			}
+			break;
+		case HTML2TEXT_TAG:
+			if (*inptr == '>') {
+				outptr = tag_end (html2text, outptr);
+			} else if ((*inptr == '"' || *inptr == '\'') && html2text->equals) {
+				html2text->state = *inptr == '"' ? HTML2TEXT_TAG_DQUOTE : HTML2TEXT_TAG_SQUOTE;
+				html2text->equals = FALSE;
+			} else if (*inptr == '=') {
+				html2text->equals = TRUE;
+			} else if (!is_html_space (*inptr)) {
+				html2text->equals = FALSE;
+			}
+			inptr++;
+			break;
+		case HTML2TEXT_TAG_DQUOTE:
+		case HTML2TEXT_TAG_SQUOTE:
+			if ((p = memchr (inptr, html2text->state == HTML2TEXT_TAG_DQUOTE ? '"' : '\'', inend - inptr))) {
+				html2text->state = HTML2TEXT_TAG;
+				inptr = p + 1;
+			} else {
+				inptr = inend;
+			}
+			break;
+		case HTML2TEXT_DECL:
+		case HTML2TEXT_DECL_DASH:
+			if (*inptr == '-') {
+				/* "<!--" starts a comment, anything else is a declaration */
+				html2text->state = html2text->state == HTML2TEXT_DECL ? HTML2TEXT_DECL_DASH : HTML2TEXT_COMMENT;
+				inptr++;
+			} else {
+				html2text->state = HTML2TEXT_BOGUS;
+			}
+			break;
+		case HTML2TEXT_COMMENT:
+			if ((p = memchr (inptr, '-', inend - inptr))) {
+				html2text->state = HTML2TEXT_COMMENT_DASH;
+				inptr = p + 1;
+			} else {
+				inptr = inend;
+			}
+			break;
+		case HTML2TEXT_COMMENT_DASH:
+			html2text->state = *inptr == '-' ? HTML2TEXT_COMMENT_DASH_DASH : HTML2TEXT_COMMENT;
+			inptr++;
+			break;
+		case HTML2TEXT_COMMENT_DASH_DASH:
+			if (*inptr == '>')
+				html2text->state = HTML2TEXT_TEXT;
+			else if (*inptr != '-')
+				html2text->state = HTML2TEXT_COMMENT;
+			inptr++;
+			break;
+		case HTML2TEXT_BOGUS:
+			if ((p = memchr (inptr, '>', inend - inptr))) {
+				html2text->state = HTML2TEXT_TEXT;
+				inptr = p + 1;
+			} else {
+				inptr = inend;
+			}
+			break;
+		case HTML2TEXT_RAWTEXT:
+			if ((p = memchr (inptr, '<', inend - inptr))) {
+				html2text->state = HTML2TEXT_RAWTEXT_LT;
+				inptr = p + 1;
+			} else {
+				inptr = inend;
+			}
+			break;
+		case HTML2TEXT_RAWTEXT_LT:
+			if (*inptr == '/') {
+				html2text->state = HTML2TEXT_RAWTEXT_END;
+				html2text->namelen = 0;
+				inptr++;
+			} else {
+				html2text->state = HTML2TEXT_RAWTEXT;
+			}
+			break;
+		case HTML2TEXT_RAWTEXT_END:
+			if (html2text->rawtext[html2text->namelen] != '\0') {
+				if (g_ascii_tolower (*inptr) == html2text->rawtext[html2text->namelen]) {
+					html2text->namelen++;
+					inptr++;
+				} else {
+					html2text->state = HTML2TEXT_RAWTEXT;
+				}
+			} else if (is_html_space (*inptr) || *inptr == '/' || *inptr == '>') {
+				/* the end tag of the element, parse it like any other */
+				strcpy (html2text->name, html2text->rawtext);
+				html2text->state = HTML2TEXT_TAG;
+				html2text->endtag = TRUE;
+				html2text->equals = FALSE;
+				html2text->rawtext = NULL;
+			} else {
+				html2text->state = HTML2TEXT_RAWTEXT;
+			}
+			break;
+		case HTML2TEXT_ENTITY:
+			if (is_html_entity (*inptr) && html2text->entlen < sizeof (html2text->entity) - 1) {
+				html2text->entity[html2text->entlen++] = *inptr++;
+				break;
+			}
+			
+			html2text->state = HTML2TEXT_TEXT;
+			html2text->entity[html2text->entlen] = '\0';
+			
+			if (*inptr != ';' || html2text->entlen == 0 || (c = entity_decode (html2text->entity)) == 0) {
+				outptr = write_entity (html2text, outptr);
+				break;
+			}
+			
+			if (c == 0xa0 || c <= 0x20) {
+				write_space (html2text);
+			} else {
+				outptr = write_pending_space (html2text, outptr);
+				outptr += g_unichar_to_utf8 (c, outptr);
+				html2text->last = outptr[-1];
+			}
+			inptr++;
+			break;
+		}
+	}
+	
+	if (flush) {
+		if (html2text->state == HTML2TEXT_TAG_OPEN) {
+			outptr = write_pending_space (html2text, outptr);
+			html2text->last = *outptr++ = '<';
+		} else if (html2text->state == HTML2TEXT_ENTITY) {
+			outptr = write_entity (html2text, outptr);
+		}
+		
+		html2text->state = HTML2TEXT_TEXT;
+	}
+	
+	*outlen = outptr - outstart;
+	*outprespace = filter->outpre;
+	*outbuf = outstart;
+}
+
+static void
+filter_filter (GMimeFilter *filter, char *inbuf, size_t inlen, size_t prespace,
+	       char **outbuf, size_t *outlen, size_t *outprespace)
+{
+	convert (filter, inbuf, inlen, prespace, outbuf, outlen, outprespace, FALSE);
+}
+
+static void 
+filter_complete (GMimeFilter *filter, char *inbuf, size_t inlen, size_t prespace,
+		 char **outbuf, size_t *outlen, size_t *outprespace)
+{
+	convert (filter, inbuf, inlen, prespace, outbuf, outlen, outprespace, TRUE);
+}
+
+static void
+filter_reset (GMimeFilter *filter)
+{
+	GMimeFilterHTML2Text *html2text = (GMimeFilterHTML2Text *) filter;
+	
+	html2text->state = HTML2TEXT_TEXT;
+	html2text->endtag = FALSE;
+	html2text->equals = FALSE;
+	html2text->rawtext = NULL;
+	html2text->namelen = 0;
+	html2text->entlen = 0;
+	html2text->last = '\n';
+}
+
+
+/**
+ * g_mime_filter_html2text_new:
+ *
+ * Creates a new #GMimeFilterHTML2Text filter.
+ *
+ * Returns: a new #GMimeFilterHTML2Text filter.
+ **/
+GMimeFilter *
+g_mime_filter_html2text_new (void)
+{
+	return g_object_new (GMIME_TYPE_FILTER_HTML2TEXT, NULL);
+}
@@ -0,0 +1,83 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*- */
+/*  GMime
+ *  Copyright (C) 2000-2022 Jeffrey Stedfast
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public License
+ *  as published by the Free Software Foundation; either version 2.1
+ *  of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free
+ *  Software Foundation, 51 Franklin Street, Fifth Floor, Boston, MA
+ *  02110-1301, USA.
+ */
+
+
+#ifndef __GMIME_FILTER_HTML2TEXT_H__
+#define __GMIME_FILTER_HTML2TEXT_H__
+
+#include <gmime/gmime-filter.h>
+
+G_BEGIN_DECLS
+
+#define GMIME_TYPE_FILTER_HTML2TEXT            (g_mime_filter_html2text_get_type ())
+#define GMIME_FILTER_HTML2TEXT(obj)            (G_TYPE_CHECK_INSTANCE_CAST ((obj), GMIME_TYPE_FILTER_HTML2TEXT, GMimeFilterHTML2Text))
+#define GMIME_FILTER_HTML2TEXT_CLASS(klass)    (G_TYPE_CHECK_CLASS_CAST ((klass), GMIME_TYPE_FILTER_HTML2TEXT, GMimeFilterHTML2TextClass))
+#define GMIME_IS_FILTER_HTML2TEXT(obj)         (G_TYPE_CHECK_INSTANCE_TYPE ((obj), GMIME_TYPE_FILTER_HTML2TEXT))
+#define GMIME_IS_FILTER_HTML2TEXT_CLASS(klass) (G_TYPE_CHECK_CLASS_TYPE ((klass), GMIME_TYPE_FILTER_HTML2TEXT))
+#define GMIME_FILTER_HTML2TEXT_GET_CLASS(obj)  (G_TYPE_INSTANCE_GET_CLASS ((obj), GMIME_TYPE_FILTER_HTML2TEXT, GMimeFilterHTML2TextClass))
+
+typedef struct _GMimeFilterHTML2Text GMimeFilterHTML2Text;
+typedef struct _GMimeFilterHTML2TextClass GMimeFilterHTML2TextClass;
+
+/**
+ * GMimeFilterHTML2Text:
+ * @parent_object: parent #GMimeFilter
+ * @state: the parser state
+ * @endtag: %TRUE if the current tag is an end tag
+ * @equals: %TRUE if the last non-whitespace character in the current tag was an '='
+ * @rawtext: the name of the element whose content is being skipped, if any
+ * @name: the (lowercase) name of the current tag
+ * @namelen: the length of @name
+ * @entity: the entity being parsed
+ * @entlen: the length of @entity
+ * @last: the last character written, or a space if one is being held back
+ *
+ * A filter for converting HTML into plain text.
+ **/
+struct _GMimeFilterHTML2Text {
+	GMimeFilter parent_object;
+	
+	int state;
+	gboolean endtag;
+	gboolean equals;
+	const char *rawtext;
+	
+	char name[16];
+	guint namelen;
+	
+	char entity[32];
+	guint entlen;
+	
+	char last;
+};
+
+struct _GMimeFilterHTML2TextClass {
+	GMimeFilterClass parent_class;
+	
+};
+
+
+GType g_mime_filter_html2text_get_type (void);
+
+GMimeFilter *g_mime_filter_html2text_new (void);
+
+G_END_DECLS
+
+#endif /* __GMIME_FILTER_HTML2TEXT_H__ */
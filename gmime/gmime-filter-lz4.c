@@ -0,0 +1,512 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*- */
+/*  GMime
+ *  Copyright (C) 2000-2022 Jeffrey Stedfast
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public License
+ *  as published by the Free Software Foundation; either version 2.1
+ *  of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free
+ *  Software Foundation, 51 Franklin Street, Fifth Floor, Boston, MA
+ *  02110-1301, USA.
+ */
+
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <string.h>
+
+#ifdef HAVE_LZ4
+#include <lz4frame.h>
+#endif
+
+#include "gmime-filter-lz4.h"
+
+#ifdef ENABLE_WARNINGS
+#define w(x) x
+#else
+#define w(x)
+#endif /* ENABLE_WARNINGS */
+
+
+/**
+ * SECTION: gmime-filter-lz4
+ * @title: GMimeFilterLz4
+ * @short_description: LZ4 compression/decompression
+ * @see_also: #GMimeFilter, #GMimeFilterZstd
+ *
+ * A #GMimeFilter used for compressing or decompressing a stream using
+ * the LZ4 frame format. LZ4 compresses less than gzip or Zstandard
+ * but decompresses considerably faster than either of them.
+ *
+ * When a frame size is set, the compressor starts a new, independent
+ * frame every time that much data has been compressed, so that a
+ * reader can begin decompressing at any frame boundary. Decompression
+ * handles any number of consecutive frames.
+ *
+ * Note: if GMime was built without liblz4, g_mime_filter_lz4_new()
+ * returns %NULL.
+ **/
+
+
+struct _GMimeFilterLz4Private {
+#ifdef HAVE_LZ4
+	LZ4F_cctx *cctx;
+	LZ4F_dctx *dctx;
+	LZ4F_preferences_t prefs;
+#endif
+	unsigned char *dict;
+	size_t dictlen;
+	
+	size_t frame_size;
+	size_t frame_in;
+	gboolean in_frame;
+	guint nframes;
+	
+	gboolean flushed;
+	gboolean error;
+};
+
+static void g_mime_filter_lz4_class_init (GMimeFilterLz4Class *klass);
+static void g_mime_filter_lz4_init (GMimeFilterLz4 *filter, GMimeFilterLz4Class *klass);
+static void g_mime_filter_lz4_finalize (GObject *object);
+
+#ifdef HAVE_LZ4
+static GMimeFilter *filter_copy (GMimeFilter *filter);
+static void filter_filter (GMimeFilter *filter, char *in, size_t len, size_t prespace,
+			   char **out, size_t *outlen, size_t *outprespace);
+static void filter_complete (GMimeFilter *filter, char *in, size_t len, size_t prespace,
+			     char **out, size_t *outlen, size_t *outprespace);
+static void filter_reset (GMimeFilter *filter);
+#endif
+
+
+static GMimeFilterClass *parent_class = NULL;
+
+
+GType
+g_mime_filter_lz4_get_type (void)
+{
+	static GType type = 0;
+	
+	if (!type) {
+		static const GTypeInfo info = {
+			sizeof (GMimeFilterLz4Class),
+			NULL, /* base_class_init */
+			NULL, /* base_class_finalize */
+			(GClassInitFunc) g_mime_filter_lz4_class_init,
+			NULL, /* class_finalize */
+			NULL, /* class_data */
+			sizeof (GMimeFilterLz4),
+			0,    /* n_preallocs */
+			(GInstanceInitFunc) g_mime_filter_lz4_init,
+		};
+		
+		type = g_type_register_static (GMIME_TYPE_FILTER, "GMimeFilterLz4", &info, 0);
+	}
+	
+	return type;
+}
+
+
+static void
+g_mime_filter_lz4_class_init (GMimeFilterLz4Class *klass)
+{
+	GObjectClass *object_class = G_OBJECT_CLASS (klass);
+#ifdef HAVE_LZ4
+	GMimeFilterClass *filter_class = GMIME_FILTER_CLASS (klass);
+#endif
+	
+	parent_class = g_type_class_ref (GMIME_TYPE_FILTER);
+	
+	object_class->finalize = g_mime_filter_lz4_finalize;
+	
+#ifdef HAVE_LZ4
+	filter_class->copy = filter_copy;
+	filter_class->filter = filter_filter;
+	filter_class->complete = filter_complete;
+	filter_class->reset = filter_reset;
+#endif
+}
+
+static void
+g_mime_filter_lz4_init (GMimeFilterLz4 *filter, GMimeFilterLz4Class *klass)
+{
+	filter->priv = g_new0 (struct _GMimeFilterLz4Private, 1);
+}
+
+static void
+g_mime_filter_lz4_finalize (GObject *object)
+{
+	GMimeFilterLz4 *lz4 = (GMimeFilterLz4 *) object;
+	struct _GMimeFilterLz4Private *priv = lz4->priv;
+	
+#ifdef HAVE_LZ4
+	if (priv->cctx)
+		LZ4F_freeCompressionContext (priv->cctx);
+	if (priv->dctx)
+		LZ4F_freeDecompressionContext (priv->dctx);
+#endif
+	g_free (priv->dict);
+	g_free (priv);
+	
+	G_OBJECT_CLASS (parent_class)->finalize (object);
+}
+
+
+#ifdef HAVE_LZ4
+static GMimeFilter *
+filter_copy (GMimeFilter *filter)
+{
+	GMimeFilterLz4 *lz4 = (GMimeFilterLz4 *) filter;
+	GMimeFilter *copy;
+	
+	copy = g_mime_filter_lz4_new (lz4->mode, lz4->level);
+	g_mime_filter_lz4_set_frame_size ((GMimeFilterLz4 *) copy, lz4->priv->frame_size);
+	
+	if (lz4->priv->dict)
+		g_mime_filter_lz4_set_dictionary ((GMimeFilterLz4 *) copy, lz4->priv->dict, lz4->priv->dictlen);
+	
+	return copy;
+}
+
+static void
+filter_reserve (GMimeFilter *filter, size_t outlen, size_t needed)
+{
+	if (outlen + needed > filter->outsize)
+		g_mime_filter_set_size (filter, MAX (outlen + needed, filter->outsize * 2), TRUE);
+}
+
+static gboolean
+lz4_frame_begin (GMimeFilter *filter, size_t *outlen)
+{
+	struct _GMimeFilterLz4Private *priv = ((GMimeFilterLz4 *) filter)->priv;
+	size_t ret;
+	
+	filter_reserve (filter, *outlen, LZ4F_HEADER_SIZE_MAX);
+	
+#ifdef HAVE_LZ4F_COMPRESSBEGIN_USINGDICT
+	if (priv->dict)
+		ret = LZ4F_compressBegin_usingDict (priv->cctx, filter->outbuf + *outlen, filter->outsize - *outlen,
+						    priv->dict, priv->dictlen, &priv->prefs);
+	else
+#endif
+		ret = LZ4F_compressBegin (priv->cctx, filter->outbuf + *outlen, filter->outsize - *outlen, &priv->prefs);
+	
+	if (LZ4F_isError (ret)) {
+		w(fprintf (stderr, "lz4: %s\n", LZ4F_getErrorName (ret)));
+		return FALSE;
+	}
+	
+	priv->in_frame = TRUE;
+	priv->frame_in = 0;
+	*outlen += ret;
+	
+	return TRUE;
+}
+
+static gboolean
+lz4_frame_end (GMimeFilter *filter, size_t *outlen)
+{
+	struct _GMimeFilterLz4Private *priv = ((GMimeFilterLz4 *) filter)->priv;
+	size_t ret;
+	
+	filter_reserve (filter, *outlen, LZ4F_compressBound (0, &priv->prefs));
+	
+	ret = LZ4F_compressEnd (priv->cctx, filter->outbuf + *outlen, filter->outsize - *outlen, NULL);
+	
+	if (LZ4F_isError (ret)) {
+		w(fprintf (stderr, "lz4: %s\n", LZ4F_getErrorName (ret)));
+		return FALSE;
+	}
+	
+	priv->in_frame = FALSE;
+	priv->nframes++;
+	*outlen += ret;
+	
+	return TRUE;
+}
+
+static void
+lz4_compress (GMimeFilter *filter, char *inbuf, size_t inlen, size_t prespace,
+	      char **out, size_t *outlen, size_t *outprespace, gboolean flush)
+{
+	GMimeFilterLz4 *lz4 = (GMimeFilterLz4 *) filter;
+	struct _GMimeFilterLz4Private *priv = lz4->priv;
+	size_t olen = 0, offset = 0, n, ret;
+	
+	if (priv->flushed || priv->error) {
+		*outprespace = prespace;
+		*outlen = 0;
+		*out = inbuf;
+		return;
+	}
+	
+	while (offset < inlen) {
+		if (!priv->in_frame && !lz4_frame_begin (filter, &olen))
+			goto error;
+		
+		n = inlen - offset;
+		if (priv->frame_size > 0)
+			n = MIN (n, priv->frame_size - priv->frame_in);
+		
+		filter_reserve (filter, olen, LZ4F_compressBound (n, &priv->prefs));
+		
+		ret = LZ4F_compressUpdate (priv->cctx, filter->outbuf + olen, filter->outsize - olen,
+					   inbuf + offset, n, NULL);
+		
+		if (LZ4F_isError (ret)) {
+			w(fprintf (stderr, "lz4: %s\n", LZ4F_getErrorName (ret)));
+			goto error;
+		}
+		
+		priv->frame_in += n;
+		offset += n;
+		olen += ret;
+		
+		if (priv->frame_size > 0 && priv->frame_in == priv->frame_size && !lz4_frame_end (filter, &olen))
+			goto error;
+	}
+	
+	if (flush) {
+		/* always end with a complete frame, even if it is an empty one */
+		if (!priv->in_frame && priv->nframes == 0 && !lz4_frame_begin (filter, &olen))
+			goto error;
+		
+		if (priv->in_frame && !lz4_frame_end (filter, &olen))
+			goto error;
+		
+		priv->flushed = TRUE;
+	}
+	
+	*out = filter->outbuf;
+	*outlen = olen;
+	*outprespace = filter->outpre;
+	
+	return;
+	
+ error:
+	priv->error = TRUE;
+	
+	*out = filter->outbuf;
+	*outlen = olen;
+	*outprespace = filter->outpre;
+}
+
+static void
+lz4_decompress (GMimeFilter *filter, char *inbuf, size_t inlen, size_t prespace,
+		char **out, size_t *outlen, size_t *outprespace)
+{
+	GMimeFilterLz4 *lz4 = (GMimeFilterLz4 *) filter;
+	struct _GMimeFilterLz4Private *priv = lz4->priv;
+	size_t olen = 0, offset = 0;
+	size_t nread, nwritten, ret;
+	
+	if (priv->error) {
+		*outprespace = prespace;
+		*outlen = 0;
+		*out = inbuf;
+		return;
+	}
+	
+	/* the decompression context starts on the next frame by itself
+	 * once the current one is complete and skips skippable frames */
+	do {
+		filter_reserve (filter, olen, 64 * 1024);
+		
+		nwritten = filter->outsize - olen;
+		nread = inlen - offset;
+		
+#ifdef HAVE_LZ4F_COMPRESSBEGIN_USINGDICT
+		if (priv->dict)
+			ret = LZ4F_decompress_usingDict (priv->dctx, filter->outbuf + olen, &nwritten,
+							 inbuf + offset, &nread, priv->dict, priv->dictlen, NULL);
+		else
+#endif
+			ret = LZ4F_decompress (priv->dctx, filter->outbuf + olen, &nwritten,
+					       inbuf + offset, &nread, NULL);
+		
+		olen += nwritten;
+		offset += nread;
+		
+		if (LZ4F_isError (ret)) {
+			w(fprintf (stderr, "unlz4: %s\n", LZ4F_getErrorName (ret)));
+			priv->error = TRUE;
+			break;
+		}
+	} while (offset < inlen || olen == filter->outsize);
+	
+	*out = filter->outbuf;
+	*outlen = olen;
+	*outprespace = filter->outpre;
+}
+
+static void
+filter_filter (GMimeFilter *filter, char *in, size_t len, size_t prespace,
+	       char **out, size_t *outlen, size_t *outprespace)
+{
+	GMimeFilterLz4 *lz4 = (GMimeFilterLz4 *) filter;
+	
+	if (lz4->mode == GMIME_FILTER_LZ4_MODE_COMPRESS)
+		lz4_compress (filter, in, len, prespace, out, outlen, outprespace, FALSE);
+	else
+		lz4_decompress (filter, in, len, prespace, out, outlen, outprespace);
+}
+
+static void
+filter_complete (GMimeFilter *filter, char *in, size_t len, size_t prespace,
+		 char **out, size_t *outlen, size_t *outprespace)
+{
+	GMimeFilterLz4 *lz4 = (GMimeFilterLz4 *) filter;
+	
+	if (lz4->mode == GMIME_FILTER_LZ4_MODE_COMPRESS)
+		lz4_compress (filter, in, len, prespace, out, outlen, outprespace, TRUE);
+	else
+		lz4_decompress (filter, in, len, prespace, out, outlen, outprespace);
+}
+
+static void
+filter_reset (GMimeFilter *filter)
+{
+	GMimeFilterLz4 *lz4 = (GMimeFilterLz4 *) filter;
+	struct _GMimeFilterLz4Private *priv = lz4->priv;
+	
+	/* a compression context is reset by the next LZ4F_compressBegin() */
+	if (lz4->mode == GMIME_FILTER_LZ4_MODE_DECOMPRESS)
+		LZ4F_resetDecompressionContext (priv->dctx);
+	
+	priv->in_frame = FALSE;
+	priv->frame_in = 0;
+	priv->nframes = 0;
+	priv->flushed = FALSE;
+	priv->error = FALSE;
+}
+#endif /* HAVE_LZ4 */
+
+
+/**
+ * g_mime_filter_lz4_new:
+ * @mode: compress or decompress
+ * @level: compression level (%0 for the default, %3 and above for LZ4HC)
+ *
+ * Creates a new LZ4 compression (or decompression) filter.
+ *
+ * Returns: a new lz4 filter or %NULL if GMime was built without LZ4
+ * support.
+ **/
+GMimeFilter *
+g_mime_filter_lz4_new (GMimeFilterLz4Mode mode, int level)
+{
+#ifdef HAVE_LZ4
+	GMimeFilterLz4 *lz4;
+	LZ4F_errorCode_t ret;
+	
+	lz4 = g_object_new (GMIME_TYPE_FILTER_LZ4, NULL);
+	lz4->mode = mode;
+	lz4->level = level;
+	
+	if (mode == GMIME_FILTER_LZ4_MODE_COMPRESS) {
+		lz4->priv->prefs.frameInfo.blockSizeID = LZ4F_max64KB;
+		lz4->priv->prefs.frameInfo.blockMode = LZ4F_blockLinked;
+		lz4->priv->prefs.frameInfo.contentChecksumFlag = LZ4F_contentChecksumEnabled;
+		lz4->priv->prefs.compressionLevel = level;
+		
+		ret = LZ4F_createCompressionContext (&lz4->priv->cctx, LZ4F_VERSION);
+	} else {
+		ret = LZ4F_createDecompressionContext (&lz4->priv->dctx, LZ4F_VERSION);
+	}
+	
+	if (LZ4F_isError (ret)) {
+		g_object_unref (lz4);
+		return NULL;
+	}
+	
+	return (GMimeFilter *) lz4;
+#else
+	return NULL;
+#endif /* HAVE_LZ4 */
+}
+
+
+/**
+ * g_mime_filter_lz4_set_dictionary:
+ * @lz4: A #GMimeFilterLz4 filter
+ * @dict: (array length=len): the dictionary
+ * @len: the length of the dictionary
+ *
+ * Sets the dictionary to compress or decompress with. This must be
+ * called before any data is passed through the filter and the same
+ * dictionary must be used to decompress the data as was used to
+ * compress it. Only the last 64 KB of the dictionary are used.
+ *
+ * Dictionary support requires liblz4 1.10 or later.
+ *
+ * Returns: %TRUE on success or %FALSE if dictionaries are not supported.
+ **/
+gboolean
+g_mime_filter_lz4_set_dictionary (GMimeFilterLz4 *lz4, const unsigned char *dict, size_t len)
+{
+#ifdef HAVE_LZ4F_COMPRESSBEGIN_USINGDICT
+	struct _GMimeFilterLz4Private *priv;
+	
+	g_return_val_if_fail (GMIME_IS_FILTER_LZ4 (lz4), FALSE);
+	g_return_val_if_fail (dict != NULL || len == 0, FALSE);
+	
+	priv = lz4->priv;
+	
+	g_free (priv->dict);
+	priv->dict = len > 0 ? g_memdup2 (dict, len) : NULL;
+	priv->dictlen = len;
+	
+	return TRUE;
+#else
+	return FALSE;
+#endif /* HAVE_LZ4F_COMPRESSBEGIN_USINGDICT */
+}
+
+
+/**
+ * g_mime_filter_lz4_get_frame_size:
+ * @lz4: A #GMimeFilterLz4 filter
+ *
+ * Gets the amount of uncompressed data that the compressor puts in
+ * each frame.
+ *
+ * Returns: the frame size or %0 if all of the data goes in a single frame.
+ **/
+size_t
+g_mime_filter_lz4_get_frame_size (GMimeFilterLz4 *lz4)
+{
+	g_return_val_if_fail (GMIME_IS_FILTER_LZ4 (lz4), 0);
+	
+	return lz4->priv->frame_size;
+}
+
+
+/**
+ * g_mime_filter_lz4_set_frame_size:
+ * @lz4: A #GMimeFilterLz4 filter
+ * @frame_size: the frame size or %0 for a single frame
+ *
+ * Sets the amount of uncompressed data that the compressor should put
+ * in each frame. Each frame can be decompressed independently of the
+ * others, so smaller frames allow for finer-grained random access at
+ * the cost of a slightly worse compression ratio.
+ **/
+void
+g_mime_filter_lz4_set_frame_size (GMimeFilterLz4 *lz4, size_t frame_size)
+{
+	g_return_if_fail (GMIME_IS_FILTER_LZ4 (lz4));
+	
+	lz4->priv->frame_size = frame_size;
+}
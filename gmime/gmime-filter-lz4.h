@@ -0,0 +1,87 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*- */
+/*  GMime
+ *  Copyright (C) 2000-2022 Jeffrey Stedfast
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public License
+ *  as published by the Free Software Foundation; either version 2.1
+ *  of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free
+ *  Software Foundation, 51 Franklin Street, Fifth Floor, Boston, MA
+ *  02110-1301, USA.
+ */
+
+#ifndef __GMIME_FILTER_LZ4_H__
+#define __GMIME_FILTER_LZ4_H__
+
+#include <gmime/gmime-filter.h>
+
+G_BEGIN_DECLS
+
+#define GMIME_TYPE_FILTER_LZ4            (g_mime_filter_lz4_get_type ())
+#define GMIME_FILTER_LZ4(obj)            (G_TYPE_CHECK_INSTANCE_CAST ((obj), GMIME_TYPE_FILTER_LZ4, GMimeFilterLz4))
+#define GMIME_FILTER_LZ4_CLASS(klass)    (G_TYPE_CHECK_CLASS_CAST ((klass), GMIME_TYPE_FILTER_LZ4, GMimeFilterLz4Class))
+#define GMIME_IS_FILTER_LZ4(obj)         (G_TYPE_CHECK_INSTANCE_TYPE ((obj), GMIME_TYPE_FILTER_LZ4))
+#define GMIME_IS_FILTER_LZ4_CLASS(klass) (G_TYPE_CHECK_CLASS_TYPE ((klass), GMIME_TYPE_FILTER_LZ4))
+#define GMIME_FILTER_LZ4_GET_CLASS(obj)  (G_TYPE_INSTANCE_GET_CLASS ((obj), GMIME_TYPE_FILTER_LZ4, GMimeFilterLz4Class))
+
+typedef struct _GMimeFilterLz4 GMimeFilterLz4;
+typedef struct _GMimeFilterLz4Class GMimeFilterLz4Class;
+
+
+/**
+ * GMimeFilterLz4Mode:
+ * @GMIME_FILTER_LZ4_MODE_COMPRESS: Compress mode.
+ * @GMIME_FILTER_LZ4_MODE_DECOMPRESS: Decompress mode.
+ *
+ * The mode for the #GMimeFilterLz4 filter.
+ **/
+typedef enum {
+	GMIME_FILTER_LZ4_MODE_COMPRESS,
+	GMIME_FILTER_LZ4_MODE_DECOMPRESS
+} GMimeFilterLz4Mode;
+
+
+/**
+ * GMimeFilterLz4:
+ * @parent_object: parent #GMimeFilter
+ * @priv: private state data
+ * @mode: #GMimeFilterLz4Mode
+ * @level: compression level
+ *
+ * A filter for compressing or decompressing an LZ4 frame stream.
+ **/
+struct _GMimeFilterLz4 {
+	GMimeFilter parent_object;
+	
+	struct _GMimeFilterLz4Private *priv;
+	
+	GMimeFilterLz4Mode mode;
+	int level;
+};
+
+struct _GMimeFilterLz4Class {
+	GMimeFilterClass parent_class;
+	
+};
+
+
+GType g_mime_filter_lz4_get_type (void);
+
+GMimeFilter *g_mime_filter_lz4_new (GMimeFilterLz4Mode mode, int level);
+
+gboolean g_mime_filter_lz4_set_dictionary (GMimeFilterLz4 *lz4, const unsigned char *dict, size_t len);
+
+size_t g_mime_filter_lz4_get_frame_size (GMimeFilterLz4 *lz4);
+void g_mime_filter_lz4_set_frame_size (GMimeFilterLz4 *lz4, size_t frame_size);
+
+G_END_DECLS
+
+#endif /* __GMIME_FILTER_LZ4_H__ */
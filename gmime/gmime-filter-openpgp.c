@@ -24,6 +24,7 @@
 #endif
 
 #include "gmime-filter-openpgp.h"
+#include "gmime-simd.h"
 
 
 /**
@@ -169,6 +170,21 @@ is_partial_match (const char *input, const char *inend, const GMimeOpenPGPMarker
 	return inptr == inend;
 }
 
+/* all of the armor markers start with "-----", so any line that
+ * does not start with "--" can be skipped without comparing it to
+ * each of the markers */
+static inline gboolean
+is_marker_candidate (const char *inptr, const char *inend)
+{
+	return inend - inptr < 2 || (inptr[0] == '-' && inptr[1] == '-');
+}
+
+static inline const char *
+next_marker_candidate (const char *inptr, const char *inend)
+{
+	return inptr + g_mime_simd_line_find ((const unsigned char *) inptr, inend - inptr, '-', '-');
+}
+
 static void
 set_position (GMimeFilterOpenPGP *openpgp, gint64 offset, guint marker, gboolean cr)
 {
@@ -223,6 +239,21 @@ scan (GMimeFilter *filter, char *inbuf, size_t inlen, size_t prespace,
 		do {
 			const char *lineptr = inptr;
 			
+			if (!is_marker_candidate (inptr, inend)) {
+				/* skip ahead to the next line that could be an armor marker */
+				inptr = next_marker_candidate (inptr, inend);
+				
+				if (inptr == inend) {
+					/* the last line is incomplete and is not a marker */
+					openpgp->position += inptr - inbuf;
+					openpgp->midline = TRUE;
+					return;
+				}
+				
+				inptr++;
+				continue;
+			}
+			
 			while (inptr < inend && *inptr != '\n')
 				inptr++;
 			
@@ -240,7 +271,7 @@ scan (GMimeFilter *filter, char *inbuf, size_t inlen, size_t prespace,
 					g_mime_filter_backup (filter, lineptr, inptr - lineptr);
 					openpgp->position += lineptr - inbuf;
 				} else {
-					openpgp->position += inptr - lineptr;
+					openpgp->position += inptr - inbuf;
 					openpgp->midline = TRUE;
 				}
 				
@@ -273,6 +304,23 @@ scan (GMimeFilter *filter, char *inbuf, size_t inlen, size_t prespace,
 	do {
 		const char *lineptr = inptr;
 		
+		if (!is_marker_candidate (inptr, inend)) {
+			inptr = next_marker_candidate (inptr, inend);
+			
+			if (inptr == inend) {
+				openpgp->position += inptr - inbuf;
+				*outlen = inptr - *outbuf;
+				
+				if (!flush)
+					openpgp->midline = TRUE;
+				
+				return;
+			}
+			
+			inptr++;
+			continue;
+		}
+		
 		while (inptr < inend && *inptr != '\n')
 			inptr++;
 		
@@ -23,29 +23,66 @@
 #include <config.h>
 #endif
 
+#include <string.h>
+
 #include "gmime-filter-smtp-data.h"
+#include "gmime-internal.h"
 
 
 /**
  * SECTION: gmime-filter-smtp-data
  * @title: GMimeFilterSmtpData
- * @short_description: Byte-stuffs outgoing SMTP DATA.
+ * @short_description: Byte-stuffs outgoing or unstuffs incoming SMTP DATA.
+ *
+ * A #GMimeFilter for byte-stuffing outgoing SMTP DATA or, in
+ * #GMIME_FILTER_SMTP_DATA_MODE_DECODE mode, for unstuffing the DATA
+ * received by an SMTP server.
  *
- * A #GMimeFilter for byte-stuffing outgoing SMTP DATA.
+ * The decoder removes the leading '.' from each line that starts with
+ * one and stops at the "\r\n.\r\n" end-of-data marker, dropping the
+ * marker and anything that follows it. g_mime_filter_smtp_data_get_eod()
+ * tells whether the marker has been seen yet, so a server writing the
+ * DATA into a #GMimeStreamFilter as it arrives knows when to stop and
+ * hand the resulting stream to a #GMimeParser. Alternatively, the
+ * parser can read directly from a #GMimeStreamFilter wrapping the DATA,
+ * in which case the decoder unstuffs the data in place. Once the marker
+ * has been seen, the #GMimeStreamFilter reports the end of the stream
+ * without reading any further from its source.
  **/
 
 
+enum {
+	SMTP_DATA_BOL_CRLF,	/* at the start of a line following a CRLF */
+	SMTP_DATA_BOL_LF,	/* at the start of a line following a bare LF */
+	SMTP_DATA_TEXT,		/* in the middle of a line */
+	SMTP_DATA_TEXT_CR,	/* in the middle of a line, after a '\r' */
+	SMTP_DATA_DOT,		/* after the '.' starting a line following a CRLF */
+	SMTP_DATA_DOT_CR	/* after ".\r" at the start of a line following a CRLF */
+};
+
+
 static void g_mime_filter_smtp_data_class_init (GMimeFilterSmtpDataClass *klass);
 static void g_mime_filter_smtp_data_init (GMimeFilterSmtpData *filter, GMimeFilterSmtpDataClass *klass);
 
 static GMimeFilter *filter_copy (GMimeFilter *filter);
 static void filter_filter (GMimeFilter *filter, char *in, size_t len, size_t prespace,
 			   char **out, size_t *outlen, size_t *outprespace);
+static void filter_complete (GMimeFilter *filter, char *in, size_t len, size_t prespace,
+			     char **out, size_t *outlen, size_t *outprespace);
 static void filter_reset (GMimeFilter *filter);
 
 
 static GMimeFilterClass *parent_class = NULL;
 
+struct _GMimeFilterSmtpDataPrivate {
+	GMimeFilterSmtpDataMode mode;
+	int state;        /* decoder state */
+};
+
+static int private_offset = 0;
+
+#define GMIME_FILTER_SMTP_DATA_GET_PRIVATE(smtp) ((struct _GMimeFilterSmtpDataPrivate *) G_STRUCT_MEMBER_P ((smtp), private_offset))
+
 
 GType
 g_mime_filter_smtp_data_get_type (void)
@@ -66,6 +103,7 @@ g_mime_filter_smtp_data_get_type (void)
 		};
 		
 		type = g_type_register_static (GMIME_TYPE_FILTER, "GMimeFilterSmtpData", &info, 0);
+		private_offset = g_type_add_instance_private (type, sizeof (struct _GMimeFilterSmtpDataPrivate));
 	}
 	
 	return type;
@@ -78,16 +116,21 @@ g_mime_filter_smtp_data_class_init (GMimeFilterSmtpDataClass *klass)
 	GMimeFilterClass *filter_class = GMIME_FILTER_CLASS (klass);
 	
 	parent_class = g_type_class_ref (GMIME_TYPE_FILTER);
+	g_type_class_adjust_private_offset (klass, &private_offset);
 	
 	filter_class->copy = filter_copy;
 	filter_class->filter = filter_filter;
-	filter_class->complete = filter_filter;
+	filter_class->complete = filter_complete;
 	filter_class->reset = filter_reset;
 }
 
 static void
 g_mime_filter_smtp_data_init (GMimeFilterSmtpData *filter, GMimeFilterSmtpDataClass *klass)
 {
+	struct _GMimeFilterSmtpDataPrivate *priv = GMIME_FILTER_SMTP_DATA_GET_PRIVATE (filter);
+	
+	priv->mode = GMIME_FILTER_SMTP_DATA_MODE_ENCODE;
+	priv->state = SMTP_DATA_BOL_CRLF;
 	filter->bol = TRUE;
 }
 
@@ -95,12 +138,12 @@ g_mime_filter_smtp_data_init (GMimeFilterSmtpData *filter, GMimeFilterSmtpDataCl
 static GMimeFilter *
 filter_copy (GMimeFilter *filter)
 {
-	return g_mime_filter_smtp_data_new ();
+	return g_mime_filter_smtp_data_new_with_mode (GMIME_FILTER_SMTP_DATA_GET_PRIVATE (filter)->mode);
 }
 
 static void
-filter_filter (GMimeFilter *filter, char *inbuf, size_t inlen, size_t prespace,
-	       char **outbuf, size_t *outlen, size_t *outprespace)
+encode (GMimeFilter *filter, char *inbuf, size_t inlen, size_t prespace,
+	char **outbuf, size_t *outlen, size_t *outprespace)
 {
 	GMimeFilterSmtpData *smtp = (GMimeFilterSmtpData *) filter;
 	register const char *inptr = inbuf;
@@ -141,11 +184,126 @@ filter_filter (GMimeFilter *filter, char *inbuf, size_t inlen, size_t prespace,
 	*outbuf = filter->outbuf;
 }
 
+static void
+decode (GMimeFilter *filter, char *inbuf, size_t inlen, size_t prespace,
+	char **outbuf, size_t *outlen, size_t *outprespace, gboolean flush)
+{
+	struct _GMimeFilterSmtpDataPrivate *priv = GMIME_FILTER_SMTP_DATA_GET_PRIVATE (filter);
+	register const char *inptr = inbuf;
+	const char *inend = inbuf + inlen;
+	char *outptr, *outstart;
+	const char *lf;
+	size_t n;
+	
+	if (_g_mime_filter_get_eod (filter)) {
+		/* everything following the end-of-data marker is dropped */
+		*outprespace = prespace;
+		*outbuf = inbuf;
+		*outlen = 0;
+		return;
+	}
+	
+	if (_g_mime_filter_can_filter_inplace (filter) && prespace > 0) {
+		/* the output is never longer than the input plus a held-back '\r',
+		 * so we can write it over the input starting 1 byte earlier */
+		outstart = inbuf - 1;
+		prespace--;
+	} else {
+		g_mime_filter_set_size (filter, inlen + 1, FALSE);
+		outstart = filter->outbuf;
+		prespace = filter->outpre;
+	}
+	
+	outptr = outstart;
+	while (inptr < inend) {
+		switch (priv->state) {
+		case SMTP_DATA_BOL_CRLF:
+		case SMTP_DATA_BOL_LF:
+			if (*inptr == '.') {
+				/* unstuff the dot, but only a CRLF-terminated line
+				 * can be followed by the end-of-data marker */
+				priv->state = priv->state == SMTP_DATA_BOL_CRLF ? SMTP_DATA_DOT : SMTP_DATA_TEXT;
+				inptr++;
+				continue;
+			}
+			break;
+		case SMTP_DATA_DOT:
+			if (*inptr == '\r') {
+				/* hold back the '\r' until we know what follows it */
+				priv->state = SMTP_DATA_DOT_CR;
+				inptr++;
+				continue;
+			}
+			break;
+		case SMTP_DATA_DOT_CR:
+			if (*inptr == '\n') {
+				_g_mime_filter_set_eod (filter);
+				goto done;
+			}
+			
+			*outptr++ = '\r';
+			break;
+		}
+		
+		/* copy the rest of the line in one go */
+		if (!(lf = memchr (inptr, '\n', inend - inptr))) {
+			n = inend - inptr;
+			priv->state = inend[-1] == '\r' ? SMTP_DATA_TEXT_CR : SMTP_DATA_TEXT;
+			memmove (outptr, inptr, n);
+			outptr += n;
+			break;
+		}
+		
+		n = (lf + 1) - inptr;
+		
+		if (lf > inptr)
+			priv->state = lf[-1] == '\r' ? SMTP_DATA_BOL_CRLF : SMTP_DATA_BOL_LF;
+		else
+			priv->state = priv->state == SMTP_DATA_TEXT_CR ? SMTP_DATA_BOL_CRLF : SMTP_DATA_BOL_LF;
+		
+		memmove (outptr, inptr, n);
+		outptr += n;
+		inptr += n;
+	}
+	
+	if (flush && priv->state == SMTP_DATA_DOT_CR) {
+		/* the DATA was cut short */
+		*outptr++ = '\r';
+	}
+	
+ done:
+	*outlen = outptr - outstart;
+	*outprespace = prespace;
+	*outbuf = outstart;
+}
+
+static void
+filter_filter (GMimeFilter *filter, char *inbuf, size_t inlen, size_t prespace,
+	       char **outbuf, size_t *outlen, size_t *outprespace)
+{
+	if (GMIME_FILTER_SMTP_DATA_GET_PRIVATE (filter)->mode == GMIME_FILTER_SMTP_DATA_MODE_DECODE)
+		decode (filter, inbuf, inlen, prespace, outbuf, outlen, outprespace, FALSE);
+	else
+		encode (filter, inbuf, inlen, prespace, outbuf, outlen, outprespace);
+}
+
+static void
+filter_complete (GMimeFilter *filter, char *inbuf, size_t inlen, size_t prespace,
+		 char **outbuf, size_t *outlen, size_t *outprespace)
+{
+	if (GMIME_FILTER_SMTP_DATA_GET_PRIVATE (filter)->mode == GMIME_FILTER_SMTP_DATA_MODE_DECODE)
+		decode (filter, inbuf, inlen, prespace, outbuf, outlen, outprespace, TRUE);
+	else
+		encode (filter, inbuf, inlen, prespace, outbuf, outlen, outprespace);
+}
+
 static void
 filter_reset (GMimeFilter *filter)
 {
+	struct _GMimeFilterSmtpDataPrivate *priv = GMIME_FILTER_SMTP_DATA_GET_PRIVATE (filter);
 	GMimeFilterSmtpData *smtp = (GMimeFilterSmtpData *) filter;
 	
+	priv->state = SMTP_DATA_BOL_CRLF;
 	smtp->bol = TRUE;
 }
 
@@ -162,3 +320,47 @@ g_mime_filter_smtp_data_new (void)
 {
 	return g_object_new (GMIME_TYPE_FILTER_SMTP_DATA, NULL);
 }
+
+
+/**
+ * g_mime_filter_smtp_data_new_with_mode:
+ * @mode: #GMimeFilterSmtpDataMode
+ *
+ * Creates a new #GMimeFilterSmtpData filter that either byte-stuffs
+ * outgoing SMTP DATA or unstuffs incoming SMTP DATA.
+ *
+ * Returns: a new #GMimeFilterSmtpData filter.
+ **/
+GMimeFilter *
+g_mime_filter_smtp_data_new_with_mode (GMimeFilterSmtpDataMode mode)
+{
+	GMimeFilterSmtpData *smtp;
+	
+	smtp = g_object_new (GMIME_TYPE_FILTER_SMTP_DATA, NULL);
+	GMIME_FILTER_SMTP_DATA_GET_PRIVATE (smtp)->mode = mode;
+	
+	if (mode == GMIME_FILTER_SMTP_DATA_MODE_DECODE)
+		_g_mime_filter_set_inplace ((GMimeFilter *) smtp, TRUE);
+	
+	return (GMimeFilter *) smtp;
+}
+
+
+/**
+ * g_mime_filter_smtp_data_get_eod:
+ * @filter: a #GMimeFilterSmtpData filter
+ *
+ * Gets whether a #GMimeFilterSmtpData decoder has seen the
+ * "\r\n.\r\n" end-of-data marker. Once it has, any further input
+ * is discarded.
+ *
+ * Returns: %TRUE if the end of the SMTP DATA has been reached or
+ * %FALSE otherwise.
+ **/
+gboolean
+g_mime_filter_smtp_data_get_eod (GMimeFilterSmtpData *filter)
+{
+	g_return_val_if_fail (GMIME_IS_FILTER_SMTP_DATA (filter), FALSE);
+	
+	return _g_mime_filter_get_eod ((GMimeFilter *) filter);
+}
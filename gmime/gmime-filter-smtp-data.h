@@ -36,12 +36,25 @@ G_BEGIN_DECLS
 typedef struct _GMimeFilterSmtpData GMimeFilterSmtpData;
 typedef struct _GMimeFilterSmtpDataClass GMimeFilterSmtpDataClass;
 
+/**
+ * GMimeFilterSmtpDataMode:
+ * @GMIME_FILTER_SMTP_DATA_MODE_ENCODE: Byte-stuff outgoing SMTP DATA.
+ * @GMIME_FILTER_SMTP_DATA_MODE_DECODE: Unstuff incoming SMTP DATA, stopping at the end-of-data marker.
+ *
+ * The mode for the #GMimeFilterSmtpData filter.
+ **/
+typedef enum {
+	GMIME_FILTER_SMTP_DATA_MODE_ENCODE,
+	GMIME_FILTER_SMTP_DATA_MODE_DECODE
+} GMimeFilterSmtpDataMode;
+
+
 /**
  * GMimeFilterSmtpData:
  * @parent_object: parent #GMimeFilter
  * @bol: beginning-of-line state.
  *
- * A filter to byte-stuff SMTP DATA.
+ * A filter to byte-stuff or unstuff SMTP DATA.
  **/
 struct _GMimeFilterSmtpData {
 	GMimeFilter parent_object;
@@ -58,6 +71,9 @@ struct _GMimeFilterSmtpDataClass {
 GType g_mime_filter_smtp_data_get_type (void);
 
 GMimeFilter *g_mime_filter_smtp_data_new (void);
+GMimeFilter *g_mime_filter_smtp_data_new_with_mode (GMimeFilterSmtpDataMode mode);
+
+gboolean g_mime_filter_smtp_data_get_eod (GMimeFilterSmtpData *filter);
 
 G_END_DECLS
 
@@ -27,6 +27,8 @@
 #include <string.h>
 
 #include "gmime-filter-strip.h"
+#include "gmime-internal.h"
+#include "gmime-simd.h"
 #include "gmime-table-private.h"
 #include "packed.h"
 
@@ -102,6 +104,8 @@ static void
 g_mime_filter_strip_init (GMimeFilterStrip *filter, GMimeFilterStripClass *klass)
 {
 	filter->lwsp = packed_byte_array_new ();
+	
+	_g_mime_filter_set_inplace ((GMimeFilter *) filter, TRUE);
 }
 
 static void
@@ -129,6 +133,7 @@ convert (GMimeFilter *filter, char *in, size_t len, size_t prespace,
 	PackedByteArray *lwsp = (PackedByteArray *) strip->lwsp;
 	register char *inptr, *outptr;
 	char *inend, *outbuf;
+	char *eol, *end;
 	
 	if (len == 0) {
 		if (flush)
@@ -141,8 +146,17 @@ convert (GMimeFilter *filter, char *in, size_t len, size_t prespace,
 		return;
 	}
 	
-	g_mime_filter_set_size (filter, len + lwsp->len, FALSE);
-	outptr = outbuf = filter->outbuf;
+	if (_g_mime_filter_can_filter_inplace (filter) && prespace >= lwsp->len) {
+		/* the output is never longer than the input plus the whitespace
+		 * held back from last time, so we can write it over the input */
+		outptr = outbuf = in - lwsp->len;
+		prespace -= lwsp->len;
+	} else {
+		g_mime_filter_set_size (filter, len + lwsp->len, FALSE);
+		outptr = outbuf = filter->outbuf;
+		prespace = filter->outpre;
+	}
+	
 	inend = in + len;
 	inptr = in;
 	
@@ -150,33 +164,43 @@ convert (GMimeFilter *filter, char *in, size_t len, size_t prespace,
 		packed_byte_array_clear (strip->lwsp);
 	
 	while (inptr < inend) {
-		if (is_blank (*inptr)) {
-			packed_byte_array_add (lwsp, *inptr);
-		} else if (*inptr == '\r') {
-			packed_byte_array_clear (lwsp);
-			*outptr++ = *inptr;
-		} else if (*inptr == '\n') {
-			packed_byte_array_clear (lwsp);
-			*outptr++ = *inptr;
-		} else {
+		/* find the end of the line (or of the input) in bulk and
+		 * then the whitespace trailing the text before it */
+		eol = inptr + g_mime_simd_eol_span ((const unsigned char *) inptr, inend - inptr);
+		end = eol;
+		
+		while (end > inptr && is_blank (end[-1]))
+			end--;
+		
+		if (end > inptr) {
+			/* the whitespace held back wasn't trailing after all */
 			if (lwsp->len > 0) {
 				packed_byte_array_copy_to (lwsp, outptr);
 				outptr += lwsp->len;
 				packed_byte_array_clear (lwsp);
 			}
 			
-			*outptr++ = *inptr;
+			memmove (outptr, inptr, end - inptr);
+			outptr += end - inptr;
+			inptr = end;
 		}
 		
-		inptr++;
+		/* hold back the whitespace until we know whether it is trailing */
+		while (inptr < eol)
+			packed_byte_array_add (lwsp, *inptr++);
+		
+		if (inptr < inend) {
+			packed_byte_array_clear (lwsp);
+			*outptr++ = *inptr++;
+		}
 	}
 	
 	if (flush)
 		packed_byte_array_clear (lwsp);
 	
-	*outprespace = filter->outpre;
-	*outlen = (outptr - filter->outbuf);
-	*out = filter->outbuf;
+	*outprespace = prespace;
+	*outlen = (outptr - outbuf);
+	*out = outbuf;
 }
 
 static void
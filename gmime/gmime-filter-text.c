@@ -0,0 +1,403 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*- */
+/*  GMime
+ *  Copyright (C) 2000-2022 Jeffrey Stedfast
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public License
+ *  as published by the Free Software Foundation; either version 2.1
+ *  of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free
+ *  Software Foundation, 51 Franklin Street, Fifth Floor, Boston, MA
+ *  02110-1301, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <string.h>
+#include <errno.h>
+
+#include "gmime-filter-text.h"
+#include "gmime-charset.h"
+#include "gmime-iconv.h"
+#include "gmime-internal.h"
+
+
+/**
+ * SECTION: gmime-filter-text
+ * @title: GMimeFilterText
+ * @short_description: Text extraction filter
+ * @see_also: #GMimeFilterBasic, #GMimeFilterCharset, #GMimeFilterDos2Unix
+ *
+ * A #GMimeFilter which does the work of a #GMimeFilterBasic decoder,
+ * a #GMimeFilterCharset converting to UTF-8 and a #GMimeFilterDos2Unix
+ * filter in a single pass over the data, without the intermediate
+ * copies that stacking those filters would make.
+ *
+ * A #GMimeStreamFilter automatically uses this filter in place of
+ * such a chain of filters.
+ **/
+
+
+static void g_mime_filter_text_class_init (GMimeFilterTextClass *klass);
+static void g_mime_filter_text_init (GMimeFilterText *filter, GMimeFilterTextClass *klass);
+static void g_mime_filter_text_finalize (GObject *object);
+
+static GMimeFilter *filter_copy (GMimeFilter *filter);
+static void filter_filter (GMimeFilter *filter, char *in, size_t len, size_t prespace,
+			   char **out, size_t *outlen, size_t *outprespace);
+static void filter_complete (GMimeFilter *filter, char *in, size_t len, size_t prespace,
+			     char **out, size_t *outlen, size_t *outprespace);
+static void filter_reset (GMimeFilter *filter);
+
+
+static GMimeFilterClass *parent_class = NULL;
+
+
+GType
+g_mime_filter_text_get_type (void)
+{
+	static GType type = 0;
+	
+	if (!type) {
+		static const GTypeInfo info = {
+			sizeof (GMimeFilterTextClass),
+			NULL, /* base_class_init */
+			NULL, /* base_class_finalize */
+			(GClassInitFunc) g_mime_filter_text_class_init,
+			NULL, /* class_finalize */
+			NULL, /* class_data */
+			sizeof (GMimeFilterText),
+			0,    /* n_preallocs */
+			(GInstanceInitFunc) g_mime_filter_text_init,
+		};
+		
+		type = g_type_register_static (GMIME_TYPE_FILTER, "GMimeFilterText", &info, 0);
+	}
+	
+	return type;
+}
+
+
+static void
+g_mime_filter_text_class_init (GMimeFilterTextClass *klass)
+{
+	GObjectClass *object_class = G_OBJECT_CLASS (klass);
+	GMimeFilterClass *filter_class = GMIME_FILTER_CLASS (klass);
+	
+	parent_class = g_type_class_ref (GMIME_TYPE_FILTER);
+	
+	object_class->finalize = g_mime_filter_text_finalize;
+	
+	filter_class->copy = filter_copy;
+	filter_class->filter = filter_filter;
+	filter_class->complete = filter_complete;
+	filter_class->reset = filter_reset;
+}
+
+static void
+g_mime_filter_text_init (GMimeFilterText *filter, GMimeFilterTextClass *klass)
+{
+	g_mime_encoding_init_decode (&filter->decoder, GMIME_CONTENT_ENCODING_DEFAULT);
+	filter->charset = NULL;
+	filter->cd = (iconv_t) -1;
+	filter->ensure_newline = FALSE;
+	filter->pc = '\0';
+	filter->pending = NULL;
+	filter->npending = 0;
+	filter->pendingsize = 0;
+}
+
+static void
+g_mime_filter_text_finalize (GObject *object)
+{
+	GMimeFilterText *filter = (GMimeFilterText *) object;
+	
+	if (filter->cd != (iconv_t) -1)
+		g_mime_iconv_close (filter->cd);
+	
+	g_free (filter->pending);
+	g_free (filter->charset);
+	
+	G_OBJECT_CLASS (parent_class)->finalize (object);
+}
+
+
+static GMimeFilter *
+filter_copy (GMimeFilter *filter)
+{
+	GMimeFilterText *text = (GMimeFilterText *) filter;
+	
+	return g_mime_filter_text_new (text->decoder.encoding, text->charset, text->ensure_newline);
+}
+
+static void
+pending_set_size (GMimeFilterText *text, size_t size)
+{
+	if (size > text->pendingsize) {
+		text->pendingsize = MAX (size, 256);
+		text->pending = g_realloc (text->pending, text->pendingsize);
+	}
+}
+
+static gboolean
+is_identity (GMimeContentEncoding encoding)
+{
+	switch (encoding) {
+	case GMIME_CONTENT_ENCODING_BASE64:
+	case GMIME_CONTENT_ENCODING_QUOTEDPRINTABLE:
+		return FALSE;
+	default:
+		return TRUE;
+	}
+}
+
+/* converts @inlen bytes of text at @inptr to Unix line endings,
+ * writing the result to @outptr which may be at most one byte
+ * before @inptr in the same buffer */
+static char *
+dos2unix (GMimeFilterText *text, const char *inptr, size_t inlen, char *outptr)
+{
+	const char *inend = inptr + inlen;
+	const char *cr;
+	size_t n;
+	char c;
+	
+	while (inptr < inend) {
+		if (text->pc != '\r') {
+			/* copy everything up to the next '\r' in one go */
+			if (!(cr = memchr (inptr, '\r', inend - inptr)))
+				cr = inend;
+			
+			if ((n = cr - inptr) > 0) {
+				memmove (outptr, inptr, n);
+				text->pc = cr[-1];
+				outptr += n;
+				inptr = cr;
+			}
+			
+			if (inptr == inend)
+				break;
+			
+			/* hold back the '\r' until we know what follows it */
+			text->pc = *inptr++;
+			continue;
+		}
+		
+		c = *inptr++;
+		if (c != '\n')
+			*outptr++ = '\r';
+		if (c != '\r')
+			*outptr++ = c;
+		text->pc = c;
+	}
+	
+	return outptr;
+}
+
+/* converts @inlen bytes at @inbuf to UTF-8, writing the result to
+ * @outptr and saving an incomplete trailing multibyte sequence for
+ * the next call; one byte is always left free at the end of the
+ * output buffer for the newline that @ensure_newline may append */
+static char *
+convert_charset (GMimeFilter *filter, char *inbuf, size_t inlen, char *outptr, gboolean flush)
+{
+	GMimeFilterText *text = (GMimeFilterText *) filter;
+	size_t inleft = inlen, outleft, converted;
+	char *outbuf = outptr;
+	const GMimeIconvPath *path;
+	
+	outleft = (filter->outbuf + filter->outsize) - outptr - 1;
+	path = _g_mime_iconv_get_path ("UTF-8", text->charset);
+	
+	while (inleft > 0) {
+		if (_g_mime_iconv_convert (text->cd, path, &inbuf, &inleft, &outbuf, &outleft) != (size_t) -1)
+			continue;
+		
+		if (errno == E2BIG) {
+			/* grow our output buffer and try again */
+			converted = outbuf - filter->outbuf;
+			g_mime_filter_set_size (filter, inleft * 5 + filter->outsize + 16, TRUE);
+			outbuf = filter->outbuf + converted;
+			outleft = filter->outsize - converted - 1;
+		} else if (errno == EILSEQ || errno == ERANGE) {
+			/* eat the invalid bytes in the sequence and continue */
+			inbuf++;
+			inleft--;
+		} else if (errno == EINVAL) {
+			/* incomplete multibyte sequence, we'll process it next time through */
+			break;
+		} else {
+			/* unknown error condition, pass the rest through unconverted */
+			converted = outbuf - filter->outbuf;
+			g_mime_filter_set_size (filter, converted + inleft + 1, TRUE);
+			outbuf = filter->outbuf + converted;
+			memcpy (outbuf, inbuf, inleft);
+			outbuf += inleft;
+			inbuf += inleft;
+			inleft = 0;
+		}
+	}
+	
+	if (inleft > 0 && !flush) {
+		pending_set_size (text, inleft);
+		memmove (text->pending, inbuf, inleft);
+		text->npending = inleft;
+	} else {
+		text->npending = 0;
+	}
+	
+	if (flush) {
+		/* flush the iconv conversion */
+		while (_g_mime_iconv_convert (text->cd, path, NULL, NULL, &outbuf, &outleft) == (size_t) -1) {
+			if (errno != E2BIG)
+				break;
+			
+			converted = outbuf - filter->outbuf;
+			g_mime_filter_set_size (filter, filter->outsize + 16, TRUE);
+			outbuf = filter->outbuf + converted;
+			outleft = filter->outsize - converted - 1;
+		}
+	}
+	
+	return outbuf;
+}
+
+static void
+convert (GMimeFilter *filter, char *inbuf, size_t inlen, size_t prespace,
+	 char **out, size_t *outlen, size_t *outprespace, gboolean flush)
+{
+	GMimeFilterText *text = (GMimeFilterText *) filter;
+	GMimeEncoding *decoder = &text->decoder;
+	char *decoded, *outptr;
+	size_t declen, n;
+	
+	if (text->charset == NULL) {
+		if (is_identity (decoder->encoding)) {
+			/* only line endings to convert */
+			g_mime_filter_set_size (filter, inlen + 2, FALSE);
+			outptr = dos2unix (text, inbuf, inlen, filter->outbuf);
+		} else {
+			/* decode into our output buffer (leaving room for a held-back '\r')
+			 * and then convert the line endings in place */
+			g_mime_filter_set_size (filter, g_mime_encoding_outlen (decoder, inlen) + 2, FALSE);
+			
+			if (flush)
+				n = g_mime_encoding_flush (decoder, inbuf, inlen, filter->outbuf + 1);
+			else
+				n = g_mime_encoding_step (decoder, inbuf, inlen, filter->outbuf + 1);
+			
+			outptr = dos2unix (text, filter->outbuf + 1, n, filter->outbuf);
+		}
+	} else {
+		/* decode after any bytes of a multibyte sequence left over from last time */
+		if (is_identity (decoder->encoding)) {
+			if (text->npending > 0) {
+				pending_set_size (text, text->npending + inlen);
+				memcpy (text->pending + text->npending, inbuf, inlen);
+				decoded = text->pending;
+				declen = text->npending + inlen;
+			} else {
+				decoded = inbuf;
+				declen = inlen;
+			}
+		} else {
+			pending_set_size (text, text->npending + g_mime_encoding_outlen (decoder, inlen));
+			
+			if (flush)
+				n = g_mime_encoding_flush (decoder, inbuf, inlen, text->pending + text->npending);
+			else
+				n = g_mime_encoding_step (decoder, inbuf, inlen, text->pending + text->npending);
+			
+			decoded = text->pending;
+			declen = text->npending + n;
+		}
+		
+		/* convert the charset into our output buffer and then the line endings in place */
+		g_mime_filter_set_size (filter, declen * 5 + 16 + 2, FALSE);
+		outptr = convert_charset (filter, decoded, declen, filter->outbuf + 1, flush);
+		outptr = dos2unix (text, filter->outbuf + 1, outptr - (filter->outbuf + 1), filter->outbuf);
+	}
+	
+	if (flush && text->ensure_newline && text->pc != '\n')
+		text->pc = *outptr++ = '\n';
+	
+	*out = filter->outbuf;
+	*outlen = outptr - filter->outbuf;
+	*outprespace = filter->outpre;
+}
+
+static void
+filter_filter (GMimeFilter *filter, char *inbuf, size_t inlen, size_t prespace,
+	       char **outbuf, size_t *outlen, size_t *outprespace)
+{
+	convert (filter, inbuf, inlen, prespace, outbuf, outlen, outprespace, FALSE);
+}
+
+static void 
+filter_complete (GMimeFilter *filter, char *inbuf, size_t inlen, size_t prespace,
+		 char **outbuf, size_t *outlen, size_t *outprespace)
+{
+	convert (filter, inbuf, inlen, prespace, outbuf, outlen, outprespace, TRUE);
+}
+
+static void
+filter_reset (GMimeFilter *filter)
+{
+	GMimeFilterText *text = (GMimeFilterText *) filter;
+	
+	g_mime_encoding_reset (&text->decoder);
+	
+	if (text->cd != (iconv_t) -1)
+		iconv (text->cd, NULL, NULL, NULL, NULL);
+	
+	text->npending = 0;
+	text->pc = '\0';
+}
+
+
+/**
+ * g_mime_filter_text_new:
+ * @encoding: the #GMimeContentEncoding of the input
+ * @charset: charset of the decoded text or %NULL if it is already UTF-8
+ * @ensure_newline: %TRUE if the filter should ensure that the stream ends in a new line
+ *
+ * Creates a new #GMimeFilterText filter which decodes text in the
+ * given transfer @encoding, converts it from @charset to UTF-8 and
+ * converts line endings to Unix line endings.
+ *
+ * Note: only base64, quoted-printable and the identity encodings
+ * (7bit, 8bit and binary) are supported.
+ *
+ * Returns: a new text filter or %NULL if @encoding is not supported
+ * or the charset conversion is not possible.
+ **/
+GMimeFilter *
+g_mime_filter_text_new (GMimeContentEncoding encoding, const char *charset, gboolean ensure_newline)
+{
+	GMimeFilterText *text;
+	iconv_t cd = (iconv_t) -1;
+	
+	if (encoding == GMIME_CONTENT_ENCODING_UUENCODE)
+		return NULL;
+	
+	if (charset != NULL && !_g_mime_iconv_get_path ("UTF-8", charset) &&
+	    (cd = g_mime_iconv_open ("UTF-8", charset)) == (iconv_t) -1)
+		return NULL;
+	
+	text = g_object_new (GMIME_TYPE_FILTER_TEXT, NULL);
+	g_mime_encoding_init_decode (&text->decoder, encoding);
+	text->charset = g_strdup (charset);
+	text->ensure_newline = ensure_newline;
+	text->cd = cd;
+	
+	return (GMimeFilter *) text;
+}
@@ -0,0 +1,83 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*- */
+/*  GMime
+ *  Copyright (C) 2000-2022 Jeffrey Stedfast
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public License
+ *  as published by the Free Software Foundation; either version 2.1
+ *  of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free
+ *  Software Foundation, 51 Franklin Street, Fifth Floor, Boston, MA
+ *  02110-1301, USA.
+ */
+
+#ifndef __GMIME_FILTER_TEXT_H__
+#define __GMIME_FILTER_TEXT_H__
+
+#include <iconv.h>
+#include <gmime/gmime-filter.h>
+#include <gmime/gmime-encodings.h>
+
+G_BEGIN_DECLS
+
+#define GMIME_TYPE_FILTER_TEXT            (g_mime_filter_text_get_type ())
+#define GMIME_FILTER_TEXT(obj)            (G_TYPE_CHECK_INSTANCE_CAST ((obj), GMIME_TYPE_FILTER_TEXT, GMimeFilterText))
+#define GMIME_FILTER_TEXT_CLASS(klass)    (G_TYPE_CHECK_CLASS_CAST ((klass), GMIME_TYPE_FILTER_TEXT, GMimeFilterTextClass))
+#define GMIME_IS_FILTER_TEXT(obj)         (G_TYPE_CHECK_INSTANCE_TYPE ((obj), GMIME_TYPE_FILTER_TEXT))
+#define GMIME_IS_FILTER_TEXT_CLASS(klass) (G_TYPE_CHECK_CLASS_TYPE ((klass), GMIME_TYPE_FILTER_TEXT))
+#define GMIME_FILTER_TEXT_GET_CLASS(obj)  (G_TYPE_INSTANCE_GET_CLASS ((obj), GMIME_TYPE_FILTER_TEXT, GMimeFilterTextClass))
+
+typedef struct _GMimeFilterText GMimeFilterText;
+typedef struct _GMimeFilterTextClass GMimeFilterTextClass;
+
+/**
+ * GMimeFilterText:
+ * @parent_object: parent #GMimeFilter
+ * @decoder: #GMimeEncoding state of the transfer decoder
+ * @charset: charset that the filter is converting from or %NULL
+ * @cd: charset conversion state or (iconv_t) -1 if GMime converts from @charset natively or no conversion is needed
+ * @ensure_newline: %TRUE if the filter should ensure that the stream ends with a new line
+ * @pc: the previous character encountered
+ * @pending: decoded bytes of an incomplete multibyte sequence
+ * @npending: number of bytes in @pending
+ * @pendingsize: allocated size of @pending
+ *
+ * A filter which extracts text from a transfer-encoded stream: it
+ * decodes the content, converts it to UTF-8 and converts Windows/DOS
+ * line endings to Unix line endings in a single pass.
+ **/
+struct _GMimeFilterText {
+	GMimeFilter parent_object;
+	
+	GMimeEncoding decoder;
+	char *charset;
+	iconv_t cd;
+	
+	gboolean ensure_newline;
+	char pc;
+	
+	char *pending;
+	size_t npending;
+	size_t pendingsize;
+};
+
+struct _GMimeFilterTextClass {
+	GMimeFilterClass parent_class;
+	
+};
+
+
+GType g_mime_filter_text_get_type (void);
+
+GMimeFilter *g_mime_filter_text_new (GMimeContentEncoding encoding, const char *charset, gboolean ensure_newline);
+
+G_END_DECLS
+
+#endif /* __GMIME_FILTER_TEXT_H__ */
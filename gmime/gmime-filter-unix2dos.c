@@ -23,6 +23,8 @@
 #include <config.h>
 #endif
 
+#include <string.h>
+
 #include "gmime-filter-unix2dos.h"
 
 
@@ -111,7 +113,9 @@ convert (GMimeFilter *filter, char *inbuf, size_t inlen, size_t prespace,
 	register const char *inptr = inbuf;
 	const char *inend = inbuf + inlen;
 	size_t expected = inlen * 2;
+	const char *lf;
 	char *outptr;
+	size_t n;
 	
 	if (flush && unix2dos->ensure_newline)
 		expected += 2;
@@ -120,17 +124,24 @@ convert (GMimeFilter *filter, char *inbuf, size_t inlen, size_t prespace,
 	
 	outptr = filter->outbuf;
 	while (inptr < inend) {
-		if (*inptr == '\r') {
-			*outptr++ = *inptr;
-		} else if (*inptr == '\n') {
-			if (unix2dos->pc != '\r')
-				*outptr++ = '\r';
-			*outptr++ = *inptr;
-		} else {
-			*outptr++ = *inptr;
+		/* copy everything up to the next '\n' in one go */
+		if (!(lf = memchr (inptr, '\n', inend - inptr)))
+			lf = inend;
+		
+		if ((n = lf - inptr) > 0) {
+			memcpy (outptr, inptr, n);
+			unix2dos->pc = lf[-1];
+			outptr += n;
+			inptr = lf;
 		}
 		
-		unix2dos->pc = *inptr++;
+		if (inptr == inend)
+			break;
+		
+		if (unix2dos->pc != '\r')
+			*outptr++ = '\r';
+		
+		unix2dos->pc = *outptr++ = *inptr++;
 	}
 	
 	if (flush && unix2dos->ensure_newline && unix2dos->pc != '\n') {
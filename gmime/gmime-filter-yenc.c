@@ -25,7 +25,12 @@
 
 #include <string.h>
 
+#ifdef __ARM_FEATURE_CRC32
+#include <arm_acle.h>
+#endif
+
 #include "gmime-filter-yenc.h"
+#include "gmime-simd.h"
 
 
 /**
@@ -420,6 +425,88 @@ static const int yenc_crc_table[256] = {
 
 #define yenc_crc_add(crc, c) (yenc_crc_table[(((int) (crc)) ^ ((unsigned char) (c))) & 0xff] ^ ((((int) (crc)) >> 8) & 0x00ffffff))
 
+static guint32 yenc_crc_slice[8][256];
+
+static void
+yenc_crc_slice_init (void)
+{
+	static gsize initialized = 0;
+	guint32 crc;
+	int i, j;
+	
+	if (!g_once_init_enter (&initialized))
+		return;
+	
+	for (i = 0; i < 256; i++)
+		yenc_crc_slice[0][i] = (guint32) yenc_crc_table[i];
+	
+	for (i = 0; i < 256; i++) {
+		crc = yenc_crc_slice[0][i];
+		
+		for (j = 1; j < 8; j++) {
+			crc = yenc_crc_slice[0][crc & 0xff] ^ (crc >> 8);
+			yenc_crc_slice[j][i] = crc;
+		}
+	}
+	
+	g_once_init_leave (&initialized, 1);
+}
+
+/* updates both the part crc and the combined crc over the same data in a single pass */
+static void
+yenc_crc_update (guint32 *pcrc, guint32 *crc, const unsigned char *inbuf, size_t inlen)
+{
+	register const unsigned char *inptr = inbuf;
+	const unsigned char *inend = inbuf + inlen;
+	guint32 p = *pcrc, c = *crc;
+	
+#if defined (__ARM_FEATURE_CRC32) && G_BYTE_ORDER == G_LITTLE_ENDIAN
+	guint64 v;
+	
+	/* the ARMv8 crc32 instructions use the same polynomial as yEnc */
+	while (inend - inptr >= 8) {
+		memcpy (&v, inptr, 8);
+		p = __crc32d (p, v);
+		c = __crc32d (c, v);
+		inptr += 8;
+	}
+#else
+	guint32 lo, hi;
+	
+	/* slicing-by-8: 8 independent table lookups per 8 bytes instead of 8 dependent ones */
+	yenc_crc_slice_init ();
+	
+	while (inend - inptr >= 8) {
+		hi = inptr[4] | (inptr[5] << 8) | (inptr[6] << 16) | ((guint32) inptr[7] << 24);
+		lo = inptr[0] | (inptr[1] << 8) | (inptr[2] << 16) | ((guint32) inptr[3] << 24);
+		
+		p ^= lo;
+		c ^= lo;
+		
+		p = yenc_crc_slice[7][p & 0xff] ^ yenc_crc_slice[6][(p >> 8) & 0xff] ^
+			yenc_crc_slice[5][(p >> 16) & 0xff] ^ yenc_crc_slice[4][p >> 24] ^
+			yenc_crc_slice[3][hi & 0xff] ^ yenc_crc_slice[2][(hi >> 8) & 0xff] ^
+			yenc_crc_slice[1][(hi >> 16) & 0xff] ^ yenc_crc_slice[0][hi >> 24];
+		
+		c = yenc_crc_slice[7][c & 0xff] ^ yenc_crc_slice[6][(c >> 8) & 0xff] ^
+			yenc_crc_slice[5][(c >> 16) & 0xff] ^ yenc_crc_slice[4][c >> 24] ^
+			yenc_crc_slice[3][hi & 0xff] ^ yenc_crc_slice[2][(hi >> 8) & 0xff] ^
+			yenc_crc_slice[1][(hi >> 16) & 0xff] ^ yenc_crc_slice[0][hi >> 24];
+		
+		inptr += 8;
+	}
+#endif
+	
+	while (inptr < inend) {
+		p = yenc_crc_add (p, *inptr);
+		c = yenc_crc_add (c, *inptr);
+		inptr++;
+	}
+	
+	*pcrc = p;
+	*crc = c;
+}
+
 #define YENC_NEWLINE_ESCAPE (GMIME_YDECODE_STATE_EOLN | GMIME_YDECODE_STATE_ESCAPE)
 
 
@@ -451,12 +538,15 @@ g_mime_ydecode_step (const unsigned char *inbuf, size_t inlen, unsigned char *ou
 	register const unsigned char *inptr;
 	register unsigned char *outptr;
 	const unsigned char *inend;
+	gboolean simd;
 	unsigned char c;
+	size_t n;
 	int ystate;
 	
 	if (*state & GMIME_YDECODE_STATE_END)
 		return 0;
 	
+	simd = g_mime_simd_get_level () != GMIME_SIMD_NONE;
 	ystate = *state;
 	
 	inend = inbuf + inlen;
@@ -464,6 +554,16 @@ g_mime_ydecode_step (const unsigned char *inbuf, size_t inlen, unsigned char *ou
 	
 	inptr = inbuf;
 	while (inptr < inend) {
+		if (simd && !(ystate & YENC_NEWLINE_ESCAPE) && (inend - inptr) >= 16) {
+			/* decode up to the next escape or line break in bulk */
+			n = g_mime_simd_ydecode_span (inptr, (size_t) (inend - inptr), outptr);
+			outptr += n;
+			inptr += n;
+			
+			if (inptr == inend)
+				break;
+		}
+		
 		c = *inptr++;
 		
 		if ((ystate & YENC_NEWLINE_ESCAPE) == YENC_NEWLINE_ESCAPE) {
@@ -491,12 +591,11 @@ g_mime_ydecode_step (const unsigned char *inbuf, size_t inlen, unsigned char *ou
 		
 		ystate &= ~GMIME_YDECODE_STATE_EOLN;
 		
-		*outptr++ = c -= 42;
-		
-		*pcrc = yenc_crc_add (*pcrc, c);
-		*crc = yenc_crc_add (*crc, c);
+		*outptr++ = c - 42;
 	}
 	
+	yenc_crc_update (pcrc, crc, outbuf, (size_t) (outptr - outbuf));
+	
 	*state = ystate;
 	
 	return outptr - outbuf;
@@ -532,21 +631,33 @@ g_mime_yencode_step (const unsigned char *inbuf, size_t inlen, unsigned char *ou
 	register unsigned char *outptr;
 	const unsigned char *inend;
 	register int already;
+	gboolean simd;
 	unsigned char c;
+	size_t n;
 	
+	simd = g_mime_simd_get_level () != GMIME_SIMD_NONE;
 	inend = inbuf + inlen;
 	outptr = outbuf;
 	
 	already = *state;
 	
+	yenc_crc_update (pcrc, crc, inbuf, inlen);
+	
 	inptr = inbuf;
 	while (inptr < inend) {
-		c = *inptr++;
-		
-		*pcrc = yenc_crc_add (*pcrc, c);
-		*crc = yenc_crc_add (*crc, c);
+		if (simd && already <= 111 && (inend - inptr) >= 16) {
+			/* encode the run of bytes that need no escaping and fit on this line in bulk */
+			n = MIN ((size_t) (inend - inptr), (size_t) (127 - already));
+			n = g_mime_simd_yencode_span (inptr, n, outptr);
+			outptr += n;
+			inptr += n;
+			already += n;
+			
+			if (inptr == inend)
+				break;
+		}
 		
-		c += 42;
+		c = *inptr++ + 42;
 		
 		if (c == '\0' || c == '\t' || c == '\r' || c == '\n' || c == '=') {
 			*outptr++ = '=';
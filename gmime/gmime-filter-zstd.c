@@ -0,0 +1,535 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*- */
+/*  GMime
+ *  Copyright (C) 2000-2022 Jeffrey Stedfast
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public License
+ *  as published by the Free Software Foundation; either version 2.1
+ *  of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free
+ *  Software Foundation, 51 Franklin Street, Fifth Floor, Boston, MA
+ *  02110-1301, USA.
+ */
+
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <string.h>
+
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+#include "gmime-filter-zstd.h"
+
+#ifdef ENABLE_WARNINGS
+#define w(x) x
+#else
+#define w(x)
+#endif /* ENABLE_WARNINGS */
+
+
+/**
+ * SECTION: gmime-filter-zstd
+ * @title: GMimeFilterZstd
+ * @short_description: Zstandard compression/decompression
+ * @see_also: #GMimeFilter, #GMimeFilterLz4
+ *
+ * A #GMimeFilter used for compressing or decompressing a stream using
+ * Zstandard, optionally with a pre-shared dictionary.
+ *
+ * When a frame size is set, the compressor splits its output into
+ * independent frames and appends a seek table in the Zstandard
+ * seekable format, which allows readers of the seekable format to
+ * seek within the decompressed content without having to decompress
+ * everything before it. Decompression handles both single-frame and
+ * multi-frame input.
+ *
+ * Note: if GMime was built without libzstd, g_mime_filter_zstd_new()
+ * returns %NULL.
+ **/
+
+
+/* https://github.com/facebook/zstd/blob/dev/contrib/seekable_format/zstd_seekable_compression_format.md */
+#define SEEKABLE_SKIPPABLE_MAGIC 0x184D2A5E
+#define SEEKABLE_MAGIC           0x8F92EAB1
+#define SEEKABLE_MAX_FRAME_SIZE  (1024 * 1024 * 1024)
+
+struct _GMimeFilterZstdPrivate {
+#ifdef HAVE_ZSTD
+	ZSTD_CCtx *cctx;
+	ZSTD_DCtx *dctx;
+#endif
+	unsigned char *dict;
+	size_t dictlen;
+	
+	/* seekable output state */
+	size_t frame_size;
+	size_t frame_in;
+	guint64 frame_start;
+	guint64 total_out;
+	GArray *frames;
+	
+	gboolean flushed;
+	gboolean error;
+};
+
+typedef struct {
+	guint32 compressed;
+	guint32 decompressed;
+} ZstdFrame;
+
+static void g_mime_filter_zstd_class_init (GMimeFilterZstdClass *klass);
+static void g_mime_filter_zstd_init (GMimeFilterZstd *filter, GMimeFilterZstdClass *klass);
+static void g_mime_filter_zstd_finalize (GObject *object);
+
+#ifdef HAVE_ZSTD
+static GMimeFilter *filter_copy (GMimeFilter *filter);
+static void filter_filter (GMimeFilter *filter, char *in, size_t len, size_t prespace,
+			   char **out, size_t *outlen, size_t *outprespace);
+static void filter_complete (GMimeFilter *filter, char *in, size_t len, size_t prespace,
+			     char **out, size_t *outlen, size_t *outprespace);
+static void filter_reset (GMimeFilter *filter);
+#endif
+
+
+static GMimeFilterClass *parent_class = NULL;
+
+
+GType
+g_mime_filter_zstd_get_type (void)
+{
+	static GType type = 0;
+	
+	if (!type) {
+		static const GTypeInfo info = {
+			sizeof (GMimeFilterZstdClass),
+			NULL, /* base_class_init */
+			NULL, /* base_class_finalize */
+			(GClassInitFunc) g_mime_filter_zstd_class_init,
+			NULL, /* class_finalize */
+			NULL, /* class_data */
+			sizeof (GMimeFilterZstd),
+			0,    /* n_preallocs */
+			(GInstanceInitFunc) g_mime_filter_zstd_init,
+		};
+		
+		type = g_type_register_static (GMIME_TYPE_FILTER, "GMimeFilterZstd", &info, 0);
+	}
+	
+	return type;
+}
+
+
+static void
+g_mime_filter_zstd_class_init (GMimeFilterZstdClass *klass)
+{
+	GObjectClass *object_class = G_OBJECT_CLASS (klass);
+#ifdef HAVE_ZSTD
+	GMimeFilterClass *filter_class = GMIME_FILTER_CLASS (klass);
+#endif
+	
+	parent_class = g_type_class_ref (GMIME_TYPE_FILTER);
+	
+	object_class->finalize = g_mime_filter_zstd_finalize;
+	
+#ifdef HAVE_ZSTD
+	filter_class->copy = filter_copy;
+	filter_class->filter = filter_filter;
+	filter_class->complete = filter_complete;
+	filter_class->reset = filter_reset;
+#endif
+}
+
+static void
+g_mime_filter_zstd_init (GMimeFilterZstd *filter, GMimeFilterZstdClass *klass)
+{
+	filter->priv = g_new0 (struct _GMimeFilterZstdPrivate, 1);
+	filter->priv->frames = g_array_new (FALSE, FALSE, sizeof (ZstdFrame));
+}
+
+static void
+g_mime_filter_zstd_finalize (GObject *object)
+{
+	GMimeFilterZstd *zstd = (GMimeFilterZstd *) object;
+	struct _GMimeFilterZstdPrivate *priv = zstd->priv;
+	
+#ifdef HAVE_ZSTD
+	ZSTD_freeCCtx (priv->cctx);
+	ZSTD_freeDCtx (priv->dctx);
+#endif
+	g_array_free (priv->frames, TRUE);
+	g_free (priv->dict);
+	g_free (priv);
+	
+	G_OBJECT_CLASS (parent_class)->finalize (object);
+}
+
+
+#ifdef HAVE_ZSTD
+static GMimeFilter *
+filter_copy (GMimeFilter *filter)
+{
+	GMimeFilterZstd *zstd = (GMimeFilterZstd *) filter;
+	GMimeFilter *copy;
+	
+	copy = g_mime_filter_zstd_new (zstd->mode, zstd->level);
+	g_mime_filter_zstd_set_frame_size ((GMimeFilterZstd *) copy, zstd->priv->frame_size);
+	
+	if (zstd->priv->dict)
+		g_mime_filter_zstd_set_dictionary ((GMimeFilterZstd *) copy, zstd->priv->dict, zstd->priv->dictlen);
+	
+	return copy;
+}
+
+static void
+filter_reserve (GMimeFilter *filter, size_t outlen, size_t needed)
+{
+	if (outlen + needed > filter->outsize)
+		g_mime_filter_set_size (filter, MAX (outlen + needed, filter->outsize * 2), TRUE);
+}
+
+static void
+seek_table_encode (GMimeFilter *filter, size_t *outlen)
+{
+	struct _GMimeFilterZstdPrivate *priv = ((GMimeFilterZstd *) filter)->priv;
+	size_t size = priv->frames->len * 8 + 9;
+	unsigned char *outptr;
+	ZstdFrame *frame;
+	guint32 val;
+	guint i;
+	
+	filter_reserve (filter, *outlen, 8 + size);
+	outptr = (unsigned char *) filter->outbuf + *outlen;
+	
+	val = GUINT32_TO_LE (SEEKABLE_SKIPPABLE_MAGIC);
+	memcpy (outptr, &val, 4);
+	val = GUINT32_TO_LE ((guint32) size);
+	memcpy (outptr + 4, &val, 4);
+	outptr += 8;
+	
+	for (i = 0; i < priv->frames->len; i++) {
+		frame = &g_array_index (priv->frames, ZstdFrame, i);
+		
+		val = GUINT32_TO_LE (frame->compressed);
+		memcpy (outptr, &val, 4);
+		val = GUINT32_TO_LE (frame->decompressed);
+		memcpy (outptr + 4, &val, 4);
+		outptr += 8;
+	}
+	
+	/* the footer: the number of frames, a descriptor without the checksum flag and the magic */
+	val = GUINT32_TO_LE (priv->frames->len);
+	memcpy (outptr, &val, 4);
+	outptr[4] = 0;
+	val = GUINT32_TO_LE (SEEKABLE_MAGIC);
+	memcpy (outptr + 5, &val, 4);
+	
+	*outlen += 8 + size;
+}
+
+static void
+zstd_compress (GMimeFilter *filter, char *inbuf, size_t inlen, size_t prespace,
+	       char **out, size_t *outlen, size_t *outprespace, gboolean flush)
+{
+	GMimeFilterZstd *zstd = (GMimeFilterZstd *) filter;
+	struct _GMimeFilterZstdPrivate *priv = zstd->priv;
+	size_t olen = 0, offset = 0, n, ret;
+	ZSTD_outBuffer output;
+	ZSTD_inBuffer input;
+	ZstdFrame frame;
+	gboolean end;
+	
+	if (priv->flushed || priv->error) {
+		*outprespace = prespace;
+		*outlen = 0;
+		*out = inbuf;
+		return;
+	}
+	
+	do {
+		n = inlen - offset;
+		if (priv->frame_size > 0)
+			n = MIN (n, priv->frame_size - priv->frame_in);
+		
+		/* end the frame once it is full or, when flushing, once we
+		 * are out of input (unless that would create an empty frame) */
+		end = (priv->frame_size > 0 && priv->frame_in + n == priv->frame_size) ||
+			(flush && offset + n == inlen && (priv->frame_in + n > 0 || priv->frames->len == 0));
+		
+		if (n == 0 && !end)
+			break;
+		
+		input.src = inbuf + offset;
+		input.size = n;
+		input.pos = 0;
+		
+		do {
+			filter_reserve (filter, olen, ZSTD_CStreamOutSize ());
+			output.dst = filter->outbuf;
+			output.size = filter->outsize;
+			output.pos = olen;
+			
+			ret = ZSTD_compressStream2 (priv->cctx, &output, &input, end ? ZSTD_e_end : ZSTD_e_continue);
+			priv->total_out += output.pos - olen;
+			olen = output.pos;
+			
+			if (ZSTD_isError (ret)) {
+				w(fprintf (stderr, "zstd: %s\n", ZSTD_getErrorName (ret)));
+				priv->error = TRUE;
+				goto done;
+			}
+		} while (end ? ret != 0 : input.pos < input.size);
+		
+		priv->frame_in += n;
+		offset += n;
+		
+		if (end) {
+			frame.compressed = (guint32) (priv->total_out - priv->frame_start);
+			frame.decompressed = (guint32) priv->frame_in;
+			g_array_append_val (priv->frames, frame);
+			priv->frame_start = priv->total_out;
+			priv->frame_in = 0;
+		}
+	} while (offset < inlen);
+	
+	if (flush) {
+		if (priv->frame_size > 0)
+			seek_table_encode (filter, &olen);
+		
+		priv->flushed = TRUE;
+	}
+	
+ done:
+	*out = filter->outbuf;
+	*outlen = olen;
+	*outprespace = filter->outpre;
+}
+
+static void
+zstd_decompress (GMimeFilter *filter, char *inbuf, size_t inlen, size_t prespace,
+		 char **out, size_t *outlen, size_t *outprespace)
+{
+	GMimeFilterZstd *zstd = (GMimeFilterZstd *) filter;
+	struct _GMimeFilterZstdPrivate *priv = zstd->priv;
+	ZSTD_outBuffer output;
+	ZSTD_inBuffer input;
+	size_t olen = 0;
+	size_t ret;
+	
+	if (priv->error) {
+		*outprespace = prespace;
+		*outlen = 0;
+		*out = inbuf;
+		return;
+	}
+	
+	input.src = inbuf;
+	input.size = inlen;
+	input.pos = 0;
+	
+	/* consecutive frames are decoded one after the other and
+	 * skippable frames (such as a seek table) are ignored */
+	do {
+		filter_reserve (filter, olen, ZSTD_DStreamOutSize ());
+		output.dst = filter->outbuf;
+		output.size = filter->outsize;
+		output.pos = olen;
+		
+		ret = ZSTD_decompressStream (priv->dctx, &output, &input);
+		olen = output.pos;
+		
+		if (ZSTD_isError (ret)) {
+			w(fprintf (stderr, "unzstd: %s\n", ZSTD_getErrorName (ret)));
+			priv->error = TRUE;
+			break;
+		}
+	} while (input.pos < input.size || output.pos == output.size);
+	
+	*out = filter->outbuf;
+	*outlen = olen;
+	*outprespace = filter->outpre;
+}
+
+static void
+filter_filter (GMimeFilter *filter, char *in, size_t len, size_t prespace,
+	       char **out, size_t *outlen, size_t *outprespace)
+{
+	GMimeFilterZstd *zstd = (GMimeFilterZstd *) filter;
+	
+	if (zstd->mode == GMIME_FILTER_ZSTD_MODE_COMPRESS)
+		zstd_compress (filter, in, len, prespace, out, outlen, outprespace, FALSE);
+	else
+		zstd_decompress (filter, in, len, prespace, out, outlen, outprespace);
+}
+
+static void
+filter_complete (GMimeFilter *filter, char *in, size_t len, size_t prespace,
+		 char **out, size_t *outlen, size_t *outprespace)
+{
+	GMimeFilterZstd *zstd = (GMimeFilterZstd *) filter;
+	
+	if (zstd->mode == GMIME_FILTER_ZSTD_MODE_COMPRESS)
+		zstd_compress (filter, in, len, prespace, out, outlen, outprespace, TRUE);
+	else
+		zstd_decompress (filter, in, len, prespace, out, outlen, outprespace);
+}
+
+static void
+filter_reset (GMimeFilter *filter)
+{
+	GMimeFilterZstd *zstd = (GMimeFilterZstd *) filter;
+	struct _GMimeFilterZstdPrivate *priv = zstd->priv;
+	
+	/* resetting the session keeps the parameters and the dictionary */
+	if (zstd->mode == GMIME_FILTER_ZSTD_MODE_COMPRESS)
+		ZSTD_CCtx_reset (priv->cctx, ZSTD_reset_session_only);
+	else
+		ZSTD_DCtx_reset (priv->dctx, ZSTD_reset_session_only);
+	
+	g_array_set_size (priv->frames, 0);
+	priv->frame_start = 0;
+	priv->total_out = 0;
+	priv->frame_in = 0;
+	priv->flushed = FALSE;
+	priv->error = FALSE;
+}
+#endif /* HAVE_ZSTD */
+
+
+/**
+ * g_mime_filter_zstd_new:
+ * @mode: compress or decompress
+ * @level: compression level (%0 for the default)
+ *
+ * Creates a new Zstandard compression (or decompression) filter.
+ *
+ * Returns: a new zstd filter or %NULL if GMime was built without
+ * Zstandard support.
+ **/
+GMimeFilter *
+g_mime_filter_zstd_new (GMimeFilterZstdMode mode, int level)
+{
+#ifdef HAVE_ZSTD
+	GMimeFilterZstd *zstd;
+	
+	zstd = g_object_new (GMIME_TYPE_FILTER_ZSTD, NULL);
+	zstd->mode = mode;
+	zstd->level = level;
+	
+	if (mode == GMIME_FILTER_ZSTD_MODE_COMPRESS) {
+		if (!(zstd->priv->cctx = ZSTD_createCCtx ())) {
+			g_object_unref (zstd);
+			return NULL;
+		}
+		
+		ZSTD_CCtx_setParameter (zstd->priv->cctx, ZSTD_c_compressionLevel, level);
+		ZSTD_CCtx_setParameter (zstd->priv->cctx, ZSTD_c_checksumFlag, 1);
+	} else if (!(zstd->priv->dctx = ZSTD_createDCtx ())) {
+		g_object_unref (zstd);
+		return NULL;
+	}
+	
+	return (GMimeFilter *) zstd;
+#else
+	return NULL;
+#endif /* HAVE_ZSTD */
+}
+
+
+/**
+ * g_mime_filter_zstd_set_dictionary:
+ * @zstd: A #GMimeFilterZstd filter
+ * @dict: (array length=len): the dictionary
+ * @len: the length of the dictionary
+ *
+ * Sets the dictionary to compress or decompress with. This must be
+ * called before any data is passed through the filter and the same
+ * dictionary must be used to decompress the data as was used to
+ * compress it.
+ *
+ * Both dictionaries trained by `zstd --train` and raw content (such
+ * as a typical set of message headers) can be used.
+ *
+ * Returns: %TRUE on success or %FALSE if the dictionary could not be loaded.
+ **/
+gboolean
+g_mime_filter_zstd_set_dictionary (GMimeFilterZstd *zstd, const unsigned char *dict, size_t len)
+{
+#ifdef HAVE_ZSTD
+	struct _GMimeFilterZstdPrivate *priv;
+	size_t ret;
+	
+	g_return_val_if_fail (GMIME_IS_FILTER_ZSTD (zstd), FALSE);
+	g_return_val_if_fail (dict != NULL || len == 0, FALSE);
+	
+	priv = zstd->priv;
+	
+	if (zstd->mode == GMIME_FILTER_ZSTD_MODE_COMPRESS)
+		ret = ZSTD_CCtx_loadDictionary (priv->cctx, dict, len);
+	else
+		ret = ZSTD_DCtx_loadDictionary (priv->dctx, dict, len);
+	
+	if (ZSTD_isError (ret))
+		return FALSE;
+	
+	g_free (priv->dict);
+	priv->dict = len > 0 ? g_memdup2 (dict, len) : NULL;
+	priv->dictlen = len;
+	
+	return TRUE;
+#else
+	return FALSE;
+#endif /* HAVE_ZSTD */
+}
+
+
+/**
+ * g_mime_filter_zstd_get_frame_size:
+ * @zstd: A #GMimeFilterZstd filter
+ *
+ * Gets the amount of uncompressed data that the compressor puts in
+ * each frame.
+ *
+ * Returns: the frame size or %0 if all of the data goes in a single frame.
+ **/
+size_t
+g_mime_filter_zstd_get_frame_size (GMimeFilterZstd *zstd)
+{
+	g_return_val_if_fail (GMIME_IS_FILTER_ZSTD (zstd), 0);
+	
+	return zstd->priv->frame_size;
+}
+
+
+/**
+ * g_mime_filter_zstd_set_frame_size:
+ * @zstd: A #GMimeFilterZstd filter
+ * @frame_size: the frame size or %0 for a single frame
+ *
+ * Sets the amount of uncompressed data that the compressor should put
+ * in each frame, up to 1 GB. When this is non-zero, the output is
+ * written in the Zstandard seekable format: a series of independent
+ * frames followed by a seek table.
+ *
+ * Smaller frames allow for finer-grained random access at the cost of
+ * a slightly worse compression ratio.
+ **/
+void
+g_mime_filter_zstd_set_frame_size (GMimeFilterZstd *zstd, size_t frame_size)
+{
+	g_return_if_fail (GMIME_IS_FILTER_ZSTD (zstd));
+	g_return_if_fail (frame_size <= SEEKABLE_MAX_FRAME_SIZE);
+	
+	zstd->priv->frame_size = frame_size;
+}
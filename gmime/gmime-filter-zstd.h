@@ -0,0 +1,87 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*- */
+/*  GMime
+ *  Copyright (C) 2000-2022 Jeffrey Stedfast
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public License
+ *  as published by the Free Software Foundation; either version 2.1
+ *  of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free
+ *  Software Foundation, 51 Franklin Street, Fifth Floor, Boston, MA
+ *  02110-1301, USA.
+ */
+
+#ifndef __GMIME_FILTER_ZSTD_H__
+#define __GMIME_FILTER_ZSTD_H__
+
+#include <gmime/gmime-filter.h>
+
+G_BEGIN_DECLS
+
+#define GMIME_TYPE_FILTER_ZSTD            (g_mime_filter_zstd_get_type ())
+#define GMIME_FILTER_ZSTD(obj)            (G_TYPE_CHECK_INSTANCE_CAST ((obj), GMIME_TYPE_FILTER_ZSTD, GMimeFilterZstd))
+#define GMIME_FILTER_ZSTD_CLASS(klass)    (G_TYPE_CHECK_CLASS_CAST ((klass), GMIME_TYPE_FILTER_ZSTD, GMimeFilterZstdClass))
+#define GMIME_IS_FILTER_ZSTD(obj)         (G_TYPE_CHECK_INSTANCE_TYPE ((obj), GMIME_TYPE_FILTER_ZSTD))
+#define GMIME_IS_FILTER_ZSTD_CLASS(klass) (G_TYPE_CHECK_CLASS_TYPE ((klass), GMIME_TYPE_FILTER_ZSTD))
+#define GMIME_FILTER_ZSTD_GET_CLASS(obj)  (G_TYPE_INSTANCE_GET_CLASS ((obj), GMIME_TYPE_FILTER_ZSTD, GMimeFilterZstdClass))
+
+typedef struct _GMimeFilterZstd GMimeFilterZstd;
+typedef struct _GMimeFilterZstdClass GMimeFilterZstdClass;
+
+
+/**
+ * GMimeFilterZstdMode:
+ * @GMIME_FILTER_ZSTD_MODE_COMPRESS: Compress mode.
+ * @GMIME_FILTER_ZSTD_MODE_DECOMPRESS: Decompress mode.
+ *
+ * The mode for the #GMimeFilterZstd filter.
+ **/
+typedef enum {
+	GMIME_FILTER_ZSTD_MODE_COMPRESS,
+	GMIME_FILTER_ZSTD_MODE_DECOMPRESS
+} GMimeFilterZstdMode;
+
+
+/**
+ * GMimeFilterZstd:
+ * @parent_object: parent #GMimeFilter
+ * @priv: private state data
+ * @mode: #GMimeFilterZstdMode
+ * @level: compression level
+ *
+ * A filter for compressing or decompressing a Zstandard stream.
+ **/
+struct _GMimeFilterZstd {
+	GMimeFilter parent_object;
+	
+	struct _GMimeFilterZstdPrivate *priv;
+	
+	GMimeFilterZstdMode mode;
+	int level;
+};
+
+struct _GMimeFilterZstdClass {
+	GMimeFilterClass parent_class;
+	
+};
+
+
+GType g_mime_filter_zstd_get_type (void);
+
+GMimeFilter *g_mime_filter_zstd_new (GMimeFilterZstdMode mode, int level);
+
+gboolean g_mime_filter_zstd_set_dictionary (GMimeFilterZstd *zstd, const unsigned char *dict, size_t len);
+
+size_t g_mime_filter_zstd_get_frame_size (GMimeFilterZstd *zstd);
+void g_mime_filter_zstd_set_frame_size (GMimeFilterZstd *zstd, size_t frame_size);
+
+G_END_DECLS
+
+#endif /* __GMIME_FILTER_ZSTD_H__ */
@@ -26,6 +26,7 @@
 #include <string.h> /* for memcpy */
 
 #include "gmime-filter.h"
+#include "gmime-internal.h"
 
 
 /**
@@ -36,18 +37,43 @@
  *
  * Stream filters are an efficient way of converting data from one
  * format to another.
+ *
+ * The output and backup buffers of filters are recycled through a
+ * small per-thread pool, so creating and destroying filters for every
+ * part that gets decoded does not hit the allocator each time.
  **/
 
 
 struct _GMimeFilterPrivate {
 	char *inbuf;
 	size_t inlen;
+	
+	gboolean inplace;	/* the filter can write its output over its input */
+	gboolean writable;	/* the input of the current call may be overwritten */
+	gboolean eod;		/* the filter has reached the end of its data */
 };
 
 #define PRE_HEAD (64)
 #define BACK_HEAD (64)
 #define _PRIVATE(o) (((GMimeFilter *)(o))->priv)
 
+#define POOL_MIN_SHIFT  9			/* 512 bytes */
+#define POOL_MAX_SHIFT  18			/* 256 KB */
+#define POOL_CLASSES    (POOL_MAX_SHIFT - POOL_MIN_SHIFT + 1)
+#define POOL_DEPTH      8			/* max buffers kept per size class */
+#define POOL_CLASS_MAX  (256 * 1024)		/* max bytes kept per size class */
+
+typedef struct {
+	char *buffers[POOL_CLASSES][POOL_DEPTH];
+	guint count[POOL_CLASSES];
+} BufferPool;
+
+static void buffer_pool_free (gpointer data);
+
+static GPrivate buffer_pool = G_PRIVATE_INIT (buffer_pool_free);
+static gsize pool_allocated = 0;
+static gsize pool_reused = 0;
+
 static void g_mime_filter_class_init (GMimeFilterClass *klass);
 static void g_mime_filter_init (GMimeFilter *filter, GMimeFilterClass *klass);
 static void g_mime_filter_finalize (GObject *object);
@@ -63,6 +89,86 @@ static void filter_reset (GMimeFilter *filter);
 static GObjectClass *parent_class = NULL;
 
 
+static void
+buffer_pool_free (gpointer data)
+{
+	BufferPool *pool = data;
+	guint i, j;
+	
+	for (i = 0; i < POOL_CLASSES; i++) {
+		for (j = 0; j < pool->count[i]; j++)
+			g_free (pool->buffers[i][j]);
+	}
+	
+	g_free (pool);
+}
+
+static guint
+buffer_size_class (size_t size)
+{
+	guint shift = POOL_MIN_SHIFT;
+	
+	while (shift <= POOL_MAX_SHIFT && ((size_t) 1 << shift) < size)
+		shift++;
+	
+	return shift - POOL_MIN_SHIFT;
+}
+
+/* allocates a buffer of at least *@size bytes and sets *@size to its real size */
+static char *
+buffer_alloc (size_t *size)
+{
+	guint class = buffer_size_class (*size);
+	BufferPool *pool;
+	
+	if (class < POOL_CLASSES) {
+		*size = (size_t) 1 << (class + POOL_MIN_SHIFT);
+		
+		if ((pool = g_private_get (&buffer_pool)) && pool->count[class] > 0) {
+			g_atomic_pointer_add (&pool_reused, 1);
+			return pool->buffers[class][--pool->count[class]];
+		}
+	}
+	
+	g_atomic_pointer_add (&pool_allocated, 1);
+	
+	return g_malloc (*size);
+}
+
+/* releases a buffer of @size bytes (as returned by buffer_alloc()) back to the pool */
+static void
+buffer_free (char *buffer, size_t size)
+{
+	guint class = buffer_size_class (size);
+	BufferPool *pool;
+	
+	if (buffer == NULL)
+		return;
+	
+	if (class >= POOL_CLASSES || size != ((size_t) 1 << (class + POOL_MIN_SHIFT))) {
+		g_free (buffer);
+		return;
+	}
+	
+	if (!(pool = g_private_get (&buffer_pool))) {
+		pool = g_new0 (BufferPool, 1);
+		g_private_set (&buffer_pool, pool);
+	}
+	
+	if (pool->count[class] < MIN (POOL_DEPTH, POOL_CLASS_MAX / size))
+		pool->buffers[class][pool->count[class]++] = buffer;
+	else
+		g_free (buffer);
+}
+
+void
+g_mime_filter_pool_shutdown (void)
+{
+	/* frees the calling thread's pool */
+	g_private_replace (&buffer_pool, NULL);
+}
+
+
 GType
 g_mime_filter_get_type (void)
 {
@@ -108,6 +214,9 @@ static void
 g_mime_filter_init (GMimeFilter *filter, GMimeFilterClass *klass)
 {
 	filter->priv = g_new0 (struct _GMimeFilterPrivate, 1);
+	filter->priv->inplace = FALSE;
+	filter->priv->writable = FALSE;
+	filter->priv->eod = FALSE;
 	filter->outptr = NULL;
 	filter->outreal = NULL;
 	filter->outbuf = NULL;
@@ -123,10 +232,10 @@ g_mime_filter_finalize (GObject *object)
 {
 	GMimeFilter *filter = (GMimeFilter *) object;
 	
-	g_free (filter->priv->inbuf);
+	buffer_free (filter->priv->inbuf, filter->priv->inlen);
+	buffer_free (filter->outreal, filter->outsize + PRE_HEAD * 4);
+	buffer_free (filter->backbuf, filter->backsize);
 	g_free (filter->priv);
-	g_free (filter->outreal);
-	g_free (filter->backbuf);
 	
 	G_OBJECT_CLASS (parent_class)->finalize (object);
 }
@@ -158,28 +267,30 @@ g_mime_filter_copy (GMimeFilter *filter)
 
 static void
 filter_run (GMimeFilter *filter, char *inbuf, size_t inlen, size_t prespace,
-	    char **outbuf, size_t *outlen, size_t *outprespace,
+	    char **outbuf, size_t *outlen, size_t *outprespace, gboolean writable,
 	    void (*filterfunc) (GMimeFilter *filter,
 				char *inbuf, size_t inlen, size_t prespace,
 				char **outbuf, size_t *outlen, size_t *outprespace))
 {
+	struct _GMimeFilterPrivate *p = _PRIVATE (filter);
+	
 	/* here we take a performance hit, if the input buffer doesn't
 	   have the pre-space required.  We make a buffer that does... */
 	if (prespace < filter->backlen) {
-		struct _GMimeFilterPrivate *p = _PRIVATE (filter);
 		size_t newlen = inlen + prespace + filter->backlen;
 		
 		if (p->inlen < newlen) {
 			/* NOTE: g_realloc copies data, we don't need that (slower) */
-			g_free (p->inbuf);
-			p->inbuf = g_malloc (newlen + PRE_HEAD);
+			buffer_free (p->inbuf, p->inlen);
 			p->inlen = newlen + PRE_HEAD;
+			p->inbuf = buffer_alloc (&p->inlen);
 		}
 		
 		/* copy to end of structure */
 		memcpy (p->inbuf + p->inlen - inlen, inbuf, inlen);
 		inbuf = p->inbuf + p->inlen - inlen;
 		prespace = p->inlen - inlen;
+		writable = TRUE;
 	}
 	
 	/* preload any backed up data */
@@ -191,7 +302,44 @@ filter_run (GMimeFilter *filter, char *inbuf, size_t inlen, size_t prespace,
 		filter->backlen = 0;
 	}
 	
+	p->writable = writable;
 	filterfunc (filter, inbuf, inlen, prespace, outbuf, outlen, outprespace);
+	p->writable = FALSE;
+}
+
+void
+_g_mime_filter_run (GMimeFilter *filter, char *inbuf, size_t inlen, size_t prespace,
+		    char **outbuf, size_t *outlen, size_t *outprespace,
+		    gboolean writable, gboolean complete)
+{
+	GMimeFilterClass *klass = GMIME_FILTER_GET_CLASS (filter);
+	
+	filter_run (filter, inbuf, inlen, prespace, outbuf, outlen, outprespace, writable,
+		    complete ? klass->complete : klass->filter);
+}
+
+void
+_g_mime_filter_set_inplace (GMimeFilter *filter, gboolean inplace)
+{
+	filter->priv->inplace = inplace;
+}
+
+gboolean
+_g_mime_filter_can_filter_inplace (GMimeFilter *filter)
+{
+	return filter->priv->inplace && filter->priv->writable;
+}
+
+void
+_g_mime_filter_set_eod (GMimeFilter *filter)
+{
+	filter->priv->eod = TRUE;
+}
+
+gboolean
+_g_mime_filter_get_eod (GMimeFilter *filter)
+{
+	return filter->priv->eod;
 }
 
 
@@ -222,7 +370,7 @@ g_mime_filter_filter (GMimeFilter *filter, char *inbuf, size_t inlen, size_t pre
 {
 	g_return_if_fail (GMIME_IS_FILTER (filter));
 	
-	filter_run (filter, inbuf, inlen, prespace, outbuf, outlen, outprespace,
+	filter_run (filter, inbuf, inlen, prespace, outbuf, outlen, outprespace, FALSE,
 		    GMIME_FILTER_GET_CLASS (filter)->filter);
 }
 
@@ -255,7 +403,7 @@ g_mime_filter_complete (GMimeFilter *filter,
 {
 	g_return_if_fail (GMIME_IS_FILTER (filter));
 	
-	filter_run (filter, inbuf, inlen, prespace, outbuf, outlen, outprespace,
+	filter_run (filter, inbuf, inlen, prespace, outbuf, outlen, outprespace, FALSE,
 		    GMIME_FILTER_GET_CLASS (filter)->complete);
 }
 
@@ -279,6 +427,7 @@ g_mime_filter_reset (GMimeFilter *filter)
 	g_return_if_fail (GMIME_IS_FILTER (filter));
 	
 	GMIME_FILTER_GET_CLASS (filter)->reset (filter);
+	filter->priv->eod = FALSE;
 	
 	/* could free some buffers, if they are really big? */
 	filter->backlen = 0;
@@ -301,9 +450,9 @@ g_mime_filter_backup (GMimeFilter *filter, const char *data, size_t length)
 	
 	if (!filter->backbuf || filter->backsize < length) {
 		/* g_realloc copies data, unnecessary overhead */
-		g_free (filter->backbuf);
-		filter->backbuf = g_malloc (length + BACK_HEAD);
+		buffer_free (filter->backbuf, filter->backsize);
 		filter->backsize = length + BACK_HEAD;
+		filter->backbuf = buffer_alloc (&filter->backsize);
 	}
 	
 	filter->backlen = length;
@@ -326,17 +475,20 @@ g_mime_filter_set_size (GMimeFilter *filter, size_t size, gboolean keep)
 	
 	if (!filter->outreal || filter->outsize < size) {
 		size_t offset = filter->outptr - filter->outreal;
+		size_t real = size + PRE_HEAD * 4;
+		char *outreal;
 		
-		if (keep) {
-			filter->outreal = g_realloc (filter->outreal, size + PRE_HEAD * 4);
-		} else {
-			g_free (filter->outreal);
-			filter->outreal = g_malloc (size + PRE_HEAD * 4);
-		}
+		outreal = buffer_alloc (&real);
+		
+		if (keep && filter->outreal)
+			memcpy (outreal, filter->outreal, filter->outsize + PRE_HEAD * 4);
+		
+		buffer_free (filter->outreal, filter->outsize + PRE_HEAD * 4);
 		
+		filter->outreal = outreal;
 		filter->outptr = filter->outreal + offset;
 		filter->outbuf = filter->outreal + PRE_HEAD * 4;
-		filter->outsize = size;
+		filter->outsize = real - PRE_HEAD * 4;
 		
 		/* this could be offset from the end of the structure, but 
 		   this should be good enough */
@@ -344,3 +496,24 @@ g_mime_filter_set_size (GMimeFilter *filter, size_t size, gboolean keep)
 		filter->outpre = PRE_HEAD * 4;
 	}
 }
+
+
+/**
+ * g_mime_filter_get_pool_stats:
+ * @allocated: (out) (optional): number of filter buffers allocated from the heap
+ * @reused: (out) (optional): number of filter buffers reused from the pool
+ *
+ * Gets the number of times, since the library was loaded, that a
+ * filter needed an output, backup or input buffer and either had to
+ * allocate one or could reuse one released by an earlier filter on the
+ * same thread.
+ **/
+void
+g_mime_filter_get_pool_stats (guint64 *allocated, guint64 *reused)
+{
+	if (allocated)
+		*allocated = (guint64) g_atomic_pointer_get (&pool_allocated);
+	
+	if (reused)
+		*reused = (guint64) g_atomic_pointer_get (&pool_reused);
+}
@@ -100,6 +100,8 @@ void g_mime_filter_backup (GMimeFilter *filter, const char *data, size_t length)
 /* ensure this much size available for filter output */
 void g_mime_filter_set_size (GMimeFilter *filter, size_t size, gboolean keep);
 
+void g_mime_filter_get_pool_stats (guint64 *allocated, guint64 *reused);
+
 G_END_DECLS
 
 #endif /* __GMIME_FILTER_H__ */
@@ -29,6 +29,7 @@
 
 #include "gmime-iconv-utils.h"
 #include "gmime-charset.h"
+#include "gmime-internal.h"
 
 #ifdef ENABLE_WARNINGS
 #define w(x) x
@@ -47,22 +48,9 @@
  **/
 
 
-/**
- * g_mime_iconv_strndup: (skip)
- * @cd: conversion descriptor
- * @str: string in source charset
- * @n: number of bytes to convert
- *
- * Allocates a new string buffer containing the first @n bytes of @str
- * converted to the destination charset as described by the conversion
- * descriptor @cd.
- *
- * Returns: a new string buffer containing the first @n bytes of
- * @str converted to the destination charset as described by the
- * conversion descriptor @cd.
- **/
+/* converts along @path, if it is not %NULL, without the help of @cd */
 char *
-g_mime_iconv_strndup (iconv_t cd, const char *str, size_t n)
+_g_mime_iconv_strndup (iconv_t cd, const GMimeIconvPath *path, const char *str, size_t n)
 {
 	size_t inleft, outleft, converted = 0;
 	char *out, *outbuf;
@@ -70,7 +58,7 @@ g_mime_iconv_strndup (iconv_t cd, const char *str, size_t n)
 	size_t outlen;
 	int errnosav;
 	
-	if (cd == (iconv_t) -1)
+	if (path == NULL && cd == (iconv_t) -1)
 		return g_strndup (str, n);
 	
 	outlen = n * 2 + 16;
@@ -84,7 +72,7 @@ g_mime_iconv_strndup (iconv_t cd, const char *str, size_t n)
 		outbuf = out + converted;
 		outleft = outlen - converted;
 		
-		converted = iconv (cd, (char **) &inbuf, &inleft, &outbuf, &outleft);
+		converted = _g_mime_iconv_convert (cd, path, (char **) &inbuf, &inleft, &outbuf, &outleft);
 		if (converted != (size_t) -1 || errno == EINVAL) {
 			/*
 			 * EINVAL  An  incomplete  multibyte sequence has been encoun-
@@ -104,7 +92,7 @@ g_mime_iconv_strndup (iconv_t cd, const char *str, size_t n)
 			g_free (out);
 			
 			/* reset the cd */
-			iconv (cd, NULL, NULL, NULL, NULL);
+			_g_mime_iconv_convert (cd, path, NULL, NULL, NULL, NULL);
 			
 			errno = errnosav;
 			
@@ -124,7 +112,7 @@ g_mime_iconv_strndup (iconv_t cd, const char *str, size_t n)
 	} while (TRUE);
 	
 	/* flush the iconv conversion */
-	while (iconv (cd, NULL, NULL, &outbuf, &outleft) == (size_t) -1) {
+	while (_g_mime_iconv_convert (cd, path, NULL, NULL, &outbuf, &outleft) == (size_t) -1) {
 		if (errno != E2BIG)
 			break;
 		
@@ -144,12 +132,33 @@ g_mime_iconv_strndup (iconv_t cd, const char *str, size_t n)
 	memset (outbuf, 0, 4);
 	
 	/* reset the cd */
-	iconv (cd, NULL, NULL, NULL, NULL);
+	_g_mime_iconv_convert (cd, path, NULL, NULL, NULL, NULL);
 	
 	return out;
 }
 
 
+/**
+ * g_mime_iconv_strndup: (skip)
+ * @cd: conversion descriptor
+ * @str: string in source charset
+ * @n: number of bytes to convert
+ *
+ * Allocates a new string buffer containing the first @n bytes of @str
+ * converted to the destination charset as described by the conversion
+ * descriptor @cd.
+ *
+ * Returns: a new string buffer containing the first @n bytes of
+ * @str converted to the destination charset as described by the
+ * conversion descriptor @cd.
+ **/
+char *
+g_mime_iconv_strndup (iconv_t cd, const char *str, size_t n)
+{
+	return _g_mime_iconv_strndup (cd, NULL, str, n);
+}
+
+
 /**
  * g_mime_iconv_strdup: (skip)
  * @cd: conversion descriptor
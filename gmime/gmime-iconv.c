@@ -24,10 +24,13 @@
 #endif
 
 #include <glib.h>
+#include <string.h>
 #include <errno.h>
 
 #include "gmime-charset.h"
 #include "gmime-iconv.h"
+#include "gmime-internal.h"
+#include "gmime-simd.h"
 
 
 /**
@@ -39,9 +42,162 @@
  * These functions are wrappers around the system iconv(3) routines. The
  * purpose of this wrapper is to use the appropriate system charset alias for
  * the MIME charset names given as arguments.
+ *
+ * Opening a conversion descriptor is expensive on most systems, so
+ * descriptors closed with g_mime_iconv_close() are reset and kept in a
+ * small cache from which g_mime_iconv_open() can hand them out again.
+ * The cache is thread-safe and each thread keeps a few descriptors of
+ * its own so that reusing them does not require taking a lock.
  **/
 
 
+#define ICONV_CACHE_SIZE   32	/* max idle descriptors kept in the shared cache */
+#define ICONV_THREAD_IDLE  4	/* max idle descriptors stashed by each thread */
+#define ICONV_THREAD_BUSY  16	/* max checked out descriptors tracked by each thread */
+
+typedef struct _IconvNode {
+	struct _IconvNode *next;	/* next node in the free list */
+	GList link;			/* link in the shared lru queue */
+	char *to, *from;
+	iconv_t cd;
+	gpointer owner;			/* thread cache that checked the descriptor out */
+	guint serial;			/* incremented every time the descriptor is checked out */
+} IconvNode;
+
+typedef struct {
+	IconvNode *node;
+	guint serial;
+} IconvCheckout;
+
+typedef struct {
+	IconvNode *idle[ICONV_THREAD_IDLE];	/* most recently used first */
+	guint nidle;
+	IconvCheckout busy[ICONV_THREAD_BUSY];
+	guint nbusy;
+} IconvThreadCache;
+
+static void thread_cache_free (gpointer data);
+
+static GPrivate thread_cache = G_PRIVATE_INIT (thread_cache_free);
+static GMutex cache_lock;
+
+/* Every descriptor that we opened is mapped to its node so that it can
+ * be returned to the cache from any thread. Nodes are recycled rather
+ * than freed which makes it safe to check whether a thread's record of
+ * a checked out descriptor has gone stale. */
+static GHashTable *descriptors = NULL;
+static GQueue lru = G_QUEUE_INIT;
+static IconvNode *free_nodes = NULL;
+
+static gsize cache_hits = 0;
+static gsize cache_misses = 0;
+
+
+/* must be called with the cache lock held */
+static void
+node_release (IconvNode *node)
+{
+	g_free (node->from);
+	g_free (node->to);
+	node->from = node->to = NULL;
+	g_atomic_pointer_set (&node->cd, (iconv_t) -1);
+	
+	node->next = free_nodes;
+	free_nodes = node;
+}
+
+/* must be called with the cache lock held */
+static void
+cache_add (IconvNode *node)
+{
+	IconvNode *evicted;
+	
+	if (descriptors == NULL) {
+		/* the cache has been shut down */
+		iconv_close (node->cd);
+		node_release (node);
+		return;
+	}
+	
+	g_queue_push_head_link (&lru, &node->link);
+	
+	while (lru.length > ICONV_CACHE_SIZE) {
+		evicted = g_queue_pop_tail_link (&lru)->data;
+		g_hash_table_remove (descriptors, evicted->cd);
+		iconv_close (evicted->cd);
+		node_release (evicted);
+	}
+}
+
+static gboolean
+checkout_valid (IconvThreadCache *tc, IconvCheckout *checkout)
+{
+	IconvNode *node = checkout->node;
+	
+	return g_atomic_pointer_get (&node->owner) == tc &&
+		(guint) g_atomic_int_get (&node->serial) == checkout->serial;
+}
+
+static void
+thread_cache_purge (IconvThreadCache *tc)
+{
+	guint i, n = 0;
+	
+	/* forget about descriptors that were closed by other threads */
+	for (i = 0; i < tc->nbusy; i++) {
+		if (checkout_valid (tc, &tc->busy[i]))
+			tc->busy[n++] = tc->busy[i];
+	}
+	
+	if (n == ICONV_THREAD_BUSY) {
+		/* too many open descriptors: stop tracking the oldest one,
+		 * closing it will simply take the slow path */
+		memmove (tc->busy, tc->busy + 1, (n - 1) * sizeof (IconvCheckout));
+		n--;
+	}
+	
+	tc->nbusy = n;
+}
+
+static void
+thread_cache_free (gpointer data)
+{
+	IconvThreadCache *tc = data;
+	guint i;
+	
+	for (i = 0; i < tc->nbusy; i++) {
+		if (checkout_valid (tc, &tc->busy[i]))
+			g_atomic_pointer_compare_and_exchange (&tc->busy[i].node->owner, tc, NULL);
+	}
+	
+	g_mutex_lock (&cache_lock);
+	for (i = tc->nidle; i > 0; i--)
+		cache_add (tc->idle[i - 1]);
+	g_mutex_unlock (&cache_lock);
+	
+	g_free (tc);
+}
+
+static IconvThreadCache *
+thread_cache_get (void)
+{
+	IconvThreadCache *tc;
+	
+	if (!(tc = g_private_get (&thread_cache))) {
+		tc = g_new0 (IconvThreadCache, 1);
+		g_private_set (&thread_cache, tc);
+	}
+	
+	return tc;
+}
+
+static gboolean
+node_matches (IconvNode *node, const char *to, const char *from)
+{
+	return !strcmp (node->to, to) && !strcmp (node->from, from);
+}
+
+
 /**
  * g_mime_iconv_open: (skip)
  * @to: charset to convert to
@@ -52,6 +208,9 @@
  * descriptor can be used with iconv() (or the g_mime_iconv() wrapper) any
  * number of times until closed using g_mime_iconv_close().
  *
+ * If a descriptor for the same conversion was recently closed, it is
+ * reused (in its initial state) instead of opening a new one.
+ *
  * See the manual page for iconv_open(3) for further details.
  *
  * Returns: a new conversion descriptor for use with g_mime_iconv() on
@@ -61,6 +220,12 @@
 iconv_t
 g_mime_iconv_open (const char *to, const char *from)
 {
+	IconvThreadCache *tc;
+	IconvNode *node = NULL;
+	GList *link;
+	iconv_t cd;
+	guint i;
+	
 	if (from == NULL || to == NULL) {
 		errno = EINVAL;
 		return (iconv_t) -1;
@@ -72,7 +237,68 @@ g_mime_iconv_open (const char *to, const char *from)
 	from = g_mime_charset_iconv_name (from);
 	to = g_mime_charset_iconv_name (to);
 	
-	return iconv_open (to, from);
+	tc = thread_cache_get ();
+	
+	/* first try the descriptors stashed away by this thread... */
+	for (i = 0; i < tc->nidle; i++) {
+		if (node_matches (tc->idle[i], to, from)) {
+			node = tc->idle[i];
+			tc->nidle--;
+			memmove (tc->idle + i, tc->idle + i + 1, (tc->nidle - i) * sizeof (IconvNode *));
+			break;
+		}
+	}
+	
+	/* ...then the shared cache */
+	if (node == NULL) {
+		g_mutex_lock (&cache_lock);
+		for (link = lru.head; link != NULL; link = link->next) {
+			if (node_matches (link->data, to, from)) {
+				node = link->data;
+				g_queue_unlink (&lru, link);
+				break;
+			}
+		}
+		g_mutex_unlock (&cache_lock);
+	}
+	
+	if (node != NULL) {
+		g_atomic_pointer_add (&cache_hits, 1);
+	} else {
+		if ((cd = iconv_open (to, from)) == (iconv_t) -1)
+			return cd;
+		
+		g_atomic_pointer_add (&cache_misses, 1);
+		
+		g_mutex_lock (&cache_lock);
+		if (descriptors == NULL)
+			descriptors = g_hash_table_new (g_direct_hash, g_direct_equal);
+		
+		if ((node = free_nodes) != NULL)
+			free_nodes = node->next;
+		else
+			node = g_new0 (IconvNode, 1);
+		
+		node->link.data = node;
+		node->from = g_strdup (from);
+		node->to = g_strdup (to);
+		g_atomic_pointer_set (&node->cd, cd);
+		
+		g_hash_table_insert (descriptors, cd, node);
+		g_mutex_unlock (&cache_lock);
+	}
+	
+	/* check the descriptor out to this thread so that closing it
+	 * won't need to take the lock */
+	if (tc->nbusy == ICONV_THREAD_BUSY)
+		thread_cache_purge (tc);
+	
+	tc->busy[tc->nbusy].serial = (guint) g_atomic_int_add (&node->serial, 1) + 1;
+	tc->busy[tc->nbusy].node = node;
+	g_atomic_pointer_set (&node->owner, tc);
+	tc->nbusy++;
+	
+	return node->cd;
 }
 
 
@@ -80,7 +306,9 @@ g_mime_iconv_open (const char *to, const char *from)
  * g_mime_iconv_close: (skip)
  * @cd: iconv conversion descriptor
  *
- * Closes the iconv descriptor @cd.
+ * Closes the iconv descriptor @cd. Descriptors opened with
+ * g_mime_iconv_open() are reset to their initial state and returned
+ * to the cache rather than being freed.
  *
  * See the manual page for iconv_close(3) for further details.
  *
@@ -90,5 +318,364 @@ g_mime_iconv_open (const char *to, const char *from)
 int
 g_mime_iconv_close (iconv_t cd)
 {
-	return iconv_close (cd);
+	IconvCheckout *checkout;
+	IconvThreadCache *tc;
+	IconvNode *node = NULL;
+	guint i;
+	
+	if (cd == (iconv_t) -1) {
+		errno = EBADF;
+		return -1;
+	}
+	
+	tc = thread_cache_get ();
+	
+	for (i = tc->nbusy; i > 0; i--) {
+		checkout = &tc->busy[i - 1];
+		
+		/* the descriptor must be read before checking that the
+		 * node is still ours, it may get recycled by another
+		 * thread as soon as that is no longer the case */
+		if (g_atomic_pointer_get (&checkout->node->cd) == cd && checkout_valid (tc, checkout)) {
+			node = checkout->node;
+			tc->nbusy--;
+			memmove (tc->busy + i - 1, tc->busy + i, (tc->nbusy - (i - 1)) * sizeof (IconvCheckout));
+			break;
+		}
+	}
+	
+	if (node == NULL) {
+		/* opened by another thread, or not by us at all */
+		g_mutex_lock (&cache_lock);
+		if (descriptors != NULL)
+			node = g_hash_table_lookup (descriptors, cd);
+		g_mutex_unlock (&cache_lock);
+		
+		if (node == NULL)
+			return iconv_close (cd);
+	}
+	
+	iconv (cd, NULL, NULL, NULL, NULL);
+	g_atomic_pointer_set (&node->owner, NULL);
+	
+	if (tc->nidle == ICONV_THREAD_IDLE) {
+		/* make room by moving the least recently used descriptor
+		 * over to the shared cache */
+		tc->nidle--;
+		
+		g_mutex_lock (&cache_lock);
+		cache_add (tc->idle[tc->nidle]);
+		g_mutex_unlock (&cache_lock);
+	}
+	
+	memmove (tc->idle + 1, tc->idle, tc->nidle * sizeof (IconvNode *));
+	tc->idle[0] = node;
+	tc->nidle++;
+	
+	return 0;
+}
+
+
+/**
+ * g_mime_iconv_get_cache_stats:
+ * @hits: (out) (optional): number of descriptors reused from the cache
+ * @misses: (out) (optional): number of descriptors opened with iconv_open()
+ *
+ * Gets the number of times, since the library was loaded, that
+ * g_mime_iconv_open() was able to hand out a cached conversion
+ * descriptor and the number of times it had to open a new one.
+ **/
+void
+g_mime_iconv_get_cache_stats (guint64 *hits, guint64 *misses)
+{
+	if (hits)
+		*hits = (guint64) g_atomic_pointer_get (&cache_hits);
+	
+	if (misses)
+		*misses = (guint64) g_atomic_pointer_get (&cache_misses);
+}
+
+
+/* Closes every idle descriptor in the cache (including those stashed
+ * by the calling thread). Descriptors that are still checked out are
+ * simply closed by g_mime_iconv_close() from now on. */
+void
+g_mime_iconv_cache_shutdown (void)
+{
+	IconvNode *node;
+	GHashTable *table;
+	GList *link;
+	
+	g_private_replace (&thread_cache, NULL);
+	
+	g_mutex_lock (&cache_lock);
+	table = descriptors;
+	descriptors = NULL;
+	
+	while ((link = g_queue_pop_head_link (&lru)) != NULL) {
+		node = link->data;
+		iconv_close (node->cd);
+		node_release (node);
+	}
+	g_mutex_unlock (&cache_lock);
+	
+	if (table != NULL)
+		g_hash_table_destroy (table);
+}
+
+
+/* a conversion to UTF-8 which GMime can do without the help of
+ * iconv(3): well-formed UTF-8 is validated and copied, 8bit charsets
+ * are mapped through a table of code points and UTF-16 is decoded
+ * algorithmically */
+struct _GMimeIconvPath {
+	const char *charset;
+	const unsigned short *table;
+};
+
+#include "gmime-charset-table-private.h"
+
+static const GMimeIconvPath utf8_path = { "utf-8", NULL };
+static const GMimeIconvPath utf16le_path = { "utf-16le", NULL };
+static const GMimeIconvPath utf16be_path = { "utf-16be", NULL };
+
+
+/* returns the native converter for a conversion from @from to @to or
+ * %NULL if the conversion must be done by iconv(3) */
+const GMimeIconvPath *
+_g_mime_iconv_get_path (const char *to, const char *from)
+{
+	guint i;
+	
+	if (from == NULL || to == NULL)
+		return NULL;
+	
+	if (!g_ascii_strcasecmp (from, "x-unknown"))
+		from = g_mime_locale_charset ();
+	
+	if (g_ascii_strcasecmp (g_mime_charset_canon_name (to), "utf-8") != 0)
+		return NULL;
+	
+	from = g_mime_charset_canon_name (from);
+	
+	if (!g_ascii_strcasecmp (from, "utf-8"))
+		return &utf8_path;
+	
+	if (!g_ascii_strcasecmp (from, "utf-16le"))
+		return &utf16le_path;
+	
+	if (!g_ascii_strcasecmp (from, "utf-16be"))
+		return &utf16be_path;
+	
+	for (i = 0; i < G_N_ELEMENTS (charset_tables); i++) {
+		if (!g_ascii_strcasecmp (from, charset_tables[i].charset))
+			return &charset_tables[i];
+	}
+	
+	return NULL;
+}
+
+
+/* checks whether converting @inlen bytes of @inbuf along @path would
+ * simply copy them */
+gboolean
+_g_mime_iconv_is_identity (const GMimeIconvPath *path, const char *inbuf, size_t inlen)
+{
+	if (path == &utf8_path)
+		return g_mime_simd_utf8_span ((const unsigned char *) inbuf, inlen) == inlen;
+	
+	if (path != NULL && path->table != NULL)
+		return g_mime_simd_ascii_span ((const unsigned char *) inbuf, inlen) == inlen;
+	
+	return FALSE;
+}
+
+static size_t
+utf8_convert (char **inbuf, size_t *inleft, char **outbuf, size_t *outleft)
+{
+	const unsigned char *inptr = (const unsigned char *) *inbuf;
+	size_t n;
+	
+	/* copy as much well-formed UTF-8 as will fit */
+	n = g_mime_simd_utf8_span (inptr, MIN (*inleft, *outleft));
+	memcpy (*outbuf, *inbuf, n);
+	*outleft -= n;
+	*outbuf += n;
+	*inleft -= n;
+	*inbuf += n;
+	inptr += n;
+	
+	if (*inleft == 0)
+		return 0;
+	
+	/* figure out why we stopped in the same terms iconv(3) would */
+	if (g_mime_simd_utf8_span (inptr, MIN (*inleft, 4)) > 0)
+		errno = E2BIG;
+	else if (g_mime_simd_utf8_incomplete (inptr, *inleft))
+		errno = EINVAL;
+	else
+		errno = EILSEQ;
+	
+	return (size_t) -1;
+}
+
+static inline size_t
+utf8_encode (gunichar c, unsigned char *outptr)
+{
+	if (c < 0x80) {
+		outptr[0] = c;
+		return 1;
+	}
+	
+	if (c < 0x800) {
+		outptr[0] = 0xc0 | (c >> 6);
+		outptr[1] = 0x80 | (c & 0x3f);
+		return 2;
+	}
+	
+	if (c < 0x10000) {
+		outptr[0] = 0xe0 | (c >> 12);
+		outptr[1] = 0x80 | ((c >> 6) & 0x3f);
+		outptr[2] = 0x80 | (c & 0x3f);
+		return 3;
+	}
+	
+	outptr[0] = 0xf0 | (c >> 18);
+	outptr[1] = 0x80 | ((c >> 12) & 0x3f);
+	outptr[2] = 0x80 | ((c >> 6) & 0x3f);
+	outptr[3] = 0x80 | (c & 0x3f);
+	
+	return 4;
+}
+
+#define utf8_length(c) ((c) < 0x80 ? 1 : (c) < 0x800 ? 2 : (c) < 0x10000 ? 3 : 4)
+
+static size_t
+table_convert (const unsigned short *table, char **inbuf, size_t *inleft, char **outbuf, size_t *outleft)
+{
+	const unsigned char *inptr = (const unsigned char *) *inbuf;
+	const unsigned char *inend = inptr + *inleft;
+	unsigned char *outptr = (unsigned char *) *outbuf;
+	unsigned char *outend = outptr + *outleft;
+	gunichar c;
+	size_t n;
+	
+	errno = 0;
+	
+	while (inptr < inend) {
+		if (*inptr < 0x80) {
+			/* US-ASCII is the same in UTF-8, so copy it through */
+			if (outptr == outend) {
+				errno = E2BIG;
+				break;
+			}
+			
+			n = g_mime_simd_ascii_span (inptr, MIN ((size_t) (inend - inptr), (size_t) (outend - outptr)));
+			memcpy (outptr, inptr, n);
+			outptr += n;
+			inptr += n;
+			continue;
+		}
+		
+		if ((c = table[*inptr - 0x80]) == 0) {
+			errno = EILSEQ;
+			break;
+		}
+		
+		if ((size_t) (outend - outptr) < utf8_length (c)) {
+			errno = E2BIG;
+			break;
+		}
+		
+		outptr += utf8_encode (c, outptr);
+		inptr++;
+	}
+	
+	*outleft = outend - outptr;
+	*outbuf = (char *) outptr;
+	*inleft = inend - inptr;
+	*inbuf = (char *) inptr;
+	
+	return errno ? (size_t) -1 : 0;
+}
+
+static size_t
+utf16_convert (gboolean big_endian, char **inbuf, size_t *inleft, char **outbuf, size_t *outleft)
+{
+	const unsigned char *inptr = (const unsigned char *) *inbuf;
+	const unsigned char *inend = inptr + *inleft;
+	unsigned char *outptr = (unsigned char *) *outbuf;
+	unsigned char *outend = outptr + *outleft;
+	int hi = big_endian ? 0 : 1;
+	gunichar c, c2;
+	size_t n;
+	
+	errno = 0;
+	
+	while (inend - inptr >= 2) {
+		c = (inptr[hi] << 8) | inptr[1 - hi];
+		n = 2;
+		
+		if (c >= 0xd800 && c < 0xdc00) {
+			/* a high surrogate must be followed by a low surrogate */
+			if (inend - inptr < 4) {
+				errno = EINVAL;
+				break;
+			}
+			
+			c2 = (inptr[2 + hi] << 8) | inptr[3 - hi];
+			if (c2 < 0xdc00 || c2 >= 0xe000) {
+				errno = EILSEQ;
+				break;
+			}
+			
+			c = 0x10000 + ((c - 0xd800) << 10) + (c2 - 0xdc00);
+			n = 4;
+		} else if (c >= 0xdc00 && c < 0xe000) {
+			errno = EILSEQ;
+			break;
+		}
+		
+		if ((size_t) (outend - outptr) < utf8_length (c)) {
+			errno = E2BIG;
+			break;
+		}
+		
+		outptr += utf8_encode (c, outptr);
+		inptr += n;
+	}
+	
+	if (errno == 0 && inptr < inend)
+		errno = EINVAL;
+	
+	*outleft = outend - outptr;
+	*outbuf = (char *) outptr;
+	*inleft = inend - inptr;
+	*inbuf = (char *) inptr;
+	
+	return errno ? (size_t) -1 : 0;
+}
+
+
+/* a drop-in replacement for iconv(3) which converts along @path
+ * without calling iconv(3) at all unless @path is %NULL, in which
+ * case @cd is used; errors are reported exactly as iconv(3) would.
+ * @cd may be (iconv_t) -1 if @path is not %NULL. */
+size_t
+_g_mime_iconv_convert (iconv_t cd, const GMimeIconvPath *path, char **inbuf, size_t *inleft, char **outbuf, size_t *outleft)
+{
+	if (path == NULL)
+		return iconv (cd, inbuf, inleft, outbuf, outleft);
+	
+	/* none of the native converters have any shift state to flush or reset */
+	if (inbuf == NULL || *inbuf == NULL)
+		return 0;
+	
+	if (path->table != NULL)
+		return table_convert (path->table, inbuf, inleft, outbuf, outleft);
+	
+	if (path == &utf16le_path || path == &utf16be_path)
+		return utf16_convert (path == &utf16be_path, inbuf, inleft, outbuf, outleft);
+	
+	return utf8_convert (inbuf, inleft, outbuf, outleft);
 }
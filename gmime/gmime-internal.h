@@ -27,6 +27,8 @@
 #include <gmime/gmime-object.h>
 #include <gmime/gmime-events.h>
 #include <gmime/gmime-utils.h>
+#include <gmime/gmime-filter.h>
+#include <gmime/gmime-iconv.h>
 
 G_BEGIN_DECLS
 
@@ -53,6 +55,25 @@ G_GNUC_INTERNAL void g_mime_parser_options_init (void);
 G_GNUC_INTERNAL void g_mime_parser_options_shutdown (void);
 G_GNUC_INTERNAL void _g_mime_parser_options_warn (GMimeParserOptions *options, gint64 offset, GMimeParserWarning errcode,
 						  const gchar *item);
+G_GNUC_INTERNAL GMimeStream *_g_mime_parser_options_create_stream (GMimeParserOptions *options);
+
+/* GMimeStream */
+typedef struct {
+	void     (* read_async)   (GMimeStream *stream, char *buf, size_t len, int io_priority,
+				   GCancellable *cancellable, GAsyncReadyCallback callback, gpointer user_data);
+	ssize_t  (* read_finish)  (GMimeStream *stream, GAsyncResult *result, GError **err);
+	void     (* write_async)  (GMimeStream *stream, const char *buf, size_t len, int io_priority,
+				   GCancellable *cancellable, GAsyncReadyCallback callback, gpointer user_data);
+	ssize_t  (* write_finish) (GMimeStream *stream, GAsyncResult *result, GError **err);
+	void     (* flush_async)  (GMimeStream *stream, int io_priority, GCancellable *cancellable,
+				   GAsyncReadyCallback callback, gpointer user_data);
+	int      (* flush_finish) (GMimeStream *stream, GAsyncResult *result, GError **err);
+	void     (* close_async)  (GMimeStream *stream, int io_priority, GCancellable *cancellable,
+				   GAsyncReadyCallback callback, gpointer user_data);
+	int      (* close_finish) (GMimeStream *stream, GAsyncResult *result, GError **err);
+} GMimeStreamAsyncMethods;
+
+G_GNUC_INTERNAL GMimeStreamAsyncMethods *_g_mime_stream_class_get_async_methods (GMimeStreamClass *klass);
 
 /* GMimeHeader */
 //G_GNUC_INTERNAL void _g_mime_header_set_raw_value (GMimeHeader *header, const char *raw_value);
@@ -92,6 +113,27 @@ G_GNUC_INTERNAL char *_g_mime_utils_header_decode_text (GMimeParserOptions *opti
 G_GNUC_INTERNAL char *_g_mime_utils_header_decode_phrase (GMimeParserOptions *options, const char *text, const char **charset,
 							  gint64 offset);
 
+/* GMimeFilter */
+G_GNUC_INTERNAL void g_mime_filter_pool_shutdown (void);
+G_GNUC_INTERNAL void _g_mime_filter_set_inplace (GMimeFilter *filter, gboolean inplace);
+G_GNUC_INTERNAL gboolean _g_mime_filter_can_filter_inplace (GMimeFilter *filter);
+G_GNUC_INTERNAL void _g_mime_filter_set_eod (GMimeFilter *filter);
+G_GNUC_INTERNAL gboolean _g_mime_filter_get_eod (GMimeFilter *filter);
+G_GNUC_INTERNAL void _g_mime_filter_run (GMimeFilter *filter, char *inbuf, size_t inlen, size_t prespace,
+					 char **outbuf, size_t *outlen, size_t *outprespace,
+					 gboolean writable, gboolean complete);
+
+/* GMimeIconv */
+typedef struct _GMimeIconvPath GMimeIconvPath;
+
+G_GNUC_INTERNAL void g_mime_iconv_cache_shutdown (void);
+
+G_GNUC_INTERNAL const GMimeIconvPath *_g_mime_iconv_get_path (const char *to, const char *from);
+G_GNUC_INTERNAL gboolean _g_mime_iconv_is_identity (const GMimeIconvPath *path, const char *inbuf, size_t inlen);
+G_GNUC_INTERNAL size_t _g_mime_iconv_convert (iconv_t cd, const GMimeIconvPath *path, char **inbuf, size_t *inleft,
+					      char **outbuf, size_t *outleft);
+G_GNUC_INTERNAL char *_g_mime_iconv_strndup (iconv_t cd, const GMimeIconvPath *path, const char *str, size_t n);
+
 /* InternetAddressList */
 G_GNUC_INTERNAL InternetAddressList *_internet_address_list_parse (GMimeParserOptions *options, const char *str, gint64 offset);
 G_GNUC_INTERNAL void _internet_address_list_append_parse (InternetAddressList *list, GMimeParserOptions *options, const char *str, gint64 offset);
@@ -32,6 +32,10 @@
 #include "gmime-multipart-signed.h"
 #include "gmime-multipart-encrypted.h"
 #include "gmime-part.h"
+#include "gmime-message-part.h"
+#include "gmime-filter-basic.h"
+#include "gmime-filter-charset.h"
+#include "gmime-filter-html2text.h"
 #include "gmime-utils.h"
 #include "gmime-common.h"
 #include "gmime-stream-mem.h"
@@ -1221,6 +1225,366 @@ g_mime_message_get_body (GMimeMessage *message)
 }
 
 
+enum {
+	STRIP_TEXT,
+	STRIP_LT,
+	STRIP_TAG
+};
+
+typedef struct {
+	GMimeTextExtractFunc callback;
+	gpointer user_data;
+	gint64 nwritten;
+	gint64 max_len;
+	gboolean error;
+	char buffer[4096];
+} TextExtractor;
+
+/* removes the text/enriched commands from @text in place and returns the new length */
+static size_t
+strip_enriched (int *state, char *text, size_t len)
+{
+	char *inptr = text, *inend = text + len;
+	char *outptr = text;
+	char *tag;
+	size_t n;
+	
+	while (inptr < inend) {
+		switch (*state) {
+		case STRIP_TEXT:
+			if ((tag = memchr (inptr, '<', inend - inptr)) == NULL)
+				tag = inend;
+			
+			n = tag - inptr;
+			memmove (outptr, inptr, n);
+			outptr += n;
+			inptr = tag;
+			
+			if (inptr < inend) {
+				*state = STRIP_LT;
+				inptr++;
+			}
+			break;
+		case STRIP_LT:
+			/* text/enriched uses "<<" for a literal '<' */
+			if (*inptr == '<') {
+				*outptr++ = '<';
+				*state = STRIP_TEXT;
+			} else {
+				*state = *inptr == '>' ? STRIP_TEXT : STRIP_TAG;
+			}
+			inptr++;
+			break;
+		default:
+			if ((inptr = memchr (inptr, '>', inend - inptr)) == NULL)
+				return outptr - text;
+			
+			*state = STRIP_TEXT;
+			inptr++;
+			break;
+		}
+	}
+	
+	return outptr - text;
+}
+
+/* gets the number of bytes at the end of @text that start an incomplete UTF-8 sequence */
+static size_t
+utf8_incomplete_tail (const char *text, size_t len)
+{
+	size_t i, need;
+	unsigned char c;
+	
+	for (i = 1; i <= MIN (len, 3); i++) {
+		c = (unsigned char) text[len - i];
+		
+		if ((c & 0xc0) == 0x80)
+			continue;
+		
+		if ((c & 0xe0) == 0xc0)
+			need = 2;
+		else if ((c & 0xf0) == 0xe0)
+			need = 3;
+		else if ((c & 0xf8) == 0xf0)
+			need = 4;
+		else
+			return 0;
+		
+		return need > i ? i : 0;
+	}
+	
+	return 0;
+}
+
+static gboolean
+extract_part_text (TextExtractor *extractor, GMimePart *part)
+{
+	GMimeContentType *content_type;
+	GMimeStream *filtered, *stream;
+	GMimeDataWrapper *content;
+	GMimeFilter *filter;
+	const char *charset;
+	gboolean html, enriched;
+	int state = STRIP_TEXT;
+	gboolean more = TRUE;
+	size_t n, nleft = 0;
+	ssize_t nread;
+	
+	content_type = g_mime_object_get_content_type ((GMimeObject *) part);
+	html = g_mime_content_type_is_type (content_type, "text", "html");
+	enriched = g_mime_content_type_is_type (content_type, "text", "enriched");
+	
+	if (!html && !enriched && !g_mime_content_type_is_type (content_type, "text", "plain"))
+		return TRUE;
+	
+	if (!(content = g_mime_part_get_content (part)))
+		return TRUE;
+	
+	stream = g_mime_data_wrapper_get_stream (content);
+	g_mime_stream_reset (stream);
+	
+	filtered = g_mime_stream_filter_new (stream);
+	
+	switch (g_mime_data_wrapper_get_encoding (content)) {
+	case GMIME_CONTENT_ENCODING_BASE64:
+	case GMIME_CONTENT_ENCODING_QUOTEDPRINTABLE:
+	case GMIME_CONTENT_ENCODING_UUENCODE:
+		filter = g_mime_filter_basic_new (g_mime_data_wrapper_get_encoding (content), FALSE);
+		g_mime_stream_filter_add ((GMimeStreamFilter *) filtered, filter);
+		g_object_unref (filter);
+		break;
+	default:
+		break;
+	}
+	
+	if ((charset = g_mime_content_type_get_parameter (content_type, "charset")) != NULL &&
+	    (filter = g_mime_filter_charset_new (charset, "utf-8")) != NULL) {
+		g_mime_stream_filter_add ((GMimeStreamFilter *) filtered, filter);
+		g_object_unref (filter);
+	}
+	
+	if (html) {
+		filter = g_mime_filter_html2text_new ();
+		g_mime_stream_filter_add ((GMimeStreamFilter *) filtered, filter);
+		g_object_unref (filter);
+	}
+	
+	while (more) {
+		if ((nread = g_mime_stream_read (filtered, extractor->buffer + nleft, sizeof (extractor->buffer) - nleft)) <= 0) {
+			/* pass along whatever is left of a truncated multibyte sequence */
+			if (nread == -1 || nleft == 0)
+				break;
+			
+			n = nleft;
+			nleft = 0;
+		} else {
+			if (enriched)
+				n = nleft + strip_enriched (&state, extractor->buffer + nleft, nread);
+			else
+				n = nleft + nread;
+			
+			/* hold back an incomplete multibyte sequence so that it is not split between callbacks */
+			nleft = utf8_incomplete_tail (extractor->buffer, n);
+			n -= nleft;
+		}
+		
+		if (extractor->max_len >= 0 && extractor->nwritten + n >= extractor->max_len) {
+			if (extractor->nwritten + n > extractor->max_len) {
+				n = extractor->max_len - extractor->nwritten;
+				
+				/* don't split a multibyte sequence */
+				while (n > 0 && (extractor->buffer[n] & 0xc0) == 0x80)
+					n--;
+			}
+			
+			more = FALSE;
+		}
+		
+		if (n > 0) {
+			extractor->nwritten += n;
+			
+			if (!extractor->callback (part, extractor->buffer, n, extractor->user_data))
+				more = FALSE;
+		}
+		
+		if (more && nleft > 0)
+			memmove (extractor->buffer, extractor->buffer + n, nleft);
+	}
+	
+	if (more && nread == -1) {
+		extractor->error = TRUE;
+		more = FALSE;
+	}
+	
+	g_object_unref (filtered);
+	g_mime_stream_reset (stream);
+	
+	return more;
+}
+
+static gboolean
+extract_text (TextExtractor *extractor, GMimeObject *object)
+{
+	GMimeMessage *message;
+	int count, i;
+	
+	if (GMIME_IS_MULTIPART (object)) {
+		count = g_mime_multipart_get_count ((GMimeMultipart *) object);
+		
+		for (i = 0; i < count; i++) {
+			if (!extract_text (extractor, g_mime_multipart_get_part ((GMimeMultipart *) object, i)))
+				return FALSE;
+		}
+	} else if (GMIME_IS_MESSAGE_PART (object)) {
+		message = g_mime_message_part_get_message ((GMimeMessagePart *) object);
+		
+		if (message != NULL && message->mime_part != NULL)
+			return extract_text (extractor, message->mime_part);
+	} else if (GMIME_IS_PART (object)) {
+		return extract_part_text (extractor, (GMimePart *) object);
+	}
+	
+	return TRUE;
+}
+
+
+/**
+ * g_mime_message_extract_text:
+ * @message: A #GMimeMessage
+ * @max_len: the maximum number of bytes of text to extract or %-1 for no limit
+ * @callback: (scope call): function to call with each chunk of text
+ * @user_data: user-supplied callback data
+ *
+ * Extracts the text of each text/plain, text/html and text/enriched
+ * part of @message (including the parts of any attached messages) in
+ * a single pass and passes it to @callback in UTF-8 chunks. HTML is
+ * converted to plain text with a #GMimeFilterHTML2Text and the
+ * formatting commands are removed from text/enriched parts.
+ *
+ * The chunks passed to @callback are only valid for the duration of
+ * the call. Extraction stops once @max_len bytes have been passed to
+ * @callback or @callback returns %FALSE.
+ *
+ * Returns: the number of bytes of text passed to @callback or %-1 on
+ * error.
+ **/
+gint64
+g_mime_message_extract_text (GMimeMessage *message, gint64 max_len, GMimeTextExtractFunc callback, gpointer user_data)
+{
+	TextExtractor extractor;
+	
+	g_return_val_if_fail (GMIME_IS_MESSAGE (message), -1);
+	g_return_val_if_fail (callback != NULL, -1);
+	
+	if (message->mime_part == NULL || max_len == 0)
+		return 0;
+	
+	extractor.callback = callback;
+	extractor.user_data = user_data;
+	extractor.max_len = max_len;
+	extractor.error = FALSE;
+	extractor.nwritten = 0;
+	
+	extract_text (&extractor, message->mime_part);
+	
+	return extractor.error ? -1 : extractor.nwritten;
+}
+
+typedef struct {
+	GMimeStream *stream;
+	GMimePart *part;
+	gint64 nwritten;
+	gint64 max_len;
+	gboolean eoln;
+	gboolean error;
+} TextWriter;
+
+static gboolean
+write_text (GMimePart *part, const char *text, size_t len, gpointer user_data)
+{
+	TextWriter *writer = user_data;
+	gboolean more = TRUE;
+	
+	/* separate the text of each part with a newline */
+	if (part != writer->part) {
+		if (writer->part != NULL && !writer->eoln) {
+			if (writer->max_len >= 0 && writer->nwritten >= writer->max_len)
+				return FALSE;
+			
+			if (g_mime_stream_write (writer->stream, "\n", 1) == -1)
+				goto error;
+			
+			writer->nwritten++;
+			writer->eoln = TRUE;
+		}
+		
+		writer->part = part;
+	}
+	
+	/* the separators count towards @max_len as well */
+	if (writer->max_len >= 0 && writer->nwritten + (gint64) len >= writer->max_len) {
+		if (writer->nwritten + (gint64) len > writer->max_len) {
+			len = (size_t) (writer->max_len - writer->nwritten);
+			
+			/* don't split a multibyte sequence */
+			while (len > 0 && (text[len] & 0xc0) == 0x80)
+				len--;
+		}
+		
+		more = FALSE;
+	}
+	
+	if (len == 0)
+		return more;
+	
+	if (g_mime_stream_write (writer->stream, text, len) == -1)
+		goto error;
+	
+	writer->eoln = text[len - 1] == '\n';
+	writer->nwritten += len;
+	
+	return more;
+	
+ error:
+	writer->error = TRUE;
+	
+	return FALSE;
+}
+
+
+/**
+ * g_mime_message_extract_text_to_stream:
+ * @message: A #GMimeMessage
+ * @max_len: the maximum number of bytes of text to extract or %-1 for no limit
+ * @stream: the output stream
+ *
+ * Writes the text extracted by g_mime_message_extract_text() to
+ * @stream, separating the text of each part with a newline. The
+ * newlines count towards @max_len.
+ *
+ * Returns: the number of bytes written to @stream or %-1 on error.
+ **/
+gint64
+g_mime_message_extract_text_to_stream (GMimeMessage *message, gint64 max_len, GMimeStream *stream)
+{
+	TextWriter writer;
+	
+	g_return_val_if_fail (GMIME_IS_MESSAGE (message), -1);
+	g_return_val_if_fail (GMIME_IS_STREAM (stream), -1);
+	
+	writer.stream = stream;
+	writer.part = NULL;
+	writer.max_len = max_len;
+	writer.nwritten = 0;
+	writer.eoln = TRUE;
+	writer.error = FALSE;
+	
+	if (g_mime_message_extract_text (message, max_len, write_text, &writer) == -1 || writer.error)
+		return -1;
+	
+	return writer.nwritten;
+}
+
 /**
  * g_mime_message_get_autocrypt_header:
  * @message: a #GMimeMessage object.
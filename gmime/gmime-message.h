@@ -28,6 +28,7 @@
 #include <gmime/internet-address.h>
 #include <gmime/gmime-encodings.h>
 #include <gmime/gmime-object.h>
+#include <gmime/gmime-part.h>
 #include <gmime/gmime-header.h>
 #include <gmime/gmime-stream.h>
 #include <gmime/gmime-autocrypt.h>
@@ -67,6 +68,20 @@ typedef enum _GMimeAddressType {
 } GMimeAddressType;
 
 
+/**
+ * GMimeTextExtractFunc:
+ * @part: the #GMimePart that the text was extracted from
+ * @text: (array length=len) (element-type guint8): a chunk of UTF-8 text
+ * @len: the length of @text
+ * @user_data: User-supplied callback data.
+ *
+ * The function signature for a callback to g_mime_message_extract_text().
+ *
+ * Returns: %TRUE to continue extracting text or %FALSE to stop.
+ **/
+typedef gboolean (* GMimeTextExtractFunc) (GMimePart *part, const char *text, size_t len, gpointer user_data);
+
+
 /**
  * GMimeMessage:
  * @parent_object: parent #GMimeObject
@@ -135,6 +150,10 @@ void g_mime_message_foreach (GMimeMessage *message, GMimeObjectForeachFunc callb
 
 GMimeObject *g_mime_message_get_body (GMimeMessage *message);
 
+gint64 g_mime_message_extract_text (GMimeMessage *message, gint64 max_len,
+				    GMimeTextExtractFunc callback, gpointer user_data);
+gint64 g_mime_message_extract_text_to_stream (GMimeMessage *message, gint64 max_len, GMimeStream *stream);
+
 G_END_DECLS
 
 #endif /* __GMIME_MESSAGE_H__ */
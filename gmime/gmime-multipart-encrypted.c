@@ -176,7 +176,7 @@ g_mime_multipart_encrypted_encrypt (GMimeCryptoContext *ctx, GMimeObject *entity
 	}
 	
 	/* get the cleartext */
-	stream = g_mime_stream_mem_new ();
+	stream = _g_mime_parser_options_create_stream (NULL);
 	
 	options = _g_mime_format_options_clone (NULL, FALSE);
 	g_mime_format_options_set_newline_format (options, GMIME_NEWLINE_FORMAT_DOS);
@@ -187,7 +187,7 @@ g_mime_multipart_encrypted_encrypt (GMimeCryptoContext *ctx, GMimeObject *entity
 	g_mime_stream_reset (stream);
 	
 	/* encrypt the content stream */
-	ciphertext = g_mime_stream_mem_new ();
+	ciphertext = _g_mime_parser_options_create_stream (NULL);
 	if (g_mime_crypto_context_encrypt (ctx, sign, userid, flags, recipients, stream, ciphertext, err) == -1) {
 		g_object_unref (ciphertext);
 		g_object_unref (stream);
@@ -333,11 +333,11 @@ g_mime_multipart_encrypted_decrypt (GMimeMultipartEncrypted *encrypted, GMimeDec
 	
 	/* get the ciphertext stream */
 	content = g_mime_part_get_content ((GMimePart *) encrypted_part);
-	ciphertext = g_mime_stream_mem_new ();
+	ciphertext = _g_mime_parser_options_create_stream (NULL);
 	g_mime_data_wrapper_write_to_stream (content, ciphertext);
 	g_mime_stream_reset (ciphertext);
 	
-	stream = g_mime_stream_mem_new ();
+	stream = _g_mime_parser_options_create_stream (NULL);
 	filtered = g_mime_stream_filter_new (stream);
 	filter = g_mime_filter_dos2unix_new (FALSE);
 	g_mime_stream_filter_add ((GMimeStreamFilter *) filtered, filter);
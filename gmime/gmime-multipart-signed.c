@@ -235,7 +235,7 @@ g_mime_multipart_signed_sign (GMimeCryptoContext *ctx, GMimeObject *entity,
 	sign_prepare (entity);
 	
 	/* get the cleartext */
-	stream = g_mime_stream_mem_new ();
+	stream = _g_mime_parser_options_create_stream (NULL);
 	filtered = g_mime_stream_filter_new (stream);
 	
 	/* Note: see rfc3156, section 3 - second note */
@@ -430,7 +430,7 @@ g_mime_multipart_signed_verify (GMimeMultipartSigned *mps, GMimeVerifyFlags flag
 	content = g_mime_multipart_get_part ((GMimeMultipart *) mps, GMIME_MULTIPART_SIGNED_CONTENT);
 	
 	/* get the content stream */
-	stream = g_mime_stream_mem_new ();
+	stream = _g_mime_parser_options_create_stream (NULL);
 	
 	/* Note: see rfc2015 or rfc3156, section 5.1 */
 	options = _g_mime_format_options_clone (NULL, FALSE);
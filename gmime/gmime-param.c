@@ -1209,6 +1209,7 @@ rfc2184_param_charset (const char **in, char **langp)
 static char *
 charset_convert (const char *charset, char *in, size_t inlen)
 {
+	const GMimeIconvPath *path;
 	gboolean locale = FALSE;
 	char *result = NULL;
 	iconv_t cd;
@@ -1222,14 +1223,20 @@ charset_convert (const char *charset, char *in, size_t inlen)
 		locale = TRUE;
 	}
 	
-	/* need charset conversion */
-	cd = g_mime_iconv_open ("UTF-8", charset);
-	if (cd == (iconv_t) -1 && !locale) {
-		charset = g_mime_locale_charset ();
+	/* need charset conversion (which we may be able to do without iconv) */
+	cd = (iconv_t) -1;
+	if (!(path = _g_mime_iconv_get_path ("UTF-8", charset)))
 		cd = g_mime_iconv_open ("UTF-8", charset);
+	
+	if (path == NULL && cd == (iconv_t) -1 && !locale) {
+		charset = g_mime_locale_charset ();
+		if (!(path = _g_mime_iconv_get_path ("UTF-8", charset)))
+			cd = g_mime_iconv_open ("UTF-8", charset);
 	}
 	
-	if (cd != (iconv_t) -1) {
+	if (path != NULL) {
+		result = _g_mime_iconv_strndup (cd, path, in, inlen);
+	} else if (cd != (iconv_t) -1) {
 		result = g_mime_iconv_strndup (cd, in, inlen);
 		g_mime_iconv_close (cd);
 	}
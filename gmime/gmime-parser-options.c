@@ -26,6 +26,9 @@
 #include <string.h>
 
 #include "gmime-parser-options.h"
+#include "gmime-stream-spill.h"
+#include "gmime-stream-mem.h"
+#include "gmime-internal.h"
 
 
 static char *default_charsets[3] = { "utf-8", "iso-8859-1", NULL };
@@ -50,6 +53,7 @@ struct _GMimeParserOptions {
 	char **charsets;
 	GMimeParserWarningFunc warning_cb;
 	gpointer warning_user_data;
+	size_t spill_threshold;
 };
 
 static GMimeParserOptions *default_options = NULL;
@@ -92,6 +96,20 @@ _g_mime_parser_options_warn (GMimeParserOptions *options, gint64 offset, guint e
 		warn (offset, errcode, item, user_data);
 }
 
+/* creates a stream for intermediate content, spilling to disk once it
+ * exceeds the threshold of @options (or of the default options if
+ * @options is %NULL, as is the case for the crypto helpers) */
+GMimeStream *
+_g_mime_parser_options_create_stream (GMimeParserOptions *options)
+{
+	size_t threshold = options ? options->spill_threshold : default_options->spill_threshold;
+	
+	if (threshold > 0)
+		return g_mime_stream_spill_new (threshold);
+	
+	return g_mime_stream_mem_new ();
+}
+
 /**
  * g_mime_parser_options_get_default:
  *
@@ -131,6 +149,7 @@ g_mime_parser_options_new (void)
 	
 	options->warning_cb = NULL;
 	options->warning_user_data = NULL;
+	options->spill_threshold = 0;
 
 	return options;
 }
@@ -169,6 +188,7 @@ g_mime_parser_options_clone (GMimeParserOptions *options)
 	
 	clone->warning_cb = options->warning_cb;
 	clone->warning_user_data = options->warning_user_data;
+	clone->spill_threshold = options->spill_threshold;
 
 	return clone;
 }
@@ -451,3 +471,50 @@ g_mime_parser_options_set_warning_callback (GMimeParserOptions *options, GMimePa
 	options->warning_cb = warning_cb;
 	options->warning_user_data = user_data;
 }
+
+
+/**
+ * g_mime_parser_options_get_spill_threshold:
+ * @options: (nullable): a #GMimeParserOptions or %NULL
+ *
+ * Gets the number of bytes of content that may be buffered in memory
+ * before it is spilled to an anonymous temporary file.
+ *
+ * Returns: the spill threshold or %0 if content is always kept in memory.
+ **/
+size_t
+g_mime_parser_options_get_spill_threshold (GMimeParserOptions *options)
+{
+	return options ? options->spill_threshold : default_options->spill_threshold;
+}
+
+
+/**
+ * g_mime_parser_options_set_spill_threshold:
+ * @options: a #GMimeParserOptions
+ * @threshold: the spill threshold in bytes or %0 to disable spilling
+ *
+ * Sets the number of bytes of content that may be buffered in memory
+ * before it is spilled to an anonymous temporary file (see
+ * #GMimeStreamSpill).
+ *
+ * This affects the content of MIME parts loaded by a #GMimeParser
+ * that is not persisting its stream (see
+ * g_mime_parser_set_persist_stream()).
+ *
+ * Note: The crypto helpers such as g_mime_multipart_encrypted_decrypt(),
+ * g_mime_multipart_signed_sign(), g_mime_application_pkcs7_mime_encrypt()
+ * and g_mime_part_openpgp_decrypt() do not take a #GMimeParserOptions
+ * argument and parse their output with the default options, so the
+ * streams they create only follow the threshold set on the options
+ * returned by g_mime_parser_options_get_default().
+ *
+ * By default, this feature is disabled and all content is kept in memory.
+ **/
+void
+g_mime_parser_options_set_spill_threshold (GMimeParserOptions *options, size_t threshold)
+{
+	g_return_if_fail (options != NULL);
+	
+	options->spill_threshold = threshold;
+}
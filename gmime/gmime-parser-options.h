@@ -131,6 +131,9 @@ GMimeParserWarningFunc g_mime_parser_options_get_warning_callback (GMimeParserOp
 void g_mime_parser_options_set_warning_callback (GMimeParserOptions *options, GMimeParserWarningFunc warning_cb,
 						 gpointer user_data);
 
+size_t g_mime_parser_options_get_spill_threshold (GMimeParserOptions *options);
+void g_mime_parser_options_set_spill_threshold (GMimeParserOptions *options, size_t threshold);
+
 G_END_DECLS
 
 #endif /* __GMIME_PARSER_OPTIONS_H__ */
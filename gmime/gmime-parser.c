@@ -36,6 +36,7 @@
 #include "gmime-stream-mem.h"
 #include "gmime-multipart.h"
 #include "gmime-internal.h"
+#include "gmime-simd.h"
 #include "gmime-common.h"
 #include "gmime-part.h"
 
@@ -508,7 +509,8 @@ g_mime_parser_get_persist_stream (GMimeParser *parser)
  * loaded into memory so as to reduce memory usage. This is the default.
  *
  * If @persist is %FALSE, the @parser will always load message content
- * into memory.
+ * into memory, or into a #GMimeStreamSpill if a spill threshold has
+ * been set with g_mime_parser_options_set_spill_threshold().
  *
  * Note: This attribute only serves as a hint to the @parser. If the
  * underlying stream does not support seeking, then this attribute
@@ -1522,15 +1524,15 @@ static void
 parser_scan_content (GMimeParser *parser, GMimeStream *content, gboolean *empty)
 {
 	struct _GMimeParserPrivate *priv = parser->priv;
-	char *aligned, *start, *inend;
+	char *aligned, *start, *inend, *eoln;
 	register unsigned int *dword;
 	gboolean midline = FALSE;
 	register char *inptr;
 	unsigned int mask;
-	size_t nleft, len;
+	size_t nleft, len, n;
 	size_t atleast;
 	gint64 pos;
-	char c;
+	char c, mark;
 	
 	d(printf ("scan-content\n"));
 	
@@ -1539,6 +1541,14 @@ parser_scan_content (GMimeParser *parser, GMimeStream *content, gboolean *empty)
 	
 	g_assert (priv->inptr <= priv->inend);
 	
+	/* only lines starting with "--" or with the mbox/mmdf From-marker
+	 * can be boundaries (or OpenPGP armor markers) */
+	switch (priv->format) {
+	case GMIME_FORMAT_MBOX: mark = MBOX_BOUNDARY[0]; break;
+	case GMIME_FORMAT_MMDF: mark = MMDF_BOUNDARY[0]; break;
+	default: mark = '-'; break;
+	}
+	
 	start = inptr = priv->inptr;
 	
 	/* figure out minimum amount of data we need */
@@ -1565,6 +1575,28 @@ parser_scan_content (GMimeParser *parser, GMimeStream *content, gboolean *empty)
 		midline = FALSE;
 		
 		while (inptr < inend) {
+			if (*inptr != '-' && *inptr != mark) {
+				/* write out all of the lines up to the next one that could be a boundary at once */
+				start = inptr;
+				n = g_mime_simd_line_find ((const unsigned char *) inptr, inend - inptr, '-', mark);
+				
+				if (n < (size_t) (inend - inptr)) {
+					inptr += n + 1;
+					g_mime_stream_write (content, start, inptr - start);
+					continue;
+				}
+				
+				/* the last line is incomplete, so leave it to the loop below */
+				eoln = inend;
+				while (eoln > inptr && eoln[-1] != '\n')
+					eoln--;
+				
+				if (eoln > inptr) {
+					g_mime_stream_write (content, start, eoln - start);
+					inptr = eoln;
+				}
+			}
+			
 			aligned = (char *) (((size_t) (inptr + 3)) & ~3);
 			start = inptr;
 			
@@ -1638,12 +1670,12 @@ parser_scan_content (GMimeParser *parser, GMimeStream *content, gboolean *empty)
 }
 
 static void
-parser_scan_mime_part_content (GMimeParser *parser, GMimePart *mime_part)
+parser_scan_mime_part_content (GMimeParser *parser, GMimeParserOptions *options, GMimePart *mime_part)
 {
 	struct _GMimeParserPrivate *priv = parser->priv;
 	GMimeContentEncoding encoding;
 	GMimeDataWrapper *content;
-	GMimeStream *stream;
+	GMimeStream *stream, *sink;
 	GByteArray *buffer;
 	gint64 start, len;
 	gboolean empty;
@@ -1654,7 +1686,7 @@ parser_scan_mime_part_content (GMimeParser *parser, GMimePart *mime_part)
 		stream = g_mime_stream_null_new ();
 		start = parser_offset (priv, NULL);
 	} else {
-		stream = g_mime_stream_mem_new ();
+		stream = _g_mime_parser_options_create_stream (options);
 		start = 0;
 	}
 	
@@ -1665,10 +1697,15 @@ parser_scan_mime_part_content (GMimeParser *parser, GMimePart *mime_part)
 		g_object_unref (stream);
 		
 		stream = g_mime_stream_substream (priv->stream, start, start + len);
-	} else {
+	} else if (GMIME_IS_STREAM_MEM (stream)) {
 		buffer = g_mime_stream_mem_get_byte_array ((GMimeStreamMem *) stream);
 		g_byte_array_set_size (buffer, (guint) len);
 		g_mime_stream_reset (stream);
+	} else {
+		/* the trailing newline belongs to the boundary; chop it off */
+		sink = stream;
+		stream = g_mime_stream_substream (sink, 0, len);
+		g_object_unref (sink);
 	}
 	
 	encoding = g_mime_part_get_content_encoding (mime_part);
@@ -1919,7 +1956,7 @@ parser_construct_leaf_part (GMimeParser *parser, GMimeParserOptions *options, Co
 		if (GMIME_IS_MESSAGE_PART (object))
 			parser_scan_message_part (parser, options, (GMimeMessagePart *) object, depth + 1);
 		else
-			parser_scan_mime_part_content (parser, (GMimePart *) object);
+			parser_scan_mime_part_content (parser, options, (GMimePart *) object);
 	}
 
 	return object;
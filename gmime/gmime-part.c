@@ -1058,8 +1058,8 @@ g_mime_part_openpgp_encrypt (GMimePart *mime_part, gboolean sign, const char *us
 		return FALSE;
 	}
 	
-	encrypted = g_mime_stream_mem_new ();
-	istream = g_mime_stream_mem_new ();
+	encrypted = _g_mime_parser_options_create_stream (NULL);
+	istream = _g_mime_parser_options_create_stream (NULL);
 	g_mime_data_wrapper_write_to_stream (mime_part->content, istream);
 	g_mime_stream_reset (istream);
 	
@@ -1117,8 +1117,8 @@ g_mime_part_openpgp_decrypt (GMimePart *mime_part, GMimeDecryptFlags flags, cons
 		return NULL;
 	}
 	
-	decrypted = g_mime_stream_mem_new ();
-	istream = g_mime_stream_mem_new ();
+	decrypted = _g_mime_parser_options_create_stream (NULL);
+	istream = _g_mime_parser_options_create_stream (NULL);
 	g_mime_data_wrapper_write_to_stream (mime_part->content, istream);
 	g_mime_stream_reset (istream);
 	
@@ -1174,8 +1174,8 @@ g_mime_part_openpgp_sign (GMimePart *mime_part, const char *userid, GError **err
 		return FALSE;
 	}
 	
-	ostream = g_mime_stream_mem_new ();
-	istream = g_mime_stream_mem_new ();
+	ostream = _g_mime_parser_options_create_stream (NULL);
+	istream = _g_mime_parser_options_create_stream (NULL);
 	g_mime_data_wrapper_write_to_stream (mime_part->content, istream);
 	g_mime_stream_reset (istream);
 	
@@ -1232,8 +1232,8 @@ g_mime_part_openpgp_verify (GMimePart *mime_part, GMimeVerifyFlags flags, GError
 		return NULL;
 	}
 	
-	extracted = g_mime_stream_mem_new ();
-	istream = g_mime_stream_mem_new ();
+	extracted = _g_mime_parser_options_create_stream (NULL);
+	istream = _g_mime_parser_options_create_stream (NULL);
 	g_mime_data_wrapper_write_to_stream (mime_part->content, istream);
 	g_mime_stream_reset (istream);
 	
@@ -0,0 +1,1582 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*- */
+/*  GMime
+ *  Copyright (C) 2000-2022 Jeffrey Stedfast
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public License
+ *  as published by the Free Software Foundation; either version 2.1
+ *  of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free
+ *  Software Foundation, 51 Franklin Street, Fifth Floor, Boston, MA
+ *  02110-1301, USA.
+ */
+
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "gmime-simd.h"
+
+#ifdef HAVE_X86_SIMD
+#include <immintrin.h>
+#include <cpuid.h>
+
+#define SSSE3 __attribute__((target ("ssse3")))
+#define SSE42 __attribute__((target ("sse4.2")))
+#define AVX2 __attribute__((target ("avx2")))
+#define SHA __attribute__((target ("sha,sse4.1")))
+#endif
+
+
+/**
+ * This module holds the vectorized kernels used by the encoders,
+ * filters and scanners throughout GMime along with the runtime CPU
+ * feature detection used to pick them. Every kernel has a scalar
+ * equivalent at its call site, and callers fall back to it whenever
+ * g_mime_simd_get_level() returns #GMIME_SIMD_NONE. The exceptions
+ * are the US-ASCII, UTF-8 and line ending scanners, which carry their
+ * own scalar fallbacks since they are shared by so many callers, and
+ * the CRC32C and SHA-256 kernels, which rely on instructions that are
+ * checked for separately with g_mime_simd_has_crc32c() and
+ * g_mime_simd_has_sha256().
+ **/
+
+
+#define BASE64_LINE_IN  57 /* 19 triplets per line */
+#define BASE64_LINE_OUT 76 /* 19 quartets per line */
+
+static volatile int simd_level = -1;
+static volatile int simd_features = -1;
+
+enum {
+	SIMD_FEATURE_CRC32C = 1 << 0,
+	SIMD_FEATURE_SHA256 = 1 << 1
+};
+
+
+/**
+ * g_mime_simd_get_level:
+ *
+ * Gets the best vector instruction set supported by both this build
+ * and the host CPU. The result may be capped by setting the GMIME_SIMD
+ * environment variable to "none" or "ssse3", which is useful for
+ * benchmarking against the scalar code paths.
+ *
+ * Returns: the #GMimeSimdLevel to use.
+ **/
+GMimeSimdLevel
+g_mime_simd_get_level (void)
+{
+	GMimeSimdLevel level = GMIME_SIMD_NONE;
+	const char *env;
+	
+	if (simd_level != -1)
+		return (GMimeSimdLevel) simd_level;
+	
+#ifdef HAVE_X86_SIMD
+	__builtin_cpu_init ();
+	
+	if (__builtin_cpu_supports ("avx2"))
+		level = GMIME_SIMD_AVX2;
+	else if (__builtin_cpu_supports ("ssse3"))
+		level = GMIME_SIMD_SSSE3;
+#endif
+	
+	if ((env = getenv ("GMIME_SIMD")) != NULL) {
+		if (!g_ascii_strcasecmp (env, "none"))
+			level = GMIME_SIMD_NONE;
+		else if (!g_ascii_strcasecmp (env, "ssse3") && level > GMIME_SIMD_SSSE3)
+			level = GMIME_SIMD_SSSE3;
+	}
+	
+	simd_level = level;
+	
+	return level;
+}
+
+
+/* detects the instructions that accelerate checksums, which are not
+ * implied by any #GMimeSimdLevel */
+static int
+simd_get_features (void)
+{
+	int features = 0;
+#if defined (HAVE_X86_SIMD) && defined (HAVE_X86_SHA)
+	unsigned int eax, ebx, ecx, edx;
+#endif
+	
+	if (simd_features != -1)
+		return simd_features;
+		
+#ifdef HAVE_X86_SIMD
+	if (g_mime_simd_get_level () != GMIME_SIMD_NONE) {
+		if (__builtin_cpu_supports ("sse4.2"))
+			features |= SIMD_FEATURE_CRC32C;
+			
+#ifdef HAVE_X86_SHA
+		/* CPUID leaf 7 reports the SHA extensions in bit 29 of EBX */
+		if (__builtin_cpu_supports ("sse4.1") && __get_cpuid_count (7, 0, &eax, &ebx, &ecx, &edx) && (ebx & (1 << 29)))
+			features |= SIMD_FEATURE_SHA256;
+#endif
+	}
+#endif
+	
+	simd_features = features;
+	
+	return features;
+}
+
+
+#ifdef HAVE_X86_SIMD
+
+/* spreads 12 input bytes (in the low bytes of @in) into 16 sextets */
+static inline SSSE3 __m128i
+base64_enc_reshuffle_ssse3 (__m128i in)
+{
+	__m128i t0, t1, t2, t3;
+	
+	in = _mm_shuffle_epi8 (in, _mm_set_epi8 (10, 11, 9, 10, 7, 8, 6, 7, 4, 5, 3, 4, 1, 2, 0, 1));
+	
+	t0 = _mm_and_si128 (in, _mm_set1_epi32 (0x0fc0fc00));
+	t1 = _mm_mulhi_epu16 (t0, _mm_set1_epi32 (0x04000040));
+	t2 = _mm_and_si128 (in, _mm_set1_epi32 (0x003f03f0));
+	t3 = _mm_mullo_epi16 (t2, _mm_set1_epi32 (0x01000010));
+	
+	return _mm_or_si128 (t1, t3);
+}
+
+/* maps sextets onto the base64 alphabet */
+static inline SSSE3 __m128i
+base64_enc_translate_ssse3 (__m128i in)
+{
+	const __m128i lut = _mm_setr_epi8 (65, 71, -4, -4, -4, -4, -4, -4, -4, -4, -4, -4, -19, -16, 0, 0);
+	__m128i indices, mask;
+	
+	/* 0..25 -> 0, 26..51 -> 1, 52..61 -> 2..11, 62 -> 12, 63 -> 13 */
+	indices = _mm_subs_epu8 (in, _mm_set1_epi8 (51));
+	mask = _mm_cmpgt_epi8 (in, _mm_set1_epi8 (25));
+	indices = _mm_sub_epi8 (indices, mask);
+	
+	return _mm_add_epi8 (in, _mm_shuffle_epi8 (lut, indices));
+}
+
+/* encodes the last 9 bytes of a line into 12 characters */
+static inline SSSE3 void
+base64_encode_tail_ssse3 (const unsigned char *line, unsigned char *outptr)
+{
+	__m128i block;
+	guint32 word;
+	
+	/* load bytes 41..56 so that we never read past the end of the line */
+	block = _mm_loadu_si128 ((const __m128i *) (line + BASE64_LINE_IN - 16));
+	block = _mm_srli_si128 (block, 7);
+	block = base64_enc_translate_ssse3 (base64_enc_reshuffle_ssse3 (block));
+	
+	_mm_storel_epi64 ((__m128i *) outptr, block);
+	word = (guint32) _mm_cvtsi128_si32 (_mm_srli_si128 (block, 8));
+	memcpy (outptr + 8, &word, sizeof (word));
+}
+
+static SSSE3 size_t
+base64_encode_lines_ssse3 (const unsigned char *inptr, size_t nlines, unsigned char *outbuf)
+{
+	register unsigned char *outptr = outbuf;
+	__m128i block;
+	size_t i;
+	int j;
+	
+	for (i = 0; i < nlines; i++) {
+		/* 4 blocks of 12 bytes; the 16 byte loads never read past byte 51 */
+		for (j = 0; j < 4; j++) {
+			block = _mm_loadu_si128 ((const __m128i *) (inptr + (j * 12)));
+			block = base64_enc_translate_ssse3 (base64_enc_reshuffle_ssse3 (block));
+			_mm_storeu_si128 ((__m128i *) (outptr + (j * 16)), block);
+		}
+		
+		base64_encode_tail_ssse3 (inptr, outptr + 64);
+		outptr[BASE64_LINE_OUT] = '\n';
+		
+		outptr += BASE64_LINE_OUT + 1;
+		inptr += BASE64_LINE_IN;
+	}
+	
+	return (size_t) (outptr - outbuf);
+}
+
+static inline AVX2 __m256i
+base64_enc_reshuffle_avx2 (__m256i in)
+{
+	__m256i t0, t1, t2, t3;
+	
+	in = _mm256_shuffle_epi8 (in, _mm256_set_epi8 (10, 11, 9, 10, 7, 8, 6, 7, 4, 5, 3, 4, 1, 2, 0, 1,
+						       10, 11, 9, 10, 7, 8, 6, 7, 4, 5, 3, 4, 1, 2, 0, 1));
+	
+	t0 = _mm256_and_si256 (in, _mm256_set1_epi32 (0x0fc0fc00));
+	t1 = _mm256_mulhi_epu16 (t0, _mm256_set1_epi32 (0x04000040));
+	t2 = _mm256_and_si256 (in, _mm256_set1_epi32 (0x003f03f0));
+	t3 = _mm256_mullo_epi16 (t2, _mm256_set1_epi32 (0x01000010));
+	
+	return _mm256_or_si256 (t1, t3);
+}
+
+static inline AVX2 __m256i
+base64_enc_translate_avx2 (__m256i in)
+{
+	const __m256i lut = _mm256_setr_epi8 (65, 71, -4, -4, -4, -4, -4, -4, -4, -4, -4, -4, -19, -16, 0, 0,
+					      65, 71, -4, -4, -4, -4, -4, -4, -4, -4, -4, -4, -19, -16, 0, 0);
+	__m256i indices, mask;
+	
+	indices = _mm256_subs_epu8 (in, _mm256_set1_epi8 (51));
+	mask = _mm256_cmpgt_epi8 (in, _mm256_set1_epi8 (25));
+	indices = _mm256_sub_epi8 (indices, mask);
+	
+	return _mm256_add_epi8 (in, _mm256_shuffle_epi8 (lut, indices));
+}
+
+static AVX2 size_t
+base64_encode_lines_avx2 (const unsigned char *inptr, size_t nlines, unsigned char *outbuf)
+{
+	register unsigned char *outptr = outbuf;
+	__m256i block;
+	size_t i;
+	int j;
+	
+	for (i = 0; i < nlines; i++) {
+		/* 2 blocks of 2x12 bytes; the loads never read past byte 51 */
+		for (j = 0; j < 2; j++) {
+			block = _mm256_inserti128_si256 (_mm256_castsi128_si256 (_mm_loadu_si128 ((const __m128i *) (inptr + (j * 24)))),
+							 _mm_loadu_si128 ((const __m128i *) (inptr + (j * 24) + 12)), 1);
+			block = base64_enc_translate_avx2 (base64_enc_reshuffle_avx2 (block));
+			_mm256_storeu_si256 ((__m256i *) (outptr + (j * 32)), block);
+		}
+		
+		base64_encode_tail_ssse3 (inptr, outptr + 64);
+		outptr[BASE64_LINE_OUT] = '\n';
+		
+		outptr += BASE64_LINE_OUT + 1;
+		inptr += BASE64_LINE_IN;
+	}
+	
+	_mm256_zeroupper ();
+	
+	return (size_t) (outptr - outbuf);
+}
+
+/* packs 16 sextets (one per byte) into 12 bytes */
+static inline SSSE3 __m128i
+base64_dec_reshuffle_ssse3 (__m128i in)
+{
+	__m128i merged;
+	
+	merged = _mm_maddubs_epi16 (in, _mm_set1_epi32 (0x01400140));
+	merged = _mm_madd_epi16 (merged, _mm_set1_epi32 (0x00011000));
+	
+	return _mm_shuffle_epi8 (merged, _mm_setr_epi8 (2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1));
+}
+
+/* converts 16 base64 characters into sextets, returning FALSE if any are not in the alphabet */
+static inline SSSE3 gboolean
+base64_dec_translate_ssse3 (__m128i *block)
+{
+	const __m128i lut_lo = _mm_setr_epi8 (0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11,
+					      0x11, 0x11, 0x13, 0x1a, 0x1b, 0x1b, 0x1b, 0x1a);
+	const __m128i lut_hi = _mm_setr_epi8 (0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08,
+					      0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10);
+	const __m128i lut_roll = _mm_setr_epi8 (0, 16, 19, 4, -65, -65, -71, -71,
+						0, 0, 0, 0, 0, 0, 0, 0);
+	const __m128i mask_2f = _mm_set1_epi8 (0x2f);
+	__m128i in = *block, hi_nibbles, lo_nibbles, hi, lo, eq_2f, roll;
+	
+	hi_nibbles = _mm_and_si128 (_mm_srli_epi32 (in, 4), mask_2f);
+	lo_nibbles = _mm_and_si128 (in, mask_2f);
+	hi = _mm_shuffle_epi8 (lut_hi, hi_nibbles);
+	lo = _mm_shuffle_epi8 (lut_lo, lo_nibbles);
+	
+	if (_mm_movemask_epi8 (_mm_cmpgt_epi8 (_mm_and_si128 (lo, hi), _mm_setzero_si128 ())) != 0)
+		return FALSE;
+	
+	eq_2f = _mm_cmpeq_epi8 (in, mask_2f);
+	roll = _mm_shuffle_epi8 (lut_roll, _mm_add_epi8 (eq_2f, hi_nibbles));
+	*block = _mm_add_epi8 (in, roll);
+	
+	return TRUE;
+}
+
+static inline SSSE3 void
+base64_store12_ssse3 (unsigned char *outptr, __m128i block)
+{
+	guint32 word;
+	
+	_mm_storel_epi64 ((__m128i *) outptr, block);
+	word = (guint32) _mm_cvtsi128_si32 (_mm_srli_si128 (block, 8));
+	memcpy (outptr + 8, &word, sizeof (word));
+}
+
+/* decodes a single block of 16 base64 characters into 12 bytes */
+static inline SSSE3 gboolean
+base64_decode_block_ssse3 (const unsigned char *inptr, unsigned char *outptr)
+{
+	__m128i block;
+	
+	block = _mm_loadu_si128 ((const __m128i *) inptr);
+	if (!base64_dec_translate_ssse3 (&block))
+		return FALSE;
+	
+	base64_store12_ssse3 (outptr, base64_dec_reshuffle_ssse3 (block));
+	
+	return TRUE;
+}
+
+static SSSE3 size_t
+base64_decode_ssse3 (const unsigned char *inbuf, size_t inlen, unsigned char *outbuf, size_t *nread)
+{
+	const unsigned char *inptr = inbuf;
+	unsigned char *outptr = outbuf;
+	
+	while (inlen >= 16 && base64_decode_block_ssse3 (inptr, outptr)) {
+		outptr += 12;
+		inptr += 16;
+		inlen -= 16;
+	}
+	
+	*nread = (size_t) (inptr - inbuf);
+	
+	return (size_t) (outptr - outbuf);
+}
+
+static inline AVX2 __m256i
+base64_dec_reshuffle_avx2 (__m256i in)
+{
+	__m256i merged;
+	
+	merged = _mm256_maddubs_epi16 (in, _mm256_set1_epi32 (0x01400140));
+	merged = _mm256_madd_epi16 (merged, _mm256_set1_epi32 (0x00011000));
+	
+	return _mm256_shuffle_epi8 (merged, _mm256_setr_epi8 (2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1,
+							      2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1));
+}
+
+static inline AVX2 gboolean
+base64_dec_translate_avx2 (__m256i *block)
+{
+	const __m256i lut_lo = _mm256_setr_epi8 (0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11,
+						 0x11, 0x11, 0x13, 0x1a, 0x1b, 0x1b, 0x1b, 0x1a,
+						 0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11,
+						 0x11, 0x11, 0x13, 0x1a, 0x1b, 0x1b, 0x1b, 0x1a);
+	const __m256i lut_hi = _mm256_setr_epi8 (0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08,
+						 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10,
+						 0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08,
+						 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10);
+	const __m256i lut_roll = _mm256_setr_epi8 (0, 16, 19, 4, -65, -65, -71, -71,
+						   0, 0, 0, 0, 0, 0, 0, 0,
+						   0, 16, 19, 4, -65, -65, -71, -71,
+						   0, 0, 0, 0, 0, 0, 0, 0);
+	const __m256i mask_2f = _mm256_set1_epi8 (0x2f);
+	__m256i in = *block, hi_nibbles, lo_nibbles, hi, lo, eq_2f, roll;
+	
+	hi_nibbles = _mm256_and_si256 (_mm256_srli_epi32 (in, 4), mask_2f);
+	lo_nibbles = _mm256_and_si256 (in, mask_2f);
+	hi = _mm256_shuffle_epi8 (lut_hi, hi_nibbles);
+	lo = _mm256_shuffle_epi8 (lut_lo, lo_nibbles);
+	
+	if (!_mm256_testz_si256 (lo, hi))
+		return FALSE;
+	
+	eq_2f = _mm256_cmpeq_epi8 (in, mask_2f);
+	roll = _mm256_shuffle_epi8 (lut_roll, _mm256_add_epi8 (eq_2f, hi_nibbles));
+	*block = _mm256_add_epi8 (in, roll);
+	
+	return TRUE;
+}
+
+static AVX2 size_t
+base64_decode_avx2 (const unsigned char *inbuf, size_t inlen, unsigned char *outbuf, size_t *nread)
+{
+	const unsigned char *inptr = inbuf;
+	unsigned char *outptr = outbuf;
+	__m256i block;
+	
+	while (inlen >= 32) {
+		block = _mm256_loadu_si256 ((const __m256i *) inptr);
+		if (!base64_dec_translate_avx2 (&block))
+			break;
+		
+		block = base64_dec_reshuffle_avx2 (block);
+		base64_store12_ssse3 (outptr, _mm256_castsi256_si128 (block));
+		base64_store12_ssse3 (outptr + 12, _mm256_extracti128_si256 (block, 1));
+		outptr += 24;
+		inptr += 32;
+		inlen -= 32;
+	}
+	
+	/* the remaining (or invalid) 32 byte block may still start with a valid 16 byte block */
+	if (inlen >= 16 && base64_decode_block_ssse3 (inptr, outptr)) {
+		outptr += 12;
+		inptr += 16;
+	}
+	
+	_mm256_zeroupper ();
+	
+	*nread = (size_t) (inptr - inbuf);
+	
+	return (size_t) (outptr - outbuf);
+}
+
+#endif /* HAVE_X86_SIMD */
+
+
+/**
+ * g_mime_simd_base64_encode_lines:
+ * @inbuf: input buffer
+ * @nlines: number of complete 57 byte lines in @inbuf to encode
+ * @outbuf: output buffer
+ *
+ * Base64 encodes @nlines complete lines of input, each producing 76
+ * characters followed by a '\n', exactly like the scalar encoder in
+ * g_mime_encoding_base64_encode_step() does when starting at the
+ * beginning of a line with no saved bytes.
+ *
+ * Returns: the number of bytes written to @outbuf, or %0 if no
+ * vectorized encoder is available.
+ **/
+size_t
+g_mime_simd_base64_encode_lines (const unsigned char *inbuf, size_t nlines, unsigned char *outbuf)
+{
+	switch (g_mime_simd_get_level ()) {
+#ifdef HAVE_X86_SIMD
+	case GMIME_SIMD_AVX2:
+		return base64_encode_lines_avx2 (inbuf, nlines, outbuf);
+	case GMIME_SIMD_SSSE3:
+		return base64_encode_lines_ssse3 (inbuf, nlines, outbuf);
+#endif
+	default:
+		return 0;
+	}
+}
+
+
+/**
+ * g_mime_simd_base64_decode:
+ * @inbuf: input buffer
+ * @inlen: input buffer length
+ * @outbuf: output buffer
+ * @nread: (out): the number of input bytes consumed
+ *
+ * Decodes consecutive blocks of 16 base64 characters from @inbuf,
+ * stopping at the first block containing whitespace, padding or any
+ * other character outside of the base64 alphabet, which is left for
+ * the scalar decoder to handle. Must only be called on a quartet
+ * boundary.
+ *
+ * Returns: the number of bytes written to @outbuf.
+ **/
+size_t
+g_mime_simd_base64_decode (const unsigned char *inbuf, size_t inlen, unsigned char *outbuf, size_t *nread)
+{
+	switch (g_mime_simd_get_level ()) {
+#ifdef HAVE_X86_SIMD
+	case GMIME_SIMD_AVX2:
+		return base64_decode_avx2 (inbuf, inlen, outbuf, nread);
+	case GMIME_SIMD_SSSE3:
+		return base64_decode_ssse3 (inbuf, inlen, outbuf, nread);
+#endif
+	default:
+		*nread = 0;
+		return 0;
+	}
+}
+
+
+/* printable US-ASCII other than '=' can be copied verbatim by the quoted-printable encoder */
+#define is_qp_literal(c) ((unsigned char) ((c) - 33) < 94 && (c) != '=')
+
+#ifdef HAVE_X86_SIMD
+
+static SSSE3 size_t
+qp_safe_span_ssse3 (const unsigned char *inbuf, size_t inlen)
+{
+	const __m128i bias = _mm_set1_epi8 ((char) (0x80 + 33));
+	const __m128i limit = _mm_set1_epi8 (94 - 128);
+	const __m128i equal = _mm_set1_epi8 ('=');
+	const unsigned char *inptr = inbuf;
+	const unsigned char *inend = inbuf + inlen;
+	__m128i block, literal;
+	unsigned int mask;
+	
+	while (inend - inptr >= 16) {
+		block = _mm_loadu_si128 ((const __m128i *) inptr);
+		
+		/* (c - 33) < 94 as an unsigned comparison, done with signed bytes */
+		literal = _mm_cmplt_epi8 (_mm_sub_epi8 (block, bias), limit);
+		literal = _mm_andnot_si128 (_mm_cmpeq_epi8 (block, equal), literal);
+		
+		if ((mask = (unsigned int) _mm_movemask_epi8 (literal) ^ 0xffff) != 0)
+			return (size_t) (inptr - inbuf) + __builtin_ctz (mask);
+		
+		inptr += 16;
+	}
+	
+	while (inptr < inend && is_qp_literal (*inptr))
+		inptr++;
+	
+	return (size_t) (inptr - inbuf);
+}
+
+static AVX2 size_t
+qp_safe_span_avx2 (const unsigned char *inbuf, size_t inlen)
+{
+	const __m256i bias = _mm256_set1_epi8 ((char) (0x80 + 33));
+	const __m256i limit = _mm256_set1_epi8 (94 - 128);
+	const __m256i equal = _mm256_set1_epi8 ('=');
+	const unsigned char *inptr = inbuf;
+	const unsigned char *inend = inbuf + inlen;
+	__m256i block, literal;
+	unsigned int mask;
+	
+	while (inend - inptr >= 32) {
+		block = _mm256_loadu_si256 ((const __m256i *) inptr);
+		
+		literal = _mm256_cmpgt_epi8 (limit, _mm256_sub_epi8 (block, bias));
+		literal = _mm256_andnot_si256 (_mm256_cmpeq_epi8 (block, equal), literal);
+		
+		if ((mask = ~((unsigned int) _mm256_movemask_epi8 (literal))) != 0) {
+			_mm256_zeroupper ();
+			return (size_t) (inptr - inbuf) + __builtin_ctz (mask);
+		}
+		
+		inptr += 32;
+	}
+	
+	_mm256_zeroupper ();
+	
+	while (inptr < inend && is_qp_literal (*inptr))
+		inptr++;
+	
+	return (size_t) (inptr - inbuf);
+}
+
+#endif /* HAVE_X86_SIMD */
+
+
+/**
+ * g_mime_simd_qp_safe_span:
+ * @inbuf: input buffer
+ * @inlen: input buffer length
+ *
+ * Scans for the longest run of characters at the start of @inbuf that
+ * the quoted-printable encoder would output verbatim, i.e. printable
+ * US-ASCII other than '=' (whitespace is excluded since its encoding
+ * depends on what follows it).
+ *
+ * Returns: the length of the run, or %0 if no vectorized scanner is
+ * available.
+ **/
+size_t
+g_mime_simd_qp_safe_span (const unsigned char *inbuf, size_t inlen)
+{
+	switch (g_mime_simd_get_level ()) {
+#ifdef HAVE_X86_SIMD
+	case GMIME_SIMD_AVX2:
+		return qp_safe_span_avx2 (inbuf, inlen);
+	case GMIME_SIMD_SSSE3:
+		return qp_safe_span_ssse3 (inbuf, inlen);
+#endif
+	default:
+		return 0;
+	}
+}
+
+
+#ifdef HAVE_X86_SIMD
+
+static SSSE3 size_t
+yencode_span_ssse3 (const unsigned char *inbuf, size_t inlen, unsigned char *outbuf)
+{
+	const __m128i offset = _mm_set1_epi8 (42);
+	const unsigned char *inptr = inbuf;
+	const unsigned char *inend = inbuf + inlen;
+	unsigned char *outptr = outbuf;
+	__m128i block, critical;
+	unsigned int mask;
+	
+	while (inend - inptr >= 16) {
+		block = _mm_add_epi8 (_mm_loadu_si128 ((const __m128i *) inptr), offset);
+		
+		/* NUL, TAB, LF, CR and '=' must be escaped */
+		critical = _mm_cmpeq_epi8 (block, _mm_setzero_si128 ());
+		critical = _mm_or_si128 (critical, _mm_cmpeq_epi8 (block, _mm_set1_epi8 ('\t')));
+		critical = _mm_or_si128 (critical, _mm_cmpeq_epi8 (block, _mm_set1_epi8 ('\n')));
+		critical = _mm_or_si128 (critical, _mm_cmpeq_epi8 (block, _mm_set1_epi8 ('\r')));
+		critical = _mm_or_si128 (critical, _mm_cmpeq_epi8 (block, _mm_set1_epi8 ('=')));
+		
+		/* the caller overwrites anything past the first critical byte */
+		_mm_storeu_si128 ((__m128i *) outptr, block);
+		
+		if ((mask = (unsigned int) _mm_movemask_epi8 (critical)) != 0)
+			return (size_t) (inptr - inbuf) + __builtin_ctz (mask);
+		
+		outptr += 16;
+		inptr += 16;
+	}
+	
+	return (size_t) (inptr - inbuf);
+}
+
+static SSSE3 size_t
+ydecode_span_ssse3 (const unsigned char *inbuf, size_t inlen, unsigned char *outbuf)
+{
+	const __m128i offset = _mm_set1_epi8 (42);
+	const unsigned char *inptr = inbuf;
+	const unsigned char *inend = inbuf + inlen;
+	unsigned char *outptr = outbuf;
+	__m128i block, special;
+	unsigned int mask, n;
+	
+	while (inend - inptr >= 16) {
+		block = _mm_loadu_si128 ((const __m128i *) inptr);
+		special = _mm_or_si128 (_mm_cmpeq_epi8 (block, _mm_set1_epi8 ('=')),
+					_mm_cmpeq_epi8 (block, _mm_set1_epi8 ('\n')));
+		
+		if ((mask = (unsigned int) _mm_movemask_epi8 (special)) != 0) {
+			/* only write what we decode since @outbuf may trail @inbuf in the same buffer */
+			for (n = __builtin_ctz (mask); n > 0; n--)
+				*outptr++ = *inptr++ - 42;
+			break;
+		}
+		
+		_mm_storeu_si128 ((__m128i *) outptr, _mm_sub_epi8 (block, offset));
+		outptr += 16;
+		inptr += 16;
+	}
+	
+	return (size_t) (inptr - inbuf);
+}
+
+#endif /* HAVE_X86_SIMD */
+
+
+/**
+ * g_mime_simd_yencode_span:
+ * @inbuf: input buffer
+ * @inlen: input buffer length
+ * @outbuf: output buffer
+ *
+ * yEncodes the run of bytes at the start of @inbuf that do not need
+ * to be escaped, 16 bytes at a time. Up to 16 bytes past the end of
+ * the run may be clobbered in @outbuf, so the caller must continue
+ * writing from the end of the run.
+ *
+ * Returns: the number of bytes encoded (which is the same as the
+ * number of bytes consumed).
+ **/
+size_t
+g_mime_simd_yencode_span (const unsigned char *inbuf, size_t inlen, unsigned char *outbuf)
+{
+#ifdef HAVE_X86_SIMD
+	if (g_mime_simd_get_level () >= GMIME_SIMD_SSSE3)
+		return yencode_span_ssse3 (inbuf, inlen, outbuf);
+#endif
+	
+	return 0;
+}
+
+
+/**
+ * g_mime_simd_ydecode_span:
+ * @inbuf: input buffer
+ * @inlen: input buffer length
+ * @outbuf: output buffer
+ *
+ * yDecodes the run of bytes at the start of @inbuf up to the next
+ * escape or line break. @outbuf may be the same as @inbuf.
+ *
+ * Returns: the number of bytes decoded (which is the same as the
+ * number of bytes consumed).
+ **/
+size_t
+g_mime_simd_ydecode_span (const unsigned char *inbuf, size_t inlen, unsigned char *outbuf)
+{
+#ifdef HAVE_X86_SIMD
+	if (g_mime_simd_get_level () >= GMIME_SIMD_SSSE3)
+		return ydecode_span_ssse3 (inbuf, inlen, outbuf);
+#endif
+	
+	return 0;
+}
+
+
+#ifdef HAVE_X86_SIMD
+
+static SSSE3 size_t
+ascii_span_ssse3 (const unsigned char *inbuf, size_t inlen)
+{
+	const unsigned char *inptr = inbuf;
+	const unsigned char *inend = inbuf + inlen;
+	unsigned int mask;
+	
+	while (inend - inptr >= 16) {
+		/* the sign bit of each byte is set for anything outside of US-ASCII */
+		if ((mask = (unsigned int) _mm_movemask_epi8 (_mm_loadu_si128 ((const __m128i *) inptr))) != 0)
+			return (size_t) (inptr - inbuf) + __builtin_ctz (mask);
+		
+		inptr += 16;
+	}
+	
+	while (inptr < inend && *inptr < 0x80)
+		inptr++;
+	
+	return (size_t) (inptr - inbuf);
+}
+
+static AVX2 size_t
+ascii_span_avx2 (const unsigned char *inbuf, size_t inlen)
+{
+	const unsigned char *inptr = inbuf;
+	const unsigned char *inend = inbuf + inlen;
+	unsigned int mask;
+	
+	while (inend - inptr >= 64) {
+		__m256i lo = _mm256_loadu_si256 ((const __m256i *) inptr);
+		__m256i hi = _mm256_loadu_si256 ((const __m256i *) (inptr + 32));
+		
+		if (_mm256_movemask_epi8 (_mm256_or_si256 (lo, hi)) != 0) {
+			if ((mask = (unsigned int) _mm256_movemask_epi8 (lo)) == 0) {
+				mask = (unsigned int) _mm256_movemask_epi8 (hi);
+				inptr += 32;
+			}
+			
+			_mm256_zeroupper ();
+			return (size_t) (inptr - inbuf) + __builtin_ctz (mask);
+		}
+		
+		inptr += 64;
+	}
+	
+	if (inend - inptr >= 32) {
+		if ((mask = (unsigned int) _mm256_movemask_epi8 (_mm256_loadu_si256 ((const __m256i *) inptr))) != 0) {
+			_mm256_zeroupper ();
+			return (size_t) (inptr - inbuf) + __builtin_ctz (mask);
+		}
+		
+		inptr += 32;
+	}
+	
+	_mm256_zeroupper ();
+	
+	while (inptr < inend && *inptr < 0x80)
+		inptr++;
+	
+	return (size_t) (inptr - inbuf);
+}
+
+#endif /* HAVE_X86_SIMD */
+
+
+/**
+ * g_mime_simd_ascii_span:
+ * @inbuf: input buffer
+ * @inlen: input buffer length
+ *
+ * Scans for the longest run of US-ASCII characters at the start of
+ * @inbuf. Unlike the other scanners, this falls back to a scalar loop
+ * when no vectorized implementation is available.
+ *
+ * Returns: the length of the run.
+ **/
+size_t
+g_mime_simd_ascii_span (const unsigned char *inbuf, size_t inlen)
+{
+	const unsigned char *inptr = inbuf;
+	const unsigned char *inend = inbuf + inlen;
+	
+	switch (g_mime_simd_get_level ()) {
+#ifdef HAVE_X86_SIMD
+	case GMIME_SIMD_AVX2:
+		return ascii_span_avx2 (inbuf, inlen);
+	case GMIME_SIMD_SSSE3:
+		return ascii_span_ssse3 (inbuf, inlen);
+#endif
+	default:
+		while (inptr < inend && *inptr < 0x80)
+			inptr++;
+		
+		return (size_t) (inptr - inbuf);
+	}
+}
+
+
+/* number of bytes in a UTF-8 sequence given its lead byte, or 0 if
+ * the byte can never start a valid sequence (continuation bytes,
+ * overlong 2-byte leads and leads beyond U+10FFFF) */
+static const unsigned char utf8_seqlen[256] = {
+	1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+	1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+	1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+	1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+	1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+	1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+	1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+	1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2,
+	2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2,
+	3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3,
+	4, 4, 4, 4, 4, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0
+};
+
+/* checks the bytes following the lead byte of a sequence, stopping
+ * after @len bytes; returns the number of bytes that are valid */
+static size_t
+utf8_check_sequence (const unsigned char *inptr, size_t len)
+{
+	unsigned char lo = 0x80, hi = 0xbf;
+	size_t i;
+	
+	/* the second byte is further restricted to rule out overlong
+	 * forms, UTF-16 surrogates and code points beyond U+10FFFF */
+	switch (inptr[0]) {
+	case 0xe0: lo = 0xa0; break;
+	case 0xed: hi = 0x9f; break;
+	case 0xf0: lo = 0x90; break;
+	case 0xf4: hi = 0x8f; break;
+	}
+	
+	if (len < 2 || inptr[1] < lo || inptr[1] > hi)
+		return 1;
+	
+	for (i = 2; i < len; i++) {
+		if ((inptr[i] & 0xc0) != 0x80)
+			break;
+	}
+	
+	return i;
+}
+
+
+/**
+ * g_mime_simd_utf8_span:
+ * @inbuf: input buffer
+ * @inlen: input buffer length
+ *
+ * Scans for the longest run of complete, well-formed UTF-8 sequences
+ * at the start of @inbuf. Runs of US-ASCII are skipped with
+ * g_mime_simd_ascii_span() while multibyte sequences are validated
+ * one at a time.
+ *
+ * Returns: the length of the run.
+ **/
+size_t
+g_mime_simd_utf8_span (const unsigned char *inbuf, size_t inlen)
+{
+	const unsigned char *inptr = inbuf;
+	const unsigned char *inend = inbuf + inlen;
+	size_t n;
+	
+	while (inptr < inend) {
+		if (*inptr < 0x80) {
+			/* only hand off to the vectorized scanner if the next few bytes look like a run */
+			if (inend - inptr >= 8 && inptr[1] < 0x80 && inptr[2] < 0x80 && inptr[3] < 0x80)
+				inptr += g_mime_simd_ascii_span (inptr, (size_t) (inend - inptr));
+			else
+				inptr++;
+			continue;
+		}
+		
+		if ((n = utf8_seqlen[*inptr]) == 0 || (size_t) (inend - inptr) < n)
+			break;
+		
+		if (utf8_check_sequence (inptr, n) != n)
+			break;
+		
+		inptr += n;
+	}
+	
+	return (size_t) (inptr - inbuf);
+}
+
+
+/**
+ * g_mime_simd_utf8_incomplete:
+ * @inbuf: input buffer
+ * @inlen: input buffer length
+ *
+ * Checks whether @inbuf holds the beginning of a well-formed UTF-8
+ * sequence that has been cut short, i.e. one which could still be
+ * completed by the bytes that follow.
+ *
+ * Returns: %TRUE if @inbuf is a truncated UTF-8 sequence or %FALSE
+ * otherwise.
+ **/
+gboolean
+g_mime_simd_utf8_incomplete (const unsigned char *inbuf, size_t inlen)
+{
+	size_t n;
+	
+	if (inlen == 0 || (n = utf8_seqlen[inbuf[0]]) <= inlen)
+		return FALSE;
+	
+	return utf8_check_sequence (inbuf, inlen) == inlen;
+}
+
+
+#ifdef HAVE_X86_SIMD
+
+static SSSE3 size_t
+eol_span_ssse3 (const unsigned char *inbuf, size_t inlen)
+{
+	const __m128i cr = _mm_set1_epi8 ('\r');
+	const __m128i lf = _mm_set1_epi8 ('\n');
+	const unsigned char *inptr = inbuf;
+	const unsigned char *inend = inbuf + inlen;
+	__m128i block;
+	unsigned int mask;
+	
+	while (inend - inptr >= 16) {
+		block = _mm_loadu_si128 ((const __m128i *) inptr);
+		block = _mm_or_si128 (_mm_cmpeq_epi8 (block, cr), _mm_cmpeq_epi8 (block, lf));
+		
+		if ((mask = (unsigned int) _mm_movemask_epi8 (block)) != 0)
+			return (size_t) (inptr - inbuf) + __builtin_ctz (mask);
+		
+		inptr += 16;
+	}
+	
+	while (inptr < inend && *inptr != '\r' && *inptr != '\n')
+		inptr++;
+	
+	return (size_t) (inptr - inbuf);
+}
+
+static AVX2 size_t
+eol_span_avx2 (const unsigned char *inbuf, size_t inlen)
+{
+	const __m256i cr = _mm256_set1_epi8 ('\r');
+	const __m256i lf = _mm256_set1_epi8 ('\n');
+	const unsigned char *inptr = inbuf;
+	const unsigned char *inend = inbuf + inlen;
+	__m256i block;
+	unsigned int mask;
+	
+	while (inend - inptr >= 32) {
+		block = _mm256_loadu_si256 ((const __m256i *) inptr);
+		block = _mm256_or_si256 (_mm256_cmpeq_epi8 (block, cr), _mm256_cmpeq_epi8 (block, lf));
+		
+		if ((mask = (unsigned int) _mm256_movemask_epi8 (block)) != 0) {
+			_mm256_zeroupper ();
+			return (size_t) (inptr - inbuf) + __builtin_ctz (mask);
+		}
+		
+		inptr += 32;
+	}
+	
+	_mm256_zeroupper ();
+	
+	while (inptr < inend && *inptr != '\r' && *inptr != '\n')
+		inptr++;
+	
+	return (size_t) (inptr - inbuf);
+}
+
+#endif /* HAVE_X86_SIMD */
+
+
+/**
+ * g_mime_simd_eol_span:
+ * @inbuf: input buffer
+ * @inlen: input buffer length
+ *
+ * Scans for the longest run of characters at the start of @inbuf that
+ * contains neither a '\r' nor a '\n'. Like g_mime_simd_ascii_span(),
+ * this falls back to a scalar loop when no vectorized implementation
+ * is available.
+ *
+ * Returns: the length of the run.
+ **/
+size_t
+g_mime_simd_eol_span (const unsigned char *inbuf, size_t inlen)
+{
+	const unsigned char *inptr = inbuf;
+	const unsigned char *inend = inbuf + inlen;
+	
+	switch (g_mime_simd_get_level ()) {
+#ifdef HAVE_X86_SIMD
+	case GMIME_SIMD_AVX2:
+		return eol_span_avx2 (inbuf, inlen);
+	case GMIME_SIMD_SSSE3:
+		return eol_span_ssse3 (inbuf, inlen);
+#endif
+	default:
+		while (inptr < inend && *inptr != '\r' && *inptr != '\n')
+			inptr++;
+		
+		return (size_t) (inptr - inbuf);
+	}
+}
+
+
+#ifdef HAVE_X86_SIMD
+
+static SSSE3 size_t
+line_find_ssse3 (const unsigned char *inbuf, size_t inlen, unsigned char c0, unsigned char c1)
+{
+	const __m128i lf = _mm_set1_epi8 ('\n');
+	const __m128i v0 = _mm_set1_epi8 ((char) c0);
+	const __m128i v1 = _mm_set1_epi8 ((char) c1);
+	const unsigned char *inptr = inbuf;
+	const unsigned char *inend = inbuf + inlen;
+	__m128i block, next;
+	unsigned int mask;
+	
+	/* compare each byte against '\n' and the byte after it against c0/c1 */
+	while (inend - inptr >= 17) {
+		block = _mm_loadu_si128 ((const __m128i *) inptr);
+		next = _mm_loadu_si128 ((const __m128i *) (inptr + 1));
+		next = _mm_or_si128 (_mm_cmpeq_epi8 (next, v0), _mm_cmpeq_epi8 (next, v1));
+		block = _mm_and_si128 (_mm_cmpeq_epi8 (block, lf), next);
+		
+		if ((mask = (unsigned int) _mm_movemask_epi8 (block)) != 0)
+			return (size_t) (inptr - inbuf) + __builtin_ctz (mask);
+		
+		inptr += 16;
+	}
+	
+	return (size_t) (inptr - inbuf);
+}
+
+static AVX2 size_t
+line_find_avx2 (const unsigned char *inbuf, size_t inlen, unsigned char c0, unsigned char c1)
+{
+	const __m256i lf = _mm256_set1_epi8 ('\n');
+	const __m256i v0 = _mm256_set1_epi8 ((char) c0);
+	const __m256i v1 = _mm256_set1_epi8 ((char) c1);
+	const unsigned char *inptr = inbuf;
+	const unsigned char *inend = inbuf + inlen;
+	__m256i block, next;
+	unsigned int mask;
+	
+	while (inend - inptr >= 33) {
+		block = _mm256_loadu_si256 ((const __m256i *) inptr);
+		next = _mm256_loadu_si256 ((const __m256i *) (inptr + 1));
+		next = _mm256_or_si256 (_mm256_cmpeq_epi8 (next, v0), _mm256_cmpeq_epi8 (next, v1));
+		block = _mm256_and_si256 (_mm256_cmpeq_epi8 (block, lf), next);
+		
+		if ((mask = (unsigned int) _mm256_movemask_epi8 (block)) != 0) {
+			_mm256_zeroupper ();
+			return (size_t) (inptr - inbuf) + __builtin_ctz (mask);
+		}
+		
+		inptr += 32;
+	}
+	
+	_mm256_zeroupper ();
+	
+	return (size_t) (inptr - inbuf);
+}
+
+#endif /* HAVE_X86_SIMD */
+
+
+/**
+ * g_mime_simd_line_find:
+ * @inbuf: input buffer
+ * @inlen: input buffer length
+ * @c0: a character that an interesting line may start with
+ * @c1: another character that an interesting line may start with
+ *
+ * Scans for the first '\n' in @inbuf that is followed by either @c0
+ * or @c1, or that is the last character of @inbuf (in which case the
+ * following line cannot be ruled out yet). This allows callers that
+ * only care about lines with a particular prefix (such as MIME
+ * boundaries or OpenPGP armor markers) to skip over all other lines
+ * at once.
+ *
+ * Returns: the offset of the '\n' or @inlen if there is none.
+ **/
+size_t
+g_mime_simd_line_find (const unsigned char *inbuf, size_t inlen, unsigned char c0, unsigned char c1)
+{
+	const unsigned char *inend = inbuf + inlen;
+	const unsigned char *inptr = inbuf;
+	
+	switch (g_mime_simd_get_level ()) {
+#ifdef HAVE_X86_SIMD
+	case GMIME_SIMD_AVX2:
+		inptr += line_find_avx2 (inbuf, inlen, c0, c1);
+		break;
+	case GMIME_SIMD_SSSE3:
+		inptr += line_find_ssse3 (inbuf, inlen, c0, c1);
+		break;
+#endif
+	default:
+		break;
+	}
+	
+	while (inptr < inend) {
+		if (*inptr == '\n' && (inptr + 1 == inend || inptr[1] == c0 || inptr[1] == c1))
+			break;
+		
+		inptr++;
+	}
+	
+	return (size_t) (inptr - inbuf);
+}
+
+
+#ifdef HAVE_X86_SIMD
+
+static SSSE3 size_t
+text_stats_ssse3 (const unsigned char *inbuf, size_t inlen, GMimeSimdTextStats *stats)
+{
+	const __m128i zero = _mm_setzero_si128 ();
+	const __m128i lf = _mm_set1_epi8 ('\n');
+	const unsigned char *inend = inbuf + inlen;
+	const unsigned char *linestart = inbuf;
+	const unsigned char *inptr = inbuf;
+	size_t linelen = stats->linelen;
+	size_t maxline = stats->maxline;
+	__m128i block, acc0, acc8;
+	unsigned int mask, i;
+	guint64 sums[2];
+	
+	while (inend - inptr >= 16) {
+		/* each byte of the accumulators counts up to 255 matches in its lane */
+		acc0 = acc8 = zero;
+		
+		for (i = 0; i < 255 && inend - inptr >= 16; i++, inptr += 16) {
+			block = _mm_loadu_si128 ((const __m128i *) inptr);
+			acc0 = _mm_sub_epi8 (acc0, _mm_cmpeq_epi8 (block, zero));
+			acc8 = _mm_sub_epi8 (acc8, _mm_cmplt_epi8 (block, zero));
+			
+			mask = (unsigned int) _mm_movemask_epi8 (_mm_cmpeq_epi8 (block, lf));
+			while (mask != 0) {
+				const unsigned char *eoln = inptr + __builtin_ctz (mask);
+				
+				linelen += eoln - linestart;
+				maxline = MAX (maxline, linelen);
+				linestart = eoln + 1;
+				linelen = 0;
+				
+				mask &= mask - 1;
+			}
+		}
+		
+		_mm_storeu_si128 ((__m128i *) sums, _mm_sad_epu8 (acc0, zero));
+		stats->count0 += sums[0] + sums[1];
+		_mm_storeu_si128 ((__m128i *) sums, _mm_sad_epu8 (acc8, zero));
+		stats->count8 += sums[0] + sums[1];
+	}
+	
+	stats->linelen = linelen + (inptr - linestart);
+	stats->maxline = maxline;
+	
+	return (size_t) (inptr - inbuf);
+}
+
+static AVX2 size_t
+text_stats_avx2 (const unsigned char *inbuf, size_t inlen, GMimeSimdTextStats *stats)
+{
+	const __m256i zero = _mm256_setzero_si256 ();
+	const __m256i lf = _mm256_set1_epi8 ('\n');
+	const unsigned char *inend = inbuf + inlen;
+	const unsigned char *linestart = inbuf;
+	const unsigned char *inptr = inbuf;
+	size_t linelen = stats->linelen;
+	size_t maxline = stats->maxline;
+	__m256i block, acc0, acc8;
+	unsigned int mask, i;
+	guint64 sums[4];
+	
+	while (inend - inptr >= 32) {
+		acc0 = acc8 = zero;
+		
+		for (i = 0; i < 255 && inend - inptr >= 32; i++, inptr += 32) {
+			block = _mm256_loadu_si256 ((const __m256i *) inptr);
+			acc0 = _mm256_sub_epi8 (acc0, _mm256_cmpeq_epi8 (block, zero));
+			acc8 = _mm256_sub_epi8 (acc8, _mm256_cmpgt_epi8 (zero, block));
+			
+			mask = (unsigned int) _mm256_movemask_epi8 (_mm256_cmpeq_epi8 (block, lf));
+			while (mask != 0) {
+				const unsigned char *eoln = inptr + __builtin_ctz (mask);
+				
+				linelen += eoln - linestart;
+				maxline = MAX (maxline, linelen);
+				linestart = eoln + 1;
+				linelen = 0;
+				
+				mask &= mask - 1;
+			}
+		}
+		
+		_mm256_storeu_si256 ((__m256i *) sums, _mm256_sad_epu8 (acc0, zero));
+		stats->count0 += sums[0] + sums[1] + sums[2] + sums[3];
+		_mm256_storeu_si256 ((__m256i *) sums, _mm256_sad_epu8 (acc8, zero));
+		stats->count8 += sums[0] + sums[1] + sums[2] + sums[3];
+	}
+	
+	_mm256_zeroupper ();
+	
+	stats->linelen = linelen + (inptr - linestart);
+	stats->maxline = maxline;
+	
+	return (size_t) (inptr - inbuf);
+}
+
+#endif /* HAVE_X86_SIMD */
+
+
+/**
+ * g_mime_simd_text_stats:
+ * @inbuf: input buffer
+ * @inlen: input buffer length
+ * @stats: the statistics to update
+ *
+ * Updates @stats with the number of nul bytes and of bytes with the
+ * high bit set in @inbuf, as well as the length of the longest line
+ * (not counting the '\n'). The length of the last, unterminated, line
+ * is carried over in @stats->linelen so that a text may be scanned in
+ * any number of pieces; it is up to the caller to account for it in
+ * @stats->maxline once the end of the text is reached.
+ **/
+void
+g_mime_simd_text_stats (const unsigned char *inbuf, size_t inlen, GMimeSimdTextStats *stats)
+{
+	const unsigned char *inend = inbuf + inlen;
+	const unsigned char *inptr = inbuf;
+	
+	switch (g_mime_simd_get_level ()) {
+#ifdef HAVE_X86_SIMD
+	case GMIME_SIMD_AVX2:
+		inptr += text_stats_avx2 (inbuf, inlen, stats);
+		break;
+	case GMIME_SIMD_SSSE3:
+		inptr += text_stats_ssse3 (inbuf, inlen, stats);
+		break;
+#endif
+	default:
+		break;
+	}
+	
+	while (inptr < inend) {
+		if (*inptr == '\n') {
+			stats->maxline = MAX (stats->maxline, stats->linelen);
+			stats->linelen = 0;
+		} else {
+			if (*inptr == 0)
+				stats->count0++;
+			else if (*inptr & 0x80)
+				stats->count8++;
+			
+			stats->linelen++;
+		}
+		
+		inptr++;
+	}
+}
+
+
+#ifdef HAVE_X86_SIMD
+
+static SSSE3 size_t
+html_text_span_ssse3 (const unsigned char *inbuf, size_t inlen, unsigned char *outbuf)
+{
+	const __m128i space = _mm_set1_epi8 (' ');
+	const __m128i amp = _mm_set1_epi8 ('&');
+	const __m128i lt = _mm_set1_epi8 ('<');
+	const unsigned char *inptr = inbuf;
+	const unsigned char *inend = inbuf + inlen;
+	unsigned char *outptr = outbuf;
+	unsigned int ws, sp, special;
+	__m128i block;
+	
+	/* the byte after the block tells us whether a trailing space starts a run of whitespace */
+	while (inend - inptr > 16) {
+		block = _mm_loadu_si128 ((const __m128i *) inptr);
+		
+		ws = (unsigned int) _mm_movemask_epi8 (_mm_cmpeq_epi8 (_mm_min_epu8 (block, space), block));
+		sp = (unsigned int) _mm_movemask_epi8 (_mm_cmpeq_epi8 (block, space));
+		special = (unsigned int) _mm_movemask_epi8 (_mm_or_si128 (_mm_cmpeq_epi8 (block, lt), _mm_cmpeq_epi8 (block, amp)));
+		special |= ws & ~sp;
+		special |= sp & ((ws >> 1) | ((unsigned int) (inptr[16] <= ' ') << 15));
+		
+		/* the caller overwrites anything past the first special byte */
+		_mm_storeu_si128 ((__m128i *) outptr, block);
+		
+		if (special != 0)
+			return (size_t) (inptr - inbuf) + __builtin_ctz (special);
+		
+		outptr += 16;
+		inptr += 16;
+	}
+	
+	return (size_t) (inptr - inbuf);
+}
+
+static AVX2 size_t
+html_text_span_avx2 (const unsigned char *inbuf, size_t inlen, unsigned char *outbuf)
+{
+	const __m256i space = _mm256_set1_epi8 (' ');
+	const __m256i amp = _mm256_set1_epi8 ('&');
+	const __m256i lt = _mm256_set1_epi8 ('<');
+	const unsigned char *inptr = inbuf;
+	const unsigned char *inend = inbuf + inlen;
+	unsigned char *outptr = outbuf;
+	unsigned int ws, sp, special;
+	__m256i block;
+	
+	while (inend - inptr > 32) {
+		block = _mm256_loadu_si256 ((const __m256i *) inptr);
+		
+		ws = (unsigned int) _mm256_movemask_epi8 (_mm256_cmpeq_epi8 (_mm256_min_epu8 (block, space), block));
+		sp = (unsigned int) _mm256_movemask_epi8 (_mm256_cmpeq_epi8 (block, space));
+		special = (unsigned int) _mm256_movemask_epi8 (_mm256_or_si256 (_mm256_cmpeq_epi8 (block, lt), _mm256_cmpeq_epi8 (block, amp)));
+		special |= ws & ~sp;
+		special |= sp & ((ws >> 1) | ((unsigned int) (inptr[32] <= ' ') << 31));
+		
+		_mm256_storeu_si256 ((__m256i *) outptr, block);
+		
+		if (special != 0) {
+			_mm256_zeroupper ();
+			return (size_t) (inptr - inbuf) + __builtin_ctz (special);
+		}
+		
+		outptr += 32;
+		inptr += 32;
+	}
+	
+	_mm256_zeroupper ();
+	
+	return (size_t) (inptr - inbuf);
+}
+
+#endif /* HAVE_X86_SIMD */
+
+
+/**
+ * g_mime_simd_html_text_span:
+ * @inbuf: input buffer
+ * @inlen: input buffer length
+ * @outbuf: output buffer
+ *
+ * Copies the run of bytes at the start of @inbuf that an HTML to text
+ * converter can output verbatim: anything but '<', '&', control
+ * characters and a space that is followed by more whitespace. Up to
+ * 32 bytes past the end of the run may be clobbered in @outbuf, so
+ * the caller must continue writing from the end of the run.
+ *
+ * Returns: the number of bytes copied, or %0 if no vectorized scanner
+ * is available.
+ **/
+size_t
+g_mime_simd_html_text_span (const unsigned char *inbuf, size_t inlen, unsigned char *outbuf)
+{
+	switch (g_mime_simd_get_level ()) {
+#ifdef HAVE_X86_SIMD
+	case GMIME_SIMD_AVX2:
+		return html_text_span_avx2 (inbuf, inlen, outbuf);
+	case GMIME_SIMD_SSSE3:
+		return html_text_span_ssse3 (inbuf, inlen, outbuf);
+#endif
+	default:
+		return 0;
+	}
+}
+
+
+#ifdef HAVE_X86_SIMD
+
+static SSE42 guint32
+crc32c_sse42 (guint32 crc, const unsigned char *inbuf, size_t inlen)
+{
+	const unsigned char *inptr = inbuf;
+	const unsigned char *inend = inbuf + inlen;
+#ifdef __x86_64__
+	guint64 crc64 = crc;
+	guint64 word;
+	
+	while (inend - inptr >= 8) {
+		memcpy (&word, inptr, sizeof (word));
+		crc64 = _mm_crc32_u64 (crc64, word);
+		inptr += 8;
+	}
+	
+	crc = (guint32) crc64;
+#else
+	guint32 word;
+	
+	while (inend - inptr >= 4) {
+		memcpy (&word, inptr, sizeof (word));
+		crc = _mm_crc32_u32 (crc, word);
+		inptr += 4;
+	}
+#endif
+	
+	while (inptr < inend)
+		crc = _mm_crc32_u8 (crc, *inptr++);
+	
+	return crc;
+}
+
+#endif /* HAVE_X86_SIMD */
+
+
+/**
+ * g_mime_simd_has_crc32c:
+ *
+ * Checks whether g_mime_simd_crc32c() can be used.
+ *
+ * Returns: %TRUE if the host CPU can calculate CRC32C checksums.
+ **/
+gboolean
+g_mime_simd_has_crc32c (void)
+{
+	return (simd_get_features () & SIMD_FEATURE_CRC32C) != 0;
+}
+
+
+/**
+ * g_mime_simd_crc32c:
+ * @crc: the current CRC register
+ * @inbuf: input buffer
+ * @inlen: input buffer length
+ *
+ * Updates the (reflected and not inverted) CRC32C register @crc with
+ * the contents of @inbuf. Must only be used if g_mime_simd_has_crc32c()
+ * returns %TRUE.
+ *
+ * Returns: the updated CRC register.
+ **/
+guint32
+g_mime_simd_crc32c (guint32 crc, const unsigned char *inbuf, size_t inlen)
+{
+#ifdef HAVE_X86_SIMD
+	return crc32c_sse42 (crc, inbuf, inlen);
+#else
+	g_assert_not_reached ();
+	return crc;
+#endif
+}
+
+
+#if defined (HAVE_X86_SIMD) && defined (HAVE_X86_SHA)
+
+static const guint32 sha256_k[64] = {
+	0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+	0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+	0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+	0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+	0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+	0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+	0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+	0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+/* performs 4 rounds using the message words in @w */
+#define SHA256_ROUNDS(w, k)						\
+	msg = _mm_add_epi32 (w, _mm_loadu_si128 ((const __m128i *) (k))); \
+	state1 = _mm_sha256rnds2_epu32 (state1, state0, msg);		\
+	state0 = _mm_sha256rnds2_epu32 (state0, state1, _mm_shuffle_epi32 (msg, 0x0e))
+
+/* computes the next 4 message words, replacing @w0 (the oldest) */
+#define SHA256_SCHEDULE(w0, w1, w2, w3)					\
+	w0 = _mm_sha256msg2_epu32 (_mm_add_epi32 (_mm_sha256msg1_epu32 (w0, w1), _mm_alignr_epi8 (w3, w2, 4)), w3)
+
+static SHA void
+sha256_blocks_sha (guint32 state[8], const unsigned char *inbuf, size_t nblocks)
+{
+	const __m128i bswap = _mm_set_epi64x (0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL);
+	__m128i state0, state1, abef, cdgh, msg, tmp;
+	__m128i m0, m1, m2, m3;
+	int i;
+	
+	/* the instructions want the state as ABEF and CDGH */
+	tmp = _mm_shuffle_epi32 (_mm_loadu_si128 ((const __m128i *) &state[0]), 0xb1);
+	state1 = _mm_shuffle_epi32 (_mm_loadu_si128 ((const __m128i *) &state[4]), 0x1b);
+	state0 = _mm_alignr_epi8 (tmp, state1, 8);
+	state1 = _mm_blend_epi16 (state1, tmp, 0xf0);
+	
+	while (nblocks-- > 0) {
+		abef = state0;
+		cdgh = state1;
+		
+		m0 = _mm_shuffle_epi8 (_mm_loadu_si128 ((const __m128i *) (inbuf + 0)), bswap);
+		m1 = _mm_shuffle_epi8 (_mm_loadu_si128 ((const __m128i *) (inbuf + 16)), bswap);
+		m2 = _mm_shuffle_epi8 (_mm_loadu_si128 ((const __m128i *) (inbuf + 32)), bswap);
+		m3 = _mm_shuffle_epi8 (_mm_loadu_si128 ((const __m128i *) (inbuf + 48)), bswap);
+		
+		SHA256_ROUNDS (m0, sha256_k + 0);
+		SHA256_ROUNDS (m1, sha256_k + 4);
+		SHA256_ROUNDS (m2, sha256_k + 8);
+		SHA256_ROUNDS (m3, sha256_k + 12);
+		
+		for (i = 16; i < 64; i += 16) {
+			SHA256_SCHEDULE (m0, m1, m2, m3);
+			SHA256_ROUNDS (m0, sha256_k + i);
+			SHA256_SCHEDULE (m1, m2, m3, m0);
+			SHA256_ROUNDS (m1, sha256_k + i + 4);
+			SHA256_SCHEDULE (m2, m3, m0, m1);
+			SHA256_ROUNDS (m2, sha256_k + i + 8);
+			SHA256_SCHEDULE (m3, m0, m1, m2);
+			SHA256_ROUNDS (m3, sha256_k + i + 12);
+		}
+		
+		state0 = _mm_add_epi32 (state0, abef);
+		state1 = _mm_add_epi32 (state1, cdgh);
+		inbuf += 64;
+	}
+	
+	/* and back to ABCD and EFGH */
+	tmp = _mm_shuffle_epi32 (state0, 0x1b);
+	state1 = _mm_shuffle_epi32 (state1, 0xb1);
+	_mm_storeu_si128 ((__m128i *) &state[0], _mm_blend_epi16 (tmp, state1, 0xf0));
+	_mm_storeu_si128 ((__m128i *) &state[4], _mm_alignr_epi8 (state1, tmp, 8));
+}
+
+#endif /* HAVE_X86_SIMD && HAVE_X86_SHA */
+
+
+/**
+ * g_mime_simd_has_sha256:
+ *
+ * Checks whether g_mime_simd_sha256_blocks() can be used.
+ *
+ * Returns: %TRUE if the host CPU has the SHA extensions.
+ **/
+gboolean
+g_mime_simd_has_sha256 (void)
+{
+	return (simd_get_features () & SIMD_FEATURE_SHA256) != 0;
+}
+
+
+/**
+ * g_mime_simd_sha256_blocks:
+ * @state: the SHA-256 hash state (A through H)
+ * @inbuf: input buffer
+ * @nblocks: the number of 64-byte blocks in @inbuf
+ *
+ * Runs the SHA-256 compression function over each block of @inbuf.
+ * Must only be used if g_mime_simd_has_sha256() returns %TRUE.
+ **/
+void
+g_mime_simd_sha256_blocks (guint32 state[8], const unsigned char *inbuf, size_t nblocks)
+{
+#if defined (HAVE_X86_SIMD) && defined (HAVE_X86_SHA)
+	sha256_blocks_sha (state, inbuf, nblocks);
+#else
+	g_assert_not_reached ();
+#endif
+}
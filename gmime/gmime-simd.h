@@ -0,0 +1,78 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*- */
+/*  GMime
+ *  Copyright (C) 2000-2022 Jeffrey Stedfast
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public License
+ *  as published by the Free Software Foundation; either version 2.1
+ *  of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free
+ *  Software Foundation, 51 Franklin Street, Fifth Floor, Boston, MA
+ *  02110-1301, USA.
+ */
+
+
+#ifndef __GMIME_SIMD_H__
+#define __GMIME_SIMD_H__
+
+#include <sys/types.h>
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+typedef enum {
+	GMIME_SIMD_NONE,
+	GMIME_SIMD_SSSE3,
+	GMIME_SIMD_AVX2
+} GMimeSimdLevel;
+
+G_GNUC_INTERNAL GMimeSimdLevel g_mime_simd_get_level (void);
+
+G_GNUC_INTERNAL size_t g_mime_simd_base64_encode_lines (const unsigned char *inbuf, size_t nlines, unsigned char *outbuf);
+
+G_GNUC_INTERNAL size_t g_mime_simd_base64_decode (const unsigned char *inbuf, size_t inlen, unsigned char *outbuf, size_t *nread);
+
+G_GNUC_INTERNAL size_t g_mime_simd_qp_safe_span (const unsigned char *inbuf, size_t inlen);
+
+G_GNUC_INTERNAL size_t g_mime_simd_yencode_span (const unsigned char *inbuf, size_t inlen, unsigned char *outbuf);
+
+G_GNUC_INTERNAL size_t g_mime_simd_ydecode_span (const unsigned char *inbuf, size_t inlen, unsigned char *outbuf);
+
+G_GNUC_INTERNAL size_t g_mime_simd_ascii_span (const unsigned char *inbuf, size_t inlen);
+
+G_GNUC_INTERNAL size_t g_mime_simd_utf8_span (const unsigned char *inbuf, size_t inlen);
+
+G_GNUC_INTERNAL gboolean g_mime_simd_utf8_incomplete (const unsigned char *inbuf, size_t inlen);
+
+G_GNUC_INTERNAL size_t g_mime_simd_eol_span (const unsigned char *inbuf, size_t inlen);
+
+G_GNUC_INTERNAL size_t g_mime_simd_line_find (const unsigned char *inbuf, size_t inlen, unsigned char c0, unsigned char c1);
+
+typedef struct {
+	size_t count0;
+	size_t count8;
+	size_t linelen;
+	size_t maxline;
+} GMimeSimdTextStats;
+
+G_GNUC_INTERNAL void g_mime_simd_text_stats (const unsigned char *inbuf, size_t inlen, GMimeSimdTextStats *stats);
+
+G_GNUC_INTERNAL size_t g_mime_simd_html_text_span (const unsigned char *inbuf, size_t inlen, unsigned char *outbuf);
+
+G_GNUC_INTERNAL gboolean g_mime_simd_has_crc32c (void);
+G_GNUC_INTERNAL guint32 g_mime_simd_crc32c (guint32 crc, const unsigned char *inbuf, size_t inlen);
+
+G_GNUC_INTERNAL gboolean g_mime_simd_has_sha256 (void);
+G_GNUC_INTERNAL void g_mime_simd_sha256_blocks (guint32 state[8], const unsigned char *inbuf, size_t nblocks);
+
+G_END_DECLS
+
+#endif /* __GMIME_SIMD_H__ */
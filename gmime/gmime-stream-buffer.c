@@ -35,17 +35,26 @@
  * @see_also: #GMimeStream
  *
  * A #GMimeStreamBuffer can be used on top of any other type of stream
- * and has 3 modes: block reads, block writes, and cached reads. Block
+ * and has 3 modes: block reads, block writes, and read-ahead. Block
  * reads are especially useful if you will be making a lot of small
  * reads from a stream that accesses the file system. Block writes are
- * useful for very much the same reason. The final mode, cached reads,
- * can become memory intensive but can be very helpful when inheriting
- * from a stream that does not support seeking (Note: this mode is the
- * least tested so be careful using it).
+ * useful for very much the same reason. The read-ahead mode behaves
+ * like block reads, but tops the buffer back up from the source once
+ * it drains below a quarter of its size so that lines rarely straddle
+ * a refill; since this may issue a read before the caller asks for
+ * more data, it should not be used on interactive sources such as
+ * sockets.
+ *
+ * The size of the internal buffer defaults to 4096 bytes and may be
+ * chosen at construction time using
+ * g_mime_stream_buffer_new_with_size().
  **/
 
 #define BLOCK_BUFFER_LEN   4096
 
+#define BUFFER_SIZE(buffer) ((size_t) ((buffer)->bufend - (buffer)->buffer))
+#define BUFFER_READS(buffer) ((buffer)->mode != GMIME_STREAM_BUFFER_BLOCK_WRITE)
+
 static void g_mime_stream_buffer_class_init (GMimeStreamBufferClass *klass);
 static void g_mime_stream_buffer_init (GMimeStreamBuffer *stream, GMimeStreamBufferClass *klass);
 static void g_mime_stream_buffer_finalize (GObject *object);
@@ -134,18 +143,58 @@ g_mime_stream_buffer_finalize (GObject *object)
 }
 
 
+/* moves any unread data to the front of the buffer and fills the rest */
+static ssize_t
+buffer_fill (GMimeStreamBuffer *buffer)
+{
+	size_t size = BUFFER_SIZE (buffer);
+	ssize_t n;
+	
+	if (buffer->buflen > 0 && buffer->bufptr > buffer->buffer)
+		memmove (buffer->buffer, buffer->bufptr, buffer->buflen);
+	
+	buffer->bufptr = buffer->buffer;
+	
+	if (buffer->buflen == size)
+		return 0;
+	
+	if ((n = g_mime_stream_read (buffer->source, buffer->buffer + buffer->buflen, size - buffer->buflen)) > 0)
+		buffer->buflen += n;
+	
+	return n;
+}
+
+/* in read-ahead mode, top the buffer up before it runs dry */
+static void
+buffer_read_ahead (GMimeStreamBuffer *buffer)
+{
+	if (buffer->mode != GMIME_STREAM_BUFFER_READ_AHEAD)
+		return;
+	
+	if (buffer->buflen >= BUFFER_SIZE (buffer) / 4)
+		return;
+	
+	if (g_mime_stream_eos (buffer->source))
+		return;
+	
+	buffer_fill (buffer);
+}
+
 static ssize_t
 stream_read (GMimeStream *stream, char *buf, size_t len)
 {
 	GMimeStreamBuffer *buffer = (GMimeStreamBuffer *) stream;
 	ssize_t n, nread = 0;
+	size_t size;
 	
 	if (buffer->source == NULL) {
 		errno = EBADF;
 		return -1;
 	}
 	
-	if (buffer->mode == GMIME_STREAM_BUFFER_BLOCK_READ) {
+	if (BUFFER_READS (buffer)) {
+		size = BUFFER_SIZE (buffer);
+		
 		while (len > 0) {
 			/* consume what we can from any pre-buffered data we have left */
 			if ((n = MIN (buffer->buflen, len)) > 0) {
@@ -156,7 +205,7 @@ stream_read (GMimeStream *stream, char *buf, size_t len)
 				len -= n;
 			}
 			
-			if (len >= BLOCK_BUFFER_LEN) {
+			if (len >= size) {
 				/* bypass intermediate buffer, read straight from disk */
 				buffer->bufptr = buffer->buffer;
 				if ((n = g_mime_stream_read (buffer->source, buf + nread, len)) > 0) {
@@ -167,7 +216,7 @@ stream_read (GMimeStream *stream, char *buf, size_t len)
 				break;
 			} else if (len > 0) {
 				/* buffer more data */
-				if ((n = g_mime_stream_read (buffer->source, buffer->buffer, BLOCK_BUFFER_LEN)) > 0)
+				if ((n = g_mime_stream_read (buffer->source, buffer->buffer, size)) > 0)
 					buffer->buflen = n;
 				
 				buffer->bufptr = buffer->buffer;
@@ -180,6 +229,8 @@ stream_read (GMimeStream *stream, char *buf, size_t len)
 				break;
 			}
 		}
+		
+		buffer_read_ahead (buffer);
 	} else {
 		if ((nread = g_mime_stream_read (buffer->source, buf, len)) == -1)
 			return -1;
@@ -197,6 +248,7 @@ stream_write (GMimeStream *stream, const char *buf, size_t len)
 	GMimeStream *source = buffer->source;
 	ssize_t n, nwritten = 0;
 	size_t left = len;
+	size_t size;
 	
 	if (buffer->source == NULL) {
 		errno = EBADF;
@@ -204,9 +256,11 @@ stream_write (GMimeStream *stream, const char *buf, size_t len)
 	}
 	
 	if (buffer->mode == GMIME_STREAM_BUFFER_BLOCK_WRITE) {
+		size = BUFFER_SIZE (buffer);
+		
 		while (left > 0) {
-			n = MIN (BLOCK_BUFFER_LEN - buffer->buflen, left);
-			if (buffer->buflen > 0 || n < BLOCK_BUFFER_LEN) {
+			n = MIN (size - buffer->buflen, left);
+			if (buffer->buflen > 0 || n < size) {
 				/* add the data to our pending write buffer */
 				memcpy (buffer->bufptr, buf + nwritten, n);
 				buffer->bufptr += n;
@@ -215,16 +269,16 @@ stream_write (GMimeStream *stream, const char *buf, size_t len)
 				left -= n;
 			}
 			
-			if (buffer->buflen == BLOCK_BUFFER_LEN) {
+			if (buffer->buflen == size) {
 				/* flush our buffer... */
-				n = g_mime_stream_write (source, buffer->buffer, BLOCK_BUFFER_LEN);
-				if (n == BLOCK_BUFFER_LEN) {
+				n = g_mime_stream_write (source, buffer->buffer, size);
+				if (n == (ssize_t) size) {
 					/* wrote everything... */
 					buffer->bufptr = buffer->buffer;
 					buffer->buflen = 0;
 				} else if (n > 0) {
 					/* still have buffered data left... */
-					memmove (buffer->buffer, buffer->buffer + n, BLOCK_BUFFER_LEN - n);
+					memmove (buffer->buffer, buffer->buffer + n, size - n);
 					buffer->bufptr -= n;
 					buffer->buflen -= n;
 				} else if (n == -1) {
@@ -235,9 +289,9 @@ stream_write (GMimeStream *stream, const char *buf, size_t len)
 				}
 			}
 			
-			if (buffer->buflen == 0 && left >= BLOCK_BUFFER_LEN) {
-				while (left >= BLOCK_BUFFER_LEN) {
-					if ((n = g_mime_stream_write (source, buf + nwritten, BLOCK_BUFFER_LEN)) == -1) {
+			if (buffer->buflen == 0 && left >= size) {
+				while (left >= size) {
+					if ((n = g_mime_stream_write (source, buf + nwritten, size)) == -1) {
 						if (nwritten == 0)
 							return -1;
 						
@@ -248,7 +302,7 @@ stream_write (GMimeStream *stream, const char *buf, size_t len)
 					left -= n;
 				}
 				
-				if (left >= BLOCK_BUFFER_LEN)
+				if (left >= size)
 					break;
 			}
 		}
@@ -315,7 +369,7 @@ stream_eos (GMimeStream *stream)
 	if (!g_mime_stream_eos (buffer->source))
 		return FALSE;
 	
-	if (buffer->mode == GMIME_STREAM_BUFFER_BLOCK_READ)
+	if (BUFFER_READS (buffer))
 		return buffer->buflen == 0;
 	
 	return TRUE;
@@ -430,7 +484,7 @@ stream_seek (GMimeStream *stream, gint64 offset, GMimeSeekWhence whence)
 		return -1;
 	}
 	
-	if (buffer->mode == GMIME_STREAM_BUFFER_BLOCK_READ)
+	if (BUFFER_READS (buffer))
 		return stream_seek_block_read (stream, offset, whence);
 	
 	if (stream_flush (stream) != 0)
@@ -485,16 +539,36 @@ stream_substream (GMimeStream *stream, gint64 start, gint64 end)
  * @source: source stream
  * @mode: buffering mode
  *
- * Creates a new GMimeStreamBuffer object.
+ * Creates a new GMimeStreamBuffer object with a 4096 byte buffer.
  *
  * Returns: a new buffer stream with source @source and mode @mode.
  **/
 GMimeStream *
 g_mime_stream_buffer_new (GMimeStream *source, GMimeStreamBufferMode mode)
+{
+	return g_mime_stream_buffer_new_with_size (source, mode, BLOCK_BUFFER_LEN);
+}
+
+
+/**
+ * g_mime_stream_buffer_new_with_size:
+ * @source: source stream
+ * @mode: buffering mode
+ * @size: size of the internal buffer, in bytes
+ *
+ * Creates a new GMimeStreamBuffer object with an internal buffer of
+ * @size bytes. Larger buffers reduce the number of reads issued on
+ * @source at the cost of memory.
+ *
+ * Returns: a new buffer stream with source @source and mode @mode.
+ **/
+GMimeStream *
+g_mime_stream_buffer_new_with_size (GMimeStream *source, GMimeStreamBufferMode mode, size_t size)
 {
 	GMimeStreamBuffer *buffer;
 	
 	g_return_val_if_fail (GMIME_IS_STREAM (source), NULL);
+	g_return_val_if_fail (size > 0, NULL);
 	
 	buffer = g_object_new (GMIME_TYPE_STREAM_BUFFER, NULL);
 	
@@ -502,8 +576,8 @@ g_mime_stream_buffer_new (GMimeStream *source, GMimeStreamBufferMode mode)
 	g_object_ref (source);
 	
 	buffer->mode = mode;
-	buffer->buffer = g_malloc (BLOCK_BUFFER_LEN);
-	buffer->bufend = buffer->buffer + BLOCK_BUFFER_LEN;
+	buffer->buffer = g_malloc (size);
+	buffer->bufend = buffer->buffer + size;
 	buffer->bufptr = buffer->buffer;
 	buffer->buflen = 0;
 	
@@ -533,10 +607,11 @@ g_mime_stream_buffer_new (GMimeStream *source, GMimeStreamBufferMode mode)
 ssize_t
 g_mime_stream_buffer_gets (GMimeStream *stream, char *buf, size_t max)
 {
-	register char *inptr, *outptr;
-	char *inend, *outend;
-	ssize_t nread, n;
+	register char *outptr;
+	char *outend, *eoln;
+	ssize_t nread;
 	char c = '\0';
+	size_t len;
 	
 	g_return_val_if_fail (GMIME_IS_STREAM (stream), -1);
 	
@@ -546,32 +621,27 @@ g_mime_stream_buffer_gets (GMimeStream *stream, char *buf, size_t max)
 	if (GMIME_IS_STREAM_BUFFER (stream)) {
 		GMimeStreamBuffer *buffer = (GMimeStreamBuffer *) stream;
 		
-		if (buffer->mode == GMIME_STREAM_BUFFER_BLOCK_READ) {
+		if (BUFFER_READS (buffer)) {
 			while (outptr < outend) {
-				inptr = buffer->bufptr;
-				inend = inptr + buffer->buflen;
-				
-				while (outptr < outend && inptr < inend && *inptr != '\n')
-					c = *outptr++ = *inptr++;
-				
-				if (outptr < outend && inptr < inend && c != '\n')
-					c = *outptr++ = *inptr++;
-				
-				buffer->buflen = inend - inptr;
-				buffer->bufptr = inptr;
-				
-				if (c == '\n')
-					break;
+				buffer_read_ahead (buffer);
 				
 				if (buffer->buflen == 0) {
 					/* buffer more data */
-					buffer->bufptr = buffer->buffer;
-					n = g_mime_stream_read (buffer->source, buffer->buffer, BLOCK_BUFFER_LEN);
-					if (n <= 0)
+					if (buffer_fill (buffer) <= 0)
 						break;
-					
-					buffer->buflen = n;
 				}
+				
+				len = MIN (buffer->buflen, (size_t) (outend - outptr));
+				if ((eoln = memchr (buffer->bufptr, '\n', len)))
+					len = (eoln - buffer->bufptr) + 1;
+				
+				memcpy (outptr, buffer->bufptr, len);
+				buffer->bufptr += len;
+				buffer->buflen -= len;
+				outptr += len;
+				
+				if (eoln != NULL)
+					break;
 			}
 			
 			/* increment our stream position pointer */
@@ -610,6 +680,33 @@ g_mime_stream_buffer_readln (GMimeStream *stream, GByteArray *buffer)
 	
 	g_return_if_fail (GMIME_IS_STREAM (stream));
 	
+	if (GMIME_IS_STREAM_BUFFER (stream) && BUFFER_READS ((GMimeStreamBuffer *) stream)) {
+		GMimeStreamBuffer *sbuf = (GMimeStreamBuffer *) stream;
+		char *eoln;
+		
+		/* scan for the end of the line directly within our buffer */
+		do {
+			buffer_read_ahead (sbuf);
+			
+			if (sbuf->buflen == 0 && buffer_fill (sbuf) <= 0)
+				break;
+			
+			if ((eoln = memchr (sbuf->bufptr, '\n', sbuf->buflen)))
+				len = (eoln - sbuf->bufptr) + 1;
+			else
+				len = sbuf->buflen;
+			
+			if (buffer)
+				g_byte_array_append (buffer, (unsigned char *) sbuf->bufptr, len);
+			
+			stream->position += len;
+			sbuf->bufptr += len;
+			sbuf->buflen -= len;
+		} while (eoln == NULL);
+		
+		return;
+	}
+	
 	while (!g_mime_stream_eos (stream)) {
 		if ((len = g_mime_stream_buffer_gets (stream, linebuf, sizeof (linebuf))) <= 0)
 			break;
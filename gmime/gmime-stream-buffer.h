@@ -39,14 +39,17 @@ typedef struct _GMimeStreamBufferClass GMimeStreamBufferClass;
 
 /**
  * GMimeStreamBufferMode:
- * @GMIME_STREAM_BUFFER_BLOCK_READ: Read in 4k blocks.
- * @GMIME_STREAM_BUFFER_BLOCK_WRITE: Write in 4k blocks.
+ * @GMIME_STREAM_BUFFER_BLOCK_READ: Read in blocks.
+ * @GMIME_STREAM_BUFFER_BLOCK_WRITE: Write in blocks.
+ * @GMIME_STREAM_BUFFER_READ_AHEAD: Read in blocks, topping up the
+ * buffer before it runs dry.
  *
  * The buffering mode for a #GMimeStreamBuffer stream.
  **/
 typedef enum {
 	GMIME_STREAM_BUFFER_BLOCK_READ,
-	GMIME_STREAM_BUFFER_BLOCK_WRITE
+	GMIME_STREAM_BUFFER_BLOCK_WRITE,
+	GMIME_STREAM_BUFFER_READ_AHEAD
 } GMimeStreamBufferMode;
 
 
@@ -83,6 +86,7 @@ struct _GMimeStreamBufferClass {
 GType g_mime_stream_buffer_get_type (void);
 
 GMimeStream *g_mime_stream_buffer_new (GMimeStream *source, GMimeStreamBufferMode mode);
+GMimeStream *g_mime_stream_buffer_new_with_size (GMimeStream *source, GMimeStreamBufferMode mode, size_t size);
 
 ssize_t g_mime_stream_buffer_gets (GMimeStream *stream, char *buf, size_t max);
 
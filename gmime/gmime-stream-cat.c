@@ -37,6 +37,10 @@
  * @see_also: #GMimeStream
  *
  * A #GMimeStream which chains together any number of other streams.
+ *
+ * The offset of each source within the concatenated stream is
+ * computed lazily and cached, so seeking within a #GMimeStreamCat is
+ * a binary search rather than a walk over the list of sources.
  **/
 
 
@@ -63,9 +67,20 @@ struct _cat_node {
 	struct _cat_node *next;
 	GMimeStream *stream;
 	gint64 position;
-	int id; /* for debugging */
+	gint64 offset; /* offset of this source within the cat (valid if id <= priv->indexed) */
+	gint64 length; /* length of this source (valid if id < priv->indexed) */
+	int id; /* index into priv->nodes */
+};
+
+struct _GMimeStreamCatPrivate {
+	GPtrArray *nodes; /* the sources, used to locate a source by offset */
+	guint indexed;    /* the number of leading sources whose length is known */
 };
 
+static int private_offset = 0;
+
+#define GMIME_STREAM_CAT_GET_PRIVATE(cat) ((struct _GMimeStreamCatPrivate *) G_STRUCT_MEMBER_P ((cat), private_offset))
+
 GType
 g_mime_stream_cat_get_type (void)
 {
@@ -85,6 +100,7 @@ g_mime_stream_cat_get_type (void)
 		};
 		
 		type = g_type_register_static (GMIME_TYPE_STREAM, "GMimeStreamCat", &info, 0);
+		private_offset = g_type_add_instance_private (type, sizeof (struct _GMimeStreamCatPrivate));
 	}
 	
 	return type;
@@ -98,6 +114,7 @@ g_mime_stream_cat_class_init (GMimeStreamCatClass *klass)
 	GObjectClass *object_class = G_OBJECT_CLASS (klass);
 	
 	parent_class = g_type_class_ref (GMIME_TYPE_STREAM);
+	g_type_class_adjust_private_offset (klass, &private_offset);
 	
 	object_class->finalize = g_mime_stream_cat_finalize;
 	
@@ -116,6 +133,10 @@ g_mime_stream_cat_class_init (GMimeStreamCatClass *klass)
 static void
 g_mime_stream_cat_init (GMimeStreamCat *stream, GMimeStreamCatClass *klass)
 {
+	struct _GMimeStreamCatPrivate *priv = GMIME_STREAM_CAT_GET_PRIVATE (stream);
+	
+	priv->nodes = g_ptr_array_new ();
+	priv->indexed = 0;
 	stream->sources = NULL;
 	stream->current = NULL;
 }
@@ -123,13 +144,164 @@ g_mime_stream_cat_init (GMimeStreamCat *stream, GMimeStreamCatClass *klass)
 static void
 g_mime_stream_cat_finalize (GObject *object)
 {
-	GMimeStream *stream = (GMimeStream *) object;
+	GMimeStreamCat *cat = (GMimeStreamCat *) object;
 	
-	stream_close (stream);
+	stream_close ((GMimeStream *) cat);
+	g_ptr_array_free (GMIME_STREAM_CAT_GET_PRIVATE (cat)->nodes, TRUE);
 	
 	G_OBJECT_CLASS (parent_class)->finalize (object);
 }
 
+static gint64
+source_length (GMimeStream *source)
+{
+	if (source->bound_end != -1)
+		return source->bound_end - source->bound_start;
+	
+	return g_mime_stream_length (source);
+}
+
+/* compute (and cache) the offsets and lengths of the first @count sources */
+static int
+cat_index_sources (GMimeStreamCat *cat, guint count)
+{
+	struct _GMimeStreamCatPrivate *priv = GMIME_STREAM_CAT_GET_PRIVATE (cat);
+	struct _cat_node *node, *prev;
+	gint64 len;
+	
+	while (priv->indexed < count) {
+		node = priv->nodes->pdata[priv->indexed];
+		
+		if (priv->indexed > 0) {
+			prev = priv->nodes->pdata[priv->indexed - 1];
+			node->offset = prev->offset + prev->length;
+		} else {
+			node->offset = 0;
+		}
+		
+		/* Note: the offset of this source remains valid even if its length is unknown */
+		if ((len = source_length (node->stream)) == -1)
+			return -1;
+		
+		node->length = len;
+		priv->indexed++;
+	}
+	
+	return 0;
+}
+
+/* forget the cached offsets of @node and every source after it */
+static void
+cat_invalidate_index (GMimeStreamCat *cat, struct _cat_node *node)
+{
+	struct _GMimeStreamCatPrivate *priv = GMIME_STREAM_CAT_GET_PRIVATE (cat);
+	
+	if (priv->indexed > (guint) node->id)
+		priv->indexed = node->id;
+}
+
+static gint64
+cat_total_length (GMimeStreamCat *cat)
+{
+	struct _GMimeStreamCatPrivate *priv = GMIME_STREAM_CAT_GET_PRIVATE (cat);
+	struct _cat_node *last;
+	
+	if (priv->nodes->len == 0)
+		return 0;
+	
+	if (cat_index_sources (cat, priv->nodes->len) == -1)
+		return -1;
+	
+	last = priv->nodes->pdata[priv->nodes->len - 1];
+	
+	return last->offset + last->length;
+}
+
+/* find the source containing @offset and the position of @offset within it */
+static struct _cat_node *
+cat_find_source (GMimeStreamCat *cat, gint64 offset, gint64 *position)
+{
+	struct _GMimeStreamCatPrivate *priv = GMIME_STREAM_CAT_GET_PRIVATE (cat);
+	struct _cat_node *node, *last;
+	guint lo, hi, mid;
+	gint64 real;
+	
+	if (priv->nodes->len == 0 || offset < 0)
+		return NULL;
+	
+	/* only index as far as the source holding @offset, so that a later
+	 * source of unknown length doesn't get in the way */
+	while (priv->indexed < priv->nodes->len) {
+		if (priv->indexed > 0) {
+			last = priv->nodes->pdata[priv->indexed - 1];
+			if (offset < last->offset + last->length)
+				break;
+		}
+		
+		if (cat_index_sources (cat, priv->indexed + 1) == -1)
+			break;
+	}
+	
+	if (priv->indexed > 0) {
+		last = priv->nodes->pdata[priv->indexed - 1];
+		
+		if (offset < last->offset + last->length || priv->indexed == priv->nodes->len) {
+			if (offset > last->offset + last->length) {
+				/* offset not within our grasp... */
+				return NULL;
+			}
+			
+			/* binary search for the last source that begins at or before
+			 * @offset; if there are empty sources, this skips past them
+			 * to the one holding the data */
+			lo = 0;
+			hi = priv->indexed;
+			while (hi - lo > 1) {
+				mid = lo + ((hi - lo) >> 1);
+				node = priv->nodes->pdata[mid];
+				
+				if (node->offset <= offset)
+					lo = mid;
+				else
+					hi = mid;
+			}
+			
+			node = priv->nodes->pdata[lo];
+			*position = offset - node->offset;
+			
+			return node;
+		}
+	}
+	
+	/* @offset is at or beyond the start of a source whose length is
+	 * unknown, so we can only get there if we have already read that
+	 * far: walk the positions of the sources from there up to the
+	 * current source. */
+	node = priv->nodes->pdata[priv->indexed];
+	if (cat->current != NULL && cat->current->id < node->id)
+		return NULL;
+	
+	real = node->offset;
+	while (node != cat->current && offset >= real + node->position) {
+		if (node->next == NULL) {
+			/* we've read to the end of the last source */
+			break;
+		}
+		
+		real += node->position;
+		node = node->next;
+	}
+	
+	if (offset > real + node->position) {
+		/* beyond what we have read of the current source */
+		return NULL;
+	}
+	
+	*position = offset - real;
+	
+	return node;
+}
+
 static ssize_t
 stream_read (GMimeStream *stream, char *buf, size_t len)
 {
@@ -194,6 +366,9 @@ stream_write (GMimeStream *stream, const char *buf, size_t len)
 	if (!(current = cat->current))
 		return -1;
 	
+	/* writing may change the length of the sources */
+	cat_invalidate_index (cat, current);
+	
 	/* make sure our stream position is where it should be */
 	offset = current->stream->bound_start + current->position;
 	if (g_mime_stream_seek (current->stream, offset, GMIME_STREAM_SEEK_SET) == -1)
@@ -275,6 +450,8 @@ stream_close (GMimeStream *stream)
 		n = nn;
 	}
 	
+	g_ptr_array_set_size (GMIME_STREAM_CAT_GET_PRIVATE (cat)->nodes, 0);
+	GMIME_STREAM_CAT_GET_PRIVATE (cat)->indexed = 0;
 	cat->sources = NULL;
 	
 	return 0;
@@ -298,18 +475,17 @@ static int
 stream_reset (GMimeStream *stream)
 {
 	GMimeStreamCat *cat = (GMimeStreamCat *) stream;
-	struct _cat_node *n;
 	
 	if (stream->position == stream->bound_start)
 		return 0;
 	
-	n = cat->sources;
-	while (n != NULL) {
-		if (g_mime_stream_reset (n->stream) == -1)
+	/* Note: read() and write() reset each subsequent source as they
+	 * advance to it, so only the first source needs resetting. */
+	if (cat->sources != NULL) {
+		if (g_mime_stream_reset (cat->sources->stream) == -1)
 			return -1;
 		
-		n->position = 0;
-		n = n->next;
+		cat->sources->position = 0;
 	}
 	
 	cat->current = cat->sources;
@@ -321,8 +497,8 @@ static gint64
 stream_seek (GMimeStream *stream, gint64 offset, GMimeSeekWhence whence)
 {
 	GMimeStreamCat *cat = (GMimeStreamCat *) stream;
-	struct _cat_node *current, *n;
-	gint64 real, off, len;
+	struct _cat_node *current;
+	gint64 off, len, pos;
 	
 	d(fprintf (stderr, "GMimeStreamCat::stream_seek (%p, %ld, %d)\n",
 		   stream, offset, whence));
@@ -332,137 +508,6 @@ stream_seek (GMimeStream *stream, gint64 offset, GMimeSeekWhence whence)
 	
 	switch (whence) {
 	case GMIME_STREAM_SEEK_SET:
-	seek_set:
-		/* sanity check our seek - make sure we don't under/over-seek our bounds */
-		if (offset < 0) {
-			d(fprintf (stderr, "offset %ld < 0, fail\n", offset));
-			return -1;
-		}
-		
-		/* sanity check our seek */
-		if (stream->bound_end != -1 && offset > stream->bound_end) {
-			d(fprintf (stderr, "offset %ld > bound_end %ld, fail\n",
-				   offset, stream->bound_end));
-			return -1;
-		}
-		
-		/* short-cut if we are seeking to our current position */
-		if (offset == stream->position) {
-			d(fprintf (stderr, "offset %ld == stream->position %ld, no need to seek\n",
-				   offset, stream->position));
-			return offset;
-		}
-		
-		real = 0;
-		n = cat->sources;
-		current = cat->current;
-		
-		while (n != current) {
-			if (real + n->position > offset)
-				break;
-			real += n->position;
-			n = n->next;
-		}
-		
-		if (n == NULL) {
-			/* offset not within our grasp... */
-			return -1;
-		}
-		
-		if (n != current) {
-			/* seeking to a previous stream (n->stream) */
-			if ((offset - real) != n->position) {
-				/* FIXME: could probably skip these seek checks... */
-				off = n->stream->bound_start + (offset - real);
-				if (g_mime_stream_seek (n->stream, off, GMIME_STREAM_SEEK_SET) == -1)
-					return -1;
-			}
-			
-			d(fprintf (stderr, "setting current stream to %i and updating cur->position to %ld\n",
-				   n->id, offset - real));
-			
-			current = n;
-			current->position = offset - real;
-			
-			break;
-		} else {
-			/* seeking to someplace in our current (or next) stream */
-			d(fprintf (stderr, "seek offset %ld in current stream[%d] or after\n",
-				   offset, current->id));
-			if ((offset - real) == current->position) {
-				/* exactly at our current position */
-				d(fprintf (stderr, "seek offset at cur position of stream[%d]\n",
-					   current->id));
-				stream->position = offset;
-				return offset;
-			}
-			
-			if ((offset - real) < current->position) {
-				/* in current stream, but before current position */
-				d(fprintf (stderr, "seeking backwards in cur stream[%d]\n",
-					   current->id));
-				/* FIXME: again, could probably skip seek checks... */
-				off = current->stream->bound_start + (offset - real);
-				if (g_mime_stream_seek (current->stream, off, GMIME_STREAM_SEEK_SET) == -1)
-					return -1;
-				
-				d(fprintf (stderr, "setting cur stream[%d] position to %ld\n",
-					   current->id, offset - real));
-				current->position = offset - real;
-				
-				break;
-			}
-			
-			/* after our current position */
-			d(fprintf (stderr, "after cur position in stream[%d] or in a later stream\n",
-				   current->id));
-			do {
-				if (current->stream->bound_end != -1) {
-					len = current->stream->bound_end - current->stream->bound_start;
-				} else {
-					if ((len = g_mime_stream_length (current->stream)) == -1)
-						return -1;
-				}
-				
-				d(fprintf (stderr, "real = %lld, stream[%d] len = %lld\n",
-					   real, current->id, len));
-				
-				if ((real + len) > offset) {
-					/* within the bounds of the current stream */
-					d(fprintf (stderr, "offset within bounds of stream[%d]\n",
-						   current->id));
-					break;
-				} else {
-					d(fprintf (stderr, "not within bounds of stream[%d]\n",
-						   current->id));
-					current->position = len;
-					real += len;
-					
-					current = current->next;
-					if (current == NULL) {
-						d(fprintf (stderr, "ran out of streams, failed\n"));
-						return -1;
-					}
-					
-					d(fprintf (stderr, "advanced to stream[%d]...\n", current->id));
-					
-					if (g_mime_stream_reset (current->stream) == -1)
-						return -1;
-					
-					current->position = 0;
-				}
-			} while (1);
-			
-			/* FIXME: another seek check... probably can skip this */
-			off = current->stream->bound_start + (offset - real);
-			if (g_mime_stream_seek (current->stream, off, GMIME_STREAM_SEEK_SET) == -1)
-				return -1;
-			
-			d(fprintf (stderr, "setting cur position of stream[%d] to %ld\n",
-				   current->id, offset - real));
-			current->position = offset - real;
-		}
-		
 		break;
 	case GMIME_STREAM_SEEK_CUR:
 		if (offset == 0)
@@ -470,47 +515,58 @@ stream_seek (GMimeStream *stream, gint64 offset, GMimeSeekWhence whence)
 		
 		/* calculate offset relative to the beginning of the stream */
 		offset = stream->position + offset;
-		goto seek_set;
 		break;
 	case GMIME_STREAM_SEEK_END:
 		if (offset > 0)
 			return -1;
 		
 		/* calculate the offset of the end of the stream */
-		n = cat->sources;
-		real = stream->bound_start;
-		while (n != NULL) {
-			if ((len = g_mime_stream_length (n->stream)) == -1)
-				return -1;
-			
-			real += len;
-			n = n->next;
-		}
+		if ((len = cat_total_length (cat)) == -1)
+			return -1;
 		
 		/* calculate offset relative to the beginning of the stream */
-		offset = real + offset;
-		goto seek_set;
+		offset = stream->bound_start + len + offset;
 		break;
 	default:
 		g_assert_not_reached ();
 		return -1;
 	}
 	
+	/* sanity check our seek - make sure we don't under/over-seek our bounds */
+	if (offset < 0) {
+		d(fprintf (stderr, "offset %ld < 0, fail\n", offset));
+		return -1;
+	}
+	
+	if (stream->bound_end != -1 && offset > stream->bound_end) {
+		d(fprintf (stderr, "offset %ld > bound_end %ld, fail\n",
+			   offset, stream->bound_end));
+		return -1;
+	}
+	
+	/* short-cut if we are seeking to our current position */
+	if (offset == stream->position) {
+		d(fprintf (stderr, "offset %ld == stream->position %ld, no need to seek\n",
+			   offset, stream->position));
+		return offset;
+	}
+	
+	if (!(current = cat_find_source (cat, offset, &pos)))
+		return -1;
+	
+	off = current->stream->bound_start + pos;
+	if (g_mime_stream_seek (current->stream, off, GMIME_STREAM_SEEK_SET) == -1)
+		return -1;
+	
 	d(fprintf (stderr, "setting stream->offset to %ld and current stream to %d\n",
 		   offset, current->id));
 	
+	/* Note: there is no need to reset the sources following @current,
+	 * read() and write() will reset them as they advance. */
+	current->position = pos;
 	stream->position = offset;
 	cat->current = current;
 	
-	/* reset all following streams */
-	n = current->next;
-	while (n != NULL) {
-		if (g_mime_stream_reset (n->stream) == -1)
-			return -1;
-		n->position = 0;
-		n = n->next;
-	}
-	
 	return offset;
 }
 
@@ -524,22 +580,11 @@ static gint64
 stream_length (GMimeStream *stream)
 {
 	GMimeStreamCat *cat = GMIME_STREAM_CAT (stream);
-	gint64 len, total = 0;
-	struct _cat_node *n;
 	
 	if (stream->bound_end != -1)
 		return stream->bound_end - stream->bound_start;
 	
-	n = cat->sources;
-	while (n != NULL) {
-		if ((len = g_mime_stream_length (n->stream)) == -1)
-			return -1;
-		
-		total += len;
-		n = n->next;
-	}
-	
-	return total;
+	return cat_total_length (cat);
 }
 
 struct _sub_node {
@@ -553,37 +598,19 @@ stream_substream (GMimeStream *stream, gint64 start, gint64 end)
 {
 	GMimeStreamCat *cat = (GMimeStreamCat *) stream;
 	struct _sub_node *streams, *tail, *s;
-	gint64 offset = 0, subend = 0;
 	GMimeStream *substream;
 	struct _cat_node *n;
-	gint64 len;
+	gint64 offset, len;
+	gint64 subend = 0;
 	
 	d(fprintf (stderr, "GMimeStreamCat::substream (%p, %ld, %ld)\n", stream, start, end));
 	
 	/* find the first source stream that contains data we're interested in... */
-	n = cat->sources;
-	while (offset < start && n != NULL) {
-		if (n->stream->bound_end == -1) {
-			if ((len = g_mime_stream_length (n->stream)) == -1)
-				return NULL;
-		} else {
-			len = n->stream->bound_end - n->stream->bound_start;
-		}
-		
-		if ((offset + len) > start)
-			break;
-		
-		if (end != -1 && (offset + len) >= end)
-			break;
-		
-		offset += len;
-		
-		n = n->next;
-	}
-	
-	if (n == NULL)
+	if (!(n = cat_find_source (cat, start, &offset)))
 		return NULL;
 	
+	offset = start - offset;
+	
 	d(fprintf (stderr, "stream[%d] is the first stream containing data we want\n", n->id));
 	
 	streams = NULL;
@@ -600,20 +627,23 @@ stream_substream (GMimeStream *stream, gint64 start, gint64 end)
 		tail = s;
 		
 		s->start = n->stream->bound_start;
-		if (n == cat->sources)
-			s->start += start;
-		else if (offset < start)
+		if (offset < start)
 			s->start += (start - offset);
 		
 		d(fprintf (stderr, "added stream[%d] to our list\n", n->id));
 		
-		if (n->stream->bound_end == -1) {
-			if ((len = g_mime_stream_length (n->stream)) == -1)
-				goto error;
-		} else {
-			len = n->stream->bound_end - n->stream->bound_start;
+		if (cat_index_sources (cat, n->id + 1) == -1) {
+			while (streams != NULL) {
+				s = streams->next;
+				g_free (streams);
+				streams = s;
+			}
+			
+			return NULL;
 		}
 		
+		len = n->length;
+		
 		d(fprintf (stderr, "stream[%d]: len = %ld, offset of beginning of stream is %ld\n",
 			   n->id, len, offset));
 		
@@ -655,16 +685,6 @@ stream_substream (GMimeStream *stream, gint64 start, gint64 end)
 	substream = (GMimeStream *) cat;
 	
 	return substream;
-	
- error:
-	
-	while (streams != NULL) {
-		s = streams->next;
-		g_free (streams);
-		streams = s;
-	}
-	
-	return NULL;
 }
 
 
@@ -694,34 +714,44 @@ g_mime_stream_cat_new (void)
  *
  * Adds the @source stream to the @cat.
  *
+ * Note: the length of each source is cached the first time it is
+ * needed (e.g. to seek), so sources should not be modified behind the
+ * back of the @cat once they have been added.
+ *
  * Returns: %0 on success or %-1 on fail.
  **/
 int
 g_mime_stream_cat_add_source (GMimeStreamCat *cat, GMimeStream *source)
 {
+	struct _GMimeStreamCatPrivate *priv;
 	struct _cat_node *node, *n;
 	
 	g_return_val_if_fail (GMIME_IS_STREAM_CAT (cat), -1);
 	g_return_val_if_fail (GMIME_IS_STREAM (source), -1);
 	
+	priv = GMIME_STREAM_CAT_GET_PRIVATE (cat);
+	
 	node = g_new (struct _cat_node, 1);
 	node->next = NULL;
 	node->stream = source;
 	g_object_ref (source);
 	node->position = 0;
+	node->offset = 0;
+	node->length = 0;
 	
-	n = cat->sources;
-	while (n && n->next)
-		n = n->next;
+	/* Note: the new source is past the end of the index, so the cached
+	 * offsets of the existing sources remain valid. */
+	node->id = (int) priv->nodes->len;
 	
-	if (n == NULL) {
-		cat->sources = node;
-		node->id = 0;
-	} else {
-		node->id = n->id + 1;
+	if (priv->nodes->len > 0) {
+		n = priv->nodes->pdata[priv->nodes->len - 1];
 		n->next = node;
+	} else {
+		cat->sources = node;
 	}
 	
+	g_ptr_array_add (priv->nodes, node);
+	
 	if (!cat->current)
 		cat->current = node;
 	
@@ -26,6 +26,12 @@
 #include <string.h>
 
 #include "gmime-stream-filter.h"
+#include "gmime-filter-basic.h"
+#include "gmime-filter-charset.h"
+#include "gmime-filter-dos2unix.h"
+#include "gmime-filter-text.h"
+#include "gmime-charset.h"
+#include "gmime-internal.h"
 
 
 /**
@@ -41,6 +47,11 @@
  *
  * When data passes through a #GMimeStreamFilter, it will pass through
  * #GMimeFilter filters in the order they were added.
+ *
+ * A #GMimeFilterBasic decoder followed by a #GMimeFilterDos2Unix
+ * filter, optionally with a #GMimeFilterCharset converting to UTF-8
+ * in between, is replaced internally by a single #GMimeFilterText
+ * which does the same work in one pass.
  **/
 
 
@@ -59,6 +70,10 @@ struct _GMimeStreamFilterPrivate {
 	struct _filter *filters;
 	int filterid;		/* next filter id */
 	
+	GMimeFilter *fused;	/* replaces the filters starting at fused_head */
+	struct _filter *fused_head;
+	int fused_count;
+	
 	char *realbuffer;	/* buffer - READ_PAD */
 	char *buffer;		/* READ_SIZE bytes */
 	
@@ -143,6 +158,9 @@ g_mime_stream_filter_init (GMimeStreamFilter *stream, GMimeStreamFilterClass *kl
 	stream->priv = g_new (struct _GMimeStreamFilterPrivate, 1);
 	stream->priv->filters = NULL;
 	stream->priv->filterid = 0;
+	stream->priv->fused = NULL;
+	stream->priv->fused_head = NULL;
+	stream->priv->fused_count = 0;
 	stream->priv->realbuffer = g_malloc (READ_SIZE + READ_PAD);
 	stream->priv->buffer = stream->priv->realbuffer + READ_PAD;
 	stream->priv->last_was_read = TRUE;
@@ -165,6 +183,9 @@ g_mime_stream_filter_finalize (GObject *object)
 		f = fn;
 	}
 	
+	if (p->fused)
+		g_object_unref (p->fused);
+	
 	g_free (p->realbuffer);
 	g_free (p);
 	
@@ -175,33 +196,148 @@ g_mime_stream_filter_finalize (GObject *object)
 }
 
 
+/* finds a basic decoder + [charset to UTF-8] + dos2unix chain that can be fused into a single text filter */
+static void
+filter_chain_fuse (struct _GMimeStreamFilterPrivate *priv)
+{
+	GMimeFilterDos2Unix *dos2unix;
+	GMimeFilterCharset *charset;
+	GMimeEncoding *decoder;
+	const char *from;
+	struct _filter *f, *n;
+	GMimeFilter *fused;
+	int count;
+	
+	for (f = priv->filters; f != NULL; f = f->next) {
+		if (G_OBJECT_TYPE (f->filter) != GMIME_TYPE_FILTER_BASIC)
+			continue;
+		
+		decoder = &((GMimeFilterBasic *) f->filter)->encoder;
+		if (decoder->encode || (decoder->encoding != GMIME_CONTENT_ENCODING_BASE64 &&
+					decoder->encoding != GMIME_CONTENT_ENCODING_QUOTEDPRINTABLE))
+			continue;
+		
+		n = f->next;
+		from = NULL;
+		count = 1;
+		
+		if (n != NULL && G_OBJECT_TYPE (n->filter) == GMIME_TYPE_FILTER_CHARSET) {
+			charset = (GMimeFilterCharset *) n->filter;
+			if (g_ascii_strcasecmp (g_mime_charset_canon_name (charset->to_charset), "utf-8") != 0)
+				continue;
+			
+			from = charset->from_charset;
+			n = n->next;
+			count++;
+		}
+		
+		if (n == NULL || G_OBJECT_TYPE (n->filter) != GMIME_TYPE_FILTER_DOS2UNIX)
+			continue;
+		
+		dos2unix = (GMimeFilterDos2Unix *) n->filter;
+		count++;
+		
+		/* keep the state of an existing fused filter for the same chain */
+		if (priv->fused && priv->fused_head == f && priv->fused_count == count)
+			return;
+		
+		if (!(fused = g_mime_filter_text_new (decoder->encoding, from, dos2unix->ensure_newline)))
+			continue;
+		
+		if (priv->fused)
+			g_object_unref (priv->fused);
+		
+		priv->fused = fused;
+		priv->fused_head = f;
+		priv->fused_count = count;
+		
+		return;
+	}
+	
+	if (priv->fused) {
+		g_object_unref (priv->fused);
+		priv->fused_head = NULL;
+		priv->fused_count = 0;
+		priv->fused = NULL;
+	}
+}
+
+/* passes the data through each of the filters (or the fused filter that replaces some of them);
+ * @writable is whether @in is our own buffer, which filters capable of it may overwrite */
+static void
+filter_chain_apply (struct _GMimeStreamFilterPrivate *priv, char *in, size_t len, size_t prespace,
+		    char **out, size_t *outlen, size_t *outprespace, gboolean writable, gboolean complete)
+{
+	struct _filter *f = priv->filters;
+	GMimeFilter *filter;
+	char *start, *end;
+	int i;
+	
+	*out = in;
+	*outlen = len;
+	*outprespace = prespace;
+	
+	while (f != NULL) {
+		if (f == priv->fused_head) {
+			filter = priv->fused;
+			for (i = 0; i < priv->fused_count; i++)
+				f = f->next;
+		} else {
+			filter = f->filter;
+			f = f->next;
+		}
+		
+		start = *out - *outprespace;
+		end = *out + *outlen;
+		
+		_g_mime_filter_run (filter, *out, *outlen, *outprespace, out, outlen, outprespace, writable, complete);
+		
+		/* output left in (or written over) the input buffer is as writable as the input was,
+		 * output in the filter's own output buffer may always be overwritten by the next filter */
+		if (*out < start || *out > end)
+			writable = *out >= filter->outreal && *out <= filter->outbuf + filter->outsize;
+	}
+}
+
+/* checks whether one of the filters (such as an SMTP DATA decoder) has seen the end of its data */
+static gboolean
+filter_chain_eod (struct _GMimeStreamFilterPrivate *priv)
+{
+	struct _filter *f;
+	
+	for (f = priv->filters; f != NULL; f = f->next) {
+		if (_g_mime_filter_get_eod (f->filter))
+			return TRUE;
+	}
+	
+	return FALSE;
+}
+
 static ssize_t
 stream_read (GMimeStream *stream, char *buf, size_t n)
 {
 	GMimeStreamFilter *filter = (GMimeStreamFilter *) stream;
 	struct _GMimeStreamFilterPrivate *priv = filter->priv;
-	struct _filter *f;
 	ssize_t nread;
 	
 	priv->last_was_read = TRUE;
 	
-	if (priv->filteredlen <= 0) {
+	/* keep reading until the filters produce something: returning 0
+	 * would make it look like we had reached the end of the stream */
+	while (priv->filteredlen <= 0) {
 		size_t presize = READ_PAD;
 		
+		/* nothing more will come out of the filters, so don't read
+		 * (and possibly block on) whatever follows in the source */
+		if (filter_chain_eod (priv))
+			return 0;
+		
 		nread = g_mime_stream_read (filter->source, priv->buffer, READ_SIZE);
 		if (nread <= 0) {
 			/* this is somewhat untested */
 			if (g_mime_stream_eos (filter->source) && !priv->flushed) {
-				priv->filtered = priv->buffer;
-				priv->filteredlen = 0;
-				f = priv->filters;
-				
-				while (f != NULL) {
-					g_mime_filter_complete (f->filter, priv->filtered, priv->filteredlen,
-								presize, &priv->filtered, &priv->filteredlen,
-								&presize);
-					f = f->next;
-				}
+				filter_chain_apply (priv, priv->buffer, 0, presize, &priv->filtered,
+						    &priv->filteredlen, &presize, TRUE, TRUE);
 				
 				nread = priv->filteredlen;
 				priv->flushed = TRUE;
@@ -210,17 +346,10 @@ stream_read (GMimeStream *stream, char *buf, size_t n)
 			if (nread <= 0)
 				return nread;
 		} else {
-			priv->filtered = priv->buffer;
-			priv->filteredlen = nread;
 			priv->flushed = FALSE;
-			f = priv->filters;
 			
-			while (f != NULL) {
-				g_mime_filter_filter (f->filter, priv->filtered, priv->filteredlen, presize,
-						      &priv->filtered, &priv->filteredlen, &presize);
-				
-				f = f->next;
-			}
+			filter_chain_apply (priv, priv->buffer, nread, presize, &priv->filtered,
+					    &priv->filteredlen, &presize, TRUE, FALSE);
 		}
 	}
 	
@@ -237,21 +366,14 @@ stream_write (GMimeStream *stream, const char *buf, size_t n)
 {
 	GMimeStreamFilter *filter = (GMimeStreamFilter *) stream;
 	struct _GMimeStreamFilterPrivate *priv = filter->priv;
-	char *buffer = (char *) buf;
 	ssize_t nwritten = n;
-	struct _filter *f;
 	size_t presize;
+	char *buffer;
 	
 	priv->last_was_read = FALSE;
 	priv->flushed = FALSE;
 	
-	f = priv->filters;
-	presize = 0;
-	while (f != NULL) {
-		g_mime_filter_filter (f->filter, buffer, n, presize, &buffer, &n, &presize);
-		
-		f = f->next;
-	}
+	filter_chain_apply (priv, (char *) buf, n, 0, &buffer, &n, &presize, FALSE, FALSE);
 	
 	if (g_mime_stream_write (filter->source, buffer, n) == -1)
 		return -1;
@@ -266,7 +388,6 @@ stream_flush (GMimeStream *stream)
 	GMimeStreamFilter *filter = (GMimeStreamFilter *) stream;
 	struct _GMimeStreamFilterPrivate *priv = filter->priv;
 	size_t presize, len;
-	struct _filter *f;
 	char *buffer;
 	
 	if (priv->last_was_read) {
@@ -274,16 +395,7 @@ stream_flush (GMimeStream *stream)
 		return 0;
 	}
 	
-	buffer = "";
-	len = 0;
-	presize = 0;
-	f = priv->filters;
-	
-	while (f != NULL) {
-		g_mime_filter_complete (f->filter, buffer, len, presize, &buffer, &len, &presize);
-		
-		f = f->next;
-	}
+	filter_chain_apply (priv, "", 0, 0, &buffer, &len, &presize, FALSE, TRUE);
 	
 	if (len > 0 && g_mime_stream_write (filter->source, buffer, len) == -1)
 		return -1;
@@ -315,6 +427,9 @@ stream_eos (GMimeStream *stream)
 	if (priv->filteredlen > 0)
 		return FALSE;
 	
+	if (filter_chain_eod (priv))
+		return TRUE;
+	
 	if (!priv->flushed)
 		return FALSE;
 	
@@ -341,6 +456,9 @@ stream_reset (GMimeStream *stream)
 		f = f->next;
 	}
 	
+	if (priv->fused)
+		g_mime_filter_reset (priv->fused);
+	
 	return 0;
 }
 
@@ -394,6 +512,7 @@ stream_substream (GMimeStream *stream, gint64 start, gint64 end)
 		s->next = NULL;
 		
 		sub->priv->filterid = filter->priv->filterid;
+		filter_chain_fuse (sub->priv);
 	}
 	
 	g_mime_stream_construct ((GMimeStream *) filter, start, end);
@@ -465,6 +584,8 @@ g_mime_stream_filter_add (GMimeStreamFilter *stream, GMimeFilter *filter)
 	f->next = fn;
 	fn->next = NULL;
 	
+	filter_chain_fuse (priv);
+	
 	return fn->id;
 }
 
@@ -500,6 +621,8 @@ g_mime_stream_filter_remove (GMimeStreamFilter *stream, int id)
 		}
 		f = f->next;
 	}
+	
+	filter_chain_fuse (priv);
 }
 
 
@@ -54,6 +54,14 @@ static int fsync (int fd) { return 0; }
  *
  * A simple #GMimeStream implementation that sits on top of the
  * low-level UNIX file descriptor based I/O layer.
+ *
+ * When a read-ahead window is set using
+ * g_mime_stream_fs_set_read_ahead(), reads are issued with pread()
+ * and the kernel is asked to start fetching the next window of the
+ * file while the current one is being consumed, keeping several
+ * reads in flight ahead of the parser. g_mime_stream_fs_open_batch()
+ * opens many files relative to a single directory and primes each
+ * of them this way before the first one is read.
  **/
 
 
@@ -75,6 +83,15 @@ static GMimeStream *stream_substream (GMimeStream *stream, gint64 start, gint64
 
 static GMimeStreamClass *parent_class = NULL;
 
+struct _GMimeStreamFsPrivate {
+	size_t read_ahead; /* size of the read-ahead window, or 0 if disabled */
+	gint64 advised;    /* end offset of the last read-ahead request */
+};
+
+static int private_offset = 0;
+
+#define GMIME_STREAM_FS_GET_PRIVATE(fs) ((struct _GMimeStreamFsPrivate *) G_STRUCT_MEMBER_P ((fs), private_offset))
+
 
 GType
 g_mime_stream_fs_get_type (void)
@@ -95,6 +112,7 @@ g_mime_stream_fs_get_type (void)
 		};
 		
 		type = g_type_register_static (GMIME_TYPE_STREAM, "GMimeStreamFs", &info, 0);
+		private_offset = g_type_add_instance_private (type, sizeof (struct _GMimeStreamFsPrivate));
 	}
 	
 	return type;
@@ -108,6 +126,7 @@ g_mime_stream_fs_class_init (GMimeStreamFsClass *klass)
 	GObjectClass *object_class = G_OBJECT_CLASS (klass);
 	
 	parent_class = g_type_class_ref (GMIME_TYPE_STREAM);
+	g_type_class_adjust_private_offset (klass, &private_offset);
 	
 	object_class->finalize = g_mime_stream_fs_finalize;
 	
@@ -126,9 +145,14 @@ g_mime_stream_fs_class_init (GMimeStreamFsClass *klass)
 static void
 g_mime_stream_fs_init (GMimeStreamFs *stream, GMimeStreamFsClass *klass)
 {
+	struct _GMimeStreamFsPrivate *priv = GMIME_STREAM_FS_GET_PRIVATE (stream);
+	
 	stream->owner = TRUE;
 	stream->eos = FALSE;
 	stream->fd = -1;
+	
+	priv->read_ahead = 0;
+	priv->advised = 0;
 }
 
 static void
@@ -141,6 +165,57 @@ g_mime_stream_fs_finalize (GObject *object)
 	G_OBJECT_CLASS (parent_class)->finalize (object);
 }
 
+/* asks the kernel to start reading the window that follows @position */
+static void
+fs_advise_read_ahead (GMimeStreamFs *fs, gint64 position)
+{
+#ifdef HAVE_POSIX_FADVISE
+	struct _GMimeStreamFsPrivate *priv = GMIME_STREAM_FS_GET_PRIVATE (fs);
+	GMimeStream *stream = (GMimeStream *) fs;
+	gint64 start, end;
+	
+	/* the reader jumped backwards out of the advised window */
+	if (priv->advised > position + (gint64) priv->read_ahead)
+		priv->advised = position;
+	
+	/* re-issue once half of the advised window has been consumed */
+	if (position + (gint64) (priv->read_ahead / 2) < priv->advised)
+		return;
+	
+	start = MAX (position, priv->advised);
+	end = position + (gint64) priv->read_ahead;
+	
+	if (stream->bound_end != -1 && end > stream->bound_end)
+		end = stream->bound_end;
+	
+	if (end > start)
+		posix_fadvise (fs->fd, (off_t) start, (off_t) (end - start), POSIX_FADV_WILLNEED);
+	
+	priv->advised = end;
+#endif
+}
+
+static ssize_t
+fs_pread (GMimeStreamFs *fs, char *buf, size_t len, gint64 offset)
+{
+	ssize_t nread;
+	
+#ifdef HAVE_PREAD
+	do {
+		nread = pread (fs->fd, buf, len, (off_t) offset);
+	} while (nread == -1 && errno == EINTR);
+#else
+	if (lseek (fs->fd, (off_t) offset, SEEK_SET) == -1)
+		return -1;
+	
+	do {
+		nread = read (fs->fd, buf, len);
+	} while (nread == -1 && errno == EINTR);
+#endif
+	
+	return nread;
+}
+
 static ssize_t
 stream_read (GMimeStream *stream, char *buf, size_t len)
 {
@@ -160,13 +235,18 @@ stream_read (GMimeStream *stream, char *buf, size_t len)
 	if (stream->bound_end != -1)
 		len = (size_t) MIN (stream->bound_end - stream->position, (gint64) len);
 	
-	/* make sure we are at the right position */
-	if (lseek (fs->fd, (off_t) stream->position, SEEK_SET) == -1)
-		return -1;
-	
-	do {
-		nread = read (fs->fd, buf, len);
-	} while (nread == -1 && errno == EINTR);
+	if (GMIME_STREAM_FS_GET_PRIVATE (fs)->read_ahead > 0) {
+		fs_advise_read_ahead (fs, stream->position);
+		nread = fs_pread (fs, buf, len, stream->position);
+	} else {
+		/* make sure we are at the right position */
+		if (lseek (fs->fd, (off_t) stream->position, SEEK_SET) == -1)
+			return -1;
+		
+		do {
+			nread = read (fs->fd, buf, len);
+		} while (nread == -1 && errno == EINTR);
+	}
 	
 	if (nread > 0) {
 		stream->position += nread;
@@ -399,11 +479,15 @@ stream_length (GMimeStream *stream)
 static GMimeStream *
 stream_substream (GMimeStream *stream, gint64 start, gint64 end)
 {
+	struct _GMimeStreamFsPrivate *priv;
 	GMimeStreamFs *fs;
 	
 	fs = g_object_new (GMIME_TYPE_STREAM_FS, NULL);
 	g_mime_stream_construct ((GMimeStream *) fs, start, end);
+	priv = GMIME_STREAM_FS_GET_PRIVATE (fs);
 	fs->fd = ((GMimeStreamFs *) stream)->fd;
+	priv->read_ahead = GMIME_STREAM_FS_GET_PRIVATE (stream)->read_ahead;
+	priv->advised = start;
 	fs->owner = FALSE;
 	fs->eos = FALSE;
 	
@@ -493,6 +577,92 @@ g_mime_stream_fs_open (const char *path, int flags, int mode, GError **err)
 }
 
 
+static void
+fs_stream_free (gpointer stream)
+{
+	if (stream != NULL)
+		g_object_unref (stream);
+}
+
+
+/**
+ * g_mime_stream_fs_open_batch:
+ * @dirname: the path to a directory
+ * @names: (array length=n_names): the names of the files within @dirname
+ * @n_names: the number of file names
+ * @flags: as in open(2)
+ * @mode: as in open(2)
+ * @read_ahead: read-ahead window for each stream, or %0 to disable
+ * @err: a #GError
+ *
+ * Opens each of the files in @names relative to @dirname, resolving
+ * @dirname only once. This is meant for processing many small files
+ * from a single directory, such as the messages in a maildir folder.
+ *
+ * If @read_ahead is non-zero, each stream is configured as if by
+ * g_mime_stream_fs_set_read_ahead() which immediately asks the kernel
+ * to start fetching the beginning of every file in the batch.
+ *
+ * Returns: (transfer full) (element-type GMimeStream): an array of
+ * @n_names streams, in the same order as @names, where files that
+ * could not be opened are represented by %NULL, or %NULL if @dirname
+ * could not be opened.
+ **/
+GPtrArray *
+g_mime_stream_fs_open_batch (const char *dirname, const char **names, guint n_names,
+			     int flags, int mode, size_t read_ahead, GError **err)
+{
+	GMimeStream *stream;
+	GPtrArray *streams;
+	int fd, dirfd = -1;
+	guint i;
+	
+	g_return_val_if_fail (dirname != NULL, NULL);
+	g_return_val_if_fail (names != NULL || n_names == 0, NULL);
+	
+#ifdef HAVE_OPENAT
+#ifdef O_DIRECTORY
+	dirfd = open (dirname, O_RDONLY | O_DIRECTORY);
+#else
+	dirfd = open (dirname, O_RDONLY);
+#endif
+	if (dirfd == -1) {
+		g_set_error (err, GMIME_ERROR, errno, "Failed to open `%s': %s", dirname, g_strerror (errno));
+		return NULL;
+	}
+#endif
+	
+	streams = g_ptr_array_new_full (n_names, fs_stream_free);
+	
+	for (i = 0; i < n_names; i++) {
+#ifdef HAVE_OPENAT
+		fd = openat (dirfd, names[i], flags, mode);
+#else
+		char *path = g_build_filename (dirname, names[i], NULL);
+		
+		fd = g_open (path, flags, mode);
+		g_free (path);
+#endif
+		
+		if (fd == -1) {
+			g_ptr_array_add (streams, NULL);
+			continue;
+		}
+		
+		stream = g_mime_stream_fs_new_with_bounds (fd, 0, -1);
+		if (read_ahead > 0)
+			g_mime_stream_fs_set_read_ahead ((GMimeStreamFs *) stream, read_ahead);
+		
+		g_ptr_array_add (streams, stream);
+	}
+	
+	if (dirfd != -1)
+		close (dirfd);
+	
+	return streams;
+}
+
+
 /**
  * g_mime_stream_fs_get_owner:
  * @stream: a #GMimeStreamFs
@@ -528,3 +698,58 @@ g_mime_stream_fs_set_owner (GMimeStreamFs *stream, gboolean owner)
 	
 	stream->owner = owner;
 }
+
+
+/**
+ * g_mime_stream_fs_get_read_ahead:
+ * @stream: a #GMimeStreamFs
+ *
+ * Gets the size of the read-ahead window used by @stream.
+ *
+ * Returns: the read-ahead window, in bytes, or %0 if disabled.
+ **/
+size_t
+g_mime_stream_fs_get_read_ahead (GMimeStreamFs *stream)
+{
+	g_return_val_if_fail (GMIME_IS_STREAM_FS (stream), 0);
+	
+	return GMIME_STREAM_FS_GET_PRIVATE (stream)->read_ahead;
+}
+
+
+/**
+ * g_mime_stream_fs_set_read_ahead:
+ * @stream: a #GMimeStreamFs
+ * @window: read-ahead window, in bytes, or %0 to disable
+ *
+ * Sets the size of the read-ahead window used by @stream.
+ *
+ * When enabled, @stream reads using pread() rather than lseek() and
+ * read(), marks the file for sequential access and asks the kernel to
+ * prefetch the next @window bytes whenever half of the previously
+ * requested window has been consumed. The prefetch is only a hint and
+ * is a no-op on systems lacking posix_fadvise().
+ **/
+void
+g_mime_stream_fs_set_read_ahead (GMimeStreamFs *stream, size_t window)
+{
+	struct _GMimeStreamFsPrivate *priv;
+	gint64 position;
+	
+	g_return_if_fail (GMIME_IS_STREAM_FS (stream));
+	
+	priv = GMIME_STREAM_FS_GET_PRIVATE (stream);
+	position = ((GMimeStream *) stream)->position;
+	priv->read_ahead = window;
+	priv->advised = position;
+	
+	if (stream->fd == -1)
+		return;
+		
+#ifdef HAVE_POSIX_FADVISE
+	posix_fadvise (stream->fd, 0, 0, window > 0 ? POSIX_FADV_SEQUENTIAL : POSIX_FADV_NORMAL);
+#endif
+	
+	if (window > 0)
+		fs_advise_read_ahead (stream, position);
+}
@@ -66,9 +66,15 @@ GMimeStream *g_mime_stream_fs_new_with_bounds (int fd, gint64 start, gint64 end)
 
 GMimeStream *g_mime_stream_fs_open (const char *path, int flags, int mode, GError **err);
 
+GPtrArray *g_mime_stream_fs_open_batch (const char *dirname, const char **names, guint n_names,
+					int flags, int mode, size_t read_ahead, GError **err);
+
 gboolean g_mime_stream_fs_get_owner (GMimeStreamFs *stream);
 void g_mime_stream_fs_set_owner (GMimeStreamFs *stream, gboolean owner);
 
+size_t g_mime_stream_fs_get_read_ahead (GMimeStreamFs *stream);
+void g_mime_stream_fs_set_read_ahead (GMimeStreamFs *stream, size_t window);
+
 G_END_DECLS
 
 #endif /* __GMIME_STREAM_FS_H__ */
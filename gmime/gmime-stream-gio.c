@@ -29,6 +29,7 @@
 #include <errno.h>
 
 #include "gmime-stream-gio.h"
+#include "gmime-internal.h"
 
 
 /**
@@ -39,6 +40,9 @@
  *
  * A simple #GMimeStream implementation that sits on top of GLib's GIO
  * input and output streams.
+ *
+ * The asynchronous stream methods are implemented natively on top of
+ * the GIO asynchronous APIs rather than in a worker thread.
  **/
 
 
@@ -57,6 +61,19 @@ static gint64 stream_tell (GMimeStream *stream);
 static gint64 stream_length (GMimeStream *stream);
 static GMimeStream *stream_substream (GMimeStream *stream, gint64 start, gint64 end);
 
+static void stream_read_async (GMimeStream *stream, char *buf, size_t len, int io_priority,
+			       GCancellable *cancellable, GAsyncReadyCallback callback, gpointer user_data);
+static ssize_t stream_read_finish (GMimeStream *stream, GAsyncResult *result, GError **err);
+static void stream_write_async (GMimeStream *stream, const char *buf, size_t len, int io_priority,
+				GCancellable *cancellable, GAsyncReadyCallback callback, gpointer user_data);
+static ssize_t stream_write_finish (GMimeStream *stream, GAsyncResult *result, GError **err);
+static void stream_flush_async (GMimeStream *stream, int io_priority, GCancellable *cancellable,
+				GAsyncReadyCallback callback, gpointer user_data);
+static int stream_flush_finish (GMimeStream *stream, GAsyncResult *result, GError **err);
+static void stream_close_async (GMimeStream *stream, int io_priority, GCancellable *cancellable,
+				GAsyncReadyCallback callback, gpointer user_data);
+static int stream_close_finish (GMimeStream *stream, GAsyncResult *result, GError **err);
+
 
 static GMimeStreamClass *parent_class = NULL;
 
@@ -91,6 +108,7 @@ g_mime_stream_gio_class_init (GMimeStreamGIOClass *klass)
 {
 	GMimeStreamClass *stream_class = GMIME_STREAM_CLASS (klass);
 	GObjectClass *object_class = G_OBJECT_CLASS (klass);
+	GMimeStreamAsyncMethods *async;
 	
 	parent_class = g_type_class_ref (GMIME_TYPE_STREAM);
 	
@@ -106,6 +124,16 @@ g_mime_stream_gio_class_init (GMimeStreamGIOClass *klass)
 	stream_class->tell = stream_tell;
 	stream_class->length = stream_length;
 	stream_class->substream = stream_substream;
+	
+	async = _g_mime_stream_class_get_async_methods (stream_class);
+	async->read_async = stream_read_async;
+	async->read_finish = stream_read_finish;
+	async->write_async = stream_write_async;
+	async->write_finish = stream_write_finish;
+	async->flush_async = stream_flush_async;
+	async->flush_finish = stream_flush_finish;
+	async->close_async = stream_close_async;
+	async->close_finish = stream_close_finish;
 }
 
 static void
@@ -619,6 +647,381 @@ stream_substream (GMimeStream *stream, gint64 start, gint64 end)
 }
 
 
+typedef struct {
+	char *buf;
+	size_t len;
+} GioIORequest;
+
+static GTask *
+gio_task_new (GMimeStream *stream, gpointer source_tag, int io_priority, GCancellable *cancellable,
+	      GAsyncReadyCallback callback, gpointer user_data)
+{
+	GTask *task;
+	
+	task = g_task_new (stream, cancellable, callback, user_data);
+	g_task_set_source_tag (task, source_tag);
+	g_task_set_priority (task, io_priority);
+	
+	return task;
+}
+
+static void
+gio_task_return_errno (GTask *task, int errnum)
+{
+	g_task_return_new_error (task, G_IO_ERROR, g_io_error_from_errno (errnum),
+				 "%s", g_strerror (errnum));
+	g_object_unref (task);
+}
+
+static void
+gio_task_return_error (GTask *task, GError *err)
+{
+	g_task_return_error (task, err);
+	g_object_unref (task);
+}
+
+/* clamps the request to our bounds and syncs the seekable's position */
+static gboolean
+gio_task_prepare (GTask *task, GObject *seekable, size_t *len)
+{
+	GMimeStream *stream = g_task_get_source_object (task);
+	GError *err = NULL;
+	
+	if (stream->bound_end != -1 && stream->position >= stream->bound_end) {
+		gio_task_return_errno (task, EINVAL);
+		return FALSE;
+	}
+	
+	if (stream->bound_end != -1)
+		*len = (size_t) MIN (stream->bound_end - stream->position, (gint64) *len);
+	
+	if (G_IS_SEEKABLE (seekable)) {
+		if (!g_seekable_seek ((GSeekable *) seekable, stream->position, G_SEEK_SET,
+				      g_task_get_cancellable (task), &err)) {
+			gio_task_return_error (task, err);
+			return FALSE;
+		}
+	}
+	
+	return TRUE;
+}
+
+static void
+gio_read_done (GObject *source, GAsyncResult *result, gpointer user_data)
+{
+	GTask *task = user_data;
+	GMimeStream *stream = g_task_get_source_object (task);
+	GMimeStreamGIO *gio = (GMimeStreamGIO *) stream;
+	GError *err = NULL;
+	ssize_t nread;
+	
+	if ((nread = g_input_stream_read_finish ((GInputStream *) source, result, &err)) < 0) {
+		gio_task_return_error (task, err);
+		return;
+	}
+	
+	if (nread > 0)
+		stream->position += nread;
+	else if (nread == 0)
+		gio->eos = TRUE;
+	
+	g_task_return_int (task, nread);
+	g_object_unref (task);
+}
+
+static void
+gio_read_start (GTask *task)
+{
+	GMimeStreamGIO *gio = g_task_get_source_object (task);
+	GioIORequest *request = g_task_get_task_data (task);
+	size_t len = request->len;
+	
+	if (!gio_task_prepare (task, (GObject *) gio->istream, &len))
+		return;
+	
+	g_input_stream_read_async (gio->istream, request->buf, len, g_task_get_priority (task),
+				   g_task_get_cancellable (task), gio_read_done, task);
+}
+
+static void
+gio_read_opened (GObject *source, GAsyncResult *result, gpointer user_data)
+{
+	GTask *task = user_data;
+	GMimeStreamGIO *gio = g_task_get_source_object (task);
+	GFileInputStream *istream;
+	GError *err = NULL;
+	
+	if (!(istream = g_file_read_finish ((GFile *) source, result, &err))) {
+		gio_task_return_error (task, err);
+		return;
+	}
+	
+	if (gio->istream == NULL)
+		gio->istream = (GInputStream *) istream;
+	else
+		g_object_unref (istream);
+	
+	gio_read_start (task);
+}
+
+static void
+stream_read_async (GMimeStream *stream, char *buf, size_t len, int io_priority,
+		   GCancellable *cancellable, GAsyncReadyCallback callback, gpointer user_data)
+{
+	GMimeStreamGIO *gio = (GMimeStreamGIO *) stream;
+	GioIORequest *request;
+	GTask *task;
+	
+	task = gio_task_new (stream, stream_read_async, io_priority, cancellable, callback, user_data);
+	
+	if (gio->file == NULL) {
+		gio_task_return_errno (task, EBADF);
+		return;
+	}
+	
+	request = g_new (GioIORequest, 1);
+	request->buf = buf;
+	request->len = len;
+	
+	g_task_set_task_data (task, request, g_free);
+	
+	if (gio->istream == NULL) {
+		/* try opening an input stream */
+		g_file_read_async (gio->file, io_priority, cancellable, gio_read_opened, task);
+	} else {
+		gio_read_start (task);
+	}
+}
+
+static ssize_t
+stream_read_finish (GMimeStream *stream, GAsyncResult *result, GError **err)
+{
+	g_return_val_if_fail (g_task_is_valid (result, stream), -1);
+	
+	return g_task_propagate_int ((GTask *) result, err);
+}
+
+static void
+gio_write_done (GObject *source, GAsyncResult *result, gpointer user_data)
+{
+	GTask *task = user_data;
+	GMimeStream *stream = g_task_get_source_object (task);
+	GMimeStreamGIO *gio = (GMimeStreamGIO *) stream;
+	size_t nwritten = 0;
+	GError *err = NULL;
+	
+	if (!g_output_stream_write_all_finish ((GOutputStream *) source, result, &nwritten, &err)) {
+		gio->eos = TRUE;
+		
+		if (nwritten == 0) {
+			/* nothing was written, return error */
+			gio_task_return_error (task, err);
+			return;
+		}
+		
+		g_error_free (err);
+	}
+	
+	stream->position += nwritten;
+	
+	g_task_return_int (task, nwritten);
+	g_object_unref (task);
+}
+
+static void
+gio_write_start (GTask *task)
+{
+	GMimeStreamGIO *gio = g_task_get_source_object (task);
+	GioIORequest *request = g_task_get_task_data (task);
+	size_t len = request->len;
+	
+	if (!gio_task_prepare (task, (GObject *) gio->ostream, &len))
+		return;
+	
+	g_output_stream_write_all_async (gio->ostream, request->buf, len, g_task_get_priority (task),
+					 g_task_get_cancellable (task), gio_write_done, task);
+}
+
+static void
+gio_write_opened (GObject *source, GAsyncResult *result, gpointer user_data)
+{
+	GTask *task = user_data;
+	GMimeStreamGIO *gio = g_task_get_source_object (task);
+	GFileOutputStream *ostream;
+	GError *err = NULL;
+	
+	if (!(ostream = g_file_append_to_finish ((GFile *) source, result, &err))) {
+		gio_task_return_error (task, err);
+		return;
+	}
+	
+	if (gio->ostream == NULL)
+		gio->ostream = (GOutputStream *) ostream;
+	else
+		g_object_unref (ostream);
+	
+	gio_write_start (task);
+}
+
+static void
+stream_write_async (GMimeStream *stream, const char *buf, size_t len, int io_priority,
+		    GCancellable *cancellable, GAsyncReadyCallback callback, gpointer user_data)
+{
+	GMimeStreamGIO *gio = (GMimeStreamGIO *) stream;
+	GioIORequest *request;
+	GTask *task;
+	
+	task = gio_task_new (stream, stream_write_async, io_priority, cancellable, callback, user_data);
+	
+	if (gio->file == NULL) {
+		gio_task_return_errno (task, EBADF);
+		return;
+	}
+	
+	request = g_new (GioIORequest, 1);
+	request->buf = (char *) buf;
+	request->len = len;
+	
+	g_task_set_task_data (task, request, g_free);
+	
+	if (gio->ostream == NULL) {
+		/* try opening an output stream */
+		g_file_append_to_async (gio->file, G_FILE_CREATE_NONE, io_priority, cancellable, gio_write_opened, task);
+	} else {
+		gio_write_start (task);
+	}
+}
+
+static ssize_t
+stream_write_finish (GMimeStream *stream, GAsyncResult *result, GError **err)
+{
+	g_return_val_if_fail (g_task_is_valid (result, stream), -1);
+	
+	return g_task_propagate_int ((GTask *) result, err);
+}
+
+static void
+gio_flush_done (GObject *source, GAsyncResult *result, gpointer user_data)
+{
+	GTask *task = user_data;
+	GError *err = NULL;
+	
+	if (!g_output_stream_flush_finish ((GOutputStream *) source, result, &err)) {
+		gio_task_return_error (task, err);
+		return;
+	}
+	
+	g_task_return_int (task, 0);
+	g_object_unref (task);
+}
+
+static void
+stream_flush_async (GMimeStream *stream, int io_priority, GCancellable *cancellable,
+		    GAsyncReadyCallback callback, gpointer user_data)
+{
+	GMimeStreamGIO *gio = (GMimeStreamGIO *) stream;
+	GTask *task;
+	
+	task = gio_task_new (stream, stream_flush_async, io_priority, cancellable, callback, user_data);
+	
+	if (gio->file == NULL) {
+		gio_task_return_errno (task, EBADF);
+		return;
+	}
+	
+	if (gio->ostream == NULL) {
+		g_task_return_int (task, 0);
+		g_object_unref (task);
+		return;
+	}
+	
+	g_output_stream_flush_async (gio->ostream, io_priority, cancellable, gio_flush_done, task);
+}
+
+static int
+stream_flush_finish (GMimeStream *stream, GAsyncResult *result, GError **err)
+{
+	g_return_val_if_fail (g_task_is_valid (result, stream), -1);
+	
+	return (int) g_task_propagate_int ((GTask *) result, err);
+}
+
+static void gio_close_next (GTask *task);
+
+static void
+gio_close_input_done (GObject *source, GAsyncResult *result, gpointer user_data)
+{
+	g_input_stream_close_finish ((GInputStream *) source, result, NULL);
+	g_object_unref (source);
+	
+	gio_close_next (user_data);
+}
+
+static void
+gio_close_output_done (GObject *source, GAsyncResult *result, gpointer user_data)
+{
+	g_output_stream_close_finish ((GOutputStream *) source, result, NULL);
+	g_object_unref (source);
+	
+	gio_close_next (user_data);
+}
+
+/* closes the input stream, then the output stream, then drops the file */
+static void
+gio_close_next (GTask *task)
+{
+	GMimeStreamGIO *gio = g_task_get_source_object (task);
+	
+	if (gio->istream) {
+		GInputStream *istream = gio->istream;
+		
+		gio->istream = NULL;
+		g_input_stream_close_async (istream, g_task_get_priority (task), g_task_get_cancellable (task),
+					    gio_close_input_done, task);
+		return;
+	}
+	
+	if (gio->ostream) {
+		GOutputStream *ostream = gio->ostream;
+		
+		gio->ostream = NULL;
+		g_output_stream_close_async (ostream, g_task_get_priority (task), g_task_get_cancellable (task),
+					     gio_close_output_done, task);
+		return;
+	}
+	
+	if (gio->owner && gio->file)
+		g_object_unref (gio->file);
+	
+	gio->file = NULL;
+	
+	g_task_return_int (task, 0);
+	g_object_unref (task);
+}
+
+static void
+stream_close_async (GMimeStream *stream, int io_priority, GCancellable *cancellable,
+		    GAsyncReadyCallback callback, gpointer user_data)
+{
+	GTask *task;
+	
+	task = gio_task_new (stream, stream_close_async, io_priority, cancellable, callback, user_data);
+	
+	/* like the synchronous close, errors closing the underlying streams are ignored */
+	g_task_set_check_cancellable (task, FALSE);
+	
+	gio_close_next (task);
+}
+
+static int
+stream_close_finish (GMimeStream *stream, GAsyncResult *result, GError **err)
+{
+	g_return_val_if_fail (g_task_is_valid (result, stream), -1);
+	
+	return (int) g_task_propagate_int ((GTask *) result, err);
+}
+
+
 /**
  * g_mime_stream_gio_new:
  * @file: a #GFile
@@ -0,0 +1,592 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*- */
+/*  GMime
+ *  Copyright (C) 2000-2022 Jeffrey Stedfast
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public License
+ *  as published by the Free Software Foundation; either version 2.1
+ *  of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free
+ *  Software Foundation, 51 Franklin Street, Fifth Floor, Boston, MA
+ *  02110-1301, USA.
+ */
+
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE /* for O_TMPFILE */
+#endif
+
+#include <glib.h>
+#include <glib/gstdio.h>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <string.h>
+#include <fcntl.h>
+#include <errno.h>
+
+#include "gmime-stream-spill.h"
+
+
+/**
+ * SECTION: gmime-stream-spill
+ * @title: GMimeStreamSpill
+ * @short_description: A memory-backed stream that spills to disk
+ * @see_also: #GMimeStreamMem
+ *
+ * A #GMimeStream implementation that starts out as a memory buffer
+ * (like #GMimeStreamMem) and transparently migrates its content to an
+ * anonymous temporary file once it grows beyond a configurable
+ * threshold.
+ *
+ * This is useful as a sink for decoded or parsed content whose size
+ * is not known in advance: small parts never touch the disk, while a
+ * single huge attachment cannot exhaust the process's memory.
+ *
+ * Substreams of a #GMimeStreamSpill share the same backing store, so
+ * they remain valid even if the parent stream is spilled to disk
+ * after the substream was created.
+ **/
+
+
+struct _GMimeStreamSpillPrivate {
+	GByteArray *buffer;
+	size_t threshold;
+	gint64 length;
+	int ref_count;
+	int fd;
+};
+
+static void g_mime_stream_spill_class_init (GMimeStreamSpillClass *klass);
+static void g_mime_stream_spill_init (GMimeStreamSpill *stream, GMimeStreamSpillClass *klass);
+static void g_mime_stream_spill_finalize (GObject *object);
+
+static ssize_t stream_read (GMimeStream *stream, char *buf, size_t len);
+static ssize_t stream_write (GMimeStream *stream, const char *buf, size_t len);
+static int stream_flush (GMimeStream *stream);
+static int stream_close (GMimeStream *stream);
+static gboolean stream_eos (GMimeStream *stream);
+static int stream_reset (GMimeStream *stream);
+static gint64 stream_seek (GMimeStream *stream, gint64 offset, GMimeSeekWhence whence);
+static gint64 stream_tell (GMimeStream *stream);
+static gint64 stream_length (GMimeStream *stream);
+static GMimeStream *stream_substream (GMimeStream *stream, gint64 start, gint64 end);
+
+
+static GMimeStreamClass *parent_class = NULL;
+
+
+GType
+g_mime_stream_spill_get_type (void)
+{
+	static GType type = 0;
+	
+	if (!type) {
+		static const GTypeInfo info = {
+			sizeof (GMimeStreamSpillClass),
+			NULL, /* base_class_init */
+			NULL, /* base_class_finalize */
+			(GClassInitFunc) g_mime_stream_spill_class_init,
+			NULL, /* class_finalize */
+			NULL, /* class_data */
+			sizeof (GMimeStreamSpill),
+			0,    /* n_preallocs */
+			(GInstanceInitFunc) g_mime_stream_spill_init,
+		};
+		
+		type = g_type_register_static (GMIME_TYPE_STREAM, "GMimeStreamSpill", &info, 0);
+	}
+	
+	return type;
+}
+
+
+static void
+g_mime_stream_spill_class_init (GMimeStreamSpillClass *klass)
+{
+	GMimeStreamClass *stream_class = GMIME_STREAM_CLASS (klass);
+	GObjectClass *object_class = G_OBJECT_CLASS (klass);
+	
+	parent_class = g_type_class_ref (GMIME_TYPE_STREAM);
+	
+	object_class->finalize = g_mime_stream_spill_finalize;
+	
+	stream_class->read = stream_read;
+	stream_class->write = stream_write;
+	stream_class->flush = stream_flush;
+	stream_class->close = stream_close;
+	stream_class->eos = stream_eos;
+	stream_class->reset = stream_reset;
+	stream_class->seek = stream_seek;
+	stream_class->tell = stream_tell;
+	stream_class->length = stream_length;
+	stream_class->substream = stream_substream;
+}
+
+static void
+g_mime_stream_spill_init (GMimeStreamSpill *stream, GMimeStreamSpillClass *klass)
+{
+	stream->priv = NULL;
+}
+
+static void
+g_mime_stream_spill_finalize (GObject *object)
+{
+	GMimeStream *stream = (GMimeStream *) object;
+	
+	stream_close (stream);
+	
+	G_OBJECT_CLASS (parent_class)->finalize (object);
+}
+
+
+static struct _GMimeStreamSpillPrivate *
+spill_private_new (size_t threshold)
+{
+	struct _GMimeStreamSpillPrivate *priv;
+	
+	priv = g_slice_new (struct _GMimeStreamSpillPrivate);
+	priv->threshold = MIN (threshold, G_MAXUINT);
+	priv->buffer = g_byte_array_new ();
+	priv->ref_count = 1;
+	priv->length = 0;
+	priv->fd = -1;
+	
+	return priv;
+}
+
+static void
+spill_private_unref (struct _GMimeStreamSpillPrivate *priv)
+{
+	if (!g_atomic_int_dec_and_test (&priv->ref_count))
+		return;
+	
+	if (priv->buffer)
+		g_byte_array_free (priv->buffer, TRUE);
+	
+	if (priv->fd != -1)
+		close (priv->fd);
+	
+	g_slice_free (struct _GMimeStreamSpillPrivate, priv);
+}
+
+static int
+spill_open_tmpfile (void)
+{
+	const char *tmpdir = g_get_tmp_dir ();
+	char *path = NULL;
+	int fd = -1;
+	
+#ifdef O_TMPFILE
+	/* an unnamed inode in @tmpdir: nothing to clean up, ever */
+	do {
+		fd = open (tmpdir, O_TMPFILE | O_RDWR | O_EXCL, 0600);
+	} while (fd == -1 && errno == EINTR);
+	
+	if (fd != -1)
+		return fd;
+#endif
+	
+	/* fall back to a named file that we unlink immediately */
+	if ((fd = g_file_open_tmp ("gmime-spill-XXXXXX", &path, NULL)) == -1)
+		return -1;
+	
+	g_unlink (path);
+	g_free (path);
+	
+	return fd;
+}
+
+static ssize_t
+spill_write_all (int fd, const char *buf, size_t len)
+{
+	size_t nwritten = 0;
+	ssize_t n;
+	
+	do {
+		do {
+			n = write (fd, buf + nwritten, len - nwritten);
+		} while (n == -1 && (errno == EINTR || errno == EAGAIN));
+		
+		if (n > 0)
+			nwritten += n;
+	} while (n != -1 && nwritten < len);
+	
+	if (n == -1 && nwritten == 0)
+		return -1;
+	
+	return nwritten;
+}
+
+/* move the in-memory content out to the temporary file */
+static int
+spill_to_disk (struct _GMimeStreamSpillPrivate *priv)
+{
+	int errnosav;
+	int fd;
+	
+	if (priv->fd != -1)
+		return 0;
+	
+	if ((fd = spill_open_tmpfile ()) == -1)
+		return -1;
+	
+	if (priv->buffer->len > 0 && spill_write_all (fd, (char *) priv->buffer->data, priv->buffer->len) != (ssize_t) priv->buffer->len) {
+		errnosav = errno;
+		close (fd);
+		errno = errnosav;
+		return -1;
+	}
+	
+	g_byte_array_free (priv->buffer, TRUE);
+	priv->buffer = NULL;
+	priv->fd = fd;
+	
+	return 0;
+}
+
+/* grow the backing store to @length bytes, spilling to disk if needed */
+static int
+spill_set_length (struct _GMimeStreamSpillPrivate *priv, gint64 length)
+{
+	if (priv->buffer && length > (gint64) priv->threshold && spill_to_disk (priv) == -1)
+		return -1;
+	
+	if (priv->buffer) {
+		g_byte_array_set_size (priv->buffer, (guint) length);
+	} else if (ftruncate (priv->fd, (off_t) length) == -1) {
+		return -1;
+	}
+	
+	priv->length = length;
+	
+	return 0;
+}
+
+static ssize_t
+stream_read (GMimeStream *stream, char *buf, size_t len)
+{
+	GMimeStreamSpill *spill = (GMimeStreamSpill *) stream;
+	struct _GMimeStreamSpillPrivate *priv = spill->priv;
+	gint64 bound_end;
+	ssize_t n;
+	
+	if (priv == NULL) {
+		errno = EBADF;
+		return -1;
+	}
+	
+	bound_end = stream->bound_end != -1 ? stream->bound_end : priv->length;
+	
+	n = (ssize_t) MIN (bound_end - stream->position, (gint64) len);
+	if (n < 0) {
+		errno = EINVAL;
+		return -1;
+	}
+	
+	if (n == 0)
+		return 0;
+	
+	if (priv->buffer) {
+		/* a bounded substream may extend beyond what has been written so far */
+		n = (ssize_t) MIN ((gint64) n, (gint64) priv->buffer->len - stream->position);
+		if (n > 0)
+			memcpy (buf, priv->buffer->data + stream->position, n);
+		else
+			n = 0;
+	} else {
+		/* the fd is shared with our substreams, so always reposition it */
+		if (lseek (priv->fd, (off_t) stream->position, SEEK_SET) == -1)
+			return -1;
+		
+		do {
+			n = read (priv->fd, buf, n);
+		} while (n == -1 && errno == EINTR);
+	}
+	
+	if (n > 0)
+		stream->position += n;
+	
+	return n;
+}
+
+static ssize_t
+stream_write (GMimeStream *stream, const char *buf, size_t len)
+{
+	GMimeStreamSpill *spill = (GMimeStreamSpill *) stream;
+	struct _GMimeStreamSpillPrivate *priv = spill->priv;
+	gint64 bound_end, end;
+	ssize_t n;
+	
+	if (priv == NULL) {
+		errno = EBADF;
+		return -1;
+	}
+	
+	if (stream->bound_end != -1) {
+		if (stream->position >= stream->bound_end) {
+			errno = EINVAL;
+			return -1;
+		}
+		
+		bound_end = stream->bound_end;
+	} else {
+		bound_end = stream->position + len;
+	}
+	
+	n = (ssize_t) MIN (bound_end - stream->position, (gint64) len);
+	if (n <= 0) {
+		if (n < 0) {
+			errno = EINVAL;
+			return -1;
+		}
+		
+		return 0;
+	}
+	
+	end = stream->position + n;
+	
+	if (priv->buffer && end > (gint64) priv->threshold && spill_to_disk (priv) == -1)
+		return -1;
+	
+	if (priv->buffer) {
+		if (end > (gint64) priv->buffer->len)
+			g_byte_array_set_size (priv->buffer, (guint) end);
+		
+		memcpy (priv->buffer->data + stream->position, buf, n);
+	} else {
+		if (lseek (priv->fd, (off_t) stream->position, SEEK_SET) == -1)
+			return -1;
+		
+		if ((n = spill_write_all (priv->fd, buf, n)) == -1)
+			return -1;
+		
+		end = stream->position + n;
+	}
+	
+	if (end > priv->length)
+		priv->length = end;
+	
+	stream->position += n;
+	
+	return n;
+}
+
+static int
+stream_flush (GMimeStream *stream)
+{
+	GMimeStreamSpill *spill = (GMimeStreamSpill *) stream;
+	
+	if (spill->priv == NULL) {
+		errno = EBADF;
+		return -1;
+	}
+	
+	/* the backing file is anonymous, so there is no point in syncing it */
+	return 0;
+}
+
+static int
+stream_close (GMimeStream *stream)
+{
+	GMimeStreamSpill *spill = (GMimeStreamSpill *) stream;
+	
+	if (spill->priv)
+		spill_private_unref (spill->priv);
+	
+	spill->priv = NULL;
+	
+	return 0;
+}
+
+static gboolean
+stream_eos (GMimeStream *stream)
+{
+	GMimeStreamSpill *spill = (GMimeStreamSpill *) stream;
+	gint64 bound_end;
+	
+	if (spill->priv == NULL)
+		return TRUE;
+	
+	bound_end = stream->bound_end != -1 ? stream->bound_end : spill->priv->length;
+	
+	return stream->position >= MIN (bound_end, spill->priv->length);
+}
+
+static int
+stream_reset (GMimeStream *stream)
+{
+	GMimeStreamSpill *spill = (GMimeStreamSpill *) stream;
+	
+	if (spill->priv == NULL) {
+		errno = EBADF;
+		return -1;
+	}
+	
+	return 0;
+}
+
+static gint64
+stream_seek (GMimeStream *stream, gint64 offset, GMimeSeekWhence whence)
+{
+	GMimeStreamSpill *spill = (GMimeStreamSpill *) stream;
+	gint64 bound_end, real = stream->position;
+	
+	if (spill->priv == NULL) {
+		errno = EBADF;
+		return -1;
+	}
+	
+	bound_end = stream->bound_end != -1 ? stream->bound_end : spill->priv->length;
+	
+	switch (whence) {
+	case GMIME_STREAM_SEEK_SET:
+		real = offset;
+		break;
+	case GMIME_STREAM_SEEK_END:
+		real = offset + bound_end;
+		break;
+	case GMIME_STREAM_SEEK_CUR:
+		real = stream->position + offset;
+		break;
+	}
+	
+	if (real < stream->bound_start) {
+		errno = EINVAL;
+		return -1;
+	}
+	
+	if (stream->bound_end != -1 && real > bound_end) {
+		errno = EINVAL;
+		return -1;
+	}
+	
+	/* seeking past the end of an unbounded stream grows it (like GMimeStreamMem) */
+	if (real > spill->priv->length && stream->bound_end == -1) {
+		if (spill_set_length (spill->priv, real) == -1)
+			return -1;
+	}
+	
+	stream->position = real;
+	
+	return stream->position;
+}
+
+static gint64
+stream_tell (GMimeStream *stream)
+{
+	GMimeStreamSpill *spill = (GMimeStreamSpill *) stream;
+	
+	if (spill->priv == NULL) {
+		errno = EBADF;
+		return -1;
+	}
+	
+	return stream->position;
+}
+
+static gint64
+stream_length (GMimeStream *stream)
+{
+	GMimeStreamSpill *spill = (GMimeStreamSpill *) stream;
+	gint64 bound_end;
+	
+	if (spill->priv == NULL) {
+		errno = EBADF;
+		return -1;
+	}
+	
+	bound_end = stream->bound_end != -1 ? stream->bound_end : spill->priv->length;
+	
+	return bound_end - stream->bound_start;
+}
+
+static GMimeStream *
+stream_substream (GMimeStream *stream, gint64 start, gint64 end)
+{
+	GMimeStreamSpill *spill;
+	
+	spill = g_object_new (GMIME_TYPE_STREAM_SPILL, NULL);
+	g_mime_stream_construct ((GMimeStream *) spill, start, end);
+	spill->priv = ((GMimeStreamSpill *) stream)->priv;
+	g_atomic_int_inc (&spill->priv->ref_count);
+	
+	return (GMimeStream *) spill;
+}
+
+
+/**
+ * g_mime_stream_spill_new:
+ * @threshold: the number of bytes to keep in memory
+ *
+ * Creates a new #GMimeStreamSpill object. The stream content is kept
+ * in memory until it grows beyond @threshold bytes, at which point it
+ * is migrated to an anonymous temporary file (opened with O_TMPFILE
+ * where supported, or created and immediately unlinked otherwise).
+ *
+ * A @threshold of %0 spills to disk on the very first write.
+ *
+ * Returns: a new spill stream.
+ **/
+GMimeStream *
+g_mime_stream_spill_new (size_t threshold)
+{
+	GMimeStreamSpill *spill;
+	
+	spill = g_object_new (GMIME_TYPE_STREAM_SPILL, NULL);
+	g_mime_stream_construct ((GMimeStream *) spill, 0, -1);
+	spill->priv = spill_private_new (threshold);
+	
+	return (GMimeStream *) spill;
+}
+
+
+/**
+ * g_mime_stream_spill_get_threshold:
+ * @stream: a #GMimeStreamSpill
+ *
+ * Gets the number of bytes that @stream will keep in memory before
+ * spilling its content to disk.
+ *
+ * Returns: the spill threshold.
+ **/
+size_t
+g_mime_stream_spill_get_threshold (GMimeStreamSpill *stream)
+{
+	g_return_val_if_fail (GMIME_IS_STREAM_SPILL (stream), 0);
+	g_return_val_if_fail (stream->priv != NULL, 0);
+	
+	return stream->priv->threshold;
+}
+
+
+/**
+ * g_mime_stream_spill_get_spilled:
+ * @stream: a #GMimeStreamSpill
+ *
+ * Gets whether or not the content of @stream has been migrated to a
+ * temporary file.
+ *
+ * Returns: %TRUE if the content lives on disk or %FALSE if it is
+ * still held in memory.
+ **/
+gboolean
+g_mime_stream_spill_get_spilled (GMimeStreamSpill *stream)
+{
+	g_return_val_if_fail (GMIME_IS_STREAM_SPILL (stream), FALSE);
+	g_return_val_if_fail (stream->priv != NULL, FALSE);
+	
+	return stream->priv->fd != -1;
+}
@@ -24,8 +24,10 @@
 #endif
 
 #include <string.h>
+#include <errno.h>
 
 #include "gmime-stream.h"
+#include "gmime-internal.h"
 
 #define d(x)
 
@@ -40,6 +42,13 @@
  * used by GMime. You'll probably notice that the basic API is similar
  * to that of the low-level Unix I/O layer (read(), write(), lseek(),
  * etc) with some additional nicities such as a printf-like function.
+ *
+ * Reads, writes, flushes and closes may also be issued asynchronously
+ * using g_mime_stream_read_async() and friends. Stream implementations
+ * that wrap a natively asynchronous source (such as #GMimeStreamGIO)
+ * override these methods; for all other streams the synchronous method
+ * is run in a worker thread. In either case, the caller must not use
+ * the stream in any other way until the pending operation completes.
  **/
 
 
@@ -58,6 +67,19 @@ static gint64 stream_tell (GMimeStream *stream);
 static gint64 stream_length (GMimeStream *stream);
 static GMimeStream *stream_substream (GMimeStream *stream, gint64 start, gint64 end);
 
+static void stream_read_async (GMimeStream *stream, char *buf, size_t len, int io_priority,
+			       GCancellable *cancellable, GAsyncReadyCallback callback, gpointer user_data);
+static ssize_t stream_read_finish (GMimeStream *stream, GAsyncResult *result, GError **err);
+static void stream_write_async (GMimeStream *stream, const char *buf, size_t len, int io_priority,
+				GCancellable *cancellable, GAsyncReadyCallback callback, gpointer user_data);
+static ssize_t stream_write_finish (GMimeStream *stream, GAsyncResult *result, GError **err);
+static void stream_flush_async (GMimeStream *stream, int io_priority, GCancellable *cancellable,
+				GAsyncReadyCallback callback, gpointer user_data);
+static int stream_flush_finish (GMimeStream *stream, GAsyncResult *result, GError **err);
+static void stream_close_async (GMimeStream *stream, int io_priority, GCancellable *cancellable,
+				GAsyncReadyCallback callback, gpointer user_data);
+static int stream_close_finish (GMimeStream *stream, GAsyncResult *result, GError **err);
+
 
 static GObjectClass *parent_class = NULL;
 
@@ -82,15 +104,28 @@ g_mime_stream_get_type (void)
 		
 		type = g_type_register_static (G_TYPE_OBJECT, "GMimeStream",
 					       &info, G_TYPE_FLAG_ABSTRACT);
+		
+		/* Note: the asynchronous methods are kept in private class data
+		 * so that the size of the public GMimeStreamClass (which
+		 * subclasses built against older versions of GMime depend on)
+		 * does not change. */
+		g_type_add_class_private (type, sizeof (GMimeStreamAsyncMethods));
 	}
 	
 	return type;
 }
 
 
+GMimeStreamAsyncMethods *
+_g_mime_stream_class_get_async_methods (GMimeStreamClass *klass)
+{
+	return G_TYPE_CLASS_GET_PRIVATE (klass, GMIME_TYPE_STREAM, GMimeStreamAsyncMethods);
+}
+
 static void
 g_mime_stream_class_init (GMimeStreamClass *klass)
 {
+	GMimeStreamAsyncMethods *async = _g_mime_stream_class_get_async_methods (klass);
 	GObjectClass *object_class = G_OBJECT_CLASS (klass);
 	
 	parent_class = g_type_class_ref (G_TYPE_OBJECT);
@@ -107,6 +142,15 @@ g_mime_stream_class_init (GMimeStreamClass *klass)
 	klass->tell = stream_tell;
 	klass->length = stream_length;
 	klass->substream = stream_substream;
+	
+	async->read_async = stream_read_async;
+	async->read_finish = stream_read_finish;
+	async->write_async = stream_write_async;
+	async->write_finish = stream_write_finish;
+	async->flush_async = stream_flush_async;
+	async->flush_finish = stream_flush_finish;
+	async->close_async = stream_close_async;
+	async->close_finish = stream_close_finish;
 }
 
 static void
@@ -606,3 +650,350 @@ g_mime_stream_writev (GMimeStream *stream, GMimeStreamIOVector *vector, size_t c
 	
 	return total;
 }
+
+
+typedef struct {
+	char *buf;
+	size_t len;
+} StreamIORequest;
+
+static void
+stream_task_return_errno (GTask *task, int errnum)
+{
+	g_task_return_new_error (task, G_IO_ERROR, g_io_error_from_errno (errnum),
+				 "%s", g_strerror (errnum));
+}
+
+static GTask *
+stream_task_new (GMimeStream *stream, gpointer source_tag, int io_priority, GCancellable *cancellable,
+		 GAsyncReadyCallback callback, gpointer user_data)
+{
+	GTask *task;
+	
+	task = g_task_new (stream, cancellable, callback, user_data);
+	g_task_set_source_tag (task, source_tag);
+	g_task_set_priority (task, io_priority);
+	
+	return task;
+}
+
+static void
+stream_read_thread (GTask *task, gpointer source_object, gpointer task_data, GCancellable *cancellable)
+{
+	GMimeStream *stream = (GMimeStream *) source_object;
+	StreamIORequest *request = task_data;
+	ssize_t nread;
+	
+	if (g_task_return_error_if_cancelled (task))
+		return;
+	
+	if ((nread = g_mime_stream_read (stream, request->buf, request->len)) == -1)
+		stream_task_return_errno (task, errno);
+	else
+		g_task_return_int (task, nread);
+}
+
+static void
+stream_read_async (GMimeStream *stream, char *buf, size_t len, int io_priority,
+		   GCancellable *cancellable, GAsyncReadyCallback callback, gpointer user_data)
+{
+	StreamIORequest *request;
+	GTask *task;
+	
+	task = stream_task_new (stream, stream_read_async, io_priority, cancellable, callback, user_data);
+	
+	request = g_new (StreamIORequest, 1);
+	request->buf = buf;
+	request->len = len;
+	
+	g_task_set_task_data (task, request, g_free);
+	g_task_run_in_thread (task, stream_read_thread);
+	g_object_unref (task);
+}
+
+static ssize_t
+stream_read_finish (GMimeStream *stream, GAsyncResult *result, GError **err)
+{
+	return g_task_propagate_int ((GTask *) result, err);
+}
+
+
+/**
+ * g_mime_stream_read_async:
+ * @stream: a #GMimeStream
+ * @buf: (array length=len) (element-type guint8): buffer
+ * @len: buffer length
+ * @io_priority: the I/O priority of the request
+ * @cancellable: (nullable): a #GCancellable or %NULL
+ * @callback: (scope async): a #GAsyncReadyCallback to call when the request is satisfied
+ * @user_data: (closure): the data to pass to the callback function
+ *
+ * Asynchronously attempts to read up to @len bytes from @stream into
+ * @buf. @buf must remain valid until @callback is invoked, at which
+ * point g_mime_stream_read_finish() should be called to get the
+ * result of the operation.
+ **/
+void
+g_mime_stream_read_async (GMimeStream *stream, char *buf, size_t len, int io_priority,
+			  GCancellable *cancellable, GAsyncReadyCallback callback, gpointer user_data)
+{
+	g_return_if_fail (GMIME_IS_STREAM (stream));
+	g_return_if_fail (buf != NULL);
+	
+	_g_mime_stream_class_get_async_methods (GMIME_STREAM_GET_CLASS (stream))->read_async (stream, buf, len, io_priority, cancellable, callback, user_data);
+}
+
+
+/**
+ * g_mime_stream_read_finish:
+ * @stream: a #GMimeStream
+ * @result: a #GAsyncResult
+ * @err: a #GError
+ *
+ * Finishes an asynchronous read started with g_mime_stream_read_async().
+ *
+ * Returns: the number of bytes read or %-1 on fail.
+ **/
+ssize_t
+g_mime_stream_read_finish (GMimeStream *stream, GAsyncResult *result, GError **err)
+{
+	g_return_val_if_fail (GMIME_IS_STREAM (stream), -1);
+	g_return_val_if_fail (G_IS_ASYNC_RESULT (result), -1);
+	
+	return _g_mime_stream_class_get_async_methods (GMIME_STREAM_GET_CLASS (stream))->read_finish (stream, result, err);
+}
+
+
+static void
+stream_write_thread (GTask *task, gpointer source_object, gpointer task_data, GCancellable *cancellable)
+{
+	GMimeStream *stream = (GMimeStream *) source_object;
+	StreamIORequest *request = task_data;
+	ssize_t nwritten;
+	
+	if (g_task_return_error_if_cancelled (task))
+		return;
+	
+	if ((nwritten = g_mime_stream_write (stream, request->buf, request->len)) == -1)
+		stream_task_return_errno (task, errno);
+	else
+		g_task_return_int (task, nwritten);
+}
+
+static void
+stream_write_async (GMimeStream *stream, const char *buf, size_t len, int io_priority,
+		    GCancellable *cancellable, GAsyncReadyCallback callback, gpointer user_data)
+{
+	StreamIORequest *request;
+	GTask *task;
+	
+	task = stream_task_new (stream, stream_write_async, io_priority, cancellable, callback, user_data);
+	
+	request = g_new (StreamIORequest, 1);
+	request->buf = (char *) buf;
+	request->len = len;
+	
+	g_task_set_task_data (task, request, g_free);
+	g_task_run_in_thread (task, stream_write_thread);
+	g_object_unref (task);
+}
+
+static ssize_t
+stream_write_finish (GMimeStream *stream, GAsyncResult *result, GError **err)
+{
+	return g_task_propagate_int ((GTask *) result, err);
+}
+
+
+/**
+ * g_mime_stream_write_async:
+ * @stream: a #GMimeStream
+ * @buf: (array length=len) (element-type guint8): buffer
+ * @len: buffer length
+ * @io_priority: the I/O priority of the request
+ * @cancellable: (nullable): a #GCancellable or %NULL
+ * @callback: (scope async): a #GAsyncReadyCallback to call when the request is satisfied
+ * @user_data: (closure): the data to pass to the callback function
+ *
+ * Asynchronously attempts to write up to @len bytes of @buf to
+ * @stream. @buf must remain valid until @callback is invoked, at
+ * which point g_mime_stream_write_finish() should be called to get
+ * the result of the operation.
+ **/
+void
+g_mime_stream_write_async (GMimeStream *stream, const char *buf, size_t len, int io_priority,
+			   GCancellable *cancellable, GAsyncReadyCallback callback, gpointer user_data)
+{
+	g_return_if_fail (GMIME_IS_STREAM (stream));
+	g_return_if_fail (buf != NULL);
+	
+	_g_mime_stream_class_get_async_methods (GMIME_STREAM_GET_CLASS (stream))->write_async (stream, buf, len, io_priority, cancellable, callback, user_data);
+}
+
+
+/**
+ * g_mime_stream_write_finish:
+ * @stream: a #GMimeStream
+ * @result: a #GAsyncResult
+ * @err: a #GError
+ *
+ * Finishes an asynchronous write started with g_mime_stream_write_async().
+ *
+ * Returns: the number of bytes written or %-1 on fail.
+ **/
+ssize_t
+g_mime_stream_write_finish (GMimeStream *stream, GAsyncResult *result, GError **err)
+{
+	g_return_val_if_fail (GMIME_IS_STREAM (stream), -1);
+	g_return_val_if_fail (G_IS_ASYNC_RESULT (result), -1);
+	
+	return _g_mime_stream_class_get_async_methods (GMIME_STREAM_GET_CLASS (stream))->write_finish (stream, result, err);
+}
+
+
+static void
+stream_flush_thread (GTask *task, gpointer source_object, gpointer task_data, GCancellable *cancellable)
+{
+	GMimeStream *stream = (GMimeStream *) source_object;
+	
+	if (g_task_return_error_if_cancelled (task))
+		return;
+	
+	if (g_mime_stream_flush (stream) == -1)
+		stream_task_return_errno (task, errno);
+	else
+		g_task_return_int (task, 0);
+}
+
+static void
+stream_flush_async (GMimeStream *stream, int io_priority, GCancellable *cancellable,
+		    GAsyncReadyCallback callback, gpointer user_data)
+{
+	GTask *task;
+	
+	task = stream_task_new (stream, stream_flush_async, io_priority, cancellable, callback, user_data);
+	g_task_run_in_thread (task, stream_flush_thread);
+	g_object_unref (task);
+}
+
+static int
+stream_flush_finish (GMimeStream *stream, GAsyncResult *result, GError **err)
+{
+	return (int) g_task_propagate_int ((GTask *) result, err);
+}
+
+
+/**
+ * g_mime_stream_flush_async:
+ * @stream: a #GMimeStream
+ * @io_priority: the I/O priority of the request
+ * @cancellable: (nullable): a #GCancellable or %NULL
+ * @callback: (scope async): a #GAsyncReadyCallback to call when the request is satisfied
+ * @user_data: (closure): the data to pass to the callback function
+ *
+ * Asynchronously sync's the stream to disk. When the operation is
+ * finished, @callback will be invoked and g_mime_stream_flush_finish()
+ * should be called to get the result of the operation.
+ **/
+void
+g_mime_stream_flush_async (GMimeStream *stream, int io_priority, GCancellable *cancellable,
+			   GAsyncReadyCallback callback, gpointer user_data)
+{
+	g_return_if_fail (GMIME_IS_STREAM (stream));
+	
+	_g_mime_stream_class_get_async_methods (GMIME_STREAM_GET_CLASS (stream))->flush_async (stream, io_priority, cancellable, callback, user_data);
+}
+
+
+/**
+ * g_mime_stream_flush_finish:
+ * @stream: a #GMimeStream
+ * @result: a #GAsyncResult
+ * @err: a #GError
+ *
+ * Finishes an asynchronous flush started with g_mime_stream_flush_async().
+ *
+ * Returns: %0 on success or %-1 on fail.
+ **/
+int
+g_mime_stream_flush_finish (GMimeStream *stream, GAsyncResult *result, GError **err)
+{
+	g_return_val_if_fail (GMIME_IS_STREAM (stream), -1);
+	g_return_val_if_fail (G_IS_ASYNC_RESULT (result), -1);
+	
+	return _g_mime_stream_class_get_async_methods (GMIME_STREAM_GET_CLASS (stream))->flush_finish (stream, result, err);
+}
+
+
+static void
+stream_close_thread (GTask *task, gpointer source_object, gpointer task_data, GCancellable *cancellable)
+{
+	GMimeStream *stream = (GMimeStream *) source_object;
+	
+	if (g_task_return_error_if_cancelled (task))
+		return;
+	
+	if (g_mime_stream_close (stream) == -1)
+		stream_task_return_errno (task, errno);
+	else
+		g_task_return_int (task, 0);
+}
+
+static void
+stream_close_async (GMimeStream *stream, int io_priority, GCancellable *cancellable,
+		    GAsyncReadyCallback callback, gpointer user_data)
+{
+	GTask *task;
+	
+	task = stream_task_new (stream, stream_close_async, io_priority, cancellable, callback, user_data);
+	g_task_run_in_thread (task, stream_close_thread);
+	g_object_unref (task);
+}
+
+static int
+stream_close_finish (GMimeStream *stream, GAsyncResult *result, GError **err)
+{
+	return (int) g_task_propagate_int ((GTask *) result, err);
+}
+
+
+/**
+ * g_mime_stream_close_async:
+ * @stream: a #GMimeStream
+ * @io_priority: the I/O priority of the request
+ * @cancellable: (nullable): a #GCancellable or %NULL
+ * @callback: (scope async): a #GAsyncReadyCallback to call when the request is satisfied
+ * @user_data: (closure): the data to pass to the callback function
+ *
+ * Asynchronously closes the stream. When the operation is finished,
+ * @callback will be invoked and g_mime_stream_close_finish() should
+ * be called to get the result of the operation.
+ **/
+void
+g_mime_stream_close_async (GMimeStream *stream, int io_priority, GCancellable *cancellable,
+			   GAsyncReadyCallback callback, gpointer user_data)
+{
+	g_return_if_fail (GMIME_IS_STREAM (stream));
+	
+	_g_mime_stream_class_get_async_methods (GMIME_STREAM_GET_CLASS (stream))->close_async (stream, io_priority, cancellable, callback, user_data);
+}
+
+
+/**
+ * g_mime_stream_close_finish:
+ * @stream: a #GMimeStream
+ * @result: a #GAsyncResult
+ * @err: a #GError
+ *
+ * Finishes an asynchronous close started with g_mime_stream_close_async().
+ *
+ * Returns: %0 on success or %-1 on fail.
+ **/
+int
+g_mime_stream_close_finish (GMimeStream *stream, GAsyncResult *result, GError **err)
+{
+	g_return_val_if_fail (GMIME_IS_STREAM (stream), -1);
+	g_return_val_if_fail (G_IS_ASYNC_RESULT (result), -1);
+	
+	return _g_mime_stream_class_get_async_methods (GMIME_STREAM_GET_CLASS (stream))->close_finish (stream, result, err);
+}
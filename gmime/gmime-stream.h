@@ -24,6 +24,7 @@
 
 #include <glib.h>
 #include <glib-object.h>
+#include <gio/gio.h>
 
 #include <stdio.h>
 #include <sys/types.h>
@@ -130,6 +131,23 @@ gint64    g_mime_stream_write_to_stream (GMimeStream *src, GMimeStream *dest);
 
 gint64    g_mime_stream_writev (GMimeStream *stream, GMimeStreamIOVector *vector, size_t count);
 
+/* asynchronous methods */
+void      g_mime_stream_read_async   (GMimeStream *stream, char *buf, size_t len, int io_priority,
+				      GCancellable *cancellable, GAsyncReadyCallback callback, gpointer user_data);
+ssize_t   g_mime_stream_read_finish  (GMimeStream *stream, GAsyncResult *result, GError **err);
+
+void      g_mime_stream_write_async  (GMimeStream *stream, const char *buf, size_t len, int io_priority,
+				      GCancellable *cancellable, GAsyncReadyCallback callback, gpointer user_data);
+ssize_t   g_mime_stream_write_finish (GMimeStream *stream, GAsyncResult *result, GError **err);
+
+void      g_mime_stream_flush_async  (GMimeStream *stream, int io_priority, GCancellable *cancellable,
+				      GAsyncReadyCallback callback, gpointer user_data);
+int       g_mime_stream_flush_finish (GMimeStream *stream, GAsyncResult *result, GError **err);
+
+void      g_mime_stream_close_async  (GMimeStream *stream, int io_priority, GCancellable *cancellable,
+				      GAsyncReadyCallback callback, gpointer user_data);
+int       g_mime_stream_close_finish (GMimeStream *stream, GAsyncResult *result, GError **err);
+
 G_END_DECLS
 
 #endif /* __GMIME_STREAM_H__ */
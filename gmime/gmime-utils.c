@@ -65,6 +65,7 @@
 #include "gmime-charset.h"
 #include "gmime-iconv.h"
 #include "gmime-iconv-utils.h"
+#include "gmime-simd.h"
 
 #ifdef ENABLE_WARNINGS
 #define w(x) x
@@ -1048,17 +1049,15 @@ g_mime_utils_unquote_string (char *str)
 gboolean
 g_mime_utils_text_is_8bit (const unsigned char *text, size_t len)
 {
-	register const unsigned char *inptr;
-	const unsigned char *inend;
+	size_t n;
 	
 	g_return_val_if_fail (text != NULL, FALSE);
 	
-	inend = text + len;
-	for (inptr = text; *inptr && inptr < inend; inptr++)
-		if (*inptr > (unsigned char) 127)
-			return TRUE;
+	if ((n = g_mime_simd_ascii_span (text, len)) == len)
+		return FALSE;
 	
-	return FALSE;
+	/* the text is only considered up to the first nul-byte */
+	return memchr (text, 0, n) == NULL;
 }
 
 
@@ -1077,15 +1076,12 @@ g_mime_utils_text_is_8bit (const unsigned char *text, size_t len)
 GMimeContentEncoding
 g_mime_utils_best_encoding (const unsigned char *text, size_t len)
 {
-	const unsigned char *ch, *inend;
-	size_t count = 0;
+	GMimeSimdTextStats stats;
 	
-	inend = text + len;
-	for (ch = text; ch < inend; ch++)
-		if (*ch > (unsigned char) 127)
-			count++;
+	memset (&stats, 0, sizeof (stats));
+	g_mime_simd_text_stats (text, len, &stats);
 	
-	if ((float) count <= len * 0.17)
+	if ((float) stats.count8 <= len * 0.17)
 		return GMIME_CONTENT_ENCODING_QUOTEDPRINTABLE;
 	else
 		return GMIME_CONTENT_ENCODING_BASE64;
@@ -1095,6 +1091,7 @@ g_mime_utils_best_encoding (const unsigned char *text, size_t len)
 /**
  * charset_convert:
  * @cd: iconv converter
+ * @path: native converter from _g_mime_iconv_get_path() or %NULL to use @cd
  * @inbuf: input text buffer to convert
  * @inleft: length of the input buffer
  * @outp: pointer to output buffer
@@ -1118,7 +1115,7 @@ g_mime_utils_best_encoding (const unsigned char *text, size_t len)
  * Returns: the string length of the output buffer.
  **/
 static size_t
-charset_convert (iconv_t cd, const char *inbuf, size_t inleft, char **outp, size_t *outlenp, size_t *ninval)
+charset_convert (iconv_t cd, const GMimeIconvPath *path, const char *inbuf, size_t inleft, char **outp, size_t *outlenp, size_t *ninval)
 {
 	size_t outlen, outleft, rc, n = 0;
 	char *outbuf, *out;
@@ -1132,7 +1129,7 @@ charset_convert (iconv_t cd, const char *inbuf, size_t inleft, char **outp, size
 	}
 	
 	do {
-		rc = iconv (cd, (char **) &inbuf, &inleft, &outbuf, &outleft);
+		rc = _g_mime_iconv_convert (cd, path, (char **) &inbuf, &inleft, &outbuf, &outleft);
 		if (rc == (size_t) -1) {
 			if (errno == EINVAL) {
 				/* incomplete sequence at the end of the input buffer */
@@ -1172,7 +1169,7 @@ charset_convert (iconv_t cd, const char *inbuf, size_t inleft, char **outp, size
 		}
 	} while (inleft > 0);
 	
-	while (iconv (cd, NULL, NULL, &outbuf, &outleft) == (size_t) -1) {
+	while (_g_mime_iconv_convert (cd, path, NULL, NULL, &outbuf, &outleft) == (size_t) -1) {
 		if (errno != E2BIG)
 			break;
 		
@@ -1212,6 +1209,7 @@ char *
 g_mime_utils_decode_8bit (GMimeParserOptions *options, const char *text, size_t len)
 {
 	size_t outleft, outlen, min, ninval;
+	const GMimeIconvPath *path;
 	const char **charsets;
 	const char *best;
 	iconv_t cd;
@@ -1228,12 +1226,25 @@ g_mime_utils_decode_8bit (GMimeParserOptions *options, const char *text, size_t
 	out = g_malloc (outleft + 1);
 	
 	for (i = 0; charsets[i]; i++) {
-		if ((cd = g_mime_iconv_open ("UTF-8", charsets[i])) == (iconv_t) -1)
+		path = _g_mime_iconv_get_path ("UTF-8", charsets[i]);
+		
+		/* if the text would come out of the conversion unchanged, don't bother converting it */
+		if (_g_mime_iconv_is_identity (path, text, len)) {
+			memcpy (out, text, len);
+			out[len] = '\0';
+			
+			return g_realloc (out, len + 1);
+		}
+		
+		if (path != NULL)
+			cd = (iconv_t) -1;
+		else if ((cd = g_mime_iconv_open ("UTF-8", charsets[i])) == (iconv_t) -1)
 			continue;
 		
-		outlen = charset_convert (cd, text, len, &out, &outleft, &ninval);
+		outlen = charset_convert (cd, path, text, len, &out, &outleft, &ninval);
 		
-		g_mime_iconv_close (cd);
+		if (cd != (iconv_t) -1)
+			g_mime_iconv_close (cd);
 		
 		if (ninval == 0)
 			return g_realloc (out, outlen + 1);
@@ -1248,7 +1259,9 @@ g_mime_utils_decode_8bit (GMimeParserOptions *options, const char *text, size_t
 	 * try to find the one that fit the best and use that to convert what we can,
 	 * replacing any byte we can't convert with a '?' */
 	
-	if ((cd = g_mime_iconv_open ("UTF-8", best)) == (iconv_t) -1) {
+	if ((path = _g_mime_iconv_get_path ("UTF-8", best)) != NULL) {
+		cd = (iconv_t) -1;
+	} else if ((cd = g_mime_iconv_open ("UTF-8", best)) == (iconv_t) -1) {
 		/* this shouldn't happen... but if we are here, then
 		 * it did...  the only thing we can do at this point
 		 * is replace the 8bit garbage and pray */
@@ -1270,9 +1283,10 @@ g_mime_utils_decode_8bit (GMimeParserOptions *options, const char *text, size_t
 		return g_realloc (out, (size_t) (outbuf - out));
 	}
 	
-	outlen = charset_convert (cd, text, len, &out, &outleft, &ninval);
+	outlen = charset_convert (cd, path, text, len, &out, &outleft, &ninval);
 	
-	g_mime_iconv_close (cd);
+	if (cd != (iconv_t) -1)
+		g_mime_iconv_close (cd);
 	
 	return g_realloc (out, outlen + 1);
 }
@@ -1816,7 +1830,8 @@ static char *
 rfc2047_decode_tokens (GMimeParserOptions *options, rfc2047_token *tokens, size_t buflen, const char **charset_out)
 {
 	rfc2047_token *token, *next;
-	size_t outlen, ninval, len;
+	size_t outlen, ninval, len, n;
+	const GMimeIconvPath *path;
 	unsigned char *outptr;
 	const char *charset;
 	GByteArray *outbuf;
@@ -1880,17 +1895,23 @@ rfc2047_decode_tokens (GMimeParserOptions *options, rfc2047_token *tokens, size_
 			
 			/* convert the raw decoded text into UTF-8 */
 			if (!g_ascii_strcasecmp (charset, "UTF-8")) {
-				/* slight optimization over going through iconv */
+				/* slight optimization over going through iconv: replace
+				 * each invalid byte (as well as any NULs) with a '?' */
 				str = (char *) outptr;
 				len = outlen;
 				
-				while (!g_utf8_validate (str, len, (const char **) &str)) {
-					len = outlen - (str - (char *) outptr);
+				while ((n = g_mime_simd_utf8_span ((const unsigned char *) str, len)) < len) {
+					str += n;
+					len -= n;
 					*str = '?';
 				}
 				
+				for (str = (char *) outptr; (str = memchr (str, '\0', outlen - (str - (char *) outptr))); str++)
+					*str = '?';
+				
 				g_string_append_len (decoded, (char *) outptr, outlen);
-			} else if ((cd = g_mime_iconv_open ("UTF-8", charset)) == (iconv_t) -1) {
+			} else if ((path = _g_mime_iconv_get_path ("UTF-8", charset)) == NULL &&
+				   (cd = g_mime_iconv_open ("UTF-8", charset)) == (iconv_t) -1) {
 				w(g_warning ("Cannot convert from %s to UTF-8, header display may "
 					     "be corrupt: %s", charset[0] ? charset : "unspecified charset",
 					     g_strerror (errno)));
@@ -1899,11 +1920,16 @@ rfc2047_decode_tokens (GMimeParserOptions *options, rfc2047_token *tokens, size_
 				g_string_append (decoded, str);
 				g_free (str);
 			} else {
+				/* native conversions don't need an iconv descriptor */
+				if (path != NULL)
+					cd = (iconv_t) -1;
+				
 				str = g_malloc (outlen + 1);
 				len = outlen;
 				
-				len = charset_convert (cd, (char *) outptr, outlen, &str, &len, &ninval);
-				g_mime_iconv_close (cd);
+				len = charset_convert (cd, path, (char *) outptr, outlen, &str, &len, &ninval);
+				if (cd != (iconv_t) -1)
+					g_mime_iconv_close (cd);
 				
 				g_string_append_len (decoded, str, len);
 				g_free (str);
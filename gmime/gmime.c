@@ -143,16 +143,20 @@ g_mime_init (void)
 	g_mime_filter_best_get_type ();
 	g_mime_filter_charset_get_type ();
 	g_mime_filter_checksum_get_type ();
+	g_mime_filter_digest_get_type ();
 	g_mime_filter_dos2unix_get_type ();
 	g_mime_filter_enriched_get_type ();
 	g_mime_filter_from_get_type ();
 	g_mime_filter_gzip_get_type ();
 	g_mime_filter_html_get_type ();
+	g_mime_filter_html2text_get_type ();
+	g_mime_filter_lz4_get_type ();
 	g_mime_filter_smtp_data_get_type ();
 	g_mime_filter_strip_get_type ();
 	g_mime_filter_unix2dos_get_type ();
 	g_mime_filter_windows_get_type ();
 	g_mime_filter_yenc_get_type ();
+	g_mime_filter_zstd_get_type ();
 	
 	g_mime_stream_get_type ();
 	g_mime_stream_buffer_get_type ();
@@ -165,6 +169,7 @@ g_mime_init (void)
 	g_mime_stream_mmap_get_type ();
 	g_mime_stream_null_get_type ();
 	g_mime_stream_pipe_get_type ();
+	g_mime_stream_spill_get_type ();
 	
 	g_mime_format_options_get_type ();
 	g_mime_parser_options_get_type ();
@@ -230,4 +235,6 @@ g_mime_shutdown (void)
 	g_mime_format_options_shutdown ();
 	g_mime_parser_options_shutdown ();
 	g_mime_charset_map_shutdown ();
+	g_mime_filter_pool_shutdown ();
+	g_mime_iconv_cache_shutdown ();
 }
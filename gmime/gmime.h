@@ -61,22 +61,28 @@
 #include <gmime/gmime-stream-mmap.h>
 #include <gmime/gmime-stream-null.h>
 #include <gmime/gmime-stream-pipe.h>
+#include <gmime/gmime-stream-spill.h>
 #include <gmime/gmime-filter.h>
 #include <gmime/gmime-filter-basic.h>
 #include <gmime/gmime-filter-best.h>
 #include <gmime/gmime-filter-charset.h>
 #include <gmime/gmime-filter-checksum.h>
+#include <gmime/gmime-filter-digest.h>
 #include <gmime/gmime-filter-dos2unix.h>
 #include <gmime/gmime-filter-enriched.h>
 #include <gmime/gmime-filter-from.h>
 #include <gmime/gmime-filter-gzip.h>
 #include <gmime/gmime-filter-html.h>
+#include <gmime/gmime-filter-html2text.h>
+#include <gmime/gmime-filter-lz4.h>
 #include <gmime/gmime-filter-openpgp.h>
 #include <gmime/gmime-filter-smtp-data.h>
 #include <gmime/gmime-filter-strip.h>
+#include <gmime/gmime-filter-text.h>
 #include <gmime/gmime-filter-unix2dos.h>
 #include <gmime/gmime-filter-windows.h>
 #include <gmime/gmime-filter-yenc.h>
+#include <gmime/gmime-filter-zstd.h>
 #include <gmime/gmime-crypto-context.h>
 #include <gmime/gmime-pkcs7-context.h>
 #include <gmime/gmime-gpg-context.h>
@@ -37,9 +37,13 @@
 #include <gmime/gmime-stream-fs.h>
 #include <gmime/gmime-stream-cat.h>
 #include <gmime/gmime-stream-mem.h>
+#include <gmime/gmime-stream-pipe.h>
 
 #include "testsuite.h"
 
+/*#define ENABLE_ZENTIMER*/
+#include "zentimer.h"
+
 /* Note: this test suite assumes StreamFs and StreamMem are correct */
 
 extern int verbose;
@@ -454,6 +458,164 @@ test_cat_substream (GMimeStream *whole, struct _StreamPart *parts, int bounded)
 	g_object_unref (sub2);
 }
 
+#define MANY_SOURCES 10000
+#define MANY_SEEKS 10000
+
+static void
+test_cat_many_sources (GMimeStream *whole, struct _StreamPart *parts, int bounded)
+{
+	GMimeStream *stream, *cat;
+	char buf[128], *inptr;
+	gint64 offset, len;
+	size_t nread, size;
+	GByteArray *data;
+	Exception *ex;
+	ssize_t n;
+	int i;
+	
+	/* generate enough random data for MANY_SOURCES sources of 1-64 bytes each */
+	data = g_byte_array_sized_new (MANY_SOURCES * 64);
+	g_byte_array_set_size (data, MANY_SOURCES * 64);
+	
+	nread = 0;
+	do {
+		if ((n = read (randfd, data->data + nread, data->len - nread)) > 0)
+			nread += n;
+	} while (nread < data->len && (n > 0 || errno == EINTR));
+	
+	cat = g_mime_stream_cat_new ();
+	
+	ZenTimerStart (NULL);
+	inptr = (char *) data->data;
+	for (i = 0; i < MANY_SOURCES; i++) {
+		size = 1 + ((unsigned char) inptr[0] % 64);
+		stream = g_mime_stream_mem_new_with_buffer (inptr, size);
+		g_mime_stream_cat_add_source ((GMimeStreamCat *) cat, stream);
+		g_object_unref (stream);
+		inptr += size;
+	}
+	ZenTimerStop (NULL);
+	ZenTimerReport (NULL, "GMimeStreamCat::add_source(10k sources)");
+	
+	len = inptr - (char *) data->data;
+	
+	if (g_mime_stream_length (cat) != len) {
+		ex = exception_new ("length %lld != %lld", (long long) g_mime_stream_length (cat), (long long) len);
+		g_byte_array_free (data, TRUE);
+		g_object_unref (cat);
+		throw (ex);
+	}
+	
+	ZenTimerStart (NULL);
+	for (i = 0; i < MANY_SEEKS; i++) {
+		offset = (gint64) ((len - 1) * randf ());
+		
+		if (g_mime_stream_seek (cat, offset, GMIME_STREAM_SEEK_SET) != offset) {
+			ex = exception_new ("could not seek to %lld: %s",
+					    (long long) offset, g_strerror (errno));
+			g_byte_array_free (data, TRUE);
+			g_object_unref (cat);
+			throw (ex);
+		}
+		
+		size = (size_t) MIN ((gint64) sizeof (buf), len - offset);
+		nread = 0;
+		
+		do {
+			if ((n = g_mime_stream_read (cat, buf + nread, size - nread)) <= 0)
+				break;
+			nread += n;
+		} while (nread < size);
+		
+		if (nread != size || memcmp (buf, data->data + offset, size) != 0) {
+			ex = exception_new ("content at offset %lld does not match", (long long) offset);
+			g_byte_array_free (data, TRUE);
+			g_object_unref (cat);
+			throw (ex);
+		}
+	}
+	ZenTimerStop (NULL);
+	ZenTimerReport (NULL, "GMimeStreamCat::seek+read(10k sources)");
+	
+	g_byte_array_free (data, TRUE);
+	g_object_unref (cat);
+}
+
+static void
+test_cat_unknown_length (GMimeStream *whole, struct _StreamPart *parts, int bounded)
+{
+	GMimeStream *stream, *cat;
+	Exception *ex = NULL;
+	char buf[16];
+	gint64 offset;
+	ssize_t n;
+	int fds[2];
+	
+	/* the last source is a pipe, so the length of the cat is unknown */
+	if (pipe (fds) == -1)
+		throw (exception_new ("could not create a pipe: %s", g_strerror (errno)));
+	
+	if (write (fds[1], "pipe", 4) != 4) {
+		close (fds[0]);
+		close (fds[1]);
+		throw (exception_new ("could not write to the pipe: %s", g_strerror (errno)));
+	}
+	
+	close (fds[1]);
+	
+	cat = g_mime_stream_cat_new ();
+	
+	stream = g_mime_stream_mem_new_with_buffer ("first ", 6);
+	g_mime_stream_cat_add_source ((GMimeStreamCat *) cat, stream);
+	g_object_unref (stream);
+	
+	stream = g_mime_stream_mem_new_with_buffer ("second ", 7);
+	g_mime_stream_cat_add_source ((GMimeStreamCat *) cat, stream);
+	g_object_unref (stream);
+	
+	stream = g_mime_stream_pipe_new (fds[0]);
+	g_mime_stream_cat_add_source ((GMimeStreamCat *) cat, stream);
+	g_object_unref (stream);
+	
+	if ((n = g_mime_stream_read (cat, buf, 4)) != 4) {
+		ex = exception_new ("could not read the first source");
+		goto error;
+	}
+	
+	/* seek forward into the second source and backward into the first */
+	if ((offset = g_mime_stream_seek (cat, 8, GMIME_STREAM_SEEK_SET)) != 8) {
+		ex = exception_new ("could not seek to offset 8: %lld", (long long) offset);
+		goto error;
+	}
+	
+	if ((n = g_mime_stream_read (cat, buf, 5)) != 5 || strncmp (buf, "cond ", 5) != 0) {
+		ex = exception_new ("unexpected content at offset 8");
+		goto error;
+	}
+	
+	if ((offset = g_mime_stream_seek (cat, -11, GMIME_STREAM_SEEK_CUR)) != 2) {
+		ex = exception_new ("could not seek back to offset 2: %lld", (long long) offset);
+		goto error;
+	}
+	
+	if ((n = g_mime_stream_read (cat, buf, 4)) != 4 || strncmp (buf, "rst ", 4) != 0) {
+		ex = exception_new ("unexpected content at offset 2");
+		goto error;
+	}
+	
+	/* the end of the stream cannot be located without the length of the pipe */
+	if ((offset = g_mime_stream_seek (cat, 0, GMIME_STREAM_SEEK_END)) != -1) {
+		ex = exception_new ("seeking relative to an unknown end succeeded: %lld", (long long) offset);
+		goto error;
+	}
+	
+error:
+	g_object_unref (cat);
+	
+	if (ex != NULL)
+		throw (ex);
+}
+
 
 typedef void (* checkFunc) (GMimeStream *stream, struct _StreamPart *parts, int bounded);
 
@@ -469,6 +631,8 @@ struct {
 	{ "GMimeStreamCat::seek(unbound)",      test_cat_seek,      FALSE },
 	{ "GMimeStreamCat::substream(bound)",   test_cat_substream, TRUE  },
 	{ "GMimeStreamCat::substream(unbound)", test_cat_substream, FALSE },
+	{ "GMimeStreamCat::seek(10k sources)",  test_cat_many_sources, FALSE },
+	{ "GMimeStreamCat::seek(unknown length)", test_cat_unknown_length, FALSE },
 };
 
 int main (int argc, char **argv)
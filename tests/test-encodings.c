@@ -35,6 +35,9 @@
 
 #include "testsuite.h"
 
+/*#define ENABLE_ZENTIMER*/
+#include "zentimer.h"
+
 extern int verbose;
 
 #define d(x)
@@ -174,6 +177,169 @@ test_base64_decode_patterns (void)
 	}
 }
 
+#define LARGE_BASE64_SIZE (4 * 1024 * 1024)
+
+static void
+test_base64_large (void)
+{
+	unsigned char *input, *encoded, *expected, *decoded;
+	size_t inlen, outlen, explen, n, i;
+	guint32 save = 0;
+	int state = 0;
+	GRand *rand;
+	
+	testsuite_check ("base64 encode/decode %u bytes", LARGE_BASE64_SIZE);
+	
+	inlen = LARGE_BASE64_SIZE;
+	input = g_malloc (inlen);
+	rand = g_rand_new_with_seed (inlen);
+	for (i = 0; i < inlen; i++)
+		input[i] = (unsigned char) g_rand_int_range (rand, 0, 256);
+	g_rand_free (rand);
+	
+	encoded = g_malloc (GMIME_BASE64_ENCODE_LEN (inlen));
+	expected = g_malloc (GMIME_BASE64_ENCODE_LEN (inlen));
+	decoded = g_malloc (inlen + 3);
+	
+	/* encoding a single byte at a time never gives the encoder enough input to use its fast path */
+	for (i = 0, explen = 0; i < inlen; i++)
+		explen += g_mime_encoding_base64_encode_step (input + i, 1, expected + explen, &state, &save);
+	explen += g_mime_encoding_base64_encode_close (NULL, 0, expected + explen, &state, &save);
+	
+	state = 0;
+	save = 0;
+	
+	ZenTimerStart (NULL);
+	outlen = g_mime_encoding_base64_encode_close (input, inlen, encoded, &state, &save);
+	ZenTimerStop (NULL);
+	ZenTimerReport (NULL, "base64 encode (4 MB)");
+	
+	if (outlen != explen || memcmp (encoded, expected, outlen) != 0) {
+		testsuite_check_failed ("base64 encode/decode failed: encoded content does not match");
+		goto error;
+	}
+	
+	state = 0;
+	save = 0;
+	
+	ZenTimerStart (NULL);
+	n = g_mime_encoding_base64_decode_step (encoded, outlen, decoded, &state, &save);
+	ZenTimerStop (NULL);
+	ZenTimerReport (NULL, "base64 decode (4 MB)");
+	
+	if (n != inlen || memcmp (decoded, input, inlen) != 0) {
+		testsuite_check_failed ("base64 encode/decode failed: decoded content does not match");
+		goto error;
+	}
+	
+	testsuite_check_passed ();
+	
+error:
+	g_free (expected);
+	g_free (encoded);
+	g_free (decoded);
+	g_free (input);
+}
+
+#define LARGE_YENC_SIZE (1024 * 1024)
+
+static void
+test_yenc_crc (void)
+{
+	const char *input = "123456789";
+	guint32 pcrc, crc;
+	char output[64];
+	int state;
+	
+	testsuite_check ("yEnc crc32");
+	
+	state = GMIME_YENCODE_STATE_INIT;
+	pcrc = crc = GMIME_YENCODE_CRC_INIT;
+	g_mime_yencode_close ((const unsigned char *) input, strlen (input), (unsigned char *) output, &state, &pcrc, &crc);
+	
+	if (GMIME_YENCODE_CRC_FINAL (pcrc) != 0xcbf43926 || pcrc != crc)
+		testsuite_check_failed ("yEnc crc32 failed: expected 0xcbf43926, got 0x%08x", GMIME_YENCODE_CRC_FINAL (pcrc));
+	else
+		testsuite_check_passed ();
+}
+
+static void
+test_yenc_large (void)
+{
+	guint32 pcrc, crc, expected_crc, decoded_crc;
+	unsigned char *input, *encoded, *expected, *decoded;
+	size_t inlen, outlen, explen, n, i;
+	int state;
+	GRand *rand;
+	
+	testsuite_check ("yEnc encode/decode %u bytes", LARGE_YENC_SIZE);
+	
+	inlen = LARGE_YENC_SIZE;
+	input = g_malloc (inlen);
+	rand = g_rand_new_with_seed (inlen);
+	for (i = 0; i < inlen; i++)
+		input[i] = (unsigned char) g_rand_int_range (rand, 0, 256);
+	g_rand_free (rand);
+	
+	encoded = g_malloc ((inlen + 2) * 2 + 62);
+	expected = g_malloc ((inlen + 2) * 2 + 62);
+	decoded = g_malloc (inlen + 3);
+	
+	/* encoding a single byte at a time never gives the encoder enough input to use its fast path */
+	state = GMIME_YENCODE_STATE_INIT;
+	pcrc = crc = GMIME_YENCODE_CRC_INIT;
+	for (i = 0, explen = 0; i < inlen; i++)
+		explen += g_mime_yencode_step (input + i, 1, expected + explen, &state, &pcrc, &crc);
+	explen += g_mime_yencode_close (NULL, 0, expected + explen, &state, &pcrc, &crc);
+	expected_crc = GMIME_YENCODE_CRC_FINAL (crc);
+	
+	state = GMIME_YENCODE_STATE_INIT;
+	pcrc = crc = GMIME_YENCODE_CRC_INIT;
+	
+	ZenTimerStart (NULL);
+	outlen = g_mime_yencode_close (input, inlen, encoded, &state, &pcrc, &crc);
+	ZenTimerStop (NULL);
+	ZenTimerReport (NULL, "yEnc encode (1 MB)");
+	
+	if (outlen != explen || memcmp (encoded, expected, outlen) != 0) {
+		testsuite_check_failed ("yEnc encode/decode failed: encoded content does not match");
+		goto error;
+	}
+	
+	if (GMIME_YENCODE_CRC_FINAL (crc) != expected_crc) {
+		testsuite_check_failed ("yEnc encode/decode failed: encoder crc32 does not match");
+		goto error;
+	}
+	
+	state = GMIME_YDECODE_STATE_INIT;
+	pcrc = crc = GMIME_YENCODE_CRC_INIT;
+	
+	ZenTimerStart (NULL);
+	n = g_mime_ydecode_step (encoded, outlen, decoded, &state, &pcrc, &crc);
+	ZenTimerStop (NULL);
+	ZenTimerReport (NULL, "yEnc decode (1 MB)");
+	
+	decoded_crc = GMIME_YENCODE_CRC_FINAL (crc);
+	
+	if (n != inlen || memcmp (decoded, input, inlen) != 0) {
+		testsuite_check_failed ("yEnc encode/decode failed: decoded content does not match");
+		goto error;
+	}
+	
+	if (decoded_crc != expected_crc) {
+		testsuite_check_failed ("yEnc encode/decode failed: decoder crc32 does not match");
+		goto error;
+	}
+	
+	testsuite_check_passed ();
+	
+error:
+	g_free (expected);
+	g_free (encoded);
+	g_free (decoded);
+	g_free (input);
+}
+
 static const char *qp_encoded_patterns[] = {
 	"=e1=e2=E3=E4\r\n",
 	"=e1=g2=E3=E4\r\n",
@@ -504,6 +670,168 @@ error:
 	g_byte_array_free (actual, TRUE);
 }
 
+#define LARGE_PARALLEL_SIZE (6 * 1024 * 1024)
+
+static GByteArray *
+transcode_serial (GMimeContentEncoding encoding, gboolean encode, GByteArray *input)
+{
+	GMimeEncoding encoder;
+	GByteArray *output;
+	size_t n;
+	
+	if (encode)
+		g_mime_encoding_init_encode (&encoder, encoding);
+	else
+		g_mime_encoding_init_decode (&encoder, encoding);
+	
+	output = g_byte_array_new ();
+	g_byte_array_set_size (output, g_mime_encoding_outlen (&encoder, input->len));
+	n = g_mime_encoding_flush (&encoder, (const char *) input->data, input->len, (char *) output->data);
+	g_byte_array_set_size (output, n);
+	
+	return output;
+}
+
+static GByteArray *
+transcode_parallel (GMimeContentEncoding encoding, gboolean encode, GByteArray *input)
+{
+	GMimeStream *istream, *ostream;
+	GByteArray *output;
+	
+	istream = g_mime_stream_mem_new_with_byte_array (input);
+	g_mime_stream_mem_set_owner ((GMimeStreamMem *) istream, FALSE);
+	
+	output = g_byte_array_new ();
+	ostream = g_mime_stream_mem_new_with_byte_array (output);
+	g_mime_stream_mem_set_owner ((GMimeStreamMem *) ostream, FALSE);
+	
+	if (g_mime_encoding_write_to_stream (encoding, encode, istream, ostream, 4) != output->len) {
+		g_byte_array_free (output, TRUE);
+		output = NULL;
+	}
+	
+	g_object_unref (istream);
+	g_object_unref (ostream);
+	
+	return output;
+}
+
+static GByteArray *
+decode_data_wrapper (GMimeContentEncoding encoding, GByteArray *input, guint n_threads)
+{
+	GMimeStream *istream, *ostream;
+	GMimeDataWrapper *wrapper;
+	GByteArray *output;
+	
+	istream = g_mime_stream_mem_new_with_byte_array (input);
+	g_mime_stream_mem_set_owner ((GMimeStreamMem *) istream, FALSE);
+	wrapper = g_mime_data_wrapper_new_with_stream (istream, encoding);
+	g_mime_data_wrapper_set_decode_threads (wrapper, n_threads);
+	g_object_unref (istream);
+	
+	output = g_byte_array_new ();
+	ostream = g_mime_stream_mem_new_with_byte_array (output);
+	g_mime_stream_mem_set_owner ((GMimeStreamMem *) ostream, FALSE);
+	
+	if (g_mime_data_wrapper_write_to_stream (wrapper, ostream) != (ssize_t) output->len) {
+		g_byte_array_free (output, TRUE);
+		output = NULL;
+	}
+	
+	g_object_unref (wrapper);
+	g_object_unref (ostream);
+	
+	return output;
+}
+
+static gboolean
+byte_array_equal (GByteArray *a, GByteArray *b)
+{
+	return a != NULL && b != NULL && a->len == b->len && memcmp (a->data, b->data, a->len) == 0;
+}
+
+static void
+test_parallel (GMimeContentEncoding encoding)
+{
+	static const guint wrapper_threads[] = { 1, 4 };
+	const char *name = g_mime_content_encoding_to_string (encoding);
+	GByteArray *input, *expected, *encoded, *decoded;
+	GRand *rand;
+	guint i;
+	
+	testsuite_check ("%s parallel encode/decode", name);
+	
+	input = g_byte_array_sized_new (LARGE_PARALLEL_SIZE);
+	g_byte_array_set_size (input, LARGE_PARALLEL_SIZE);
+	
+	rand = g_rand_new_with_seed (LARGE_PARALLEL_SIZE);
+	for (i = 0; i < input->len; i++) {
+		if (encoding == GMIME_CONTENT_ENCODING_QUOTEDPRINTABLE) {
+			/* mostly text with the occasional line break and 8bit character */
+			switch (g_rand_int_range (rand, 0, 64)) {
+			case 0: input->data[i] = '\n'; break;
+			case 1: input->data[i] = 0xe9; break;
+			case 2: case 3: case 4: case 5: input->data[i] = ' '; break;
+			default: input->data[i] = (unsigned char) g_rand_int_range (rand, 'a', 'z' + 1); break;
+			}
+		} else {
+			input->data[i] = (unsigned char) g_rand_int_range (rand, 0, 256);
+		}
+	}
+	g_rand_free (rand);
+	
+	expected = transcode_serial (encoding, TRUE, input);
+	
+	ZenTimerStart (NULL);
+	encoded = transcode_parallel (encoding, TRUE, input);
+	ZenTimerStop (NULL);
+	ZenTimerReport (NULL, "g_mime_encoding_write_to_stream (encode)");
+	
+	if (!byte_array_equal (encoded, expected)) {
+		testsuite_check_failed ("%s parallel encode/decode failed: encoded content does not match", name);
+		goto error;
+	}
+	
+	ZenTimerStart (NULL);
+	decoded = transcode_parallel (encoding, FALSE, encoded);
+	ZenTimerStop (NULL);
+	ZenTimerReport (NULL, "g_mime_encoding_write_to_stream (decode)");
+	
+	g_byte_array_free (expected, TRUE);
+	expected = transcode_serial (encoding, FALSE, encoded);
+	
+	if (!byte_array_equal (decoded, expected)) {
+		testsuite_check_failed ("%s parallel encode/decode failed: decoded content does not match", name);
+		if (decoded != NULL)
+			g_byte_array_free (decoded, TRUE);
+		goto error;
+	}
+	
+	g_byte_array_free (decoded, TRUE);
+	
+	/* GMimeDataWrapper decodes serially unless told otherwise */
+	for (i = 0; i < G_N_ELEMENTS (wrapper_threads); i++) {
+		decoded = decode_data_wrapper (encoding, encoded, wrapper_threads[i]);
+		
+		if (!byte_array_equal (decoded, expected)) {
+			testsuite_check_failed ("%s parallel encode/decode failed: data wrapper content does not match (%u threads)", name, wrapper_threads[i]);
+			if (decoded != NULL)
+				g_byte_array_free (decoded, TRUE);
+			goto error;
+		}
+		
+		g_byte_array_free (decoded, TRUE);
+	}
+	
+	testsuite_check_passed ();
+	
+error:
+	if (encoded != NULL)
+		g_byte_array_free (encoded, TRUE);
+	g_byte_array_free (expected, TRUE);
+	g_byte_array_free (input, TRUE);
+}
+
 int main (int argc, char **argv)
 {
 	const char *datadir = "data/encodings";
@@ -553,6 +881,7 @@ int main (int argc, char **argv)
 	
 	testsuite_start ("base64");
 	test_base64_decode_patterns ();
+	test_base64_large ();
 	test_encoder (GMIME_CONTENT_ENCODING_BASE64, photo, b64, 4096);
 	test_encoder (GMIME_CONTENT_ENCODING_BASE64, photo, b64, 1024);
 	test_encoder (GMIME_CONTENT_ENCODING_BASE64, photo, b64, 16);
@@ -561,6 +890,7 @@ int main (int argc, char **argv)
 	test_decoder (GMIME_CONTENT_ENCODING_BASE64, b64, photo, 1024);
 	test_decoder (GMIME_CONTENT_ENCODING_BASE64, b64, photo, 16);
 	test_decoder (GMIME_CONTENT_ENCODING_BASE64, b64, photo, 1);
+	test_parallel (GMIME_CONTENT_ENCODING_BASE64);
 	testsuite_end ();
 	
 	testsuite_start ("uuencode");
@@ -574,6 +904,11 @@ int main (int argc, char **argv)
 	test_decoder (GMIME_CONTENT_ENCODING_UUENCODE, uu, photo, 1);
 	testsuite_end ();
 	
+	testsuite_start ("yEnc");
+	test_yenc_crc ();
+	test_yenc_large ();
+	testsuite_end ();
+	
 	testsuite_start ("quoted-printable");
 	test_quoted_printable_decode_patterns ();
 	test_quoted_printable_encode_space_dos_linebreak ();
@@ -588,6 +923,7 @@ int main (int argc, char **argv)
 	test_decoder (GMIME_CONTENT_ENCODING_QUOTEDPRINTABLE, qp, wikipedia, 1024);
 	test_decoder (GMIME_CONTENT_ENCODING_QUOTEDPRINTABLE, qp, wikipedia, 16);
 	test_decoder (GMIME_CONTENT_ENCODING_QUOTEDPRINTABLE, qp, wikipedia, 1);
+	test_parallel (GMIME_CONTENT_ENCODING_QUOTEDPRINTABLE);
 	testsuite_end ();
 	
 	g_byte_array_free (wikipedia, TRUE);
@@ -33,6 +33,9 @@
 
 #include <gmime/gmime.h>
 
+/*#define ENABLE_ZENTIMER*/
+#include "zentimer.h"
+
 #include "testsuite.h"
 
 extern int verbose;
@@ -156,6 +159,291 @@ error:
 	g_byte_array_free (actual, TRUE);
 }
 
+static void
+test_text (const char *datadir, const char *base, const char *charset, GMimeContentEncoding encoding)
+{
+	const char *what = "GMimeFilterText";
+	GMimeStream *stream, *filtered, *onebyte;
+	GByteArray *actual, *expected, *encoded;
+	GMimeFilter *filter;
+	char *path, *name;
+	
+	testsuite_check ("%s (%s %s %s)", what, base, charset, g_mime_content_encoding_to_string (encoding));
+	
+	/* encode the text with DOS line endings */
+	encoded = g_byte_array_new ();
+	stream = g_mime_stream_mem_new_with_byte_array (encoded);
+	g_mime_stream_mem_set_owner ((GMimeStreamMem *) stream, FALSE);
+	filtered = g_mime_stream_filter_new (stream);
+	g_object_unref (stream);
+	
+	filter = g_mime_filter_unix2dos_new (FALSE);
+	g_mime_stream_filter_add ((GMimeStreamFilter *) filtered, filter);
+	g_object_unref (filter);
+	
+	filter = g_mime_filter_basic_new (encoding, TRUE);
+	g_mime_stream_filter_add ((GMimeStreamFilter *) filtered, filter);
+	g_object_unref (filter);
+	
+	name = g_strdup_printf ("%s.%s.txt", base, charset);
+	path = g_build_filename (datadir, name, NULL);
+	stream = g_mime_stream_fs_open (path, O_RDONLY, 0644, NULL);
+	g_mime_stream_write_to_stream (stream, filtered);
+	g_mime_stream_flush (filtered);
+	g_object_unref (filtered);
+	g_object_unref (stream);
+	g_free (path);
+	g_free (name);
+	
+	/* a decoder, charset and dos2unix filter chain gets fused into a single GMimeFilterText */
+	actual = g_byte_array_new ();
+	stream = g_mime_stream_mem_new_with_byte_array (actual);
+	g_mime_stream_mem_set_owner ((GMimeStreamMem *) stream, FALSE);
+	filtered = g_mime_stream_filter_new (stream);
+	g_object_unref (stream);
+	
+	filter = g_mime_filter_basic_new (encoding, FALSE);
+	g_mime_stream_filter_add ((GMimeStreamFilter *) filtered, filter);
+	g_object_unref (filter);
+	
+	filter = g_mime_filter_charset_new (charset, "utf-8");
+	g_mime_stream_filter_add ((GMimeStreamFilter *) filtered, filter);
+	g_object_unref (filter);
+	
+	filter = g_mime_filter_dos2unix_new (FALSE);
+	g_mime_stream_filter_add ((GMimeStreamFilter *) filtered, filter);
+	g_object_unref (filter);
+	
+	onebyte = test_stream_onebyte_new (filtered);
+	g_object_unref (filtered);
+	
+	g_mime_stream_write (onebyte, (const char *) encoded->data, encoded->len);
+	g_mime_stream_flush (onebyte);
+	g_object_unref (onebyte);
+	
+	name = g_strdup_printf ("%s.utf-8.txt", base);
+	path = g_build_filename (datadir, name, NULL);
+	expected = read_all_bytes (path, TRUE);
+	g_free (path);
+	g_free (name);
+	
+	if (actual->len != expected->len) {
+		testsuite_check_failed ("%s failed: stream lengths do not match: expected=%u; actual=%u",
+					what, expected->len, actual->len);
+		goto error;
+	}
+	
+	if (memcmp (actual->data, expected->data, actual->len) != 0) {
+		testsuite_check_failed ("%s failed: stream contents do not match", what);
+		goto error;
+	}
+	
+	testsuite_check_passed ();
+	
+error:
+	
+	g_byte_array_free (expected, TRUE);
+	g_byte_array_free (encoded, TRUE);
+	g_byte_array_free (actual, TRUE);
+}
+
+static GMimeStream *
+create_text_chain (GMimeStream *stream)
+{
+	GMimeStream *filtered;
+	GMimeFilter *filter;
+	
+	filtered = g_mime_stream_filter_new (stream);
+	
+	filter = g_mime_filter_basic_new (GMIME_CONTENT_ENCODING_QUOTEDPRINTABLE, FALSE);
+	g_mime_stream_filter_add ((GMimeStreamFilter *) filtered, filter);
+	g_object_unref (filter);
+	
+	filter = g_mime_filter_strip_new ();
+	g_mime_stream_filter_add ((GMimeStreamFilter *) filtered, filter);
+	g_object_unref (filter);
+	
+	filter = g_mime_filter_dos2unix_new (FALSE);
+	g_mime_stream_filter_add ((GMimeStreamFilter *) filtered, filter);
+	g_object_unref (filter);
+	
+	return filtered;
+}
+
+static void
+test_filter_chain_reuse (void)
+{
+	const char *line = "The quick brown fox =\r\njumps over the lazy d=C3=B6g.  \t\r\n";
+	const char *expected = "The quick brown fox jumps over the lazy d\xc3\xb6g.\n";
+	const char *what = "GMimeStreamFilter buffer reuse";
+	guint64 allocated[2], reused[2];
+	GMimeStream *stream, *filtered;
+	GString *input, *output;
+	GByteArray *actual;
+	char buf[1024];
+	ssize_t nread;
+	guint i;
+	
+	testsuite_check ("%s", what);
+	
+	input = g_string_new ("");
+	output = g_string_new ("");
+	for (i = 0; i < 200; i++) {
+		g_string_append (input, line);
+		g_string_append (output, expected);
+	}
+	
+	actual = g_byte_array_new ();
+	
+	g_mime_filter_get_pool_stats (&allocated[0], &reused[0]);
+	
+	ZenTimerStart (NULL);
+	for (i = 0; i < 2000; i++) {
+		g_byte_array_set_size (actual, 0);
+		
+		if (i % 2) {
+			/* write: the filters work on buffers of their own */
+			stream = g_mime_stream_mem_new_with_byte_array (actual);
+			g_mime_stream_mem_set_owner ((GMimeStreamMem *) stream, FALSE);
+			filtered = create_text_chain (stream);
+			g_object_unref (stream);
+			
+			g_mime_stream_write (filtered, input->str, input->len);
+			g_mime_stream_flush (filtered);
+		} else {
+			/* read: the filters can work in the stream's read buffer */
+			stream = g_mime_stream_mem_new_with_buffer (input->str, input->len);
+			filtered = create_text_chain (stream);
+			g_object_unref (stream);
+			
+			while ((nread = g_mime_stream_read (filtered, buf, sizeof (buf))) > 0)
+				g_byte_array_append (actual, (guint8 *) buf, nread);
+		}
+		
+		g_object_unref (filtered);
+		
+		if (actual->len != output->len || memcmp (actual->data, output->str, output->len) != 0) {
+			testsuite_check_failed ("%s failed: %s output does not match", what, (i % 2) ? "write" : "read");
+			goto error;
+		}
+	}
+	ZenTimerStop (NULL);
+	ZenTimerReport (NULL, "filter chain create/decode/destroy (2000 times)");
+	
+	g_mime_filter_get_pool_stats (&allocated[1], &reused[1]);
+	
+	v(fprintf (stdout, "%s: %" G_GUINT64_FORMAT " buffers allocated, %" G_GUINT64_FORMAT " reused\n", what,
+		   allocated[1] - allocated[0], reused[1] - reused[0]));
+	
+	if (allocated[1] - allocated[0] >= 2000) {
+		testsuite_check_failed ("%s failed: %" G_GUINT64_FORMAT " buffers allocated for 2000 filter chains",
+					what, allocated[1] - allocated[0]);
+		goto error;
+	}
+	
+	testsuite_check_passed ();
+	
+error:
+	g_byte_array_free (actual, TRUE);
+	g_string_free (output, TRUE);
+	g_string_free (input, TRUE);
+}
+
+static GByteArray *
+filter_newlines (GMimeFilter *filter, const char *input, int mode)
+{
+	GMimeStream *stream, *filtered, *onebyte;
+	GByteArray *actual;
+	char buf[7];
+	ssize_t nread;
+	
+	actual = g_byte_array_new ();
+	
+	if (mode == 2) {
+		/* read: the filter can work in the stream's read buffer */
+		stream = g_mime_stream_mem_new_with_buffer (input, strlen (input));
+		filtered = g_mime_stream_filter_new (stream);
+		g_mime_stream_filter_add ((GMimeStreamFilter *) filtered, filter);
+		g_object_unref (stream);
+		
+		while ((nread = g_mime_stream_read (filtered, buf, sizeof (buf))) > 0)
+			g_byte_array_append (actual, (guint8 *) buf, nread);
+		
+		g_object_unref (filtered);
+		
+		return actual;
+	}
+	
+	stream = g_mime_stream_mem_new_with_byte_array (actual);
+	g_mime_stream_mem_set_owner ((GMimeStreamMem *) stream, FALSE);
+	filtered = g_mime_stream_filter_new (stream);
+	g_mime_stream_filter_add ((GMimeStreamFilter *) filtered, filter);
+	g_object_unref (stream);
+	
+	if (mode == 1) {
+		/* write one byte at a time to split CR/LF pairs and whitespace runs */
+		onebyte = test_stream_onebyte_new (filtered);
+		g_object_unref (filtered);
+	} else {
+		onebyte = filtered;
+	}
+	
+	g_mime_stream_write_string (onebyte, input);
+	g_mime_stream_flush (onebyte);
+	g_object_unref (onebyte);
+	
+	return actual;
+}
+
+static void
+test_newlines (void)
+{
+	const char *input = "line 1\r\nline 2\nline 3\r\r\nline 4 \t \r\n  \t\n"
+		"a line of text which is long enough to span several vector registers\t \r\n"
+		"\r\n    indented text followed by enough whitespace to span a register                                \n"
+		"end  ";
+	const char *dos2unix = "line 1\nline 2\nline 3\r\nline 4 \t \n  \t\n"
+		"a line of text which is long enough to span several vector registers\t \n"
+		"\n    indented text followed by enough whitespace to span a register                                \n"
+		"end  ";
+	const char *unix2dos = "line 1\r\nline 2\r\nline 3\r\r\nline 4 \t \r\n  \t\r\n"
+		"a line of text which is long enough to span several vector registers\t \r\n"
+		"\r\n    indented text followed by enough whitespace to span a register                                \r\n"
+		"end  ";
+	const char *strip = "line 1\r\nline 2\nline 3\r\r\nline 4\r\n\n"
+		"a line of text which is long enough to span several vector registers\r\n"
+		"\r\n    indented text followed by enough whitespace to span a register\n"
+		"end";
+	const char *modes[] = { "write", "one byte writes", "read" };
+	const char *names[] = { "GMimeFilterDos2Unix", "GMimeFilterUnix2Dos", "GMimeFilterStrip" };
+	const char *expected[] = { dos2unix, unix2dos, strip };
+	GMimeFilter *filter = NULL;
+	GByteArray *actual;
+	int i, mode;
+	
+	for (i = 0; i < G_N_ELEMENTS (names); i++) {
+		for (mode = 0; mode < G_N_ELEMENTS (modes); mode++) {
+			testsuite_check ("%s (%s)", names[i], modes[mode]);
+			
+			switch (i) {
+			case 0: filter = g_mime_filter_dos2unix_new (FALSE); break;
+			case 1: filter = g_mime_filter_unix2dos_new (FALSE); break;
+			case 2: filter = g_mime_filter_strip_new (); break;
+			}
+			
+			actual = filter_newlines (filter, input, mode);
+			g_object_unref (filter);
+			
+			if (actual->len != strlen (expected[i]) || memcmp (actual->data, expected[i], actual->len) != 0)
+				testsuite_check_failed ("%s (%s) failed: output does not match", names[i], modes[mode]);
+			else
+				testsuite_check_passed ();
+			
+			g_byte_array_free (actual, TRUE);
+		}
+	}
+}
+
 static void
 test_enriched (const char *datadir, const char *input, const char *output)
 {
@@ -322,84 +610,860 @@ error:
 }
 
 static void
-test_html (const char *datadir, const char *input, const char *output, guint32 citation)
+test_digest_vector (const char *input, GMimeDigestType type, const char *expected)
 {
-	guint32 flags = GMIME_FILTER_HTML_CONVERT_NL | GMIME_FILTER_HTML_CONVERT_SPACES |
-		GMIME_FILTER_HTML_CONVERT_URLS | GMIME_FILTER_HTML_CONVERT_ADDRESSES;
-	const char *what = "GMimeFilterHtml", *mode;
-	GByteArray *expected, *actual;
-	GMimeStream *stream;
 	GMimeFilter *filter;
-	char *path;
+	size_t outlen, outprespace;
+	char *outbuf, *actual;
 	
-	switch (citation) {
-	case GMIME_FILTER_HTML_BLOCKQUOTE_CITATION: mode = "blockquote"; break;
-	case GMIME_FILTER_HTML_MARK_CITATION: mode = "mark"; break;
-	case GMIME_FILTER_HTML_CITE: mode = "cite"; break;
-	default: mode = "none"; break;
-	}
+	filter = g_mime_filter_digest_new (type);
+	g_mime_filter_complete (filter, (char *) input, strlen (input), 0, &outbuf, &outlen, &outprespace);
+	actual = g_mime_filter_digest_get_string ((GMimeFilterDigest *) filter, type);
+	g_object_unref (filter);
 	
-	testsuite_check ("%s (%s %s)", what, input, mode);
+	if (strcmp (actual, expected) != 0) {
+		Exception *ex = exception_new ("digest of \"%s\" was %s instead of %s", input, actual, expected);
+		g_free (actual);
+		throw (ex);
+	}
 	
-	actual = g_byte_array_new ();
-	stream = g_mime_stream_mem_new_with_byte_array (actual);
-	g_mime_stream_mem_set_owner ((GMimeStreamMem *) stream, FALSE);
+	g_free (actual);
+}
+
+static void
+test_digest (const char *datadir, const char *filename)
+{
+	static const GChecksumType checksums[] = { G_CHECKSUM_MD5, G_CHECKSUM_SHA1, G_CHECKSUM_SHA256, G_CHECKSUM_SHA512 };
+	static const GMimeDigestType digests[] = { GMIME_DIGEST_MD5, GMIME_DIGEST_SHA1, GMIME_DIGEST_SHA256, GMIME_DIGEST_SHA512 };
+	GMimeDigestType all = GMIME_DIGEST_MD5 | GMIME_DIGEST_SHA1 | GMIME_DIGEST_SHA256 |
+		GMIME_DIGEST_SHA512 | GMIME_DIGEST_CRC32C | GMIME_DIGEST_XXH64;
+	char *path = g_build_filename (datadir, filename, NULL);
+	GMimeFilter *filter, *onebyte, *copy;
+	char *expected, *str;
+	GMimeStream *stream;
+	GByteArray *input;
+	guint i, j;
 	
-	filter = g_mime_filter_html_new (flags | citation, 0x008888);
+	testsuite_check ("GMimeFilterDigest");
+	try {
+		input = read_all_bytes (path, FALSE);
+		
+		ZenTimerStart (NULL);
+		filter = g_mime_filter_digest_new (all);
+		stream = g_mime_stream_null_new ();
+		pump_data_through_filter (filter, path, stream, FALSE, FALSE);
+		g_object_unref (stream);
+		ZenTimerStop (NULL);
+		ZenTimerReport (NULL, "GMimeFilterDigest (all digests)");
+		
+		onebyte = g_mime_filter_digest_new (all);
+		stream = g_mime_stream_null_new ();
+		pump_data_through_filter (onebyte, path, stream, FALSE, TRUE);
+		g_object_unref (stream);
+		
+		copy = g_mime_filter_copy (filter);
+		
+		for (i = 0; i < G_N_ELEMENTS (digests); i++) {
+			expected = g_compute_checksum_for_data (checksums[i], input->data, input->len);
+			
+			for (j = 0; j < 3; j++) {
+				str = g_mime_filter_digest_get_string ((GMimeFilterDigest *) (j == 0 ? filter : j == 1 ? onebyte : copy), digests[i]);
+				
+				if (str == NULL || strcmp (str, expected) != 0) {
+					g_free (expected);
+					g_free (str);
+					throw (exception_new ("digest %u does not match for the %s filter", i, j == 0 ? "original" : j == 1 ? "onebyte" : "copied"));
+				}
+				
+				g_free (str);
+			}
+			
+			g_free (expected);
+		}
+		
+		for (i = 0; i < 2; i++) {
+			GMimeDigestType type = i == 0 ? GMIME_DIGEST_CRC32C : GMIME_DIGEST_XXH64;
+			
+			expected = g_mime_filter_digest_get_string ((GMimeFilterDigest *) filter, type);
+			str = g_mime_filter_digest_get_string ((GMimeFilterDigest *) onebyte, type);
+			
+			if (expected == NULL || str == NULL || strcmp (str, expected) != 0) {
+				g_free (expected);
+				g_free (str);
+				throw (exception_new ("streamed %s does not match", i == 0 ? "CRC32C" : "XXH64"));
+			}
+			
+			g_free (expected);
+			g_free (str);
+		}
+		
+		g_object_unref (onebyte);
+		g_object_unref (filter);
+		g_object_unref (copy);
+		
+		test_digest_vector ("123456789", GMIME_DIGEST_CRC32C, "e3069283");
+		test_digest_vector ("", GMIME_DIGEST_XXH64, "ef46db3751d8e999");
+		test_digest_vector ("abc", GMIME_DIGEST_XXH64, "44bc2cf5ad770999");
+		test_digest_vector ("abc", GMIME_DIGEST_SHA256, "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad");
+		
+		testsuite_check_passed ();
+	} catch (ex) {
+		testsuite_check_failed ("GMimeFilterDigest failed: %s", ex->message);
+	} finally;
 	
-	path = g_build_filename (datadir, input, NULL);
-	pump_data_through_filter (filter, path, stream, TRUE, TRUE);
-	g_mime_filter_reset (filter);
-	g_object_unref (stream);
-	g_object_unref (filter);
+	g_byte_array_free (input, TRUE);
 	g_free (path);
+}
+
+static void
+byte_array_double (GByteArray *array)
+{
+	guint len = array->len;
 	
-	path = g_build_filename (datadir, output, NULL);
-	expected = read_all_bytes (path, TRUE);
-	g_free (path);
+	g_byte_array_set_size (array, len * 2);
+	memcpy (array->data + len, array->data, len);
+}
+
+static GByteArray *
+filter_bytes (GMimeFilter *filter, const unsigned char *data, size_t len, gboolean inc)
+{
+	GMimeStream *stream, *filtered, *onebyte;
+	GByteArray *buffer;
 	
-	if (actual->len != expected->len) {
-		testsuite_check_failed ("%s failed: stream lengths do not match: expected=%u; actual=%u",
-					what, expected->len, actual->len);
-		stream = g_mime_stream_fs_open (output, O_WRONLY | O_CREAT, 0644, NULL);
-		g_mime_stream_write (stream, (const char *) actual->data, actual->len);
-		g_mime_stream_flush (stream);
-		g_object_unref (stream);
-		goto error;
-	}
+	buffer = g_byte_array_new ();
+	stream = g_mime_stream_mem_new_with_byte_array (buffer);
+	g_mime_stream_mem_set_owner ((GMimeStreamMem *) stream, FALSE);
+	filtered = g_mime_stream_filter_new (stream);
+	g_mime_stream_filter_add ((GMimeStreamFilter *) filtered, filter);
+	g_object_unref (stream);
 	
-	if (memcmp (actual->data, expected->data, actual->len) != 0) {
-		testsuite_check_failed ("%s failed: stream contents do not match", what);
-		goto error;
+	if (inc) {
+		onebyte = test_stream_onebyte_new (filtered);
+		g_object_unref (filtered);
+	} else {
+		onebyte = filtered;
 	}
 	
-	testsuite_check_passed ();
+	g_mime_stream_write (onebyte, (const char *) data, len);
+	g_mime_stream_flush (onebyte);
+	g_object_unref (onebyte);
 	
-error:
+	return buffer;
+}
+
+static const char *
+qp_check_lines (const GByteArray *encoded)
+{
+	const unsigned char *inptr = encoded->data;
+	const unsigned char *inend = inptr + encoded->len;
+	const unsigned char *start;
 	
-	g_byte_array_free (expected, TRUE);
-	g_byte_array_free (actual, TRUE);
+	while (inptr < inend) {
+		start = inptr;
+		
+		while (inptr < inend && *inptr != '\n')
+			inptr++;
+		
+		if (inptr - start > 76)
+			return "line is longer than 76 characters";
+		
+		if (inptr > start && (inptr[-1] == ' ' || inptr[-1] == '\t'))
+			return "line ends with unencoded whitespace";
+		
+		inptr++;
+	}
+	
+	return NULL;
 }
 
 static void
-test_smtp_data (const char *datadir, const char *input, const char *output)
+test_quoted_printable (void)
 {
-	const char *what = "GMimeFilterSmtpData";
-	GByteArray *expected, *actual;
-	GMimeStream *stream;
+	const char *modes[] = { "write", "one byte writes" };
+	GByteArray *encoded[2], *decoded;
+	const char *error;
 	GMimeFilter *filter;
-	char *path;
-	
-	testsuite_check ("%s", what);
+	GString *input;
+	int i, mode;
+	
+	input = g_string_new ("");
+	
+	/* long runs of plain text which span many soft line breaks */
+	for (i = 0; i < 300; i++)
+		g_string_append_c (input, 'a' + (i % 26));
+	g_string_append_c (input, '\n');
+	
+	/* lines which end right before, at, and right after the 76-column limit */
+	for (i = 72; i < 80; i++) {
+		g_string_append_printf (input, "%0*d\n", i, i);
+		g_string_append_printf (input, "%0*d=\n", i - 1, i);
+		g_string_append_printf (input, "%0*d \n", i - 1, i);
+		g_string_append_printf (input, "%0*d\xc3\xa9\n", i - 2, i);
+	}
 	
-	actual = g_byte_array_new ();
-	stream = g_mime_stream_mem_new_with_byte_array (actual);
-	g_mime_stream_mem_set_owner ((GMimeStreamMem *) stream, FALSE);
+	/* trailing whitespace, including whitespace at the soft line break */
+	g_string_append (input, "trailing whitespace \t \n");
+	for (i = 0; i < 4; i++) {
+		g_string_append_printf (input, "%0*d", 73 + i, i);
+		g_string_append (input, "     plain text after the whitespace\n");
+	}
 	
-	filter = g_mime_filter_smtp_data_new ();
+	g_string_append (input, "no newline at the end ");
 	
-	path = g_build_filename (datadir, input, NULL);
-	pump_data_through_filter (filter, path, stream, TRUE, TRUE);
+	for (mode = 0; mode < G_N_ELEMENTS (modes); mode++) {
+		testsuite_check ("GMimeFilterBasic (quoted-printable; %s)", modes[mode]);
+		
+		filter = g_mime_filter_basic_new (GMIME_CONTENT_ENCODING_QUOTEDPRINTABLE, TRUE);
+		encoded[mode] = filter_bytes (filter, (const unsigned char *) input->str, input->len, mode);
+		g_object_unref (filter);
+		
+		filter = g_mime_filter_basic_new (GMIME_CONTENT_ENCODING_QUOTEDPRINTABLE, FALSE);
+		decoded = filter_bytes (filter, encoded[mode]->data, encoded[mode]->len, mode);
+		g_object_unref (filter);
+		
+		if ((error = qp_check_lines (encoded[mode])) != NULL) {
+			testsuite_check_failed ("GMimeFilterBasic (quoted-printable; %s) failed: %s", modes[mode], error);
+		} else if (mode > 0 && (encoded[mode]->len != encoded[0]->len ||
+					memcmp (encoded[mode]->data, encoded[0]->data, encoded[0]->len) != 0)) {
+			testsuite_check_failed ("GMimeFilterBasic (quoted-printable; %s) failed: encoded output does not match", modes[mode]);
+		} else if (decoded->len != input->len || memcmp (decoded->data, input->str, input->len) != 0) {
+			testsuite_check_failed ("GMimeFilterBasic (quoted-printable; %s) failed: decoded output does not match", modes[mode]);
+		} else {
+			testsuite_check_passed ();
+		}
+		
+		g_byte_array_free (decoded, TRUE);
+	}
+	
+	g_byte_array_free (encoded[0], TRUE);
+	g_byte_array_free (encoded[1], TRUE);
+	g_string_free (input, TRUE);
+}
+
+static struct {
+	int column;
+	const char *input;
+	const char *output;
+} qp_line_limit[] = {
+	/* an encoded char which still fits before the 76-column limit */
+	{ 73, " \n", "=20\n" },
+	/* ...and ones which have to move to the next line */
+	{ 74, " \n", "=\n=20\n" },
+	{ 74, "\t\r\n", "=\n=09\n" },
+	{ 74, "\xe9\xe9\n", "=\n=E9=E9\n" },
+	{ 74, "\xe9", "=\n=E9" },
+};
+
+static void
+test_quoted_printable_line_limit (void)
+{
+	GByteArray *encoded;
+	GMimeFilter *filter;
+	GString *expected;
+	GString *input;
+	guint i;
+	
+	testsuite_check ("GMimeFilterBasic (quoted-printable; line limit)");
+	
+	for (i = 0; i < G_N_ELEMENTS (qp_line_limit); i++) {
+		input = g_string_new ("");
+		expected = g_string_new ("");
+		
+		while (input->len < (gsize) qp_line_limit[i].column) {
+			g_string_append_c (expected, 'a');
+			g_string_append_c (input, 'a');
+		}
+		
+		g_string_append (expected, qp_line_limit[i].output);
+		g_string_append (input, qp_line_limit[i].input);
+		
+		filter = g_mime_filter_basic_new (GMIME_CONTENT_ENCODING_QUOTEDPRINTABLE, TRUE);
+		encoded = filter_bytes (filter, (const unsigned char *) input->str, input->len, FALSE);
+		g_object_unref (filter);
+		
+		if (encoded->len != expected->len || memcmp (encoded->data, expected->str, expected->len) != 0) {
+			testsuite_check_failed ("GMimeFilterBasic (quoted-printable; line limit) failed: case %u", i);
+			g_byte_array_free (encoded, TRUE);
+			g_string_free (expected, TRUE);
+			g_string_free (input, TRUE);
+			return;
+		}
+		
+		g_byte_array_free (encoded, TRUE);
+		g_string_free (expected, TRUE);
+		g_string_free (input, TRUE);
+	}
+	
+	testsuite_check_passed ();
+}
+
+static void
+test_gzip_threads (const char *datadir, const char *filename)
+{
+	char *path = g_build_filename (datadir, filename, NULL);
+	const char *what = "GMimeFilterGzip::threads";
+	GByteArray *text, *zipped, *actual;
+	GMimeFilter *filter;
+	const char *value;
+	guint i;
+	
+	testsuite_check ("%s", what);
+	
+	/* make the input span several blocks */
+	text = read_all_bytes (path, FALSE);
+	for (i = 0; i < 10; i++)
+		byte_array_double (text);
+	g_free (path);
+	
+	filter = g_mime_filter_gzip_new (GMIME_FILTER_GZIP_MODE_ZIP, 6);
+	g_mime_filter_gzip_set_threads ((GMimeFilterGZip *) filter, 4);
+	g_mime_filter_gzip_set_filename ((GMimeFilterGZip *) filter, filename);
+	
+	ZenTimerStart (NULL);
+	zipped = filter_bytes (filter, text->data, text->len, FALSE);
+	ZenTimerStop (NULL);
+	ZenTimerReport (NULL, "GMimeFilterGZip (4 threads)");
+	g_object_unref (filter);
+	
+	/* the result is a single gzip member, so a single-threaded decompressor can decode it */
+	filter = g_mime_filter_gzip_new (GMIME_FILTER_GZIP_MODE_UNZIP, 6);
+	actual = filter_bytes (filter, zipped->data, zipped->len, FALSE);
+	g_object_unref (filter);
+	
+	if (actual->len != text->len || memcmp (actual->data, text->data, text->len) != 0) {
+		testsuite_check_failed ("%s failed: block compressed stream did not decompress", what);
+		filter = NULL;
+		goto error;
+	}
+	
+	g_byte_array_free (actual, TRUE);
+	
+	/* decode two concatenated members in parallel */
+	byte_array_double (zipped);
+	byte_array_double (text);
+	
+	filter = g_mime_filter_gzip_new (GMIME_FILTER_GZIP_MODE_UNZIP, 6);
+	g_mime_filter_gzip_set_threads ((GMimeFilterGZip *) filter, 4);
+	actual = filter_bytes (filter, zipped->data, zipped->len, TRUE);
+	
+	if (actual->len != text->len) {
+		testsuite_check_failed ("%s failed: stream lengths do not match: expected=%u; actual=%u",
+					what, text->len, actual->len);
+		goto error;
+	}
+	
+	if (memcmp (actual->data, text->data, text->len) != 0) {
+		testsuite_check_failed ("%s failed: stream contents do not match", what);
+		goto error;
+	}
+	
+	value = g_mime_filter_gzip_get_filename ((GMimeFilterGZip *) filter);
+	if (!value || strcmp (value, filename) != 0) {
+		testsuite_check_failed ("%s failed: filename does not match: %s", what, value);
+		goto error;
+	}
+	
+	testsuite_check_passed ();
+	
+error:
+	
+	g_byte_array_free (zipped, TRUE);
+	g_byte_array_free (actual, TRUE);
+	g_byte_array_free (text, TRUE);
+	
+	if (filter != NULL)
+		g_object_unref (filter);
+}
+
+static void
+test_compressor (const char *what, GByteArray *text, GMimeFilter *compress, GMimeFilter *decompress, GByteArray **compressed)
+{
+	GByteArray *packed, *actual;
+	
+	ZenTimerStart (NULL);
+	packed = filter_bytes (compress, text->data, text->len, FALSE);
+	ZenTimerStop (NULL);
+	ZenTimerReport (NULL, what);
+	
+	/* decompress a byte at a time to make sure frames may be split anywhere */
+	actual = filter_bytes (decompress, packed->data, packed->len, TRUE);
+	
+	if (actual->len != text->len) {
+		testsuite_check_failed ("%s failed: stream lengths do not match: expected=%u; actual=%u",
+					what, text->len, actual->len);
+		g_byte_array_free (packed, TRUE);
+		packed = NULL;
+	} else if (memcmp (actual->data, text->data, text->len) != 0) {
+		testsuite_check_failed ("%s failed: stream contents do not match", what);
+		g_byte_array_free (packed, TRUE);
+		packed = NULL;
+	}
+	
+	g_byte_array_free (actual, TRUE);
+	*compressed = packed;
+}
+
+static void
+test_zstd (const char *datadir, const char *filename)
+{
+	char *path = g_build_filename (datadir, filename, NULL);
+	const char *what = "GMimeFilterZstd";
+	GMimeFilter *compress, *decompress;
+	GByteArray *text, *packed;
+	guint32 nframes, magic;
+	guint i;
+	
+	testsuite_check ("%s", what);
+	
+	if (!(compress = g_mime_filter_zstd_new (GMIME_FILTER_ZSTD_MODE_COMPRESS, 3))) {
+		testsuite_check_warn ("%s: not supported", what);
+		g_free (path);
+		return;
+	}
+	
+	text = read_all_bytes (path, FALSE);
+	for (i = 0; i < 6; i++)
+		byte_array_double (text);
+	g_free (path);
+	
+	/* use the start of the text itself as the dictionary */
+	g_mime_filter_zstd_set_dictionary ((GMimeFilterZstd *) compress, text->data, 1024);
+	g_mime_filter_zstd_set_frame_size ((GMimeFilterZstd *) compress, 64 * 1024);
+	
+	decompress = g_mime_filter_zstd_new (GMIME_FILTER_ZSTD_MODE_DECOMPRESS, 0);
+	g_mime_filter_zstd_set_dictionary ((GMimeFilterZstd *) decompress, text->data, 1024);
+	
+	test_compressor (what, text, compress, decompress, &packed);
+	g_object_unref (decompress);
+	g_object_unref (compress);
+	
+	if (packed == NULL)
+		goto error;
+	
+	/* the seek table footer lists one frame per 64 KB of input */
+	memcpy (&nframes, packed->data + packed->len - 9, 4);
+	memcpy (&magic, packed->data + packed->len - 4, 4);
+	
+	if (GUINT32_FROM_LE (magic) != 0x8F92EAB1) {
+		testsuite_check_failed ("%s failed: no seek table", what);
+		g_byte_array_free (packed, TRUE);
+		goto error;
+	}
+	
+	if (GUINT32_FROM_LE (nframes) != (text->len + 64 * 1024 - 1) / (64 * 1024)) {
+		testsuite_check_failed ("%s failed: unexpected number of frames: %u", what, GUINT32_FROM_LE (nframes));
+		g_byte_array_free (packed, TRUE);
+		goto error;
+	}
+	
+	g_byte_array_free (packed, TRUE);
+	testsuite_check_passed ();
+	
+error:
+	
+	g_byte_array_free (text, TRUE);
+}
+
+static void
+test_lz4 (const char *datadir, const char *filename)
+{
+	char *path = g_build_filename (datadir, filename, NULL);
+	const char *what = "GMimeFilterLz4";
+	GMimeFilter *compress, *decompress;
+	GByteArray *text, *packed;
+	guint i;
+	
+	testsuite_check ("%s", what);
+	
+	if (!(compress = g_mime_filter_lz4_new (GMIME_FILTER_LZ4_MODE_COMPRESS, 0))) {
+		testsuite_check_warn ("%s: not supported", what);
+		g_free (path);
+		return;
+	}
+	
+	text = read_all_bytes (path, FALSE);
+	for (i = 0; i < 6; i++)
+		byte_array_double (text);
+	g_free (path);
+	
+	g_mime_filter_lz4_set_frame_size ((GMimeFilterLz4 *) compress, 64 * 1024);
+	decompress = g_mime_filter_lz4_new (GMIME_FILTER_LZ4_MODE_DECOMPRESS, 0);
+	
+	test_compressor (what, text, compress, decompress, &packed);
+	g_object_unref (decompress);
+	g_object_unref (compress);
+	
+	if (packed != NULL) {
+		g_byte_array_free (packed, TRUE);
+		testsuite_check_passed ();
+	}
+	
+	what = "GMimeFilterLz4 (dictionary)";
+	testsuite_check ("%s", what);
+	
+	/* use the start of the text itself as the dictionary */
+	compress = g_mime_filter_lz4_new (GMIME_FILTER_LZ4_MODE_COMPRESS, 0);
+	if (!g_mime_filter_lz4_set_dictionary ((GMimeFilterLz4 *) compress, text->data, 1024)) {
+		testsuite_check_warn ("%s: not supported", what);
+		g_object_unref (compress);
+		goto error;
+	}
+	
+	g_mime_filter_lz4_set_frame_size ((GMimeFilterLz4 *) compress, 64 * 1024);
+	
+	decompress = g_mime_filter_lz4_new (GMIME_FILTER_LZ4_MODE_DECOMPRESS, 0);
+	g_mime_filter_lz4_set_dictionary ((GMimeFilterLz4 *) decompress, text->data, 1024);
+	
+	test_compressor (what, text, compress, decompress, &packed);
+	g_object_unref (decompress);
+	g_object_unref (compress);
+	
+	if (packed != NULL) {
+		g_byte_array_free (packed, TRUE);
+		testsuite_check_passed ();
+	}
+	
+error:
+	
+	g_byte_array_free (text, TRUE);
+}
+
+static void
+test_openpgp_markers (void)
+{
+	const char *what = "GMimeFilterOpenPGP::markers";
+	const char *begin_marker = "-----BEGIN PGP MESSAGE-----\n";
+	const char *end_marker = "-----END PGP MESSAGE-----\n";
+	GMimeStream *stream, *filtered;
+	GMimeFilterOpenPGP *openpgp;
+	gint64 begin, end, offset;
+	GByteArray *actual;
+	GMimeFilter *filter;
+	GString *text;
+	size_t n;
+	guint i;
+	
+	testsuite_check ("%s", what);
+	
+	/* lots of lines that are not (but look a bit like) armor markers */
+	text = g_string_new ("");
+	for (i = 0; i < 500; i++) {
+		g_string_append (text, "Lorem ipsum dolor sit amet, consectetur adipiscing elit.\n");
+		g_string_append (text, i % 2 ? "-- \n" : "-----BEGIN PGP MESS\n");
+	}
+	
+	begin = text->len;
+	g_string_append (text, begin_marker);
+	g_string_append (text, "\nhQEMA3ZNz3MPZp9dAQgAq2Q9HBGmXy2Xt3A8tV8Fq7sM0y4mEgh8Dg==\n=njUN\n");
+	g_string_append (text, end_marker);
+	end = text->len;
+	g_string_append (text, "trailing text\n");
+	
+	filter = g_mime_filter_openpgp_new ();
+	openpgp = (GMimeFilterOpenPGP *) filter;
+	
+	actual = g_byte_array_new ();
+	stream = g_mime_stream_mem_new_with_byte_array (actual);
+	g_mime_stream_mem_set_owner ((GMimeStreamMem *) stream, FALSE);
+	filtered = g_mime_stream_filter_new (stream);
+	g_mime_stream_filter_add ((GMimeStreamFilter *) filtered, filter);
+	g_object_unref (stream);
+	
+	/* feed the filter a few bytes at a time so that most calls end in the middle of a line */
+	for (i = 0; i < text->len; i += n) {
+		n = MIN (7, text->len - i);
+		g_mime_stream_write (filtered, text->str + i, n);
+	}
+	
+	g_mime_stream_flush (filtered);
+	g_object_unref (filtered);
+	
+	if (g_mime_filter_openpgp_get_data_type (openpgp) != GMIME_OPENPGP_DATA_ENCRYPTED) {
+		testsuite_check_failed ("%s failed: the armored block was not detected", what);
+		goto error;
+	}
+	
+	if ((offset = g_mime_filter_openpgp_get_begin_offset (openpgp)) != begin) {
+		testsuite_check_failed ("%s failed: incorrect begin offset: %" G_GINT64_FORMAT, what, offset);
+		goto error;
+	}
+	
+	if ((offset = g_mime_filter_openpgp_get_end_offset (openpgp)) != end) {
+		testsuite_check_failed ("%s failed: incorrect end offset: %" G_GINT64_FORMAT, what, offset);
+		goto error;
+	}
+	
+	if (actual->len != end - begin || memcmp (actual->data, text->str + begin, actual->len) != 0) {
+		testsuite_check_failed ("%s failed: the armored block does not match", what);
+		goto error;
+	}
+	
+	testsuite_check_passed ();
+	
+error:
+	
+	g_byte_array_free (actual, TRUE);
+	g_string_free (text, TRUE);
+	g_object_unref (filter);
+}
+
+static struct {
+	const char *text;
+	size_t len;
+	GMimeContentEncoding encoding;
+} best_encodings[] = {
+	{ "plain ascii text\nsplit over a few lines\n", 0, GMIME_CONTENT_ENCODING_DEFAULT },
+	{ "a line of text\nFrom someone\nanother line\n", 0, GMIME_CONTENT_ENCODING_QUOTEDPRINTABLE },
+	{ "a line of text\n>From someone\nFrom\n", 0, GMIME_CONTENT_ENCODING_DEFAULT },
+	{ "caf\xc3\xa9 au lait with some sugar\n", 0, GMIME_CONTENT_ENCODING_QUOTEDPRINTABLE },
+	{ "\xc3\xa9\xc3\xa9\xc3\xa9\n", 0, GMIME_CONTENT_ENCODING_BASE64 },
+	{ "text with a nul\0byte\n", 21, GMIME_CONTENT_ENCODING_BASE64 },
+};
+
+static void
+test_best (void)
+{
+	char *outbuf, *longline;
+	size_t outlen, outprespace;
+	GMimeFilterBest *best;
+	GMimeContentEncoding encoding;
+	GMimeFilter *filter;
+	size_t len, n, i;
+	guint j;
+	
+	testsuite_check ("GMimeFilterBest");
+	
+	filter = g_mime_filter_best_new (GMIME_FILTER_BEST_ENCODING);
+	best = (GMimeFilterBest *) filter;
+	
+	for (j = 0; j < G_N_ELEMENTS (best_encodings); j++) {
+		if ((len = best_encodings[j].len) == 0)
+			len = strlen (best_encodings[j].text);
+		
+		/* feed the filter a few bytes at a time so that lines get split between calls */
+		g_mime_filter_reset (filter);
+		for (i = 0; i < len; i += n) {
+			n = MIN (3, len - i);
+			g_mime_filter_filter (filter, (char *) best_encodings[j].text + i, n, 0, &outbuf, &outlen, &outprespace);
+		}
+		g_mime_filter_complete (filter, NULL, 0, 0, &outbuf, &outlen, &outprespace);
+		
+		if ((encoding = g_mime_filter_best_encoding (best, GMIME_ENCODING_CONSTRAINT_7BIT)) != best_encodings[j].encoding) {
+			testsuite_check_failed ("GMimeFilterBest failed: case %u: expected %s, got %s", j,
+						g_mime_content_encoding_to_string (best_encodings[j].encoding),
+						g_mime_content_encoding_to_string (encoding));
+			goto error;
+		}
+	}
+	
+	/* a line that is too long for 7bit or 8bit transport, ending in the middle of a pass */
+	longline = g_malloc (1500);
+	memset (longline, 'x', 1499);
+	longline[999] = '\n';
+	longline[1499] = '\n';
+	
+	g_mime_filter_reset (filter);
+	g_mime_filter_filter (filter, longline, 700, 0, &outbuf, &outlen, &outprespace);
+	g_mime_filter_complete (filter, longline + 700, 800, 0, &outbuf, &outlen, &outprespace);
+	g_free (longline);
+	
+	if ((encoding = g_mime_filter_best_encoding (best, GMIME_ENCODING_CONSTRAINT_8BIT)) != GMIME_CONTENT_ENCODING_QUOTEDPRINTABLE) {
+		testsuite_check_failed ("GMimeFilterBest failed: long line: got %s", g_mime_content_encoding_to_string (encoding));
+		goto error;
+	}
+	
+	testsuite_check_passed ();
+	
+error:
+	
+	g_object_unref (filter);
+}
+
+static struct {
+	const char *input;
+	const char *expected;
+} html2text[] = {
+	{ "<html><head><title>Title</title><style>p { color: red; }</style></head>\n"
+	  "<body><p>Hello,   <b>world</b>!</p><p>Fish &amp; chips &lt;3 &#169; &#x20AC;&nbsp;5</p></body></html>\n",
+	  "Title\nHello, world!\nFish & chips <3 \xc2\xa9 \xe2\x82\xac 5\n" },
+	{ "a<!-- a comment with > and -- in it -->b<!DOCTYPE html>c<?xml version=\"1.0\"?>d",
+	  "abcd" },
+	{ "<script>if (a < b && c > d) { s = '</scrip'; }</script >text",
+	  "text" },
+	{ "<a href=\"x>y\" title='a>b'>link</a> 1 < 2 & 3 &bogus; &amp &#xd800;",
+	  "link 1 < 2 & 3 &bogus; &amp \xef\xbf\xbd" },
+	{ "<table><tr><td>a</td><td>b</td></tr>\n<tr><td>c</td></tr></table>",
+	  "a b\nc\n" },
+	/* long runs of text with special bytes at and around the 16- and 32-byte block edges */
+	{ "0123456789abcde 0123456789abcd  0123456789abcdef<b>0123456789abcdef0123456789abcde&amp;"
+	  "0123456789abcdef0123456789abcd &lt;0123456789abcdef0123456789abcdef0123456789abcdef \n",
+	  "0123456789abcde 0123456789abcd 0123456789abcdef0123456789abcdef0123456789abcde&"
+	  "0123456789abcdef0123456789abcd <0123456789abcdef0123456789abcdef0123456789abcdef" },
+};
+
+static void
+html2text_convert (GMimeFilter *filter, const char *input, size_t chunk, GString *actual)
+{
+	size_t outlen, outprespace;
+	size_t len, n, i;
+	char *outbuf;
+	
+	g_mime_filter_reset (filter);
+	g_string_truncate (actual, 0);
+	
+	len = strlen (input);
+	for (i = 0; i < len; i += n) {
+		n = MIN (chunk, len - i);
+		g_mime_filter_filter (filter, (char *) input + i, n, 0, &outbuf, &outlen, &outprespace);
+		g_string_append_len (actual, outbuf, outlen);
+	}
+	
+	g_mime_filter_complete (filter, NULL, 0, 0, &outbuf, &outlen, &outprespace);
+	g_string_append_len (actual, outbuf, outlen);
+}
+
+static void
+test_html2text (void)
+{
+	const char *what = "GMimeFilterHTML2Text";
+	GString *actual, *expected, *input;
+	GMimeFilter *filter;
+	guint i, j;
+	
+	testsuite_check ("%s", what);
+	
+	filter = g_mime_filter_html2text_new ();
+	expected = g_string_new ("");
+	actual = g_string_new ("");
+	input = g_string_new ("");
+	
+	for (j = 0; j < G_N_ELEMENTS (html2text); j++) {
+		/* feed the filter a few bytes at a time so that tags and references get split between calls */
+		html2text_convert (filter, html2text[j].input, 5, actual);
+		
+		if (strcmp (actual->str, html2text[j].expected) != 0) {
+			testsuite_check_failed ("%s failed: case %u: got \"%s\"", what, j, actual->str);
+			goto error;
+		}
+		
+		/* ...and all at once so that long runs of text take the vectorized path */
+		html2text_convert (filter, html2text[j].input, strlen (html2text[j].input), actual);
+		
+		if (strcmp (actual->str, html2text[j].expected) != 0) {
+			testsuite_check_failed ("%s failed: case %u (whole): got \"%s\"", what, j, actual->str);
+			goto error;
+		}
+	}
+	
+	/* slide single and double spaces, tabs, tags and references across the 16- and 32-byte block edges */
+	for (i = 0; i < 40; i++) {
+		g_string_truncate (input, 0);
+		for (j = 0; j < 64 + i; j++)
+			g_string_append_c (input, 'a' + (j % 26));
+		g_string_append (input, " b  c\td<i>e</i>f&amp;g&lt;h ");
+		for (j = 0; j < 80 - i; j++)
+			g_string_append_c (input, 'A' + (j % 26));
+		g_string_insert_c (input, i, ' ');
+		g_string_insert (input, 32 - i % 8, "  ");
+		
+		html2text_convert (filter, input->str, 5, expected);
+		html2text_convert (filter, input->str, input->len, actual);
+		
+		if (strcmp (actual->str, expected->str) != 0) {
+			testsuite_check_failed ("%s failed: offset %u: got \"%s\", expected \"%s\"", what, i, actual->str, expected->str);
+			goto error;
+		}
+	}
+	
+	testsuite_check_passed ();
+	
+error:
+	
+	g_string_free (expected, TRUE);
+	g_string_free (actual, TRUE);
+	g_string_free (input, TRUE);
+	g_object_unref (filter);
+}
+
+static void
+test_html (const char *datadir, const char *input, const char *output, guint32 citation)
+{
+	guint32 flags = GMIME_FILTER_HTML_CONVERT_NL | GMIME_FILTER_HTML_CONVERT_SPACES |
+		GMIME_FILTER_HTML_CONVERT_URLS | GMIME_FILTER_HTML_CONVERT_ADDRESSES;
+	const char *what = "GMimeFilterHtml", *mode;
+	GByteArray *expected, *actual;
+	GMimeStream *stream;
+	GMimeFilter *filter;
+	char *path;
+	
+	switch (citation) {
+	case GMIME_FILTER_HTML_BLOCKQUOTE_CITATION: mode = "blockquote"; break;
+	case GMIME_FILTER_HTML_MARK_CITATION: mode = "mark"; break;
+	case GMIME_FILTER_HTML_CITE: mode = "cite"; break;
+	default: mode = "none"; break;
+	}
+	
+	testsuite_check ("%s (%s %s)", what, input, mode);
+	
+	actual = g_byte_array_new ();
+	stream = g_mime_stream_mem_new_with_byte_array (actual);
+	g_mime_stream_mem_set_owner ((GMimeStreamMem *) stream, FALSE);
+	
+	filter = g_mime_filter_html_new (flags | citation, 0x008888);
+	
+	path = g_build_filename (datadir, input, NULL);
+	pump_data_through_filter (filter, path, stream, TRUE, TRUE);
+	g_mime_filter_reset (filter);
+	g_object_unref (stream);
+	g_object_unref (filter);
+	g_free (path);
+	
+	path = g_build_filename (datadir, output, NULL);
+	expected = read_all_bytes (path, TRUE);
+	g_free (path);
+	
+	if (actual->len != expected->len) {
+		testsuite_check_failed ("%s failed: stream lengths do not match: expected=%u; actual=%u",
+					what, expected->len, actual->len);
+		stream = g_mime_stream_fs_open (output, O_WRONLY | O_CREAT, 0644, NULL);
+		g_mime_stream_write (stream, (const char *) actual->data, actual->len);
+		g_mime_stream_flush (stream);
+		g_object_unref (stream);
+		goto error;
+	}
+	
+	if (memcmp (actual->data, expected->data, actual->len) != 0) {
+		testsuite_check_failed ("%s failed: stream contents do not match", what);
+		goto error;
+	}
+	
+	testsuite_check_passed ();
+	
+error:
+	
+	g_byte_array_free (expected, TRUE);
+	g_byte_array_free (actual, TRUE);
+}
+
+static void
+test_smtp_data (const char *datadir, const char *input, const char *output)
+{
+	const char *what = "GMimeFilterSmtpData";
+	GByteArray *expected, *actual;
+	GMimeStream *stream;
+	GMimeFilter *filter;
+	char *path;
+	
+	testsuite_check ("%s", what);
+	
+	actual = g_byte_array_new ();
+	stream = g_mime_stream_mem_new_with_byte_array (actual);
+	g_mime_stream_mem_set_owner ((GMimeStreamMem *) stream, FALSE);
+	
+	filter = g_mime_filter_smtp_data_new ();
+	
+	path = g_build_filename (datadir, input, NULL);
+	pump_data_through_filter (filter, path, stream, TRUE, TRUE);
 	g_mime_filter_reset (filter);
 	g_object_unref (stream);
 	g_object_unref (filter);
@@ -428,6 +1492,213 @@ error:
 	g_byte_array_free (actual, TRUE);
 }
 
+static GByteArray *
+crlf_bytes (GByteArray *text)
+{
+	GByteArray *crlf;
+	guint i;
+	
+	crlf = g_byte_array_sized_new (text->len + text->len / 8);
+	
+	for (i = 0; i < text->len; i++) {
+		if (text->data[i] == '\n')
+			g_byte_array_append (crlf, (guint8 *) "\r", 1);
+		g_byte_array_append (crlf, text->data + i, 1);
+	}
+	
+	return crlf;
+}
+
+static void
+test_smtp_data_decode (const char *datadir, const char *input, const char *output)
+{
+	const char *message_data = "From: alice@example.com\r\nSubject: dots\r\n\r\n..leading dot\r\n.\r\nQUIT\r\n";
+	const char *what = "GMimeFilterSmtpData (decode)";
+	GByteArray *expected, *data, *actual, *text;
+	GMimeStream *stream, *filtered, *onebyte;
+	GMimeMessage *message = NULL;
+	GMimeParser *parser;
+	GMimeObject *body;
+	GMimeFilter *filter;
+	char buf[4096];
+	char *path, *str;
+	ssize_t nread;
+	
+	testsuite_check ("%s", what);
+	
+	/* the stuffed output of the encoder, terminated and followed by a pipelined command */
+	path = g_build_filename (datadir, output, NULL);
+	text = read_all_bytes (path, TRUE);
+	data = crlf_bytes (text);
+	g_byte_array_append (data, (guint8 *) ".\r\nQUIT\r\n", 9);
+	g_byte_array_free (text, TRUE);
+	g_free (path);
+	
+	path = g_build_filename (datadir, input, NULL);
+	text = read_all_bytes (path, TRUE);
+	expected = crlf_bytes (text);
+	g_byte_array_free (text, TRUE);
+	g_free (path);
+	
+	actual = g_byte_array_new ();
+	
+	/* write the DATA one byte at a time as an SMTP server would push it */
+	stream = g_mime_stream_mem_new_with_byte_array (actual);
+	g_mime_stream_mem_set_owner ((GMimeStreamMem *) stream, FALSE);
+	filtered = g_mime_stream_filter_new (stream);
+	filter = g_mime_filter_smtp_data_new_with_mode (GMIME_FILTER_SMTP_DATA_MODE_DECODE);
+	g_mime_stream_filter_add ((GMimeStreamFilter *) filtered, filter);
+	onebyte = test_stream_onebyte_new (filtered);
+	g_object_unref (filtered);
+	g_object_unref (stream);
+	
+	g_mime_stream_write (onebyte, (char *) data->data, data->len);
+	g_mime_stream_flush (onebyte);
+	g_object_unref (onebyte);
+	
+	if (!g_mime_filter_smtp_data_get_eod ((GMimeFilterSmtpData *) filter)) {
+		testsuite_check_failed ("%s failed: end-of-data was not detected", what);
+		goto error;
+	}
+	
+	if (actual->len != expected->len || memcmp (actual->data, expected->data, actual->len) != 0) {
+		testsuite_check_failed ("%s failed: write stream contents do not match", what);
+		goto error;
+	}
+	
+	/* read the DATA, letting the filter unstuff it in place */
+	g_byte_array_set_size (actual, 0);
+	g_mime_filter_reset (filter);
+	
+	stream = g_mime_stream_mem_new_with_buffer ((char *) data->data, data->len);
+	filtered = g_mime_stream_filter_new (stream);
+	g_mime_stream_filter_add ((GMimeStreamFilter *) filtered, filter);
+	g_object_unref (stream);
+	
+	while ((nread = g_mime_stream_read (filtered, buf, sizeof (buf))) > 0)
+		g_byte_array_append (actual, (guint8 *) buf, nread);
+	
+	g_object_unref (filtered);
+	
+	if (actual->len != expected->len || memcmp (actual->data, expected->data, actual->len) != 0) {
+		testsuite_check_failed ("%s failed: read stream contents do not match", what);
+		goto error;
+	}
+	
+	/* parse a message straight out of the DATA */
+	g_mime_filter_reset (filter);
+	
+	stream = g_mime_stream_mem_new_with_buffer (message_data, strlen (message_data));
+	filtered = g_mime_stream_filter_new (stream);
+	g_mime_stream_filter_add ((GMimeStreamFilter *) filtered, filter);
+	g_object_unref (stream);
+	
+	parser = g_mime_parser_new_with_stream (filtered);
+	message = g_mime_parser_construct_message (parser, NULL);
+	g_object_unref (filtered);
+	g_object_unref (parser);
+	
+	if (message == NULL || g_strcmp0 (g_mime_message_get_subject (message), "dots") != 0) {
+		testsuite_check_failed ("%s failed: could not parse the message", what);
+		goto error;
+	}
+	
+	body = g_mime_message_get_mime_part (message);
+	str = GMIME_IS_TEXT_PART (body) ? g_mime_text_part_get_text ((GMimeTextPart *) body) : NULL;
+	
+	if (str == NULL || strncmp (str, ".leading dot\r\n", 14) != 0 || strstr (str, "QUIT") != NULL) {
+		testsuite_check_failed ("%s failed: message body was not unstuffed", what);
+		g_free (str);
+		goto error;
+	}
+	
+	g_free (str);
+	
+	testsuite_check_passed ();
+	
+error:
+	
+	if (message != NULL)
+		g_object_unref (message);
+	g_object_unref (filter);
+	g_byte_array_free (expected, TRUE);
+	g_byte_array_free (actual, TRUE);
+	g_byte_array_free (data, TRUE);
+}
+
+static void
+test_smtp_data_eod (void)
+{
+	const char *data = "..leading dot\r\nbody\r\n.\r\n";
+	const char *expected = ".leading dot\r\nbody\r\n";
+	const char *what = "GMimeFilterSmtpData (end of data)";
+	GMimeStream *stream, *filtered;
+	GMimeFilter *filter;
+	GByteArray *actual;
+	char buf[4096];
+	ssize_t nread;
+	int fds[2];
+	
+	testsuite_check ("%s", what);
+	
+	/* the socket the DATA arrives on stays open for the next SMTP command, so
+	 * reading past the end-of-data marker would block (or, since the pipe is
+	 * non-blocking here, fail with EAGAIN) instead of reaching end of stream */
+	if (pipe (fds) == -1) {
+		testsuite_check_failed ("%s failed: could not create a pipe: %s", what, g_strerror (errno));
+		return;
+	}
+	
+	fcntl (fds[0], F_SETFL, fcntl (fds[0], F_GETFL) | O_NONBLOCK);
+	
+	if (write (fds[1], data, strlen (data)) != (ssize_t) strlen (data)) {
+		testsuite_check_failed ("%s failed: could not write to the pipe: %s", what, g_strerror (errno));
+		close (fds[0]);
+		close (fds[1]);
+		return;
+	}
+	
+	stream = g_mime_stream_pipe_new (fds[0]);
+	filtered = g_mime_stream_filter_new (stream);
+	filter = g_mime_filter_smtp_data_new_with_mode (GMIME_FILTER_SMTP_DATA_MODE_DECODE);
+	g_mime_stream_filter_add ((GMimeStreamFilter *) filtered, filter);
+	g_object_unref (filter);
+	
+	actual = g_byte_array_new ();
+	while ((nread = g_mime_stream_read (filtered, buf, sizeof (buf))) > 0)
+		g_byte_array_append (actual, (guint8 *) buf, nread);
+	
+	if (nread != 0 || !g_mime_stream_eos (filtered)) {
+		testsuite_check_failed ("%s failed: end of stream was not reported after the marker", what);
+		goto error;
+	}
+	
+	if (actual->len != strlen (expected) || memcmp (actual->data, expected, actual->len) != 0) {
+		testsuite_check_failed ("%s failed: stream contents do not match", what);
+		goto error;
+	}
+	
+	/* the next command must be left in the source for the server to read */
+	if (write (fds[1], "QUIT\r\n", 6) != 6 || g_mime_stream_read (filtered, buf, sizeof (buf)) != 0) {
+		testsuite_check_failed ("%s failed: read past the end-of-data marker", what);
+		goto error;
+	}
+	
+	if (read (fds[0], buf, sizeof (buf)) != 6 || memcmp (buf, "QUIT\r\n", 6) != 0) {
+		testsuite_check_failed ("%s failed: the data following the marker was consumed", what);
+		goto error;
+	}
+	
+	testsuite_check_passed ();
+	
+error:
+	
+	g_byte_array_free (actual, TRUE);
+	g_object_unref (filtered);
+	g_object_unref (stream);
+	close (fds[1]);
+}
+
 static void
 test_windows (const char *datadir, const char *filename, const char *claimed, const char *expected)
 {
@@ -504,16 +1775,37 @@ int main (int argc, char **argv)
 	test_charset_conversion (datadir, "japanese", "utf-8", "shift-jis");
 	test_charset_conversion (datadir, "japanese", "shift-jis", "utf-8");
 	
+	test_text (datadir, "cyrillic", "koi8-r", GMIME_CONTENT_ENCODING_BASE64);
+	test_text (datadir, "cyrillic", "koi8-r", GMIME_CONTENT_ENCODING_QUOTEDPRINTABLE);
+	test_text (datadir, "japanese", "iso-2022-jp", GMIME_CONTENT_ENCODING_BASE64);
+	test_text (datadir, "japanese", "shift-jis", GMIME_CONTENT_ENCODING_QUOTEDPRINTABLE);
+	
+	test_filter_chain_reuse ();
+	test_newlines ();
+	test_quoted_printable ();
+	test_quoted_printable_line_limit ();
+	
 	test_enriched (datadir, "enriched.txt", "enriched.html");
 	
 	test_gzip (datadir, "lorem-ipsum.txt");
 	test_gunzip (datadir, "lorem-ipsum.txt");
+	test_gzip_threads (datadir, "lorem-ipsum.txt");
+	test_zstd (datadir, "lorem-ipsum.txt");
+	test_lz4 (datadir, "lorem-ipsum.txt");
+	test_openpgp_markers ();
+	
+	test_best ();
+	
+	test_digest (datadir, "lorem-ipsum.txt");
 	
 	test_html (datadir, "html-input.txt", "html-output.blockquote.html", GMIME_FILTER_HTML_BLOCKQUOTE_CITATION);
 	test_html (datadir, "html-input.txt", "html-output.mark.html", GMIME_FILTER_HTML_MARK_CITATION);
 	test_html (datadir, "html-input.txt", "html-output.cite.html", GMIME_FILTER_HTML_CITE);
+	test_html2text ();
 	
 	test_smtp_data (datadir, "smtp-input.txt", "smtp-output.txt");
+	test_smtp_data_decode (datadir, "smtp-input.txt", "smtp-output.txt");
+	test_smtp_data_eod ();
 	
 	test_windows (datadir, "french-fable.cp1252.txt", "iso-8859-1", "windows-cp1252");
 	
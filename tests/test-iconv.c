@@ -132,6 +132,402 @@ test_utils (void)
 	testsuite_end ();
 }
 
+static void
+filter_text (GMimeFilter *filter, const char *text, size_t len, size_t chunk, GByteArray *output)
+{
+	size_t outlen, outprespace, n;
+	char *outbuf;
+	
+	do {
+		n = MIN (chunk, len);
+		
+		if (n == len)
+			g_mime_filter_complete (filter, (char *) text, n, 0, &outbuf, &outlen, &outprespace);
+		else
+			g_mime_filter_filter (filter, (char *) text, n, 0, &outbuf, &outlen, &outprespace);
+		
+		g_byte_array_append (output, (unsigned char *) outbuf, outlen);
+		text += n;
+		len -= n;
+	} while (len > 0);
+	
+	g_mime_filter_reset (filter);
+}
+
+static struct {
+	const char *text;
+	const char *expected;
+} malformed[] = {
+	{ "plain ASCII text", "plain ASCII text" },
+	{ "caf\xc3\xa9 \xe2\x82\xac \xf0\x9f\x98\x80", "caf\xc3\xa9 \xe2\x82\xac \xf0\x9f\x98\x80" },
+	{ "bad \xff byte", "bad  byte" },
+	{ "overlong \xc0\xaf slash", "overlong  slash" },
+	{ "surrogate \xed\xa0\x80 half", "surrogate  half" },
+	{ "truncated \xe2\x82", "truncated " },
+};
+
+static void
+test_filter_charset (void)
+{
+	GByteArray *actual;
+	GMimeFilter *filter;
+	size_t chunk;
+	char *utf8;
+	iconv_t cd;
+	int i;
+	
+	testsuite_start ("GMimeFilterCharset conversion to UTF-8");
+	
+	for (i = 0; i < G_N_ELEMENTS (tests); i++) {
+		testsuite_check ("test #%d: %s to UTF-8", i, tests[i].charset);
+		
+		try {
+			if ((cd = g_mime_iconv_open ("UTF-8", tests[i].charset)) == (iconv_t) -1) {
+				throw (exception_new ("could not open conversion for %s to UTF-8",
+						      tests[i].charset));
+			}
+			
+			utf8 = g_mime_iconv_strdup (cd, tests[i].text);
+			g_mime_iconv_close (cd);
+			
+			filter = g_mime_filter_charset_new (tests[i].charset, "UTF-8");
+			
+			/* feed the text through in progressively larger chunks so that
+			 * multibyte sequences get split across calls */
+			for (chunk = 1; chunk <= 8; chunk++) {
+				actual = g_byte_array_new ();
+				filter_text (filter, tests[i].text, strlen (tests[i].text), chunk, actual);
+				
+				if (actual->len != strlen (utf8) || memcmp (actual->data, utf8, actual->len) != 0) {
+					g_byte_array_free (actual, TRUE);
+					g_object_unref (filter);
+					g_free (utf8);
+					
+					throw (exception_new ("output did not match iconv when filtered %u bytes at a time",
+							      (unsigned int) chunk));
+				}
+				
+				g_byte_array_free (actual, TRUE);
+			}
+			
+			g_object_unref (filter);
+			g_free (utf8);
+			
+			testsuite_check_passed ();
+		} catch (ex) {
+			testsuite_check_failed ("test #%d failed: %s", i, ex->message);
+		} finally;
+	}
+	
+	for (i = 0; i < G_N_ELEMENTS (malformed); i++) {
+		testsuite_check ("malformed UTF-8 #%d", i);
+		
+		try {
+			filter = g_mime_filter_charset_new ("UTF-8", "UTF-8");
+			
+			for (chunk = 1; chunk <= 8; chunk++) {
+				actual = g_byte_array_new ();
+				filter_text (filter, malformed[i].text, strlen (malformed[i].text), chunk, actual);
+				
+				if (actual->len != strlen (malformed[i].expected) ||
+				    memcmp (actual->data, malformed[i].expected, actual->len) != 0) {
+					g_byte_array_free (actual, TRUE);
+					g_object_unref (filter);
+					
+					throw (exception_new ("output did not match when filtered %u bytes at a time",
+							      (unsigned int) chunk));
+				}
+				
+				g_byte_array_free (actual, TRUE);
+			}
+			
+			g_object_unref (filter);
+			
+			testsuite_check_passed ();
+		} catch (ex) {
+			testsuite_check_failed ("malformed UTF-8 #%d failed: %s", i, ex->message);
+		} finally;
+	}
+	
+	testsuite_end ();
+}
+
+static void
+test_native_converters (void)
+{
+	/* windows-cp1255 and windows-cp1258 are left out since some iconv
+	 * implementations compose their combining marks whereas we don't */
+	const char *charsets[] = {
+		"us-ascii", "iso-8859-1", "iso-8859-2", "iso-8859-3", "iso-8859-4", "iso-8859-5",
+		"iso-8859-6", "iso-8859-7", "iso-8859-8", "iso-8859-9", "iso-8859-10", "iso-8859-11",
+		"iso-8859-13", "iso-8859-14", "iso-8859-15", "iso-8859-16", "windows-cp1250",
+		"windows-cp1251", "windows-cp1252", "windows-cp1253", "windows-cp1254",
+		"windows-cp1256", "windows-cp1257", "koi8-r", "koi8-u"
+	};
+	static const char utf16le[] = "G\0r\0\xfc\0\xdf\0e\0 \0\xac\x20=\xd8\x00\xde";
+	static const char utf16be[] = "\0G\0r\0\xfc\0\xdf\0e\0 \x20\xac\xd8=\xde\x00";
+	static const char utf16_expected[] = "Gr\xc3\xbc\xc3\x9f" "e \xe2\x82\xac\xf0\x9f\x98\x80";
+	size_t inleft, outleft;
+	GByteArray *actual;
+	GMimeFilter *filter;
+	char *inbuf, *outbuf;
+	char text[224], expected[1024];
+	iconv_t cd;
+	int i;
+	
+	testsuite_start ("native conversions to UTF-8");
+	
+	for (i = 0; i < 224; i++)
+		text[i] = (char) (i + 32);
+	
+	for (i = 0; i < G_N_ELEMENTS (charsets); i++) {
+		testsuite_check ("%s", charsets[i]);
+		
+		try {
+			if ((cd = g_mime_iconv_open ("UTF-8", charsets[i])) == (iconv_t) -1)
+				throw (exception_new ("could not open conversion for %s to UTF-8", charsets[i]));
+			
+			/* convert every character using iconv, skipping those without a mapping */
+			inbuf = text;
+			inleft = sizeof (text);
+			outbuf = expected;
+			outleft = sizeof (expected);
+			
+			while (iconv (cd, &inbuf, &inleft, &outbuf, &outleft) == (size_t) -1) {
+				inbuf++;
+				inleft--;
+			}
+			
+			g_mime_iconv_close (cd);
+			
+			filter = g_mime_filter_charset_new (charsets[i], "UTF-8");
+			actual = g_byte_array_new ();
+			filter_text (filter, text, sizeof (text), 64, actual);
+			g_object_unref (filter);
+			
+			if (actual->len != (size_t) (outbuf - expected) || memcmp (actual->data, expected, actual->len) != 0) {
+				g_byte_array_free (actual, TRUE);
+				throw (exception_new ("output did not match iconv"));
+			}
+			
+			g_byte_array_free (actual, TRUE);
+			
+			testsuite_check_passed ();
+		} catch (ex) {
+			testsuite_check_failed ("%s failed: %s", charsets[i], ex->message);
+		} finally;
+	}
+	
+	for (i = 0; i < 2; i++) {
+		testsuite_check ("%s", i == 0 ? "utf-16le" : "utf-16be");
+		
+		try {
+			filter = g_mime_filter_charset_new (i == 0 ? "utf-16le" : "utf-16be", "UTF-8");
+			actual = g_byte_array_new ();
+			
+			/* filter 3 bytes at a time to split code units and surrogate pairs */
+			filter_text (filter, i == 0 ? utf16le : utf16be, sizeof (utf16le) - 1, 3, actual);
+			g_object_unref (filter);
+			
+			if (actual->len != strlen (utf16_expected) || memcmp (actual->data, utf16_expected, actual->len) != 0) {
+				g_byte_array_free (actual, TRUE);
+				throw (exception_new ("output did not match"));
+			}
+			
+			g_byte_array_free (actual, TRUE);
+			
+			testsuite_check_passed ();
+		} catch (ex) {
+			testsuite_check_failed ("%s failed: %s", i == 0 ? "utf-16le" : "utf-16be", ex->message);
+		} finally;
+	}
+	
+	testsuite_end ();
+}
+
+static gboolean
+convert_and_compare (iconv_t cd, const char *text, const char *expected)
+{
+	size_t inleft, outleft;
+	char *inbuf, *outbuf;
+	char out[64];
+	
+	inbuf = (char *) text;
+	inleft = strlen (text);
+	outbuf = out;
+	outleft = sizeof (out);
+	
+	if (iconv (cd, &inbuf, &inleft, &outbuf, &outleft) == (size_t) -1)
+		return FALSE;
+	
+	return (size_t) (outbuf - out) == strlen (expected) && !memcmp (out, expected, outbuf - out);
+}
+
+static gpointer
+iconv_cache_worker (gpointer user_data)
+{
+	iconv_t cd;
+	int i;
+	
+	for (i = 0; i < 2000; i++) {
+		if ((cd = g_mime_iconv_open ("UTF-8", (i & 1) ? "euc-jp" : "iso-2022-jp")) == (iconv_t) -1)
+			return GINT_TO_POINTER (FALSE);
+		
+		if (!convert_and_compare (cd, (i & 1) ? "\xb8\xa1\xba\xf7" : "\x1b$B8!:w\x1b(B", "\xe6\xa4\x9c\xe7\xb4\xa2")) {
+			g_mime_iconv_close (cd);
+			return GINT_TO_POINTER (FALSE);
+		}
+		
+		g_mime_iconv_close (cd);
+	}
+	
+	return GINT_TO_POINTER (TRUE);
+}
+
+static gpointer
+iconv_cache_closer (gpointer user_data)
+{
+	return GINT_TO_POINTER (g_mime_iconv_close ((iconv_t) user_data) == 0);
+}
+
+static void
+test_iconv_cache (void)
+{
+	guint64 hits, misses, hits1, misses1;
+	GThread *threads[4];
+	gboolean success;
+	iconv_t cd;
+	int i;
+	
+	testsuite_start ("iconv descriptor cache");
+	
+	testsuite_check ("descriptors are reused");
+	try {
+		if ((cd = g_mime_iconv_open ("UTF-8", "iso-2022-jp")) == (iconv_t) -1)
+			throw (exception_new ("could not open conversion for iso-2022-jp to UTF-8"));
+		
+		/* leave the descriptor in its JIS X 0208 shift state */
+		convert_and_compare (cd, "\x1b$B", "");
+		g_mime_iconv_close (cd);
+		
+		g_mime_iconv_get_cache_stats (&hits, &misses);
+		
+		for (i = 0; i < 10; i++) {
+			if ((cd = g_mime_iconv_open ("UTF-8", "iso-2022-jp")) == (iconv_t) -1)
+				throw (exception_new ("could not reopen conversion for iso-2022-jp to UTF-8"));
+			
+			success = convert_and_compare (cd, "AB", "AB");
+			g_mime_iconv_close (cd);
+			
+			if (!success)
+				throw (exception_new ("reused descriptor was not reset"));
+		}
+		
+		g_mime_iconv_get_cache_stats (&hits1, &misses1);
+		
+		if (hits1 - hits != 10 || misses1 != misses)
+			throw (exception_new ("expected 10 hits and no misses, got %" G_GUINT64_FORMAT " hits and %" G_GUINT64_FORMAT " misses",
+					      hits1 - hits, misses1 - misses));
+		
+		testsuite_check_passed ();
+	} catch (ex) {
+		testsuite_check_failed ("descriptors are reused: %s", ex->message);
+	} finally;
+	
+	testsuite_check ("descriptors closed by another thread");
+	try {
+		if ((cd = g_mime_iconv_open ("UTF-8", "euc-jp")) == (iconv_t) -1)
+			throw (exception_new ("could not open conversion for euc-jp to UTF-8"));
+		
+		threads[0] = g_thread_new ("iconv-closer", iconv_cache_closer, cd);
+		if (!GPOINTER_TO_INT (g_thread_join (threads[0])))
+			throw (exception_new ("failed to close descriptor"));
+		
+		g_mime_iconv_get_cache_stats (&hits, &misses);
+		
+		if ((cd = g_mime_iconv_open ("UTF-8", "euc-jp")) == (iconv_t) -1)
+			throw (exception_new ("could not reopen conversion for euc-jp to UTF-8"));
+		
+		g_mime_iconv_close (cd);
+		
+		g_mime_iconv_get_cache_stats (&hits1, &misses1);
+		
+		if (hits1 - hits != 1)
+			throw (exception_new ("descriptor was not returned to the cache"));
+		
+		testsuite_check_passed ();
+	} catch (ex) {
+		testsuite_check_failed ("descriptors closed by another thread: %s", ex->message);
+	} finally;
+	
+	testsuite_check ("concurrent use");
+	try {
+		for (i = 0; i < G_N_ELEMENTS (threads); i++)
+			threads[i] = g_thread_new ("iconv-worker", iconv_cache_worker, NULL);
+		
+		success = TRUE;
+		for (i = 0; i < G_N_ELEMENTS (threads); i++)
+			success = GPOINTER_TO_INT (g_thread_join (threads[i])) && success;
+		
+		if (!success)
+			throw (exception_new ("conversion failed"));
+		
+		testsuite_check_passed ();
+	} catch (ex) {
+		testsuite_check_failed ("concurrent use: %s", ex->message);
+	} finally;
+	
+	testsuite_end ();
+}
+
+static void
+test_filter_charset_perf (void)
+{
+	GByteArray *actual;
+	GMimeFilter *filter;
+	GString *text;
+	int i;
+	
+	testsuite_start ("GMimeFilterCharset ASCII/UTF-8 fast path");
+	
+	text = g_string_new ("");
+	while (text->len < 4 * 1024 * 1024)
+		g_string_append (text, "The quick brown fox jumps over the lazy dog. L\xf6schen, Modifi\xe9, C\xf2njuge.\n");
+	
+	for (i = 0; i < 2; i++) {
+		const char *charset = i == 0 ? "iso-8859-1" : "UTF-8";
+		
+		testsuite_check ("%s to UTF-8", charset);
+		
+		filter = g_mime_filter_charset_new (charset, "UTF-8");
+		actual = g_byte_array_new ();
+		
+		ZenTimerStart (NULL);
+		filter_text (filter, text->str, text->len, 4096, actual);
+		ZenTimerStop (NULL);
+		ZenTimerReport (NULL, i == 0 ? "iso-8859-1 -> UTF-8 (4 MB)" : "UTF-8 -> UTF-8 (4 MB)");
+		
+		g_object_unref (filter);
+		
+		if (i == 0) {
+			/* convert it for the next pass */
+			g_string_truncate (text, 0);
+			g_string_append_len (text, (char *) actual->data, actual->len);
+			testsuite_check_passed ();
+		} else if (actual->len != text->len || memcmp (actual->data, text->str, text->len) != 0) {
+			testsuite_check_failed ("%s to UTF-8 failed: valid UTF-8 was modified", charset);
+		} else {
+			testsuite_check_passed ();
+		}
+		
+		g_byte_array_free (actual, TRUE);
+	}
+	
+	g_string_free (text, TRUE);
+	
+	testsuite_end ();
+}
+
 int main (int argc, char **argv)
 {
 	g_mime_init ();
@@ -139,6 +535,10 @@ int main (int argc, char **argv)
 	testsuite_init (argc, argv);
 	
 	test_utils ();
+	test_filter_charset ();
+	test_native_converters ();
+	test_iconv_cache ();
+	test_filter_charset_perf ();
 	
 	g_mime_shutdown ();
 	
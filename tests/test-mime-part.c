@@ -33,6 +33,9 @@
 
 #include <gmime/gmime.h>
 
+/*#define ENABLE_ZENTIMER*/
+#include "zentimer.h"
+
 #include "testsuite.h"
 
 extern int verbose;
@@ -560,6 +563,306 @@ cleanup:
 	g_object_unref (part);
 }
 
+static void
+test_write_range (GMimeContentEncoding encoding)
+{
+	static const gint64 ranges[][2] = {
+		{ 0, 100 }, { 700000, 4096 }, { 65536, 65536 }, { 123457, 1 },
+		{ 700000, 4096 }, { 1048000, -1 }, { 1048576, 10 }, { 999999, 100000 }
+	};
+	const char *what = "GMimeDataWrapper::write_range_to_stream()";
+	GMimeStream *encoded, *filtered, *stream;
+	GByteArray *content, *actual;
+	GMimeDataWrapper *wrapper;
+	GMimeFilter *filter;
+	gint64 expected;
+	ssize_t nwritten;
+	guint i;
+	
+	testsuite_check ("%s (%s)", what, g_mime_content_encoding_to_string (encoding));
+	
+	content = g_byte_array_sized_new (1048576);
+	g_byte_array_set_size (content, 1048576);
+	for (i = 0; i < content->len; i++) {
+		/* avoid CR so that the quoted-printable round-trip is exact */
+		if ((content->data[i] = (guint8) g_random_int ()) == '\r')
+			content->data[i] = ' ';
+	}
+	
+	encoded = g_mime_stream_mem_new ();
+	filtered = g_mime_stream_filter_new (encoded);
+	filter = g_mime_filter_basic_new (encoding, TRUE);
+	g_mime_stream_filter_add ((GMimeStreamFilter *) filtered, filter);
+	g_object_unref (filter);
+	g_mime_stream_write (filtered, (const char *) content->data, content->len);
+	g_mime_stream_flush (filtered);
+	g_object_unref (filtered);
+	g_mime_stream_reset (encoded);
+	
+	wrapper = g_mime_data_wrapper_new_with_stream (encoded, encoding);
+	g_object_unref (encoded);
+	
+	actual = g_byte_array_new ();
+	stream = g_mime_stream_mem_new_with_byte_array (actual);
+	g_mime_stream_mem_set_owner ((GMimeStreamMem *) stream, FALSE);
+	
+	ZenTimerStart (NULL);
+	for (i = 0; i < G_N_ELEMENTS (ranges); i++) {
+		if (ranges[i][1] < 0 || ranges[i][0] + ranges[i][1] > content->len)
+			expected = MAX ((gint64) content->len - ranges[i][0], 0);
+		else
+			expected = ranges[i][1];
+		
+		g_byte_array_set_size (actual, 0);
+		g_mime_stream_reset (stream);
+		
+		nwritten = g_mime_data_wrapper_write_range_to_stream (wrapper, ranges[i][0], ranges[i][1], stream);
+		
+		if (nwritten != expected || actual->len != expected) {
+			testsuite_check_failed ("%s failed: range %" G_GINT64_FORMAT "+%" G_GINT64_FORMAT " wrote %ld bytes",
+						what, ranges[i][0], ranges[i][1], (long) nwritten);
+			goto error;
+		}
+		
+		if (expected > 0 && memcmp (actual->data, content->data + ranges[i][0], expected) != 0) {
+			testsuite_check_failed ("%s failed: range %" G_GINT64_FORMAT "+%" G_GINT64_FORMAT " did not match",
+						what, ranges[i][0], ranges[i][1]);
+			goto error;
+		}
+	}
+	ZenTimerStop (NULL);
+	ZenTimerReport (NULL, "write_range_to_stream()");
+	
+	testsuite_check_passed ();
+	
+error:
+	g_byte_array_free (content, TRUE);
+	g_byte_array_free (actual, TRUE);
+	g_object_unref (wrapper);
+	g_object_unref (stream);
+}
+
+static void
+test_decoded_stream (void)
+{
+	const char *what = "GMimeDataWrapper::get_decoded_stream()";
+	GMimeParserOptions *options;
+	GMimeStream *encoded, *stream;
+	GMimeDataWrapper *wrapper;
+	GByteArray *content;
+	char buf[4096];
+	ssize_t n;
+	guint i;
+	
+	testsuite_check ("%s", what);
+	
+	/* "Hello, World!\n" repeated 3072 times */
+	encoded = g_mime_stream_mem_new ();
+	for (i = 0; i < 1024; i++)
+		g_mime_stream_write_string (encoded, "SGVsbG8sIFdvcmxkIQpIZWxsbywgV29ybGQhCkhlbGxvLCBXb3JsZCEK\n");
+	g_mime_stream_reset (encoded);
+	
+	wrapper = g_mime_data_wrapper_new_with_stream (encoded, GMIME_CONTENT_ENCODING_BASE64);
+	g_object_unref (encoded);
+	
+	options = g_mime_parser_options_new ();
+	g_mime_parser_options_set_spill_threshold (options, 4096);
+	
+	content = g_byte_array_new ();
+	
+	if (!(stream = g_mime_data_wrapper_get_decoded_stream (wrapper, options)) || !GMIME_IS_STREAM_SPILL (stream)) {
+		testsuite_check_failed ("%s failed: expected a GMimeStreamSpill", what);
+		goto error;
+	}
+	
+	if (!g_mime_stream_spill_get_spilled ((GMimeStreamSpill *) stream)) {
+		testsuite_check_failed ("%s failed: the decoded content was not spilled to disk", what);
+		goto error;
+	}
+	
+	while ((n = g_mime_stream_read (stream, buf, sizeof (buf))) > 0)
+		g_byte_array_append (content, (guint8 *) buf, n);
+	
+	if (content->len != 3072 * 14) {
+		testsuite_check_failed ("%s failed: expected %u bytes but got %u", what, 3072 * 14, content->len);
+		goto error;
+	}
+	
+	for (i = 0; i < content->len; i += 14) {
+		if (memcmp (content->data + i, "Hello, World!\n", 14) != 0) {
+			testsuite_check_failed ("%s failed: decoded content does not match at offset %u", what, i);
+			goto error;
+		}
+	}
+	
+	g_object_unref (stream);
+	
+	/* without a threshold, the content is decoded into memory */
+	stream = g_mime_data_wrapper_get_decoded_stream (wrapper, NULL);
+	if (stream == NULL || !GMIME_IS_STREAM_MEM (stream) || g_mime_stream_length (stream) != 3072 * 14) {
+		testsuite_check_failed ("%s failed: expected a GMimeStreamMem with the decoded content", what);
+		goto error;
+	}
+	
+	testsuite_check_passed ();
+	
+error:
+	g_byte_array_free (content, TRUE);
+	g_mime_parser_options_free (options);
+	g_object_unref (wrapper);
+	if (stream != NULL)
+		g_object_unref (stream);
+}
+
+static const char *extract_message =
+	"From: Alice <alice@example.com>\n"
+	"Subject: text extraction\n"
+	"MIME-Version: 1.0\n"
+	"Content-Type: multipart/mixed; boundary=\"boundary\"\n"
+	"\n"
+	"--boundary\n"
+	"Content-Type: text/plain; charset=iso-8859-1\n"
+	"Content-Transfer-Encoding: quoted-printable\n"
+	"\n"
+	"caf=E9 au lait\n"
+	"--boundary\n"
+	"Content-Type: text/html; charset=utf-8\n"
+	"Content-Transfer-Encoding: base64\n"
+	"\n"
+	"PGh0bWw+PGJvZHk+PHA+SGVsbG8gPGI+d29ybGQ8L2I+PC9wPjwvYm9keT48L2h0bWw+Cg==\n"
+	"--boundary\n"
+	"Content-Type: image/png\n"
+	"Content-Transfer-Encoding: base64\n"
+	"\n"
+	"iVBORw0KGgo=\n"
+	"--boundary\n"
+	"Content-Type: message/rfc822\n"
+	"\n"
+	"Subject: attached message\n"
+	"Content-Type: text/enriched\n"
+	"\n"
+	"<bold>Now</bold> is the time <<for all>\n"
+	"--boundary--\n";
+
+static void
+test_extract_text (void)
+{
+	const char *expected = "caf\xc3\xa9 au lait\nHello world\nNow is the time <for all>";
+	const char *what = "GMimeMessage::extract_text()";
+	GMimeStream *stream, *istream;
+	GMimeMessage *message;
+	GMimeParser *parser;
+	GByteArray *actual;
+	gint64 nwritten;
+	size_t max_len;
+	
+	testsuite_check ("%s", what);
+	
+	istream = g_mime_stream_mem_new_with_buffer (extract_message, strlen (extract_message));
+	parser = g_mime_parser_new_with_stream (istream);
+	message = g_mime_parser_construct_message (parser, NULL);
+	g_object_unref (istream);
+	g_object_unref (parser);
+	
+	actual = g_byte_array_new ();
+	stream = g_mime_stream_mem_new_with_byte_array (actual);
+	g_mime_stream_mem_set_owner ((GMimeStreamMem *) stream, FALSE);
+	
+	nwritten = g_mime_message_extract_text_to_stream (message, -1, stream);
+	
+	if (nwritten != (gint64) strlen (expected) || actual->len != (guint) nwritten || memcmp (actual->data, expected, nwritten) != 0) {
+		testsuite_check_failed ("%s failed: the extracted text does not match", what);
+		goto error;
+	}
+	
+	/* the byte cap must not split the UTF-8 sequence for U+00E9 */
+	g_byte_array_set_size (actual, 0);
+	g_mime_stream_reset (stream);
+	
+	nwritten = g_mime_message_extract_text_to_stream (message, 4, stream);
+	
+	if (nwritten != 3 || actual->len != 3 || memcmp (actual->data, "caf", 3) != 0) {
+		testsuite_check_failed ("%s failed: the byte cap was not honored", what);
+		goto error;
+	}
+	
+	/* the newlines separating the parts count towards the byte cap as well */
+	for (max_len = 1; max_len <= strlen (expected); max_len++) {
+		g_byte_array_set_size (actual, 0);
+		g_mime_stream_reset (stream);
+		
+		nwritten = g_mime_message_extract_text_to_stream (message, max_len, stream);
+		
+		if (nwritten != (gint64) actual->len || nwritten > (gint64) max_len || nwritten + 1 < (gint64) max_len ||
+		    memcmp (actual->data, expected, nwritten) != 0) {
+			testsuite_check_failed ("%s failed: the byte cap of %u was not honored", what, (guint) max_len);
+			goto error;
+		}
+	}
+	
+	testsuite_check_passed ();
+	
+error:
+	g_byte_array_free (actual, TRUE);
+	g_object_unref (message);
+	g_object_unref (stream);
+}
+
+static gboolean
+extract_utf8_chunk (GMimePart *part, const char *text, size_t len, gpointer user_data)
+{
+	GString *str = user_data;
+	
+	/* a chunk which does not end on a character boundary fails to validate */
+	if (!g_utf8_validate (text, len, NULL))
+		return FALSE;
+	
+	g_string_append_len (str, text, len);
+	
+	return TRUE;
+}
+
+static void
+test_extract_text_utf8 (void)
+{
+	const char *what = "GMimeMessage::extract_text() (multibyte characters)";
+	GMimeStream *istream;
+	GMimeMessage *message;
+	GMimeParser *parser;
+	GString *text, *raw, *actual;
+	gint64 nwritten;
+	guint i;
+	
+	testsuite_check ("%s", what);
+	
+	/* the leading 'a' makes the 2-byte sequences straddle every 4 KB boundary */
+	text = g_string_new ("a");
+	for (i = 0; i < 6000; i++)
+		g_string_append (text, i % 64 == 63 ? "\n" : "\xc3\xa9");
+	
+	raw = g_string_new ("Subject: text extraction\nMIME-Version: 1.0\nContent-Type: text/plain\n\n");
+	g_string_append_len (raw, text->str, text->len);
+	
+	istream = g_mime_stream_mem_new_with_buffer (raw->str, raw->len);
+	parser = g_mime_parser_new_with_stream (istream);
+	message = g_mime_parser_construct_message (parser, NULL);
+	g_object_unref (istream);
+	g_object_unref (parser);
+	
+	actual = g_string_new ("");
+	nwritten = g_mime_message_extract_text (message, -1, extract_utf8_chunk, actual);
+	
+	if (nwritten != (gint64) text->len || actual->len != text->len || memcmp (actual->str, text->str, text->len) != 0)
+		testsuite_check_failed ("%s failed: a multibyte sequence was split between chunks", what);
+	else
+		testsuite_check_passed ();
+	
+	g_string_free (actual, TRUE);
+	g_string_free (raw, TRUE);
+	g_string_free (text, TRUE);
+	g_object_unref (message);
+}
+
 int main (int argc, char **argv)
 {
 	const char *datadir = "data/mime-part";
@@ -597,6 +900,15 @@ int main (int argc, char **argv)
 	
 	test_text_part (datadir, "french-fable.txt", "iso-8859-1");
 	
+	test_write_range (GMIME_CONTENT_ENCODING_BASE64);
+	test_write_range (GMIME_CONTENT_ENCODING_QUOTEDPRINTABLE);
+	test_write_range (GMIME_CONTENT_ENCODING_BINARY);
+	
+	test_decoded_stream ();
+	
+	test_extract_text ();
+	test_extract_text_utf8 ();
+	
 	testsuite_end ();
 	
 	g_mime_shutdown ();
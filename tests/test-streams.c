@@ -38,6 +38,9 @@
 
 #include "testsuite.h"
 
+/*#define ENABLE_ZENTIMER*/
+#include "zentimer.h"
+
 extern int verbose;
 
 #define d(x) 
@@ -197,7 +200,310 @@ test_stream_buffer_gets (const char *filename)
 		g_object_unref (buffered);
 	}
 	
+	testsuite_check ("GMimeStreamBuffer::gets() (read-ahead)");
+	try {
+		g_mime_stream_reset (stream);
+		buffered = g_mime_stream_buffer_new_with_size (stream, GMIME_STREAM_BUFFER_READ_AHEAD, 61);
+		test_stream_gets (buffered, filename);
+		testsuite_check_passed ();
+	} catch (ex) {
+		testsuite_check_failed ("GMimeStreamBuffer::gets() (read-ahead) failed: %s",
+					ex->message);
+	} finally {
+		g_object_unref (buffered);
+	}
+	
+	g_object_unref (stream);
+}
+
+static void
+test_stream_readln (GMimeStream *stream, const char *text)
+{
+	const char *inptr = text, *eoln;
+	GByteArray *line;
+	Exception *ex = NULL;
+	size_t len;
+	
+	line = g_byte_array_new ();
+	
+	while (*inptr) {
+		if ((eoln = strchr (inptr, '\n')))
+			len = (eoln - inptr) + 1;
+		else
+			len = strlen (inptr);
+		
+		g_byte_array_set_size (line, 0);
+		g_mime_stream_buffer_readln (stream, line);
+		
+		if (line->len != len || memcmp (line->data, inptr, len) != 0) {
+			ex = exception_new ("line at offset %d did not match", (int) (inptr - text));
+			break;
+		}
+		
+		inptr += len;
+		
+		if (g_mime_stream_tell (stream) != (gint64) (inptr - text)) {
+			ex = exception_new ("stream position %lld != %d after reading a line",
+					    (long long) g_mime_stream_tell (stream), (int) (inptr - text));
+			break;
+		}
+	}
+	
+	if (ex == NULL) {
+		/* there should be nothing left */
+		g_byte_array_set_size (line, 0);
+		g_mime_stream_buffer_readln (stream, line);
+		if (line->len != 0)
+			ex = exception_new ("read %u bytes past the end of the stream", line->len);
+	}
+	
+	g_byte_array_free (line, TRUE);
+	
+	if (ex != NULL)
+		throw (ex);
+}
+
+static void
+test_stream_buffer_readln (void)
+{
+	static const GMimeStreamBufferMode modes[] = { GMIME_STREAM_BUFFER_BLOCK_READ, GMIME_STREAM_BUFFER_READ_AHEAD };
+	static const char *names[] = { "block-read", "read-ahead" };
+	GMimeStream *stream, *buffered = NULL;
+	GString *text;
+	guint i, j;
+	
+	/* lines of all sorts of lengths (including empty lines and lines
+	 * longer than the buffer) so that they straddle the boundaries of
+	 * the 64-byte buffer at different offsets, with an unterminated
+	 * last line */
+	text = g_string_new ("");
+	for (i = 0; i < 256; i++) {
+		for (j = 0; j < (i * 37) % 150; j++)
+			g_string_append_c (text, 'a' + (i + j) % 26);
+		g_string_append_c (text, '\n');
+	}
+	g_string_append (text, "no newline at the end");
+	
+	for (i = 0; i < G_N_ELEMENTS (modes); i++) {
+		testsuite_check ("GMimeStreamBuffer::readln() (%s)", names[i]);
+		try {
+			stream = g_mime_stream_mem_new_with_buffer (text->str, text->len);
+			buffered = g_mime_stream_buffer_new_with_size (stream, modes[i], 64);
+			g_object_unref (stream);
+			
+			test_stream_readln (buffered, text->str);
+			testsuite_check_passed ();
+		} catch (ex) {
+			testsuite_check_failed ("GMimeStreamBuffer::readln() (%s) failed: %s",
+						names[i], ex->message);
+		} finally {
+			g_object_unref (buffered);
+		}
+	}
+	
+	g_string_free (text, TRUE);
+}
+
+#define READ_AHEAD_FILE_SIZE (8 * 1024 * 1024)
+#define READ_AHEAD_WINDOW (256 * 1024)
+
+static void
+test_stream_fs_read (const char *filename, const char *text, size_t window)
+{
+	GMimeStream *stream;
+	Exception *ex = NULL;
+	size_t nread = 0;
+	char buf[4096];
+	ssize_t n;
+	int fd;
+	
+	if ((fd = open (filename, O_RDONLY, 0)) == -1)
+		throw (exception_new ("could not open `%s': %s", filename, g_strerror (errno)));
+	
+	stream = g_mime_stream_fs_new (fd);
+	g_mime_stream_fs_set_read_ahead ((GMimeStreamFs *) stream, window);
+	
+	ZenTimerStart (NULL);
+	while ((n = g_mime_stream_read (stream, buf, sizeof (buf))) > 0) {
+		if (nread + n > READ_AHEAD_FILE_SIZE || memcmp (buf, text + nread, n) != 0) {
+			ex = exception_new ("content at offset %" G_GSIZE_FORMAT " does not match", nread);
+			break;
+		}
+		
+		nread += n;
+	}
+	ZenTimerStop (NULL);
+	
+	if (window > 0)
+		ZenTimerReport (NULL, "GMimeStreamFs::read(8 MB, read-ahead)");
+	else
+		ZenTimerReport (NULL, "GMimeStreamFs::read(8 MB)");
+	
 	g_object_unref (stream);
+	
+	if (ex == NULL && nread != READ_AHEAD_FILE_SIZE)
+		ex = exception_new ("read %" G_GSIZE_FORMAT " bytes, expected %d", nread, READ_AHEAD_FILE_SIZE);
+	
+	if (ex != NULL)
+		throw (ex);
+}
+
+static void
+test_stream_fs_read_ahead (void)
+{
+	static const size_t windows[] = { 0, READ_AHEAD_WINDOW };
+	char *filename, *text;
+	GError *err = NULL;
+	guint i;
+	int fd;
+	
+	if ((fd = g_file_open_tmp ("gmime-streamXXXXXX", &filename, &err)) == -1) {
+		testsuite_check ("GMimeStreamFs::read()");
+		testsuite_check_failed ("GMimeStreamFs::read() failed: %s", err->message);
+		g_error_free (err);
+		return;
+	}
+	
+	close (fd);
+	
+	text = g_malloc (READ_AHEAD_FILE_SIZE);
+	for (i = 0; i < READ_AHEAD_FILE_SIZE; i++)
+		text[i] = (char) ((i * 31) ^ (i >> 11));
+	
+	if (!g_file_set_contents (filename, text, READ_AHEAD_FILE_SIZE, &err)) {
+		testsuite_check ("GMimeStreamFs::read()");
+		testsuite_check_failed ("GMimeStreamFs::read() failed: %s", err->message);
+		g_error_free (err);
+		goto cleanup;
+	}
+	
+	for (i = 0; i < G_N_ELEMENTS (windows); i++) {
+		testsuite_check ("GMimeStreamFs::read() (read-ahead = %" G_GSIZE_FORMAT ")", windows[i]);
+		try {
+			test_stream_fs_read (filename, text, windows[i]);
+			testsuite_check_passed ();
+		} catch (ex) {
+			testsuite_check_failed ("GMimeStreamFs::read() (read-ahead = %" G_GSIZE_FORMAT ") failed: %s",
+						windows[i], ex->message);
+		} finally;
+	}
+	
+cleanup:
+	
+	unlink (filename);
+	g_free (filename);
+	g_free (text);
+}
+
+typedef struct {
+	GMainLoop *loop;
+	GByteArray *data;
+	GError *err;
+	char buf[4096];
+} AsyncReadState;
+
+static void
+async_read_ready (GObject *source, GAsyncResult *result, gpointer user_data)
+{
+	GMimeStream *stream = (GMimeStream *) source;
+	AsyncReadState *state = user_data;
+	ssize_t n;
+	
+	if ((n = g_mime_stream_read_finish (stream, result, &state->err)) > 0) {
+		g_byte_array_append (state->data, (unsigned char *) state->buf, n);
+		g_mime_stream_read_async (stream, state->buf, sizeof (state->buf), G_PRIORITY_DEFAULT,
+					  NULL, async_read_ready, state);
+		return;
+	}
+	
+	g_main_loop_quit (state->loop);
+}
+
+static void
+async_close_ready (GObject *source, GAsyncResult *result, gpointer user_data)
+{
+	AsyncReadState *state = user_data;
+	
+	g_mime_stream_close_finish ((GMimeStream *) source, result, &state->err);
+	g_main_loop_quit (state->loop);
+}
+
+static void
+test_stream_async_read (GMimeStream *stream, const char *filename)
+{
+	AsyncReadState state;
+	Exception *ex = NULL;
+	gsize length;
+	char *text;
+	
+	if (!g_file_get_contents (filename, &text, &length, NULL))
+		throw (exception_new ("could not read `%s'", filename));
+	
+	state.loop = g_main_loop_new (NULL, FALSE);
+	state.data = g_byte_array_new ();
+	state.err = NULL;
+	
+	g_mime_stream_read_async (stream, state.buf, sizeof (state.buf), G_PRIORITY_DEFAULT,
+				  NULL, async_read_ready, &state);
+	g_main_loop_run (state.loop);
+	
+	if (state.err != NULL) {
+		ex = exception_new ("read failed: %s", state.err->message);
+	} else if (state.data->len != length || memcmp (state.data->data, text, length) != 0) {
+		ex = exception_new ("streams did not match");
+	} else {
+		g_mime_stream_close_async (stream, G_PRIORITY_DEFAULT, NULL, async_close_ready, &state);
+		g_main_loop_run (state.loop);
+		
+		if (state.err != NULL)
+			ex = exception_new ("close failed: %s", state.err->message);
+	}
+	
+	g_byte_array_free (state.data, TRUE);
+	g_main_loop_unref (state.loop);
+	g_clear_error (&state.err);
+	g_free (text);
+	
+	if (ex != NULL)
+		throw (ex);
+}
+
+static void
+test_stream_async (const char *filename)
+{
+	GMimeStream *stream = NULL;
+	GFile *file;
+	int fd;
+	
+	testsuite_check ("GMimeStreamGIO::read_async()");
+	try {
+		file = g_file_new_for_path (filename);
+		stream = g_mime_stream_gio_new (file);
+		test_stream_async_read (stream, filename);
+		testsuite_check_passed ();
+	} catch (ex) {
+		testsuite_check_failed ("GMimeStreamGIO::read_async() failed: %s",
+					ex->message);
+	} finally {
+		g_object_unref (stream);
+	}
+	
+	if ((fd = open (filename, O_RDONLY, 0)) == -1) {
+		v(fprintf (stderr, "failed to open %s", filename));
+		return;
+	}
+	
+	testsuite_check ("GMimeStreamFs::read_async()");
+	try {
+		stream = g_mime_stream_fs_new (fd);
+		test_stream_async_read (stream, filename);
+		testsuite_check_passed ();
+	} catch (ex) {
+		testsuite_check_failed ("GMimeStreamFs::read_async() failed: %s",
+					ex->message);
+	} finally {
+		g_object_unref (stream);
+	}
 }
 
 
@@ -304,6 +610,65 @@ cleanup:
 	return TRUE;
 }
 
+static gboolean
+check_stream_fs_batch (const char *input, const char *output, const char *filename, gint64 start, gint64 end)
+{
+	GMimeStream *streams[2], *stream;
+	char *dirname, *basename;
+	Exception *ex = NULL;
+	GPtrArray *batch;
+	int fd;
+	
+	if ((fd = open (output, O_RDONLY, 0)) == -1)
+		return FALSE;
+	
+	dirname = g_path_get_dirname (input);
+	basename = g_path_get_basename (input);
+	batch = g_mime_stream_fs_open_batch (dirname, (const char **) &basename, 1, O_RDONLY, 0, 64 * 1024, NULL);
+	g_free (basename);
+	g_free (dirname);
+	
+	if (batch == NULL || batch->pdata[0] == NULL) {
+		if (batch != NULL)
+			g_ptr_array_free (batch, TRUE);
+		close (fd);
+		return FALSE;
+	}
+	
+	stream = batch->pdata[0];
+	if (g_mime_stream_fs_get_read_ahead ((GMimeStreamFs *) stream) != 64 * 1024) {
+		ex = exception_new ("GMimeStreamFs read-ahead was not enabled for `%s'", filename);
+		g_ptr_array_free (batch, TRUE);
+		close (fd);
+		throw (ex);
+	}
+	
+	streams[0] = g_mime_stream_substream (stream, start, end);
+	g_ptr_array_free (batch, TRUE);
+	
+	streams[1] = g_mime_stream_pipe_new (fd);
+	
+	if (!streams_match (streams, filename)) {
+		ex = exception_new ("GMimeStreamFs (read-ahead) streams did not match for `%s'", filename);
+		goto cleanup;
+	}
+	
+	if (!g_mime_stream_eos (streams[0])) {
+		ex = exception_new ("GMimeStreamFs (read-ahead) is not at the end-of-stream `%s'", filename);
+		goto cleanup;
+	}
+	
+cleanup:
+	
+	g_object_unref (streams[0]);
+	g_object_unref (streams[1]);
+	
+	if (ex != NULL)
+		throw (ex);
+	
+	return TRUE;
+}
+
 static gboolean
 check_stream_file (const char *input, const char *output, const char *filename, gint64 start, gint64 end)
 {
@@ -463,6 +828,50 @@ check_stream_buffer (const char *input, const char *output, const char *filename
 	return TRUE;
 }
 
+static gboolean
+check_stream_spill (const char *input, const char *output, const char *filename, gint64 start, gint64 end)
+{
+	GMimeStream *streams[2], *stream, *fstream;
+	Exception *ex = NULL;
+	gint64 len;
+	int fd[2];
+	
+	if ((fd[0] = open (input, O_RDONLY, 0)) == -1)
+		return FALSE;
+	
+	if ((fd[1] = open (output, O_RDONLY, 0)) == -1) {
+		close (fd[0]);
+		return FALSE;
+	}
+	
+	fstream = g_mime_stream_fs_new (fd[0]);
+	len = g_mime_stream_length (fstream);
+	
+	/* make sure that most inputs end up getting spilled to disk part-way through */
+	stream = g_mime_stream_spill_new ((size_t) (len / 2));
+	
+	/* take the substream before writing so that it has to survive the spill */
+	streams[0] = g_mime_stream_substream (stream, start, end);
+	g_mime_stream_write_to_stream (fstream, stream);
+	g_object_unref (fstream);
+	
+	streams[1] = g_mime_stream_fs_new (fd[1]);
+	
+	if (len > 0 && !g_mime_stream_spill_get_spilled ((GMimeStreamSpill *) stream))
+		ex = exception_new ("GMimeStreamSpill did not spill to disk for `%s'", filename);
+	else if (!streams_match (streams, filename))
+		ex = exception_new ("GMimeStreamSpill streams did not match for `%s'", filename);
+	
+	g_object_unref (streams[0]);
+	g_object_unref (streams[1]);
+	g_object_unref (stream);
+	
+	if (ex != NULL)
+		throw (ex);
+	
+	return TRUE;
+}
+
 static gboolean
 check_stream_gio (const char *input, const char *output, const char *filename, gint64 start, gint64 end)
 {
@@ -534,12 +943,14 @@ static struct {
 	checkFunc check;
 } checks[] = {
 	{ "GMimeStreamFs",     check_stream_fs     },
+	{ "GMimeStreamFs (batch, read-ahead)", check_stream_fs_batch },
 	{ "GMimeStreamFile",   check_stream_file   },
 #ifdef HAVE_MMAP
 	{ "GMimeStreamMmap",   check_stream_mmap   },
 #endif /* HAVE_MMAP */
 	{ "GMimeStreamBuffer", check_stream_buffer },
 	{ "GMimeStreamGIO",    check_stream_gio    },
+	{ "GMimeStreamSpill",  check_stream_spill  },
 };
 
 static void
@@ -731,6 +1142,9 @@ int main (int argc, char **argv)
 	
 	testsuite_start ("Stream tests");
 	
+	test_stream_buffer_readln ();
+	test_stream_fs_read_ahead ();
+	
 	p = g_stpcpy (path, datadir);
 	*p++ = G_DIR_SEPARATOR;
 	strcpy (p, "output");
@@ -781,6 +1195,7 @@ int main (int argc, char **argv)
 		
 		strcpy (p, dent);
 		test_stream_buffer_gets (path);
+		test_stream_async (path);
 	}
 	
 	if (gen_data && stream_name && testsuite_total_errors () == 0) {
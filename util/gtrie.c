@@ -50,14 +50,45 @@ struct _trie_match {
 	gunichar c;
 };
 
+/* the trie flattened into transition tables, see g_trie_compile() */
+struct _trie_dfa {
+	unsigned char classes[128];
+	guint nclasses;
+	
+	/* for each state and character class, the next state shifted left
+	 * by 3, whether it is final and what to do with the start of the
+	 * match (one of the TRIE_DFA_* values) */
+	guint16 *delta;
+	
+	/* the goto function without the failure transitions, needed once
+	 * a match has been found (TRIE_DFA_NONE if there is no transition) */
+	guint16 *jump;
+	
+	unsigned int *final;
+	int *id;
+};
+
+#define TRIE_DFA_MAX_STATES 8192
+#define TRIE_DFA_NONE 0xffff
+
+enum {
+	TRIE_DFA_KEEP,   /* the match still starts where it did */
+	TRIE_DFA_START,  /* the match starts at the current character */
+	TRIE_DFA_RESET   /* the match starts after the current character */
+};
+
+#define TRIE_DFA_FINAL (1 << 2)
+
 struct _GTrie {
 	struct _trie_state root;
 	GPtrArray *fail_states;
+	struct _trie_dfa *dfa;
 	gboolean icase;
 };
 
 static void trie_match_free (struct _trie_match *match);
 static void trie_state_free (struct _trie_state *state);
+static void trie_dfa_free (struct _trie_dfa *dfa);
 
 static struct _trie_match *
 trie_match_new (void)
@@ -149,6 +180,7 @@ g_trie_new (gboolean icase)
 	
 	trie->fail_states = g_ptr_array_new ();
 	trie->icase = icase;
+	trie->dfa = NULL;
 	
 	return trie;
 }
@@ -159,6 +191,7 @@ g_trie_free (GTrie *trie)
 {
 	g_ptr_array_free (trie->fail_states, TRUE);
 	trie_match_free (trie->root.match);
+	trie_dfa_free (trie->dfa);
 	g_free (trie);
 }
 
@@ -252,6 +285,10 @@ g_trie_add (GTrie *trie, const char *pattern, int pattern_id)
 	guint i, depth = 0;
 	gunichar c;
 	
+	/* the compiled tables no longer match the trie */
+	trie_dfa_free (trie->dfa);
+	trie->dfa = NULL;
+	
 	/* Step 1: add the pattern to the trie */
 	
 	q = &trie->root;
@@ -314,6 +351,210 @@ g_trie_add (GTrie *trie, const char *pattern, int pattern_id)
 	d(dump_trie (&trie->root, 0));
 }
 
+static void
+trie_dfa_free (struct _trie_dfa *dfa)
+{
+	if (dfa == NULL)
+		return;
+	
+	g_free (dfa->delta);
+	g_free (dfa->jump);
+	g_free (dfa->final);
+	g_free (dfa->id);
+	g_free (dfa);
+}
+
+/**
+ * g_trie_compile:
+ * @trie: a #GTrie
+ *
+ * Flattens @trie into a table with one row of transitions per state
+ * and one column per class of characters that appear in the patterns
+ * (with any case folding already applied), so that g_trie_search()
+ * and g_trie_quick_search() need a single table lookup per character
+ * instead of walking lists of transitions and failure links.
+ *
+ * Only tries made up of US-ASCII patterns are compiled; any other trie
+ * is searched as before. Adding another pattern discards the tables,
+ * so this should be called once all the patterns have been added.
+ **/
+void
+g_trie_compile (GTrie *trie)
+{
+	gunichar chars[G_N_ELEMENTS (((struct _trie_dfa *) NULL)->classes)];
+	struct _trie_state *q, *r;
+	struct _trie_match *m, *n;
+	struct _trie_dfa *dfa;
+	GHashTable *index;
+	GPtrArray *states;
+	guint16 entry;
+	guint i, k;
+	
+	trie_dfa_free (trie->dfa);
+	trie->dfa = NULL;
+	
+	dfa = g_new0 (struct _trie_dfa, 1);
+	dfa->nclasses = 1; /* class 0 is for characters that do not appear in any pattern */
+	
+	/* number the states in breadth-first order with the root as state 0 */
+	index = g_hash_table_new (g_direct_hash, g_direct_equal);
+	states = g_ptr_array_new ();
+	
+	g_hash_table_insert (index, &trie->root, GUINT_TO_POINTER (0));
+	g_ptr_array_add (states, &trie->root);
+	
+	for (i = 0; i < states->len; i++) {
+		q = states->pdata[i];
+		
+		for (m = q->match; m != NULL; m = m->next) {
+			if (m->c >= 0x80 || states->len >= TRIE_DFA_MAX_STATES)
+				goto unsupported;
+			
+			if (dfa->classes[m->c] == 0) {
+				chars[dfa->nclasses] = m->c;
+				dfa->classes[m->c] = dfa->nclasses++;
+			}
+			
+			g_hash_table_insert (index, m->state, GUINT_TO_POINTER (states->len));
+			g_ptr_array_add (states, m->state);
+		}
+	}
+	
+	/* the patterns have already been folded, so fold the input the same way */
+	if (trie->icase) {
+		for (i = 'A'; i <= 'Z'; i++)
+			dfa->classes[i] = dfa->classes[i + ('a' - 'A')];
+	}
+	
+	dfa->delta = g_new (guint16, states->len * dfa->nclasses);
+	dfa->jump = g_new (guint16, states->len * dfa->nclasses);
+	dfa->final = g_new (unsigned int, states->len);
+	dfa->id = g_new (int, states->len);
+	
+	for (i = 0; i < states->len; i++) {
+		q = states->pdata[i];
+		
+		dfa->final[i] = q->final;
+		dfa->id[i] = q->id;
+		
+		/* nothing matches a character outside of the patterns */
+		dfa->delta[i * dfa->nclasses] = TRIE_DFA_RESET;
+		dfa->jump[i * dfa->nclasses] = TRIE_DFA_NONE;
+		
+		for (k = 1; k < dfa->nclasses; k++) {
+			/* follow the failure links just like g_trie_search() does */
+			r = q;
+			while (r != NULL && (n = g (r, chars[k])) == NULL)
+				r = r->fail;
+			
+			if (r == NULL) {
+				entry = TRIE_DFA_RESET;
+			} else {
+				entry = GPOINTER_TO_UINT (g_hash_table_lookup (index, n->state)) << 3;
+				entry |= r == &trie->root ? TRIE_DFA_START : TRIE_DFA_KEEP;
+				if (n->state->final)
+					entry |= TRIE_DFA_FINAL;
+			}
+			
+			dfa->delta[i * dfa->nclasses + k] = entry;
+			
+			if ((n = g (q, chars[k])) != NULL)
+				dfa->jump[i * dfa->nclasses + k] = GPOINTER_TO_UINT (g_hash_table_lookup (index, n->state));
+			else
+				dfa->jump[i * dfa->nclasses + k] = TRIE_DFA_NONE;
+		}
+	}
+	
+	g_hash_table_destroy (index);
+	g_ptr_array_free (states, TRUE);
+	trie->dfa = dfa;
+	
+	return;
+	
+ unsupported:
+	g_hash_table_destroy (index);
+	g_ptr_array_free (states, TRUE);
+	trie_dfa_free (dfa);
+}
+
+/* the same search as g_trie_search() and g_trie_quick_search(), using the compiled tables */
+static const char *
+trie_dfa_search (GTrie *trie, const char *buffer, size_t buflen, int *matched_id, gboolean quick)
+{
+	const unsigned char *inptr = (const unsigned char *) buffer;
+	const unsigned char *inend = inptr + buflen;
+	const unsigned char *prev, *pat;
+	struct _trie_dfa *dfa = trie->dfa;
+	unsigned int matched = 0;
+	size_t inlen = buflen;
+	guint q = 0, k;
+	guint16 entry;
+	gunichar c;
+	
+	pat = prev = inptr;
+	while (inlen > 0) {
+		if (*inptr < 0x80) {
+			if (*inptr == '\0')
+				break;
+			
+			k = dfa->classes[*inptr++];
+			inlen--;
+		} else {
+			if ((c = trie_utf8_getc ((const char **) &inptr, inlen)) == 0)
+				break;
+			
+			inlen = (inend - inptr);
+			
+			if (c == 0xfffe) {
+				if (matched)
+					return (const char *) pat;
+				
+				pat = prev = inptr;
+			}
+			
+			if (trie->icase)
+				c = g_unichar_tolower (c);
+			
+			k = c < 0x80 ? dfa->classes[c] : 0;
+		}
+		
+		if (matched == 0) {
+			entry = dfa->delta[q * dfa->nclasses + k];
+			
+			switch (entry & 3) {
+			case TRIE_DFA_START: pat = prev; break;
+			case TRIE_DFA_RESET: pat = inptr; break;
+			}
+			
+			q = entry >> 3;
+			
+			if (entry & TRIE_DFA_FINAL) {
+				if (matched_id)
+					*matched_id = dfa->id[q];
+				
+				if (quick)
+					return (const char *) pat;
+				
+				matched = dfa->final[q];
+			}
+		} else if ((entry = dfa->jump[q * dfa->nclasses + k]) != TRIE_DFA_NONE) {
+			/* see if a longer pattern matches */
+			q = entry;
+			
+			if (dfa->final[q] > matched) {
+				if (matched_id)
+					*matched_id = dfa->id[q];
+				
+				matched = dfa->final[q];
+			}
+		}
+		
+		prev = inptr;
+	}
+	
+	return matched ? (const char *) pat : NULL;
+}
+
 /*
  * Aho-Corasick
  *
@@ -343,6 +584,9 @@ g_trie_quick_search (GTrie *trie, const char *buffer, size_t buflen, int *matche
 	struct _trie_state *q;
 	gunichar c;
 	
+	if (trie->dfa != NULL)
+		return trie_dfa_search (trie, buffer, buflen, matched_id, TRUE);
+	
 	inend = buffer + buflen;
 	inptr = buffer;
 	
@@ -401,6 +645,9 @@ g_trie_search (GTrie *trie, const char *buffer, size_t buflen, int *matched_id)
 	size_t matched = 0;
 	gunichar c;
 	
+	if (trie->dfa != NULL)
+		return trie_dfa_search (trie, buffer, buflen, matched_id, FALSE);
+	
 	inend = buffer + buflen;
 	inptr = buffer;
 	
@@ -485,10 +732,11 @@ static char *haystacks[] = {
 
 int main (int argc, char **argv)
 {
-	const char *match;
+	const char *match, *matches[G_N_ELEMENTS (haystacks)];
+	int id, ids[G_N_ELEMENTS (haystacks)];
+	int retval = 0;
 	GTrie *trie;
 	guint i;
-	int id;
 	
 	trie = g_trie_new (TRUE);
 	for (i = 0; i < G_N_ELEMENTS (patterns); i++)
@@ -499,6 +747,21 @@ int main (int argc, char **argv)
 			fprintf (stderr, "matched @ '%s' with pattern '%s'\n", match, patterns[id]);
 		} else {
 			fprintf (stderr, "no match\n");
+			retval = 1;
+		}
+		
+		matches[i] = match;
+		ids[i] = id;
+	}
+	
+	/* the compiled trie must find exactly the same matches */
+	g_trie_compile (trie);
+	
+	for (i = 0; i < G_N_ELEMENTS (haystacks); i++) {
+		match = g_trie_search (trie, haystacks[i], -1, &id);
+		if (match != matches[i] || (match != NULL && id != ids[i])) {
+			fprintf (stderr, "compiled trie mismatch for '%s'\n", haystacks[i]);
+			retval = 1;
 		}
 	}
 	
@@ -506,6 +769,6 @@ int main (int argc, char **argv)
 	
 	g_trie_free (trie);
 	
-	return match == NULL ? 0 : 1;
+	return retval;
 }
 #endif /* TEST */
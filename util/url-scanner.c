@@ -70,6 +70,14 @@ url_scanner_add (UrlScanner *scanner, urlpattern_t *pattern)
 	g_ptr_array_add (scanner->patterns, pattern);
 }
 
+void
+url_scanner_compile (UrlScanner *scanner)
+{
+	g_return_if_fail (scanner != NULL);
+	
+	g_trie_compile (scanner->trie);
+}
+
 
 gboolean
 url_scanner_scan (UrlScanner *scanner, const char *in, size_t inlen, urlmatch_t *match)
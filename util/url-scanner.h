@@ -58,6 +58,8 @@ G_GNUC_INTERNAL void url_scanner_free (UrlScanner *scanner);
 
 G_GNUC_INTERNAL void url_scanner_add (UrlScanner *scanner, urlpattern_t *pattern);
 
+G_GNUC_INTERNAL void url_scanner_compile (UrlScanner *scanner);
+
 G_GNUC_INTERNAL gboolean url_scanner_scan (UrlScanner *scanner, const char *in, size_t inlen, urlmatch_t *match);
 
 G_END_DECLS